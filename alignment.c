@@ -0,0 +1,318 @@
+#include "jellyfish.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Levenshtein edit scripts using Hirschberg's divide and conquer.
+ *
+ * The strings are split at the middle row of s1. Forward and reverse DP
+ * rows for the two halves give the column where an optimal path crosses
+ * that row, and each half is then solved on its own. Only two score rows
+ * of len2 + 1 entries are kept, so memory is O(len1 + len2). Sub-problems
+ * of at most BASE_CELLS matrix cells are solved with a full matrix and a
+ * traceback.
+ */
+#define BASE_CELLS 4096
+
+struct alignment {
+    const uint32_t *s1;
+    const uint32_t *s2;
+    size_t *forward;
+    size_t *reverse;
+    size_t *matrix;
+    struct edit_op *ops;
+    size_t n_ops;
+};
+
+static void emit(struct alignment *a, enum edit_type type, size_t i, size_t j)
+{
+    a->ops[a->n_ops].type = type;
+    a->ops[a->n_ops].i = i;
+    a->ops[a->n_ops].j = j;
+    a->n_ops++;
+}
+
+/* Last row of the distance matrix between s1[i1..i2) and s2[j1..j2). */
+static void forward_row(const struct alignment *a, size_t i1, size_t i2,
+                        size_t j1, size_t j2, size_t *row)
+{
+    size_t i, j, diag, up, cost;
+
+    for (j = 0; j <= j2 - j1; j++) {
+        row[j] = j;
+    }
+    for (i = i1; i < i2; i++) {
+        diag = row[0];
+        row[0] = i - i1 + 1;
+        for (j = j1; j < j2; j++) {
+            up = row[j - j1 + 1];
+            cost = diag + (a->s1[i] != a->s2[j]);
+            row[j - j1 + 1] = MIN(cost, MIN(up, row[j - j1]) + 1);
+            diag = up;
+        }
+    }
+}
+
+/* As forward_row, over both substrings reversed: row[k] is the distance
+ * between s1[i1..i2) and the last k characters of s2[j1..j2).
+ */
+static void reverse_row(const struct alignment *a, size_t i1, size_t i2,
+                        size_t j1, size_t j2, size_t *row)
+{
+    size_t i, j, k, diag, up, cost;
+
+    for (k = 0; k <= j2 - j1; k++) {
+        row[k] = k;
+    }
+    for (i = i2; i > i1; i--) {
+        diag = row[0];
+        row[0] = i2 - i + 1;
+        for (j = j2, k = 1; j > j1; j--, k++) {
+            up = row[k];
+            cost = diag + (a->s1[i - 1] != a->s2[j - 1]);
+            row[k] = MIN(cost, MIN(up, row[k - 1]) + 1);
+            diag = up;
+        }
+    }
+}
+
+/* Full matrix and traceback for a small block. Ties prefer a diagonal
+ * step, then a deletion, so the script reads left to right like the
+ * Hirschberg splits around it.
+ */
+static void align_block(struct alignment *a, size_t i1, size_t i2, size_t j1, size_t j2)
+{
+    size_t rows = i2 - i1 + 1;
+    size_t cols = j2 - j1 + 1;
+    size_t *d = a->matrix;
+    size_t i, j, start = a->n_ops, end;
+    struct edit_op tmp;
+
+    for (i = 0; i < rows; i++) {
+        d[i * cols] = i;
+    }
+    for (j = 0; j < cols; j++) {
+        d[j] = j;
+    }
+    for (i = 1; i < rows; i++) {
+        for (j = 1; j < cols; j++) {
+            size_t diag = d[(i - 1) * cols + j - 1] + (a->s1[i1 + i - 1] != a->s2[j1 + j - 1]);
+            size_t gap = MIN(d[(i - 1) * cols + j], d[i * cols + j - 1]) + 1;
+            d[i * cols + j] = MIN(diag, gap);
+        }
+    }
+
+    /* Trace back from the bottom right corner, emitting in reverse. */
+    i = rows - 1;
+    j = cols - 1;
+    while (i > 0 || j > 0) {
+        if (i > 0 && j > 0 &&
+            d[i * cols + j] == d[(i - 1) * cols + j - 1] +
+                               (a->s1[i1 + i - 1] != a->s2[j1 + j - 1])) {
+            if (a->s1[i1 + i - 1] != a->s2[j1 + j - 1]) {
+                emit(a, EDIT_REPLACE, i1 + i - 1, j1 + j - 1);
+            }
+            i--;
+            j--;
+        } else if (i > 0 && d[i * cols + j] == d[(i - 1) * cols + j] + 1) {
+            emit(a, EDIT_DELETE, i1 + i - 1, j1 + j);
+            i--;
+        } else {
+            emit(a, EDIT_INSERT, i1 + i, j1 + j - 1);
+            j--;
+        }
+    }
+
+    for (end = a->n_ops; start + 1 < end; start++, end--) {
+        tmp = a->ops[start];
+        a->ops[start] = a->ops[end - 1];
+        a->ops[end - 1] = tmp;
+    }
+}
+
+static void hirschberg(struct alignment *a, size_t i1, size_t i2, size_t j1, size_t j2)
+{
+    size_t i, j, mid, best, split;
+
+    if (i1 == i2) {
+        for (j = j1; j < j2; j++) {
+            emit(a, EDIT_INSERT, i1, j);
+        }
+        return;
+    }
+    if (j1 == j2) {
+        for (i = i1; i < i2; i++) {
+            emit(a, EDIT_DELETE, i, j1);
+        }
+        return;
+    }
+    if ((i2 - i1 + 1) * (j2 - j1 + 1) <= BASE_CELLS || i2 - i1 == 1) {
+        if ((i2 - i1 + 1) * (j2 - j1 + 1) <= BASE_CELLS) {
+            align_block(a, i1, i2, j1, j2);
+            return;
+        }
+        /* A single character of s1 against a long s2: keep it where it
+         * first matches, otherwise replace the first character of s2.
+         */
+        for (split = j1; split < j2 && a->s2[split] != a->s1[i1]; split++) {
+        }
+        if (split == j2) {
+            emit(a, EDIT_REPLACE, i1, j1);
+            for (j = j1 + 1; j < j2; j++) {
+                emit(a, EDIT_INSERT, i2, j);
+            }
+            return;
+        }
+        for (j = j1; j < split; j++) {
+            emit(a, EDIT_INSERT, i1, j);
+        }
+        for (j = split + 1; j < j2; j++) {
+            emit(a, EDIT_INSERT, i2, j);
+        }
+        return;
+    }
+
+    mid = i1 + (i2 - i1) / 2;
+    forward_row(a, i1, mid, j1, j2, a->forward);
+    reverse_row(a, mid, i2, j1, j2, a->reverse);
+
+    split = j1;
+    best = a->forward[0] + a->reverse[j2 - j1];
+    for (j = j1 + 1; j <= j2; j++) {
+        if (a->forward[j - j1] + a->reverse[j2 - j] < best) {
+            best = a->forward[j - j1] + a->reverse[j2 - j];
+            split = j;
+        }
+    }
+
+    hirschberg(a, i1, mid, j1, split);
+    hirschberg(a, mid, i2, split, j2);
+}
+
+static uint32_t* widen_ucs4(const void *str, size_t len, int kind)
+{
+    size_t i;
+    uint32_t *wide = scratch_alloc((len + 1) * sizeof(uint32_t));
+    if (!wide) {
+        return NULL;
+    }
+
+    for (i = 0; i < len; i++) {
+        wide[i] = kind == JELLYFISH_UCS1 ? ((const uint8_t *) str)[i] :
+                  kind == JELLYFISH_UCS2 ? ((const uint16_t *) str)[i] :
+                  ((const uint32_t *) str)[i];
+    }
+    return wide;
+}
+
+/* Compute a minimal list of edits turning str1 into str2. On success *ops
+ * holds *n_ops entries, in order, which the caller frees. Returns -1 if
+ * memory runs out.
+ */
+int levenshtein_editops_kind(const void *str1, size_t len1, const void *str2, size_t len2,
+                             int kind, struct edit_op **ops, size_t *n_ops)
+{
+    STATS_SCOPE(STAT_LEVENSHTEIN_EDITOPS, (len1 + len2) * kind);
+    struct alignment a;
+    size_t prefix = 0, suffix = 0, mark = scratch_mark();
+    uint32_t *s1 = widen_ucs4(str1, len1, kind);
+    uint32_t *s2 = widen_ucs4(str2, len2, kind);
+    size_t *rows = scratch_alloc((2 * (len2 + 1) + BASE_CELLS) * sizeof(size_t));
+    struct edit_op *out = malloc((len1 + len2 + 1) * sizeof(struct edit_op));
+
+    if (!s1 || !s2 || !rows || !out) {
+        scratch_release(mark);
+        free(out);
+        return -1;
+    }
+
+    a.s1 = s1;
+    a.s2 = s2;
+    a.forward = rows;
+    a.reverse = rows + len2 + 1;
+    a.matrix = rows + 2 * (len2 + 1);
+    a.ops = out;
+    a.n_ops = 0;
+
+    /* Common prefixes and suffixes never need edits. */
+    while (prefix < len1 && prefix < len2 && s1[prefix] == s2[prefix]) {
+        prefix++;
+    }
+    while (suffix < len1 - prefix && suffix < len2 - prefix &&
+           s1[len1 - suffix - 1] == s2[len2 - suffix - 1]) {
+        suffix++;
+    }
+
+    hirschberg(&a, prefix, len1 - suffix, prefix, len2 - suffix);
+    scratch_release(mark);
+
+    *ops = out;
+    *n_ops = a.n_ops;
+    return 0;
+}
+
+int levenshtein_editops(const char *str1, const char *str2,
+                        struct edit_op **ops, size_t *n_ops)
+{
+    return levenshtein_editops_kind(str1, strlen(str1), str2, strlen(str2),
+                                    JELLYFISH_UCS1, ops, n_ops);
+}
+
+/* Group edit operations into difflib style spans: s1[i1..i2) becomes
+ * s2[j1..j2), with EDIT_EQUAL spans for the unchanged runs in between.
+ * *spans holds *n_spans entries, which the caller frees. Returns -1 if
+ * memory runs out.
+ */
+int editops_to_spans(const struct edit_op *ops, size_t n_ops, size_t len1, size_t len2,
+                     struct edit_span **spans, size_t *n_spans)
+{
+    struct edit_span *out = malloc((2 * n_ops + 1) * sizeof(struct edit_span));
+    struct edit_span *span;
+    size_t i = 0, j = 0, k = 0, n = 0;
+
+    if (!out) {
+        return -1;
+    }
+
+    while (k < n_ops) {
+        if (ops[k].i > i || ops[k].j > j) {
+            span = &out[n++];
+            span->type = EDIT_EQUAL;
+            span->i1 = i;
+            span->j1 = j;
+            span->i2 = ops[k].i;
+            span->j2 = ops[k].j;
+            i = ops[k].i;
+            j = ops[k].j;
+        }
+
+        span = &out[n++];
+        span->type = ops[k].type;
+        span->i1 = i;
+        span->j1 = j;
+        while (k < n_ops && ops[k].type == span->type && ops[k].i == i && ops[k].j == j) {
+            if (span->type != EDIT_INSERT) {
+                i++;
+            }
+            if (span->type != EDIT_DELETE) {
+                j++;
+            }
+            k++;
+        }
+        span->i2 = i;
+        span->j2 = j;
+    }
+
+    if (i < len1 || j < len2) {
+        span = &out[n++];
+        span->type = EDIT_EQUAL;
+        span->i1 = i;
+        span->j1 = j;
+        span->i2 = len1;
+        span->j2 = len2;
+    }
+
+    *spans = out;
+    *n_spans = n;
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include "jellyfish.h"
+#include <pthread.h>
+
+/* Each thread's arena is a chain of chunks, newest first, addressed by a
+ * single offset: when a block does not fit, a chunk at least twice the
+ * size is added and allocation carries on at the same offset in it,
+ * leaving its start unused while the older chunks still hold the live
+ * blocks below.  Marks are therefore plain offsets whichever chunk they
+ * were taken in.  Releasing to 0 frees every chunk but the newest, which
+ * is then big enough for everything the thread has needed at once, so
+ * from there on calls allocate nothing.
+ */
+struct chunk {
+    struct chunk *older;
+    void (*deallocate)(void *ptr);
+    size_t size;
+};
+
+struct arena {
+    struct chunk *chunk;
+    size_t top;
+    bool registered;
+};
+
+/* Chunk data starts this far in, to keep blocks 16 byte aligned. */
+#define CHUNK_HEADER ((sizeof(struct chunk) + 15) & ~(size_t) 15)
+
+/* The smallest chunk, and the largest kept once the arena empties. */
+#define SCRATCH_CHUNK (16 * 1024)
+#define SCRATCH_RETAIN (4 * 1024 * 1024)
+
+static const struct jellyfish_allocator system_allocator = { malloc, free };
+static const struct jellyfish_allocator *allocator = &system_allocator;
+
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+static pthread_key_t arena_key;
+static __thread struct arena arena;
+
+void jellyfish_set_allocator(const struct jellyfish_allocator *with)
+{
+    __atomic_store_n(&allocator, with ? with : &system_allocator, __ATOMIC_RELEASE);
+}
+
+static void free_chunks(struct chunk *chunk)
+{
+    struct chunk *older;
+
+    for (; chunk; chunk = older) {
+        older = chunk->older;
+        chunk->deallocate(chunk);
+    }
+}
+
+static void free_arena(void *arg)
+{
+    struct arena *a = arg;
+
+    free_chunks(a->chunk);
+    a->chunk = NULL;
+    a->top = 0;
+}
+
+static void create_key(void)
+{
+    pthread_key_create(&arena_key, free_arena);
+}
+
+static struct chunk* grow(struct arena *a, size_t need)
+{
+    const struct jellyfish_allocator *with = __atomic_load_n(&allocator, __ATOMIC_ACQUIRE);
+    size_t size = MAX(SCRATCH_CHUNK, need);
+    struct chunk *chunk;
+
+    if (a->chunk) {
+        size = MAX(size, 2 * a->chunk->size);
+    }
+    chunk = with->allocate(CHUNK_HEADER + size);
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->older = a->chunk;
+    chunk->deallocate = with->deallocate;
+    chunk->size = size;
+    a->chunk = chunk;
+
+    /* Threads free their arena when they exit. */
+    if (!a->registered) {
+        pthread_once(&arena_once, create_key);
+        pthread_setspecific(arena_key, a);
+        a->registered = true;
+    }
+    return chunk;
+}
+
+size_t scratch_mark(void)
+{
+    return arena.top;
+}
+
+void* scratch_alloc(size_t size)
+{
+    struct arena *a = &arena;
+    size_t start = a->top, end;
+
+    size = (size + 15) & ~(size_t) 15;
+    end = start + size;
+    if (end < start) {
+        return NULL;
+    }
+    if ((!a->chunk || end > a->chunk->size) && !grow(a, end)) {
+        return NULL;
+    }
+    a->top = end;
+    return (char *) a->chunk + CHUNK_HEADER + start;
+}
+
+void scratch_release(size_t mark)
+{
+    struct arena *a = &arena;
+
+    a->top = mark;
+    if (mark == 0 && a->chunk) {
+        free_chunks(a->chunk->older);
+        a->chunk->older = NULL;
+        if (a->chunk->size > SCRATCH_RETAIN) {
+            free_arena(a);
+        }
+    }
+}
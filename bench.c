@@ -0,0 +1,516 @@
+/* Native benchmark for every function in jellyfish.h.
+ *
+ * Each function is timed across input lengths of 4 to 4096 bytes and
+ * reported as ns/op, heap allocations/op and input throughput, as JSON:
+ *
+ *   ./jellyfish_bench [-t min_seconds] [-r repeats] [-f name_filter] [-o output.json]
+ *
+ * With -r, every case is measured that many times, in passes over the
+ * whole suite, and the fastest run is reported, which keeps perfcheck.py
+ * comparisons stable on noisy hosts.
+ * The report names the CPU model and backend, since timings only compare
+ * between runs on the same processor with the same kernels.
+ *
+ * Build with "make bench"; the Makefile links with --wrap=malloc (and
+ * calloc/realloc) so allocations made by the library can be counted.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "jellyfish.h"
+
+#ifndef JELLYFISH_VERSION
+#define JELLYFISH_VERSION "unknown"
+#endif
+
+/* Distinct inputs per case; cycling through them keeps the branch
+ * predictor from memorizing a single pair.
+ */
+#define POOL 32
+#define MAX_LEN 4096
+
+static const size_t lengths[] = { 4, 8, 16, 64, 256, 4096 };
+
+static size_t alloc_count;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    alloc_count++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    alloc_count++;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    alloc_count++;
+    return __real_realloc(ptr, size);
+}
+
+enum input_kind
+{
+    PAIR,       /* a random word and a lightly edited copy of it */
+    WORD,       /* a single lower case word */
+    UPPER,      /* a single upper case word (nysiis expects upper case) */
+    DOCUMENT,   /* space separated words and a target word */
+    PHRASES     /* space separated words and an edited copy in reverse word order */
+};
+
+struct benchmark
+{
+    const char *name;
+    enum input_kind kind;
+    void (*run)(const char *a, const char *b);
+};
+
+static volatile double sink;
+
+static void run_jaro_winkler(const char *a, const char *b)
+{
+    sink = jaro_winkler(a, b, false);
+}
+
+static void run_jaro_distance(const char *a, const char *b)
+{
+    sink = jaro_distance(a, b);
+}
+
+static void run_jaro_average(const char *a, const char *b)
+{
+    sink = jaro_average(a, b);
+}
+
+static void run_hamming_distance(const char *a, const char *b)
+{
+    sink = hamming_distance(a, b);
+}
+
+static void run_levenshtein_distance(const char *a, const char *b)
+{
+    sink = levenshtein_distance(a, b);
+}
+
+static void run_damerau_levenshtein_distance(const char *a, const char *b)
+{
+    sink = damerau_levenshtein_distance(a, b);
+}
+
+static void run_levenshtein_similarity(const char *a, const char *b)
+{
+    sink = levenshtein_similarity(a, b, 0.8);
+}
+
+static void run_damerau_levenshtein_similarity(const char *a, const char *b)
+{
+    sink = damerau_levenshtein_similarity(a, b, 0.8);
+}
+
+static void run_lcs_similarity(const char *a, const char *b)
+{
+    sink = lcs_similarity(a, b, 0);
+}
+
+static void run_match_rating_comparison(const char *a, const char *b)
+{
+    sink = match_rating_comparison(a, b);
+}
+
+static void run_soundex(const char *a, const char *b)
+{
+    free(soundex(a));
+}
+
+static void run_metaphone(const char *a, const char *b)
+{
+    free(metaphone(a));
+}
+
+static void run_nysiis(const char *a, const char *b)
+{
+    free(nysiis(a));
+}
+
+static void run_match_rating_codex(const char *a, const char *b)
+{
+    free(match_rating_codex(a));
+}
+
+static void run_stem(const char *a, const char *b)
+{
+    static char word[MAX_LEN + 1];
+    size_t len = strlen(a);
+
+    memcpy(word, a, len + 1);
+    sink = stem_in_place(word, len - 1);
+}
+
+static void run_get_matches(const char *a, const char *b)
+{
+    int *matches = get_matches(a, b, 0.9);
+
+    if ((uintptr_t) matches < RANDOM_ERROR) {
+        free(matches);
+    }
+}
+
+static void run_token_sort_similarity(const char *a, const char *b)
+{
+    sink = token_sort_similarity_kind(METRIC_LEVENSHTEIN, a, strlen(a), b, strlen(b),
+                                      JELLYFISH_UCS1, 0);
+}
+
+static void run_token_set_similarity(const char *a, const char *b)
+{
+    sink = token_set_similarity_kind(METRIC_LEVENSHTEIN, a, strlen(a), b, strlen(b),
+                                     JELLYFISH_UCS1, 0);
+}
+
+static void run_monge_elkan_similarity(const char *a, const char *b)
+{
+    sink = monge_elkan_similarity_kind(METRIC_JARO_WINKLER, a, strlen(a), b, strlen(b),
+                                       JELLYFISH_UCS1, false, 0);
+}
+
+/* Uniform costs, except for cheaper vowel substitutions, so the table
+ * lookups are not all alike.
+ */
+static struct cost_table *costs;
+
+static void run_weighted_levenshtein_distance(const char *a, const char *b)
+{
+    sink = weighted_levenshtein_distance(a, b, costs);
+}
+
+static void run_weighted_damerau_levenshtein_distance(const char *a, const char *b)
+{
+    sink = weighted_damerau_levenshtein_distance(a, b, costs);
+}
+
+static void run_levenshtein_editops(const char *a, const char *b)
+{
+    struct edit_op *ops;
+    size_t n_ops;
+
+    if (levenshtein_editops(a, b, &ops, &n_ops) == 0) {
+        sink = n_ops;
+        free(ops);
+    }
+}
+
+static void run_lcs_length(const char *a, const char *b)
+{
+    sink = lcs_length(a, b);
+}
+
+static void run_indel_distance(const char *a, const char *b)
+{
+    sink = indel_distance(a, b);
+}
+
+static const struct benchmark benchmarks[] =
+{
+    { "jaro_winkler", PAIR, run_jaro_winkler },
+    { "jaro_distance", PAIR, run_jaro_distance },
+    { "jaro_average", PAIR, run_jaro_average },
+    { "hamming_distance", PAIR, run_hamming_distance },
+    { "levenshtein_distance", PAIR, run_levenshtein_distance },
+    { "damerau_levenshtein_distance", PAIR, run_damerau_levenshtein_distance },
+    { "levenshtein_similarity", PAIR, run_levenshtein_similarity },
+    { "damerau_levenshtein_similarity", PAIR, run_damerau_levenshtein_similarity },
+    { "lcs_similarity", PAIR, run_lcs_similarity },
+    { "match_rating_comparison", PAIR, run_match_rating_comparison },
+    { "soundex", WORD, run_soundex },
+    { "metaphone", WORD, run_metaphone },
+    { "nysiis", UPPER, run_nysiis },
+    { "match_rating_codex", UPPER, run_match_rating_codex },
+    { "stem", WORD, run_stem },
+    { "get_matches", DOCUMENT, run_get_matches },
+    /* New cases go last, so the ones above keep the inputs they are seeded with. */
+    { "token_sort_similarity", PHRASES, run_token_sort_similarity },
+    { "token_set_similarity", PHRASES, run_token_set_similarity },
+    { "monge_elkan_similarity", PHRASES, run_monge_elkan_similarity },
+    { "weighted_levenshtein_distance", PAIR, run_weighted_levenshtein_distance },
+    { "weighted_damerau_levenshtein_distance", PAIR, run_weighted_damerau_levenshtein_distance },
+    { "levenshtein_editops", PAIR, run_levenshtein_editops },
+    { "lcs_length", PAIR, run_lcs_length },
+    { "indel_distance", PAIR, run_indel_distance },
+    { NULL, PAIR, NULL }
+};
+
+static unsigned long long rng_state = 0x9e3779b97f4a7c15ULL;
+
+static unsigned rng(unsigned bound)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (unsigned) (rng_state % bound);
+}
+
+static char random_letter(void)
+{
+    /* Weighted towards vowels so the phonetic encoders see realistic words. */
+    static const char letters[] = "aaaeeeiioouubcdfghjklmnnprrssttvwxyz";
+    return letters[rng(sizeof(letters) - 1)];
+}
+
+static void fill_words(size_t len, char *a)
+{
+    size_t i, word_len;
+
+    for (i = 0, word_len = 0; i < len; i++) {
+        if (word_len > 2 && rng(6) == 0) {
+            a[i] = ' ';
+            word_len = 0;
+        } else {
+            word_len++;
+        }
+    }
+}
+
+static void fill_inputs(enum input_kind kind, size_t len, char *a, char *b)
+{
+    size_t i, end, start, n;
+
+    for (i = 0; i < len; i++) {
+        a[i] = random_letter();
+    }
+    a[len] = '\0';
+
+    switch (kind) {
+    case PAIR:
+        memcpy(b, a, len + 1);
+        for (i = 0; i < len / 8 + 1; i++) {
+            b[rng(len)] = random_letter();
+        }
+        break;
+    case UPPER:
+        for (i = 0; i < len; i++) {
+            a[i] -= 'a' - 'A';
+        }
+        b[0] = '\0';
+        break;
+    case DOCUMENT:
+        fill_words(len, a);
+        strcpy(b, "nurses");
+        break;
+    case PHRASES:
+        fill_words(len, a);
+        for (end = len, n = 0; end > 0; end = start) {
+            for (start = end; start > 0 && a[start - 1] != ' '; start--) {
+            }
+            memcpy(b + n, a + start, end - start);
+            n += end - start;
+            if (start > 0) {
+                b[n++] = ' ';
+                start--;
+            }
+        }
+        b[n] = '\0';
+        for (i = 0; i < len / 8 + 1; i++) {
+            n = rng(len);
+            if (b[n] != ' ') {
+                b[n] = random_letter();
+            }
+        }
+        break;
+    case WORD:
+        b[0] = '\0';
+        break;
+    }
+}
+
+/* One function at one input length.  The inputs are drawn from an rng
+ * seeded by the case's place in the full suite, so every pass, filtered or
+ * not, times the same inputs.
+ */
+struct measurement
+{
+    const struct benchmark *bm;
+    size_t seed;
+    size_t length;
+    size_t iterations;
+    size_t allocs;
+    size_t bytes;
+    double best;
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void load_inputs(struct measurement *m, char **a, char **b)
+{
+    size_t i;
+
+    rng_state = 0x9e3779b97f4a7c15ULL * (m->seed + 1);
+    m->bytes = 0;
+    for (i = 0; i < POOL; i++) {
+        fill_inputs(m->bm->kind, m->length, a[i], b[i]);
+        m->bytes += strlen(a[i]) + strlen(b[i]);
+    }
+}
+
+static double time_case(const struct measurement *m, char **a, char **b)
+{
+    double start = now();
+    size_t i;
+
+    for (i = 0; i < m->iterations; i++) {
+        m->bm->run(a[i % POOL], b[i % POOL]);
+    }
+    return now() - start;
+}
+
+int main(int argc, char **argv)
+{
+    const struct benchmark *bm;
+    const char *filter = NULL;
+    FILE *out = stdout;
+    double min_time = 0.1;
+    int repeats = 1, r;
+    size_t l, i, n = 0;
+    double elapsed;
+    char *a[POOL], *b[POOL];
+    char model[JELLYFISH_CPU_MODEL_MAX];
+    struct measurement *cases, *m;
+    static const char vowels[] = "aeiou";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:r:f:o:")) != -1) {
+        switch (opt) {
+        case 't':
+            min_time = atof(optarg);
+            break;
+        case 'r':
+            repeats = atoi(optarg);
+            if (repeats < 1) {
+                repeats = 1;
+            }
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'o':
+            out = fopen(optarg, "w");
+            if (!out) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t min_seconds] [-r repeats] [-f name_filter] "
+                    "[-o output.json]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (jellyfish_init_backend(getenv("JELLYFISH_BACKEND")) != 0) {
+        fprintf(stderr, "JELLYFISH_BACKEND is unknown or unsupported by this CPU\n");
+        return 1;
+    }
+
+    costs = create_cost_table(1, 1, 1, 1);
+    if (!costs) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < sizeof(vowels) - 1; i++) {
+        for (l = 0; l < sizeof(vowels) - 1; l++) {
+            if (i != l) {
+                costs->substitute[(unsigned char) vowels[i]][(unsigned char) vowels[l]] = 0.5;
+            }
+        }
+    }
+
+    for (i = 0; i < POOL; i++) {
+        a[i] = malloc(MAX_LEN + 1);
+        b[i] = malloc(MAX_LEN + 1);
+        if (!a[i] || !b[i]) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+    }
+
+    cases = malloc(sizeof(benchmarks) / sizeof(benchmarks[0]) * sizeof(lengths) /
+                   sizeof(lengths[0]) * sizeof(struct measurement));
+    if (!cases) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (bm = benchmarks; bm->name; bm++) {
+        if (filter && !strstr(bm->name, filter)) {
+            continue;
+        }
+        for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            cases[n].bm = bm;
+            cases[n].seed = (bm - benchmarks) * (sizeof(lengths) / sizeof(lengths[0])) + l;
+            cases[n++].length = lengths[l];
+        }
+    }
+
+    /* The first pass doubles each case's iteration count until one run
+     * takes min_time.  With -r, the later passes time every case again and
+     * keep the fastest run, so a slow spell on the host costs one sample
+     * of a few cases rather than all the repeats of one.
+     */
+    for (i = 0; i < n; i++) {
+        m = &cases[i];
+        load_inputs(m, a, b);
+        for (m->iterations = 1; ; m->iterations *= 2) {
+            alloc_count = 0;
+            elapsed = time_case(m, a, b);
+            m->allocs = alloc_count;
+            if (elapsed >= min_time) {
+                break;
+            }
+        }
+        m->best = elapsed;
+    }
+    for (r = 1; r < repeats; r++) {
+        for (i = 0; i < n; i++) {
+            load_inputs(&cases[i], a, b);
+            elapsed = time_case(&cases[i], a, b);
+            cases[i].best = MIN(cases[i].best, elapsed);
+        }
+    }
+
+    jellyfish_cpu_model(model);
+    fprintf(out, "{\n  \"version\": \"%s\",\n  \"cpu\": \"%s\",\n  \"backend\": \"%s\",\n"
+            "  \"results\": [", JELLYFISH_VERSION, model, jellyfish_backend->name);
+    for (i = 0; i < n; i++) {
+        m = &cases[i];
+        fprintf(out, "%s\n    {\"function\": \"%s\", \"length\": %zu, \"iterations\": %zu, "
+                "\"ns_per_op\": %.1f, \"allocs_per_op\": %.2f, \"mb_per_s\": %.2f}",
+                i ? "," : "", m->bm->name, m->length, m->iterations,
+                m->best * 1e9 / m->iterations, (double) m->allocs / m->iterations,
+                (double) m->bytes / POOL * m->iterations / m->best / 1e6);
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    free(cases);
+    free_cost_table(costs);
+    for (i = 0; i < POOL; i++) {
+        free(a[i]);
+        free(b[i]);
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return 0;
+}
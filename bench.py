@@ -0,0 +1,296 @@
+#!/usr/bin/env python
+"""Python-level benchmark for the jellyfish bindings.
+
+Times every public function through the extension module across the same
+input lengths as the native benchmark (bench.c), and compares scoring one
+query against many choices with a loop of single calls versus the native
+batch entry points registered in BATCH, and scoring two columns row by row
+with a loop versus the pairwise functions listed in PAIRWISE, and all pairs
+of a column with nested loops versus pdist in MATRIX.  Results are written
+as JSON:
+
+    python bench.py [-t min_seconds] [-f name_filter] [-o output.json]
+"""
+import argparse
+import json
+import platform
+import random
+import sys
+import time
+
+import jellyfish
+
+
+LENGTHS = [4, 8, 16, 64, 256, 4096]
+
+# Number of distinct inputs cycled through per case, as in bench.c.
+POOL = 32
+
+# Number of choices scored per batch call.
+BATCH_SIZE = 1000
+
+LETTERS = "aaaeeeiioouubcdfghjklmnnprrssttvwxyz"
+
+PAIR, WORD, UPPER, PHRASES = range(4)
+
+SINGLE = [("jaro_winkler", PAIR),
+          ("jaro_distance", PAIR),
+          ("jaro_average", PAIR),
+          ("hamming_distance", PAIR),
+          ("levenshtein_distance", PAIR),
+          ("damerau_levenshtein_distance", PAIR),
+          ("levenshtein_similarity", PAIR),
+          ("damerau_levenshtein_similarity", PAIR),
+          ("lcs_similarity", PAIR),
+          ("match_rating_comparison", PAIR),
+          ("soundex", WORD),
+          ("metaphone", WORD),
+          ("nysiis", UPPER),
+          ("match_rating_codex", UPPER),
+          ("porter_stem", WORD),
+          ("token_sort_similarity", PHRASES),
+          ("token_set_similarity", PHRASES),
+          ("monge_elkan_similarity", PHRASES),
+          ("weighted_levenshtein_distance", PAIR),
+          ("weighted_damerau_levenshtein_distance", PAIR),
+          ("levenshtein_editops", PAIR),
+          ("lcs_length", PAIR),
+          ("indel_distance", PAIR)]
+
+# Uniform costs with cheaper vowel substitutions, as in bench.c.
+COSTS = jellyfish.CostTable(substitutions=dict(((v1, v2), 0.5) for v1 in "aeiou"
+                                               for v2 in "aeiou" if v1 != v2))
+
+# Arguments passed after the inputs.
+EXTRA_ARGS = {"weighted_levenshtein_distance": (COSTS,),
+              "weighted_damerau_levenshtein_distance": (COSTS,)}
+
+# (single-call function, native one-vs-many function or None).  The single
+# call loop is always timed so batch APIs can be compared against it.
+BATCH = [("jaro_winkler", None),
+         ("levenshtein_distance", None),
+         ("damerau_levenshtein_distance", None),
+         ("lcs_similarity", "lcs_similarity_many")]
+
+# (single-call function, pairwise function, metric) for row by row scoring.
+PAIRWISE = [("jaro_winkler", "pairwise_similarity", "jaro_winkler"),
+            ("levenshtein_similarity", "pairwise_similarity", "levenshtein"),
+            ("levenshtein_distance", "pairwise_distance", "levenshtein")]
+
+# (single-call function, condensed matrix function, metric) for all pairs.
+MATRIX = [("levenshtein_distance", "pdist_distance", "levenshtein"),
+          ("lcs_similarity", "pdist_similarity", "lcs")]
+
+# Number of strings whose pairs are scored per matrix call.
+MATRIX_SIZE = 300
+
+
+def random_word(rng, length):
+    return "".join(rng.choice(LETTERS) for _ in range(length))
+
+
+def mutate(rng, word):
+    chars = list(word)
+    for _ in range(len(chars) // 8 + 1):
+        chars[rng.randrange(len(chars))] = rng.choice(LETTERS)
+    return "".join(chars)
+
+
+def random_words(rng, length):
+    """Space separated words of at least three letters, length characters in all."""
+    chars = []
+    word_len = 0
+    for _ in range(length):
+        if word_len > 2 and rng.randrange(6) == 0:
+            chars.append(" ")
+            word_len = 0
+        else:
+            chars.append(rng.choice(LETTERS))
+            word_len += 1
+    return "".join(chars)
+
+
+def make_inputs(rng, kind, length):
+    inputs = []
+    for _ in range(POOL):
+        word = random_word(rng, length)
+        if kind == PHRASES:
+            phrase = random_words(rng, length)
+            reordered = list(" ".join(reversed(phrase.split(" "))))
+            for _ in range(length // 8 + 1):
+                i = rng.randrange(length)
+                if reordered[i] != " ":
+                    reordered[i] = rng.choice(LETTERS)
+            inputs.append((phrase, "".join(reordered)))
+        elif kind == PAIR:
+            inputs.append((word, mutate(rng, word)))
+        elif kind == UPPER:
+            inputs.append((word.upper(),))
+        else:
+            inputs.append((word,))
+    return inputs
+
+
+def timed(func, min_time):
+    """Run func(iterations) with doubling iteration counts until one run
+    takes min_time; return (iterations, seconds)."""
+    iterations = 1
+    while True:
+        start = time.perf_counter()
+        func(iterations)
+        elapsed = time.perf_counter() - start
+        if elapsed >= min_time:
+            return iterations, elapsed
+        iterations *= 2
+
+
+def bench_single(name, kind, length, rng, min_time):
+    func = getattr(jellyfish, name)
+    inputs = make_inputs(rng, kind, length)
+    extra = EXTRA_ARGS.get(name, ())
+
+    def run(iterations):
+        for i in range(iterations):
+            func(*(inputs[i % POOL] + extra))
+
+    iterations, elapsed = timed(run, min_time)
+    nbytes = sum(len(s) for args in inputs for s in args) / float(POOL)
+    return {"function": name,
+            "length": length,
+            "iterations": iterations,
+            "ns_per_op": round(elapsed * 1e9 / iterations, 1),
+            "mb_per_s": round(nbytes * iterations / elapsed / 1e6, 2)}
+
+
+def bench_batch(name, batch_name, length, rng, min_time):
+    func = getattr(jellyfish, name)
+    query = random_word(rng, length)
+    choices = [mutate(rng, query) for _ in range(BATCH_SIZE)]
+
+    def loop(iterations):
+        for _ in range(iterations):
+            [func(query, choice) for choice in choices]
+
+    iterations, elapsed = timed(loop, min_time)
+    result = {"function": name,
+              "length": length,
+              "batch_size": BATCH_SIZE,
+              "loop_ns_per_item": round(elapsed * 1e9 / (iterations * BATCH_SIZE), 1),
+              "native": batch_name,
+              "native_ns_per_item": None}
+
+    if batch_name and hasattr(jellyfish, batch_name):
+        batch = getattr(jellyfish, batch_name)
+
+        def native(iterations):
+            for _ in range(iterations):
+                batch(query, choices)
+
+        iterations, elapsed = timed(native, min_time)
+        result["native_ns_per_item"] = round(elapsed * 1e9 / (iterations * BATCH_SIZE), 1)
+
+    return result
+
+
+def bench_pairwise(name, pairwise_name, metric, length, rng, min_time):
+    func = getattr(jellyfish, name)
+    pairwise = getattr(jellyfish, pairwise_name)
+    strings1 = [random_word(rng, length) for _ in range(BATCH_SIZE)]
+    strings2 = [mutate(rng, s) for s in strings1]
+    rows = list(zip(strings1, strings2))
+
+    def loop(iterations):
+        for _ in range(iterations):
+            [func(s1, s2) for (s1, s2) in rows]
+
+    def native(iterations):
+        for _ in range(iterations):
+            pairwise(strings1, strings2, metric=metric)
+
+    loop_iterations, loop_elapsed = timed(loop, min_time)
+    iterations, elapsed = timed(native, min_time)
+    return {"function": name,
+            "length": length,
+            "batch_size": BATCH_SIZE,
+            "loop_ns_per_item": round(loop_elapsed * 1e9 / (loop_iterations * BATCH_SIZE), 1),
+            "native": pairwise_name,
+            "native_ns_per_item": round(elapsed * 1e9 / (iterations * BATCH_SIZE), 1)}
+
+
+def bench_matrix(name, matrix_name, metric, length, rng, min_time):
+    func = getattr(jellyfish, name)
+    matrix = getattr(jellyfish, matrix_name)
+    strings = [random_word(rng, length) for _ in range(MATRIX_SIZE)]
+    pairs = MATRIX_SIZE * (MATRIX_SIZE - 1) // 2
+
+    def loop(iterations):
+        for _ in range(iterations):
+            [func(s1, s2) for (i, s1) in enumerate(strings) for s2 in strings[i + 1:]]
+
+    def native(iterations):
+        for _ in range(iterations):
+            matrix(strings, metric=metric)
+
+    loop_iterations, loop_elapsed = timed(loop, min_time)
+    iterations, elapsed = timed(native, min_time)
+    return {"function": name,
+            "length": length,
+            "pairs": pairs,
+            "loop_ns_per_item": round(loop_elapsed * 1e9 / (loop_iterations * pairs), 1),
+            "native": matrix_name,
+            "native_ns_per_item": round(elapsed * 1e9 / (iterations * pairs), 1)}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-t", dest="min_time", type=float, default=0.1,
+                        help="minimum seconds per measurement")
+    parser.add_argument("-f", dest="filter", default="",
+                        help="only run functions whose name contains this")
+    parser.add_argument("-o", dest="output", help="write JSON here instead of stdout")
+    args = parser.parse_args()
+
+    rng = random.Random(2014)
+    report = {"python": platform.python_version(),
+              "cpu": jellyfish.cpu_features()["model"],
+              "backend": jellyfish.backend(),
+              "results": [],
+              "batch": [],
+              "pairwise": [],
+              "matrix": []}
+
+    for (name, kind) in SINGLE:
+        if args.filter not in name:
+            continue
+        for length in LENGTHS:
+            report["results"].append(bench_single(name, kind, length, rng, args.min_time))
+
+    for (name, batch_name) in BATCH:
+        if args.filter not in name:
+            continue
+        for length in (8, 16, 64):
+            report["batch"].append(bench_batch(name, batch_name, length, rng, args.min_time))
+
+    for (name, pairwise_name, metric) in PAIRWISE:
+        if args.filter not in name:
+            continue
+        for length in (8, 16, 64):
+            report["pairwise"].append(bench_pairwise(name, pairwise_name, metric, length, rng,
+                                                     args.min_time))
+
+    for (name, matrix_name, metric) in MATRIX:
+        if args.filter not in name:
+            continue
+        for length in (8, 16, 64):
+            report["matrix"].append(bench_matrix(name, matrix_name, metric, length, rng,
+                                                 args.min_time))
+
+    output = open(args.output, "w") if args.output else sys.stdout
+    json.dump(report, output, indent=2)
+    output.write("\n")
+    if args.output:
+        output.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,660 @@
+#include "jellyfish.h"
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+
+/* Fuzzy deduplication of one string column.
+ *
+ * Blocking picks the candidate pairs: rows are put in an order (by
+ * phonetic key, by length, or as they are) and each position is compared
+ * with the positions after it up to a limit, or for q-gram blocking with
+ * every later row sharing a trigram.  Candidates are scored on several
+ * threads; each thread collects its matching pairs and merges them into a
+ * union-find under a lock.  Roots are always the smallest row of their
+ * set, so the clusters do not depend on the order the threads finish in.
+ */
+
+struct dedupe_job {
+    const struct string_column *col;
+    const struct dedupe_options *options;
+    size_t n;             /* rows present, the length of order */
+    size_t *order;
+    size_t *limit;        /* per position, the end of its candidate range */
+    char **codexes;       /* match rating codexes, by row */
+    uint32_t *gram_start; /* q-gram blocking: row r's trigrams are */
+    uint32_t *grams;      /* grams[gram_start[r]..gram_start[r + 1]) */
+    size_t *post_start;   /* and the rows having trigram slot g are */
+    size_t *postings;     /* postings[post_start[g]..post_start[g + 1]) */
+    size_t gram_slots;
+    size_t *parent;
+    pthread_mutex_t lock;
+    int failed;
+};
+
+/* Union-find with path halving.  Linking the larger root under the
+ * smaller keeps every root the smallest row of its set.
+ */
+static size_t find_root(size_t *parent, size_t i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+static void union_rows(size_t *parent, size_t i, size_t j)
+{
+    i = find_root(parent, i);
+    j = find_root(parent, j);
+    if (i < j) {
+        parent[j] = i;
+    } else if (j < i) {
+        parent[i] = j;
+    }
+}
+
+/* Copy row to a NUL terminated byte string for the char based phonetic
+ * functions, as the bindings pass it: a str row (fold set) in UTF-8, in
+ * its NFKD form when normalize is set (soundex and metaphone; nysiis and
+ * the match rating codex take str as it is), a bytes row as it is.
+ * Returns NULL if memory runs out.
+ */
+static char* row_bytes(const struct string_ref *row, bool fold, bool normalize)
+{
+    char *out = malloc((fold ? NFKD_UTF8_MAX * row->len : row->len) + 1);
+    size_t n;
+
+    if (!out) {
+        return NULL;
+    }
+    if (fold && normalize) {
+        n = nfkd_utf8_partial(row->data, row->len, row->kind, out);
+    } else if (fold) {
+        n = encode_utf8(row->data, row->len, row->kind, out);
+    } else {
+        memcpy(out, row->data, row->len);
+        n = row->len;
+    }
+    out[n] = '\0';
+    return out;
+}
+
+char* row_phonetic_key(const struct string_ref *row, enum dedupe_blocking blocking, bool fold,
+                       bool codex)
+{
+    char *bytes = row_bytes(row, fold, !codex && blocking != BLOCK_NYSIIS), *key;
+
+    if (!bytes) {
+        return NULL;
+    }
+    if (codex) {
+        key = match_rating_codex(bytes);
+    } else if (blocking == BLOCK_SOUNDEX) {
+        key = soundex(bytes);
+    } else if (blocking == BLOCK_METAPHONE) {
+        key = metaphone(bytes);
+    } else {
+        key = nysiis(bytes);
+    }
+    free(bytes);
+    return key;
+}
+
+/* The longest partner a row of length len can match at all, from the
+ * metric's length bound, or SIZE_MAX when the metric has none.
+ */
+static size_t max_partner_length(const struct dedupe_options *options, size_t len)
+{
+    double t = options->threshold, ratio;
+
+    switch (options->scorer) {
+    case SCORE_DISTANCE:
+        /* Every edit distance here is at least the length difference. */
+        return len + options->max_distance;
+    case SCORE_MATCH_RATING:
+        return SIZE_MAX;
+    case SCORE_SIMILARITY:
+        break;
+    }
+    if (t <= 0) {
+        return SIZE_MAX;
+    }
+
+    switch (options->metric) {
+    case METRIC_LCS:
+        /* 2 * len / (len + longer) >= t */
+        ratio = t / (2 - t);
+        break;
+    case METRIC_JARO_WINKLER:
+        /* The prefix bonus is at most 0.4 * (1 - jaro). */
+        t = (t - 0.4) / 0.6;
+        /* fall through */
+    case METRIC_JARO:
+        /* jaro <= (1 + len / longer + 1) / 3 */
+        ratio = 3 * t - 2;
+        break;
+    default:
+        /* 1 - distance / longer <= len / longer */
+        ratio = t;
+        break;
+    }
+    if (ratio <= 0) {
+        return SIZE_MAX;
+    }
+    return (size_t) MIN(len / ratio + 1e-9, (double) SIZE_MAX / 2);
+}
+
+struct row_cache {
+    struct row_buffer outer, inner, wide;
+};
+
+/* Whether rows i and j match.  outer holds row i, fetched by the caller.
+ * Returns -1 if memory runs out.
+ */
+static int rows_match(struct dedupe_job *job, size_t i, const struct string_ref *ri, size_t j,
+                      struct row_cache *cache)
+{
+    const struct dedupe_options *options = job->options;
+    struct string_ref a = *ri, b;
+    double score;
+    long distance;
+    int found;
+
+    if (options->scorer == SCORE_MATCH_RATING) {
+        return match_rating_compare_codex(job->codexes[i], job->codexes[j]) == 1;
+    }
+
+    found = column_row(job->col, j, &b, &cache->inner);
+    if (found <= 0) {
+        return found;
+    }
+    if (a.kind < b.kind && widen_row(&a, b.kind, &cache->wide) < 0) {
+        return -1;
+    }
+    if (b.kind < a.kind && widen_row(&b, a.kind, &cache->wide) < 0) {
+        return -1;
+    }
+
+    if (options->scorer == SCORE_DISTANCE) {
+        if ((a.len > b.len ? a.len - b.len : b.len - a.len) > (size_t) options->max_distance) {
+            return 0;
+        }
+        distance = jellyfish_distance(options->metric, a.data, a.len, b.data, b.len, a.kind);
+        return distance < 0 ? -1 : distance <= options->max_distance;
+    }
+
+    score = jellyfish_similarity(options->metric, a.data, a.len, b.data, b.len, a.kind,
+                                 options->threshold);
+    return isnan(score) ? -1 : score >= options->threshold && score > 0;
+}
+
+struct pair_list {
+    size_t *pairs;
+    size_t n, size;
+};
+
+static int add_pair(struct pair_list *list, size_t i, size_t j)
+{
+    size_t *pairs;
+
+    if (list->n + 2 > list->size) {
+        pairs = realloc(list->pairs, (list->size ? 2 * list->size : 256) * sizeof(size_t));
+        if (!pairs) {
+            return -1;
+        }
+        list->pairs = pairs;
+        list->size = list->size ? 2 * list->size : 256;
+    }
+    list->pairs[list->n++] = i;
+    list->pairs[list->n++] = j;
+    return 0;
+}
+
+/* Score the candidates of one position (or for q-gram blocking, one row)
+ * into pairs.  seen marks, per row, the last row whose candidates
+ * included it, so rows sharing several trigrams are scored once.
+ */
+static int score_candidates(struct dedupe_job *job, size_t p, struct pair_list *pairs,
+                            struct row_cache *cache, size_t *seen)
+{
+    struct string_ref ri = { NULL, 0, JELLYFISH_UCS1 };
+    size_t i, j, q, g, k;
+    int match;
+
+    i = job->order ? job->order[p] : p;
+    if (job->options->scorer != SCORE_MATCH_RATING &&
+        column_row(job->col, i, &ri, &cache->outer) < 0) {
+        return -1;
+    }
+
+    if (job->options->blocking != BLOCK_QGRAM) {
+        for (q = p + 1; q < job->limit[p]; q++) {
+            j = job->order[q];
+            match = rows_match(job, i, &ri, j, cache);
+            if (match < 0 || (match && add_pair(pairs, i, j) < 0)) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    if (!job->gram_start) {
+        return 0;
+    }
+    for (g = job->gram_start[i]; g < job->gram_start[i + 1]; g++) {
+        for (k = job->post_start[job->grams[g]]; k < job->post_start[job->grams[g] + 1]; k++) {
+            j = job->postings[k];
+            if (j <= i || seen[j] == i + 1) {
+                continue;
+            }
+            seen[j] = i + 1;
+            match = rows_match(job, i, &ri, j, cache);
+            if (match < 0 || (match && add_pair(pairs, i, j) < 0)) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Blocks of positions k, each scored with position n - 1 - k, whose
+ * candidate ranges are the shortest, to even out the threads' work.
+ */
+static void score_positions(void *ctx, size_t begin, size_t end)
+{
+    struct dedupe_job *job = ctx;
+    size_t n = job->options->blocking == BLOCK_QGRAM ? job->col->length : job->n;
+    struct row_cache cache = { { NULL, 0 }, { NULL, 0 }, { NULL, 0 } };
+    struct pair_list pairs = { NULL, 0, 0 };
+    size_t *seen = NULL, k, i;
+    int status = 0;
+
+    if (job->options->blocking == BLOCK_QGRAM) {
+        seen = calloc(MAX(n, 1), sizeof(size_t));
+        status = seen ? 0 : -1;
+    }
+
+    for (k = begin; status == 0 && k < end && !__atomic_load_n(&job->failed, __ATOMIC_RELAXED);
+         k++) {
+        status = score_candidates(job, k, &pairs, &cache, seen);
+        if (status == 0 && n - 1 - k != k) {
+            status = score_candidates(job, n - 1 - k, &pairs, &cache, seen);
+        }
+    }
+
+    if (status < 0) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    } else {
+        pthread_mutex_lock(&job->lock);
+        for (i = 0; i < pairs.n; i += 2) {
+            union_rows(job->parent, pairs.pairs[i], pairs.pairs[i + 1]);
+        }
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    free(pairs.pairs);
+    free(seen);
+    free(cache.outer.data);
+    free(cache.inner.data);
+    free(cache.wide.data);
+}
+
+/* The candidates of position p, to estimate its cost: its candidate range,
+ * or for q-gram blocking the postings of its row's trigrams.
+ */
+static size_t candidates(const struct dedupe_job *job, size_t p)
+{
+    size_t g, count = 0;
+
+    if (job->options->blocking != BLOCK_QGRAM) {
+        return job->limit[p] - p - 1;
+    }
+    if (job->gram_start) {
+        for (g = job->gram_start[p]; g < job->gram_start[p + 1]; g++) {
+            count += job->post_start[job->grams[g] + 1] - job->post_start[job->grams[g]];
+        }
+    }
+    return count;
+}
+
+/* Buckets differ in size by orders of magnitude, so the positions are
+ * split by their candidates rather than by count.
+ */
+static double position_cost(void *ctx, size_t k)
+{
+    struct dedupe_job *job = ctx;
+    size_t n = job->options->blocking == BLOCK_QGRAM ? job->col->length : job->n;
+
+    return 1.0 + candidates(job, k) + (n - 1 - k != k ? candidates(job, n - 1 - k) : 0);
+}
+
+struct keyed_row {
+    const char *key;
+    size_t len;
+    size_t row;
+};
+
+static int compare_keys(const void *a, const void *b)
+{
+    const struct keyed_row *x = a, *y = b;
+    int cmp = strcmp(x->key, y->key);
+
+    if (cmp) {
+        return cmp;
+    }
+    return x->row < y->row ? -1 : x->row > y->row;
+}
+
+static int compare_lengths(const void *a, const void *b)
+{
+    const struct keyed_row *x = a, *y = b;
+
+    if (x->len != y->len) {
+        return x->len < y->len ? -1 : 1;
+    }
+    return x->row < y->row ? -1 : x->row > y->row;
+}
+
+static inline uint32_t trigram_hash(const struct string_ref *row, size_t start, size_t len)
+{
+    uint32_t h = 2166136261u, c;
+    size_t i;
+
+    for (i = start; i < start + len; i++) {
+        c = row->kind == JELLYFISH_UCS1 ? ((const unsigned char *) row->data)[i] :
+            row->kind == JELLYFISH_UCS2 ? ((const uint16_t *) row->data)[i] :
+            ((const uint32_t *) row->data)[i];
+        h = (h ^ c) * 16777619u;
+    }
+    return h;
+}
+
+/* Index the trigrams of every row (a row shorter than three characters is
+ * its own gram), hashed into gram_slots slots, as per row lists and per
+ * slot posting lists.
+ */
+static int build_qgram_index(struct dedupe_job *job)
+{
+    const struct string_column *col = job->col;
+    struct row_buffer buf = { NULL, 0 };
+    struct string_ref row;
+    size_t r, k, total = 0, grams, slots;
+    int found, status = -1;
+
+    job->gram_start = malloc((col->length + 1) * sizeof(uint32_t));
+    if (!job->gram_start) {
+        return -1;
+    }
+    for (r = 0; r < col->length; r++) {
+        found = column_row(col, r, &row, &buf);
+        if (found < 0) {
+            goto done;
+        }
+        job->gram_start[r] = total;
+        total += found ? (row.len >= 3 ? row.len - 2 : 1) : 0;
+        if (total > UINT32_MAX) {
+            goto done;
+        }
+    }
+    job->gram_start[col->length] = total;
+
+    for (slots = 1024; slots < total; slots *= 2) {
+    }
+    job->gram_slots = slots;
+    job->grams = malloc(MAX(total, 1) * sizeof(uint32_t));
+    job->post_start = calloc(slots + 1, sizeof(size_t));
+    job->postings = malloc(MAX(total, 1) * sizeof(size_t));
+    if (!job->grams || !job->post_start || !job->postings) {
+        goto done;
+    }
+
+    for (r = 0; r < col->length; r++) {
+        if (column_row(col, r, &row, &buf) <= 0) {
+            continue;
+        }
+        grams = job->gram_start[r + 1] - job->gram_start[r];
+        for (k = 0; k < grams; k++) {
+            job->grams[job->gram_start[r] + k] =
+                trigram_hash(&row, k, row.len >= 3 ? 3 : row.len) & (slots - 1);
+            job->post_start[job->grams[job->gram_start[r] + k] + 1]++;
+        }
+    }
+    for (k = 0; k < slots; k++) {
+        job->post_start[k + 1] += job->post_start[k];
+    }
+    /* Fill the postings in row order, so each list is sorted. */
+    for (r = 0; r < col->length; r++) {
+        for (k = job->gram_start[r]; k < job->gram_start[r + 1]; k++) {
+            job->postings[job->post_start[job->grams[k]]++] = r;
+        }
+    }
+    for (k = slots; k > 0; k--) {
+        job->post_start[k] = job->post_start[k - 1];
+    }
+    job->post_start[0] = 0;
+    status = 0;
+
+done:
+    free(buf.data);
+    return status;
+}
+
+/* Put the present rows in blocking order and find each position's
+ * candidate range.
+ */
+static int build_blocks(struct dedupe_job *job)
+{
+    const struct dedupe_options *options = job->options;
+    const struct string_column *col = job->col;
+    struct row_buffer buf = { NULL, 0 };
+    struct keyed_row *rows;
+    char **keys = NULL;
+    struct string_ref row;
+    size_t r, p, q, bound;
+    int found, status = -1;
+    bool phonetic = options->blocking == BLOCK_SOUNDEX ||
+                    options->blocking == BLOCK_METAPHONE ||
+                    options->blocking == BLOCK_NYSIIS;
+
+    rows = malloc(MAX(col->length, 1) * sizeof(struct keyed_row));
+    job->order = malloc(MAX(col->length, 1) * sizeof(size_t));
+    job->limit = malloc(MAX(col->length, 1) * sizeof(size_t));
+    if (phonetic) {
+        keys = calloc(MAX(col->length, 1), sizeof(char *));
+    }
+    if (!rows || !job->order || !job->limit || (phonetic && !keys)) {
+        goto done;
+    }
+
+    job->n = 0;
+    for (r = 0; r < col->length; r++) {
+        found = column_row(col, r, &row, &buf);
+        if (found < 0) {
+            goto done;
+        }
+        if (!found) {
+            continue;
+        }
+        rows[job->n].row = r;
+        rows[job->n].len = row.len;
+        rows[job->n].key = "";
+        if (phonetic) {
+            keys[r] = row_phonetic_key(&row, options->blocking, options->fold, false);
+            if (!keys[r]) {
+                goto done;
+            }
+            rows[job->n].key = keys[r];
+        }
+        job->n++;
+    }
+
+    if (phonetic) {
+        qsort(rows, job->n, sizeof(struct keyed_row), compare_keys);
+    } else if (options->blocking == BLOCK_LENGTH) {
+        qsort(rows, job->n, sizeof(struct keyed_row), compare_lengths);
+    }
+    for (p = 0; p < job->n; p++) {
+        job->order[p] = rows[p].row;
+    }
+
+    /* Candidate ranges only grow from one position to the next. */
+    for (p = 0, q = 0; p < job->n; p++) {
+        q = MAX(q, p + 1);
+        if (phonetic) {
+            while (q < job->n && strcmp(rows[q].key, rows[p].key) == 0) {
+                q++;
+            }
+        } else if (options->blocking == BLOCK_LENGTH) {
+            bound = max_partner_length(options, rows[p].len);
+            while (q < job->n && rows[q].len <= bound) {
+                q++;
+            }
+        } else {
+            q = job->n;
+        }
+        job->limit[p] = q;
+    }
+    status = 0;
+
+done:
+    if (keys) {
+        for (r = 0; r < col->length; r++) {
+            free(keys[r]);
+        }
+        free(keys);
+    }
+    free(rows);
+    free(buf.data);
+    return status;
+}
+
+static int build_codexes(struct dedupe_job *job)
+{
+    struct row_buffer buf = { NULL, 0 };
+    struct string_ref row;
+    size_t r;
+    int found;
+
+    job->codexes = calloc(MAX(job->col->length, 1), sizeof(char *));
+    if (!job->codexes) {
+        return -1;
+    }
+    for (r = 0; r < job->col->length; r++) {
+        found = column_row(job->col, r, &row, &buf);
+        if (found > 0) {
+            job->codexes[r] = row_phonetic_key(&row, job->options->blocking, job->options->fold,
+                                               true);
+        }
+        if (found < 0 || (found && !job->codexes[r])) {
+            free(buf.data);
+            return -1;
+        }
+    }
+    free(buf.data);
+    return 0;
+}
+
+int dedupe(const struct string_column *col, const struct dedupe_options *options,
+           int32_t *cluster_ids)
+{
+    struct dedupe_job job;
+    struct row_buffer buf = { NULL, 0 };
+    struct string_ref row;
+    size_t r, root, positions;
+    int32_t next = 0;
+    int found, status = -1;
+    STATS_SCOPE(STAT_DEDUPE, column_bytes(col));
+
+    memset(&job, 0, sizeof(job));
+    job.col = col;
+    job.options = options;
+    pthread_mutex_init(&job.lock, NULL);
+
+    job.parent = malloc(MAX(col->length, 1) * sizeof(size_t));
+    if (!job.parent) {
+        goto done;
+    }
+    for (r = 0; r < col->length; r++) {
+        job.parent[r] = r;
+    }
+
+    if (options->scorer == SCORE_MATCH_RATING && build_codexes(&job) < 0) {
+        goto done;
+    }
+    if (options->blocking == BLOCK_QGRAM) {
+        if (build_qgram_index(&job) < 0) {
+            goto done;
+        }
+        positions = col->length;
+    } else {
+        if (build_blocks(&job) < 0) {
+            goto done;
+        }
+        positions = job.n;
+    }
+
+    parallel_for_cost((positions + 1) / 2, 64, options->threads, score_positions, position_cost,
+                      &job);
+    if (job.failed) {
+        goto done;
+    }
+
+    /* Number the clusters in order of their first row; missing values get -1. */
+    for (r = 0; r < col->length; r++) {
+        found = column_row(col, r, &row, &buf);
+        if (found < 0) {
+            goto done;
+        }
+        if (!found) {
+            cluster_ids[r] = -1;
+            continue;
+        }
+        root = find_root(job.parent, r);
+        cluster_ids[r] = root == r ? next++ : cluster_ids[root];
+    }
+    status = 0;
+
+done:
+    if (job.codexes) {
+        for (r = 0; r < col->length; r++) {
+            free(job.codexes[r]);
+        }
+        free(job.codexes);
+    }
+    free(job.order);
+    free(job.limit);
+    free(job.gram_start);
+    free(job.grams);
+    free(job.post_start);
+    free(job.postings);
+    free(job.parent);
+    free(buf.data);
+    pthread_mutex_destroy(&job.lock);
+    return status;
+}
+
+static const struct {
+    const char *name;
+    enum dedupe_blocking blocking;
+} blocking_names[] = {
+    { "none", BLOCK_NONE },
+    { "length", BLOCK_LENGTH },
+    { "qgram", BLOCK_QGRAM },
+    { "soundex", BLOCK_SOUNDEX },
+    { "metaphone", BLOCK_METAPHONE },
+    { "nysiis", BLOCK_NYSIIS },
+};
+
+int dedupe_blocking_from_name(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(blocking_names) / sizeof(blocking_names[0]); i++) {
+        if (strcmp(name, blocking_names[i].name) == 0) {
+            return blocking_names[i].blocking;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,147 @@
+#include "jellyfish.h"
+#include <string.h>
+#ifdef JELLYFISH_X86
+#include <cpuid.h>
+#endif
+
+/* Backends in order of preference; jellyfish_init_backend() picks the
+ * first one whose required CPU features are all present.
+ */
+static const struct jellyfish_backend backends[] =
+{
+#ifdef JELLYFISH_X86
+    {
+        "avx512",
+        JELLYFISH_CPU_AVX512F | JELLYFISH_CPU_AVX512BW | JELLYFISH_CPU_POPCNT,
+        hamming_distance_avx512,
+        levenshtein_distance_avx512,
+        jaro_winkler_avx512
+    },
+    {
+        "avx2",
+        JELLYFISH_CPU_AVX2 | JELLYFISH_CPU_POPCNT,
+        hamming_distance_avx2,
+        levenshtein_distance_avx2,
+        jaro_winkler_avx2
+    },
+    {
+        "sse42",
+        JELLYFISH_CPU_SSE42 | JELLYFISH_CPU_POPCNT,
+        hamming_distance_sse42,
+        levenshtein_distance_sse42,
+        jaro_winkler_sse42
+    },
+#endif
+    {
+        "generic",
+        0,
+        hamming_distance_generic,
+        levenshtein_distance_generic,
+        jaro_winkler_generic
+    },
+    { NULL, 0, NULL, NULL, NULL }
+};
+
+const struct jellyfish_backend *jellyfish_backend = &backends[
+    sizeof(backends) / sizeof(backends[0]) - 2];
+
+unsigned jellyfish_cpu_features(void)
+{
+    unsigned features = 0;
+
+#ifdef JELLYFISH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        features |= JELLYFISH_CPU_SSE2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        features |= JELLYFISH_CPU_SSE42;
+    }
+    if (__builtin_cpu_supports("popcnt")) {
+        features |= JELLYFISH_CPU_POPCNT;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        features |= JELLYFISH_CPU_AVX2;
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        features |= JELLYFISH_CPU_AVX512F;
+    }
+    if (__builtin_cpu_supports("avx512bw")) {
+        features |= JELLYFISH_CPU_AVX512BW;
+    }
+#endif
+
+    return features;
+}
+
+/* The processor's brand string, e.g. "Intel(R) Xeon(R) Gold 6338 CPU @
+ * 2.00GHz", trimmed of the padding some CPUs put around it, or "unknown".
+ */
+void jellyfish_cpu_model(char model[JELLYFISH_CPU_MODEL_MAX])
+{
+    size_t start = 0, end = 0;
+
+#ifdef JELLYFISH_X86
+    unsigned regs[12], leaf;
+
+    if (__get_cpuid_max(0x80000000, NULL) >= 0x80000004) {
+        for (leaf = 0; leaf < 3; leaf++) {
+            __get_cpuid(0x80000002 + leaf, &regs[4 * leaf], &regs[4 * leaf + 1],
+                        &regs[4 * leaf + 2], &regs[4 * leaf + 3]);
+        }
+        memcpy(model, regs, 48);
+        model[48] = '\0';
+        end = strlen(model);
+        while (start < end && model[start] == ' ') {
+            start++;
+        }
+        while (end > start && model[end - 1] == ' ') {
+            end--;
+        }
+    }
+#endif
+    if (start == end) {
+        strcpy(model, "unknown");
+        return;
+    }
+    memmove(model, model + start, end - start);
+    model[end - start] = '\0';
+}
+
+const struct jellyfish_backend* jellyfish_backends(void)
+{
+    return backends;
+}
+
+/* Select the kernels used by hamming_distance, levenshtein_distance and the
+ * jaro functions.  With name == NULL (or "") the best backend for this CPU is
+ * chosen; otherwise the named backend is forced.
+ *
+ * Returns 0 on success, -1 if the name is unknown and -2 if the CPU lacks a
+ * feature the named backend needs.
+ */
+int jellyfish_init_backend(const char *name)
+{
+    const struct jellyfish_backend *b;
+    unsigned features = jellyfish_cpu_features();
+
+    for (b = backends; b->name; b++) {
+        if (name && *name && strcmp(name, b->name) != 0) {
+            continue;
+        }
+        if ((b->requires & features) != b->requires) {
+            if (name && *name) {
+                return -2;
+            }
+            continue;
+        }
+        /* Each interpreter importing the module makes this call; all of
+         * them see the same CPU and environment and so store the same
+         * backend, and kernels only ever read it.
+         */
+        __atomic_store_n(&jellyfish_backend, b, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    return -1;
+}
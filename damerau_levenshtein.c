@@ -1,56 +1,98 @@
 #include "jellyfish.h"
 #include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "probes.h"
 
-int damerau_levenshtein_distance(const char *s1, const char *s2)
-{
-    size_t s1_len = strlen(s1);
-    size_t s2_len = strlen(s2);
-    size_t rows = s1_len + 1;
-    size_t cols = s2_len + 1;
-
-    size_t i, j;
-    size_t d1, d2, d3, d_now;;
-    unsigned short cost;
-
-    size_t *dist = malloc(rows * cols * sizeof(size_t));
-    if (!dist) {
-        return -1;
-    }
+#define JF_CHAR char
+#define JF_NAME(name) name##_ucs1
+#include "damerau_levenshtein_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
 
-    for (i = 0; i < rows; i++) {
-        dist[i * cols] = i;
-    }
+#define JF_CHAR uint16_t
+#define JF_NAME(name) name##_ucs2
+#include "damerau_levenshtein_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
 
-    for (j = 0; j < cols; j++) {
-        dist[j] = j;
-    }
+#define JF_CHAR uint32_t
+#define JF_NAME(name) name##_ucs4
+#include "damerau_levenshtein_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
 
-    for (i = 1; i < rows; i++) {
-        for (j = 1; j < cols; j++) {
-            if (s1[i - 1] == s2[j - 1]) {
-                cost = 0;
-            } else {
-                cost = 1;
-            }
+/* Damerau-Levenshtein distance over code units of the given width
+ * (JELLYFISH_UCS1, 2 or 4).
+ */
+int damerau_levenshtein_distance_kind(const void *s1, size_t len1,
+                                      const void *s2, size_t len2, int kind)
+{
+    int distance;
+    STATS_SCOPE(STAT_DAMERAU_LEVENSHTEIN, (len1 + len2) * kind);
 
-            d1 = dist[((i - 1) * cols) + j] + 1;
-            d2 = dist[(i * cols) + (j - 1)] + 1;
-            d3 = dist[((i - 1) * cols) + (j - 1)] + cost;
+    JELLYFISH_PROBE2(damerau_levenshtein__entry, len1, len2);
+    switch (kind) {
+    case JELLYFISH_UCS2:
+        distance = damerau_levenshtein_kernel_ucs2(s1, len1, s2, len2);
+        break;
+    case JELLYFISH_UCS4:
+        distance = damerau_levenshtein_kernel_ucs4(s1, len1, s2, len2);
+        break;
+    default:
+        distance = damerau_levenshtein_kernel_ucs1(s1, len1, s2, len2);
+        break;
+    }
+    JELLYFISH_PROBE3(damerau_levenshtein__return, len1, len2, distance);
+    return distance;
+}
 
-            d_now = MIN(d1, MIN(d2, d3));
+int damerau_levenshtein_distance(const char *s1, const char *s2)
+{
+    return damerau_levenshtein_distance_kind(s1, strlen(s1), s2, strlen(s2), JELLYFISH_UCS1);
+}
 
-            if (i > 2 && j > 2 && s1[i - 1] == s2[j - 2] &&
-                s1[i - 2] == s2[j - 1]) {
-                d1 = dist[((i - 2) * cols) + (j - 2)] + cost;
-                d_now = MIN(d_now, d1);
-            }
+double damerau_levenshtein_similarity_kind(const void *s1, size_t len1,
+                                           const void *s2, size_t len2, int kind,
+                                           double score_cutoff)
+{
+    size_t longest = len1 > len2 ? len1 : len2;
+    long max = jellyfish_max_distance(longest, score_cutoff);
+    int distance;
+    double similarity;
+    STATS_SCOPE(STAT_DAMERAU_LEVENSHTEIN, (len1 + len2) * kind);
 
-            dist[(i * cols) + j] = d_now;
-        }
+    if (longest == 0) {
+        return score_cutoff <= 1 ? 1 : 0;
+    }
+    if (max < 0) {
+        return 0;
     }
 
-    d_now = dist[(cols * rows) - 1];
-    free(dist);
+    switch (kind) {
+    case JELLYFISH_UCS2:
+        distance = damerau_levenshtein_bounded_kernel_ucs2(s1, len1, s2, len2, max);
+        break;
+    case JELLYFISH_UCS4:
+        distance = damerau_levenshtein_bounded_kernel_ucs4(s1, len1, s2, len2, max);
+        break;
+    default:
+        distance = damerau_levenshtein_bounded_kernel_ucs1(s1, len1, s2, len2, max);
+        break;
+    }
 
-    return d_now;
+    if (distance < 0) {
+        return NAN;
+    }
+    if (distance > max) {
+        return 0;
+    }
+    similarity = 1 - (double) distance / longest;
+    return similarity >= score_cutoff ? similarity : 0;
+}
+
+double damerau_levenshtein_similarity(const char *s1, const char *s2, double score_cutoff)
+{
+    return damerau_levenshtein_similarity_kind(s1, strlen(s1), s2, strlen(s2), JELLYFISH_UCS1,
+                                               score_cutoff);
 }
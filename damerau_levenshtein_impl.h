@@ -0,0 +1,136 @@
+/* Damerau-Levenshtein kernel, included by damerau_levenshtein.c once per
+ * code unit width.  The includer defines JF_CHAR, the code unit type, and
+ * JF_NAME(name), which appends the width suffix (_ucs1, _ucs2, _ucs4) to name.
+ */
+
+static int JF_NAME(damerau_levenshtein_kernel)(const JF_CHAR *s1, size_t s1_len,
+                                              const JF_CHAR *s2, size_t s2_len)
+{
+    size_t rows = s1_len + 1;
+    size_t cols = s2_len + 1;
+
+    size_t i, j;
+    size_t d1, d2, d3, d_now;;
+    unsigned short cost;
+
+    size_t stack[SCRATCH_STACK / sizeof(size_t)];
+    size_t mark = scratch_mark();
+    size_t *dist = scratch_buffer(stack, sizeof(stack), rows * cols * sizeof(size_t));
+    if (!dist) {
+        return -1;
+    }
+
+    for (i = 0; i < rows; i++) {
+        dist[i * cols] = i;
+    }
+
+    for (j = 0; j < cols; j++) {
+        dist[j] = j;
+    }
+
+    for (i = 1; i < rows; i++) {
+        for (j = 1; j < cols; j++) {
+            if (s1[i - 1] == s2[j - 1]) {
+                cost = 0;
+            } else {
+                cost = 1;
+            }
+
+            d1 = dist[((i - 1) * cols) + j] + 1;
+            d2 = dist[(i * cols) + (j - 1)] + 1;
+            d3 = dist[((i - 1) * cols) + (j - 1)] + cost;
+
+            d_now = MIN(d1, MIN(d2, d3));
+
+            if (i > 1 && j > 1 && s1[i - 1] == s2[j - 2] &&
+                s1[i - 2] == s2[j - 1]) {
+                d1 = dist[((i - 2) * cols) + (j - 2)] + cost;
+                d_now = MIN(d_now, d1);
+            }
+
+            dist[(i * cols) + j] = d_now;
+        }
+    }
+
+    d_now = dist[(cols * rows) - 1];
+    scratch_release(mark);
+
+    return d_now;
+}
+
+/* As damerau_levenshtein_kernel, but returns max + 1 as soon as the
+ * distance is known to exceed max.  Only the diagonal band |i - j| <= max
+ * is computed, keeping the last three rows.
+ */
+static int JF_NAME(damerau_levenshtein_bounded_kernel)(const JF_CHAR *s1, size_t s1_len,
+                                                       const JF_CHAR *s2, size_t s2_len,
+                                                       size_t max)
+{
+    size_t i, j, lo, hi, d, cost, row_min, prev_min;
+    size_t big, result;
+    size_t *rows, *prev2, *prev, *cur, *tmp;
+    size_t stack[SCRATCH_STACK / sizeof(size_t)];
+    size_t mark = scratch_mark();
+
+    max = MIN(max, s1_len > s2_len ? s1_len : s2_len);
+    big = max + 1;
+    if ((s1_len > s2_len ? s1_len - s2_len : s2_len - s1_len) > max) {
+        return big;
+    }
+
+    rows = scratch_buffer(stack, sizeof(stack), 3 * (s2_len + 1) * sizeof(size_t));
+    if (!rows) {
+        return -1;
+    }
+    prev2 = rows;
+    prev = rows + s2_len + 1;
+    cur = rows + 2 * (s2_len + 1);
+
+    for (j = 0; j <= s2_len; j++) {
+        prev[j] = MIN(j, big);
+    }
+    prev_min = 0;
+
+    for (i = 1; i <= s1_len; i++) {
+        lo = i > max ? i - max : 1;
+        hi = MIN(s2_len, i + max);
+
+        cur[lo - 1] = lo == 1 ? MIN(i, big) : big;
+        row_min = cur[lo - 1];
+        for (j = lo; j <= hi; j++) {
+            cost = s1[i - 1] != s2[j - 1];
+            d = prev[j - 1] + cost;
+            d = MIN(d, MIN(prev[j], cur[j - 1]) + 1);
+
+            if (i > 1 && j > 1 && s1[i - 1] == s2[j - 2] &&
+                s1[i - 2] == s2[j - 1]) {
+                d = MIN(d, prev2[j - 2] + cost);
+            }
+
+            cur[j] = MIN(d, big);
+            row_min = MIN(row_min, cur[j]);
+        }
+        if (hi < s2_len) {
+            cur[hi + 1] = big;
+        }
+
+        /* A transposition can reach back over one row, so stop only
+         * once two rows in a row exceed max.
+         */
+        if (row_min > max && prev_min > max) {
+            scratch_release(mark);
+            return big;
+        }
+        prev_min = row_min;
+
+        tmp = prev2;
+        prev2 = prev;
+        prev = cur;
+        cur = tmp;
+    }
+
+    result = prev[s2_len];
+    scratch_release(mark);
+
+    return result;
+}
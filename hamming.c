@@ -1,22 +1,118 @@
 #include "jellyfish.h"
 #include <ctype.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef JELLYFISH_X86
+#include <immintrin.h>
+#endif
+
+#define JF_CHAR char
+#define JF_NAME(name) name##_ucs1
+#include "hamming_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
+
+#define JF_CHAR uint16_t
+#define JF_NAME(name) name##_ucs2
+#include "hamming_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
+
+#define JF_CHAR uint32_t
+#define JF_NAME(name) name##_ucs4
+#include "hamming_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
 
 size_t hamming_distance(const char *s1, const char *s2) {
-    unsigned distance = 0;
+    size_t len1 = strlen(s1), len2 = strlen(s2);
+    STATS_SCOPE(STAT_HAMMING, len1 + len2);
+
+    return jellyfish_backend->hamming(s1, len1, s2, len2);
+}
+
+/* Hamming distance over code units of the given width (JELLYFISH_UCS1, 2 or
+ * 4); one byte strings go through the selected backend.
+ */
+size_t hamming_distance_kind(const void *s1, size_t len1,
+                             const void *s2, size_t len2, int kind) {
+    STATS_SCOPE(STAT_HAMMING, (len1 + len2) * kind);
+
+    switch (kind) {
+    case JELLYFISH_UCS2:
+        return hamming_kernel_ucs2(s1, len1, s2, len2);
+    case JELLYFISH_UCS4:
+        return hamming_kernel_ucs4(s1, len1, s2, len2);
+    default:
+        return jellyfish_backend->hamming(s1, len1, s2, len2);
+    }
+}
+
+size_t hamming_distance_generic(const char *s1, size_t len1,
+                                const char *s2, size_t len2) {
+    return hamming_kernel_ucs1(s1, len1, s2, len2);
+}
 
-    for (; *s1 && *s2; s1++, s2++) {
-        if (*s1 != *s2) {
-            distance++;
-        }
+#ifdef JELLYFISH_X86
+
+/* The vector kernels compare a block of bytes at a time, turn the
+ * mismatches into a bit mask and popcount it; the tail shorter than one
+ * block falls back to the scalar loop.
+ */
+
+__attribute__((target("sse4.2,popcnt")))
+size_t hamming_distance_sse42(const char *s1, size_t len1,
+                              const char *s2, size_t len2) {
+    size_t i, n = MIN(len1, len2);
+    size_t distance = len1 > len2 ? len1 - len2 : len2 - len1;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (s1 + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (s2 + i));
+        unsigned eq = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+        distance += 16 - _mm_popcnt_u32(eq);
+    }
+
+    return distance + hamming_distance_generic(s1 + i, n - i, s2 + i, n - i);
+}
+
+__attribute__((target("avx2,popcnt")))
+size_t hamming_distance_avx2(const char *s1, size_t len1,
+                             const char *s2, size_t len2) {
+    size_t i, n = MIN(len1, len2);
+    size_t distance = len1 > len2 ? len1 - len2 : len2 - len1;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (s1 + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (s2 + i));
+        unsigned eq = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+        distance += 32 - _mm_popcnt_u32(eq);
     }
 
-    for ( ; *s1; s1++) {
-        distance++;
+    return distance + hamming_distance_sse42(s1 + i, n - i, s2 + i, n - i);
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+size_t hamming_distance_avx512(const char *s1, size_t len1,
+                               const char *s2, size_t len2) {
+    size_t i, n = MIN(len1, len2);
+    size_t distance = len1 > len2 ? len1 - len2 : len2 - len1;
+
+    for (i = 0; i + 64 <= n; i += 64) {
+        __m512i a = _mm512_loadu_si512((const void *) (s1 + i));
+        __m512i b = _mm512_loadu_si512((const void *) (s2 + i));
+        distance += _mm_popcnt_u64(_mm512_cmpneq_epi8_mask(a, b));
     }
 
-    for ( ; *s2; s2++) {
-        distance++;
+    if (i < n) {
+        __mmask64 tail = (1ULL << (n - i)) - 1;
+        __m512i a = _mm512_maskz_loadu_epi8(tail, s1 + i);
+        __m512i b = _mm512_maskz_loadu_epi8(tail, s2 + i);
+        distance += _mm_popcnt_u64(_mm512_cmpneq_epi8_mask(a, b));
     }
 
     return distance;
 }
+
+#endif
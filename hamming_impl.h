@@ -0,0 +1,18 @@
+/* Hamming kernel, included by hamming.c once per code unit width.  The
+ * includer defines JF_CHAR, the code unit type, and JF_NAME(name), which
+ * appends the width suffix (_ucs1, _ucs2, _ucs4) to name.
+ */
+
+static inline size_t JF_NAME(hamming_kernel)(const JF_CHAR *s1, size_t len1,
+                                             const JF_CHAR *s2, size_t len2) {
+    size_t i, n = MIN(len1, len2);
+    size_t distance = len1 > len2 ? len1 - len2 : len2 - len1;
+
+    for (i = 0; i < n; i++) {
+        if (s1[i] != s2[i]) {
+            distance++;
+        }
+    }
+
+    return distance;
+}
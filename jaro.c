@@ -3,7 +3,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <math.h>
 #include "jellyfish.h"
+#include "probes.h"
 
 #define NOTNUM(c)   ((c>57) || (c<48))
 #define INRANGE(c)  ((c>0)  && (c<91))
@@ -12,6 +14,103 @@
 #define NaN (0.0 / 0.0)
 #endif
 
+#ifdef JELLYFISH_X86
+#include <immintrin.h>
+#endif
+
+#define JF_CHAR char
+#define JF_NAME(name) name##_ucs1
+#include "jaro_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
+
+#define JF_CHAR uint16_t
+#define JF_NAME(name) name##_ucs2
+#include "jaro_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
+
+#define JF_CHAR uint32_t
+#define JF_NAME(name) name##_ucs4
+#include "jaro_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
+
+/* The vector versions of find_match test a whole block of the search
+ * window per iteration.
+ */
+#ifdef JELLYFISH_X86
+
+__attribute__((target("sse4.2,popcnt")))
+static inline long find_match_sse42(char c, const char *yang, const char *yang_flag,
+                                    long lowlim, long hilim)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    const __m128i zero = _mm_setzero_si128();
+    long j;
+
+    for (j = lowlim; j + 16 <= hilim + 1; j += 16)
+    {
+        __m128i hay = _mm_loadu_si128((const __m128i *) (yang + j));
+        __m128i flags = _mm_loadu_si128((const __m128i *) (yang_flag + j));
+        unsigned hits = (unsigned) _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(hay, needle), _mm_cmpeq_epi8(flags, zero)));
+        if (hits)
+        {
+            return j + __builtin_ctz(hits);
+        }
+    }
+    return find_match_generic_ucs1(c, yang, yang_flag, j, hilim);
+}
+
+__attribute__((target("avx2,popcnt")))
+static inline long find_match_avx2(char c, const char *yang, const char *yang_flag,
+                                   long lowlim, long hilim)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    const __m256i zero = _mm256_setzero_si256();
+    long j;
+
+    for (j = lowlim; j + 32 <= hilim + 1; j += 32)
+    {
+        __m256i hay = _mm256_loadu_si256((const __m256i *) (yang + j));
+        __m256i flags = _mm256_loadu_si256((const __m256i *) (yang_flag + j));
+        unsigned hits = (unsigned) _mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(hay, needle), _mm256_cmpeq_epi8(flags, zero)));
+        if (hits)
+        {
+            return j + __builtin_ctz(hits);
+        }
+    }
+    return find_match_sse42(c, yang, yang_flag, j, hilim);
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+static inline long find_match_avx512(char c, const char *yang, const char *yang_flag,
+                                     long lowlim, long hilim)
+{
+    const __m512i needle = _mm512_set1_epi8(c);
+    const __m512i zero = _mm512_setzero_si512();
+    long j;
+
+    for (j = lowlim; j <= hilim; j += 64)
+    {
+        long n = hilim + 1 - j;
+        __mmask64 live = n >= 64 ? ~0ULL : (1ULL << n) - 1;
+        __m512i hay = _mm512_maskz_loadu_epi8(live, yang + j);
+        __m512i flags = _mm512_maskz_loadu_epi8(live, yang_flag + j);
+        __mmask64 hits = _mm512_mask_cmpeq_epi8_mask(
+            live & _mm512_cmpeq_epi8_mask(flags, zero), hay, needle);
+        if (hits)
+        {
+            return j + __builtin_ctzll(hits);
+        }
+    }
+    return -1;
+}
+
+#endif
+
 /**
  * Calculate the Jaro and/or Jaro-Winkler metrics for the two strings ying and yang.
  *
@@ -25,170 +124,129 @@
  */
 double _jaro_winkler(const char *ying, const char *yang, bool long_tolerance, bool winklerize)
 {
-    char* ying_flag = 0;
-    char* yang_flag = 0;
+    return jaro_winkler_kind(ying, strlen(ying), yang, strlen(yang), JELLYFISH_UCS1,
+                             long_tolerance, winklerize);
+}
 
-    double weight;
+double jaro_winkler_generic(const char *s1, size_t len1, const char *s2, size_t len2,
+                            bool long_tolerance, bool winklerize)
+{
+    return jaro_winkler_kernel_ucs1(s1, len1, s2, len2, long_tolerance, winklerize,
+                                    find_match_generic_ucs1);
+}
 
-    long ying_length, yang_length, min_len;
-    long search_range;
-    long lowlim, hilim;
-    long trans_count, common_chars;
+#ifdef JELLYFISH_X86
 
-    int i, j, k;
+__attribute__((target("sse4.2,popcnt")))
+double jaro_winkler_sse42(const char *s1, size_t len1, const char *s2, size_t len2,
+                          bool long_tolerance, bool winklerize)
+{
+    return jaro_winkler_kernel_ucs1(s1, len1, s2, len2, long_tolerance, winklerize,
+                                    find_match_sse42);
+}
 
-    // ensure that neither string is blank
-    ying_length = strlen(ying);
-    yang_length = strlen(yang);
-    if (ying_length == 0 || yang_length == 0)
-    {
-        return 0;
-    }
-    if (ying_length > yang_length)
-    {
-        min_len = ying_length;
-    }
-    else
-    {
-        min_len = yang_length;
-    }
-    search_range = min_len;
+__attribute__((target("avx2,popcnt")))
+double jaro_winkler_avx2(const char *s1, size_t len1, const char *s2, size_t len2,
+                         bool long_tolerance, bool winklerize)
+{
+    return jaro_winkler_kernel_ucs1(s1, len1, s2, len2, long_tolerance, winklerize,
+                                    find_match_avx2);
+}
 
-    // Blank out the flags
-    ying_flag = alloca(ying_length + 1);
-    if (!ying_flag)
-    {
-        return NaN;
-    }
+__attribute__((target("avx512f,avx512bw,popcnt")))
+double jaro_winkler_avx512(const char *s1, size_t len1, const char *s2, size_t len2,
+                           bool long_tolerance, bool winklerize)
+{
+    return jaro_winkler_kernel_ucs1(s1, len1, s2, len2, long_tolerance, winklerize,
+                                    find_match_avx512);
+}
 
-    yang_flag = alloca(yang_length + 1);
-    if (!yang_flag)
-    {
-        return NaN;
-    }
+#endif
 
-    memset(ying_flag, 0, ying_length + 1);
-    memset(yang_flag, 0, yang_length + 1);
+/* Jaro-Winkler over code units of the given width (JELLYFISH_UCS1, 2 or 4);
+ * one byte strings go through the selected backend.  The return probe
+ * carries the score in millionths, as tracers read integer arguments.
+ */
+static double jaro_winkler_dispatch(const void *ying, size_t ying_length,
+                                    const void *yang, size_t yang_length,
+                                    int kind, bool long_tolerance, bool winklerize)
+{
+    double weight;
 
-    search_range = (search_range / 2) - 1;
-    if (search_range < 0)
+    JELLYFISH_PROBE3(jaro__entry, ying_length, yang_length, winklerize);
+    switch (kind)
     {
-        search_range = 0;
+        case JELLYFISH_UCS2:
+            weight = jaro_winkler_kernel_ucs2(ying, ying_length, yang, yang_length,
+                                              long_tolerance, winklerize, find_match_generic_ucs2);
+            break;
+        case JELLYFISH_UCS4:
+            weight = jaro_winkler_kernel_ucs4(ying, ying_length, yang, yang_length,
+                                              long_tolerance, winklerize, find_match_generic_ucs4);
+            break;
+        default:
+            weight = jellyfish_backend->jaro(ying, ying_length, yang, yang_length,
+                                             long_tolerance, winklerize);
+            break;
     }
+    JELLYFISH_PROBE3(jaro__return, ying_length, yang_length, (long) (weight * 1e6));
+    return weight;
+}
 
-    // Looking only within the search range, count and flag the matched pairs.
-    common_chars = 0;
-    for (i = 0; i < ying_length; i++)
-    {
-        if (i >= search_range)
-        {
-            lowlim = i - search_range;
-        }
-        else
-        {
-            lowlim = 0;
-        }
-        if (i + search_range <= yang_length - 1)
-        {
-            hilim = i + search_range;
-        }
-        else
-        {
-            hilim = yang_length - 1;
-        }
-        for (j = lowlim; j <= hilim; j++)
-        {
-            if (!yang_flag[j] && yang[j] == ying[i])
-            {
-                yang_flag[j] = 1;
-                ying_flag[i] = 1;
-                common_chars++;
-                break;
-            }
-        }
-    }
+double jaro_winkler_kind(const void *ying, size_t ying_length, const void *yang, size_t yang_length,
+                         int kind, bool long_tolerance, bool winklerize)
+{
+    STATS_SCOPE(winklerize ? STAT_JARO_WINKLER : STAT_JARO, (ying_length + yang_length) * kind);
 
-    // If no characters in common - return
-    if (common_chars == 0)
+    return jaro_winkler_dispatch(ying, ying_length, yang, yang_length, kind,
+                                 long_tolerance, winklerize);
+}
+
+/* Upper bound on the score of strings of these lengths: at most the
+ * shorter length of characters can match, with no transpositions, and the
+ * Winkler prefix boost adds at most 0.1 per shared leading character.
+ */
+static double jaro_upper_bound(size_t ying_length, size_t yang_length,
+                               bool long_tolerance, bool winklerize)
+{
+    size_t common = MIN(ying_length, yang_length);
+    double bound;
+
+    if (common == 0)
     {
         return 0;
     }
-    // Count the number of transpositions
-    k = 0;
-    trans_count = 0;
-    for (i = 0; i < ying_length; i++)
+
+    bound = (common / (double) ying_length + common / (double) yang_length + 1) / 3;
+    if (winklerize)
     {
-        if (ying_flag[i])
+        if (long_tolerance)
         {
-            for (j = k; j < yang_length; j++)
-            {
-                if (yang_flag[j])
-                {
-                    k = j + 1;
-                    break;
-                }
-            }
-            if (ying[i] != yang[j])
-            {
-                trans_count++;
-            }
+            return 1;
         }
+        bound += MIN(4, common) * 0.1 * (1 - bound);
     }
-    trans_count /= 2;
-
-    // adjust for similarities in nonmatched characters
+    return bound;
+}
 
-    // Main weight computation.
-    weight= common_chars / ((double) ying_length) + common_chars / ((double) yang_length)
-        + ((double) (common_chars - trans_count)) / ((double) common_chars);
-    weight /= 3.0;
+double jaro_winkler_cutoff_kind(const void *ying, size_t ying_length,
+                                const void *yang, size_t yang_length, int kind,
+                                bool long_tolerance, bool winklerize, double score_cutoff)
+{
+    double weight;
+    STATS_SCOPE(winklerize ? STAT_JARO_WINKLER : STAT_JARO, (ying_length + yang_length) * kind);
 
-    // Continue to boost the weight if the strings are similar
-    if (winklerize && weight > 0.7)
+    if (score_cutoff > 0 &&
+        jaro_upper_bound(ying_length, yang_length, long_tolerance, winklerize) < score_cutoff)
     {
-        // Adjust for having up to the first 4 characters in common
-        if (min_len >= 4)
-        {
-            j = 4;
-        }
-        else
-        {
-            j = min_len;
-        }
-        for (i = 0; i < j; i++)
-        {
-            if (ying[i] != yang[i])
-            {
-                break;
-            }
-            if (!NOTNUM(ying[i]))
-            {
-                break;
-            }
-        }
-        if (i)
-        {
-            weight += i * 0.1 * (1.0 - weight);
-        }
-
-        /* Optionally adjust for long strings. */
-        /* After agreeing beginning chars, at least two more must agree and
-           the agreeing characters must be > .5 of remaining characters.
-        */
-        if ((long_tolerance) && (min_len > 4) && (common_chars > i + 1) && (2 * common_chars >= min_len + i))
-        {
-            if (NOTNUM(ying[0]))
-            {
-                weight += (double) (1.0 - weight) *
-                    ((double) (common_chars - i - 1) / ((double) (ying_length + yang_length - i * 2 + 2)));
-            }
-        }
+        return 0;
     }
 
-    return weight;
+    weight = jaro_winkler_dispatch(ying, ying_length, yang, yang_length, kind,
+                                   long_tolerance, winklerize);
+    return weight >= score_cutoff || isnan(weight) ? weight : 0;
 }
 
-
 double jaro_winkler(const char *ying, const char *yang, bool long_tolerance)
 {
     return _jaro_winkler(ying, yang, long_tolerance, true);
@@ -0,0 +1,183 @@
+/* Jaro / Jaro-Winkler kernel, included by jaro.c once per code unit width.
+ * The includer defines JF_CHAR, the code unit type, and JF_NAME(name), which
+ * appends the width suffix (_ucs1, _ucs2, _ucs4) to name.
+ */
+
+/* Find the first unflagged position j in yang[lowlim..hilim] holding c,
+ * or -1.  This search is the inner loop of the matching pass; jaro.c has
+ * vector versions of it for one byte code units.
+ */
+typedef long (*JF_NAME(jaro_find_fn))(JF_CHAR c, const JF_CHAR *yang, const char *yang_flag,
+                                      long lowlim, long hilim);
+
+static inline long JF_NAME(find_match_generic)(JF_CHAR c, const JF_CHAR *yang,
+                                               const char *yang_flag, long lowlim, long hilim)
+{
+    long j;
+
+    for (j = lowlim; j <= hilim; j++)
+    {
+        if (!yang_flag[j] && yang[j] == c)
+        {
+            return j;
+        }
+    }
+    return -1;
+}
+
+static inline __attribute__((always_inline))
+double JF_NAME(jaro_winkler_kernel)(const JF_CHAR *ying, long ying_length,
+                                    const JF_CHAR *yang, long yang_length,
+                                    bool long_tolerance, bool winklerize,
+                                    JF_NAME(jaro_find_fn) find_match)
+{
+    char* ying_flag = 0;
+    char* yang_flag = 0;
+    char stack[SCRATCH_STACK];
+    size_t mark;
+
+    double weight;
+
+    long min_len;
+    long search_range;
+    long lowlim, hilim;
+    long trans_count, common_chars;
+
+    int i, j, k;
+
+    // ensure that neither string is blank
+    if (ying_length == 0 || yang_length == 0)
+    {
+        return 0;
+    }
+    if (ying_length > yang_length)
+    {
+        min_len = ying_length;
+    }
+    else
+    {
+        min_len = yang_length;
+    }
+    search_range = min_len;
+
+    // Blank out the flags
+    mark = scratch_mark();
+    ying_flag = scratch_buffer(stack, sizeof(stack), ying_length + yang_length + 2);
+    if (!ying_flag)
+    {
+        return NaN;
+    }
+    yang_flag = ying_flag + ying_length + 1;
+
+    memset(ying_flag, 0, ying_length + 1);
+    memset(yang_flag, 0, yang_length + 1);
+
+    search_range = (search_range / 2) - 1;
+    if (search_range < 0)
+    {
+        search_range = 0;
+    }
+
+    // Looking only within the search range, count and flag the matched pairs.
+    common_chars = 0;
+    for (i = 0; i < ying_length; i++)
+    {
+        if (i >= search_range)
+        {
+            lowlim = i - search_range;
+        }
+        else
+        {
+            lowlim = 0;
+        }
+        if (i + search_range <= yang_length - 1)
+        {
+            hilim = i + search_range;
+        }
+        else
+        {
+            hilim = yang_length - 1;
+        }
+        j = find_match(ying[i], yang, yang_flag, lowlim, hilim);
+        if (j >= 0)
+        {
+            yang_flag[j] = 1;
+            ying_flag[i] = 1;
+            common_chars++;
+        }
+    }
+
+    // If no characters in common - return
+    if (common_chars == 0)
+    {
+        scratch_release(mark);
+        return 0;
+    }
+    // Count the number of transpositions
+    k = 0;
+    trans_count = 0;
+    for (i = 0; i < ying_length; i++)
+    {
+        if (ying_flag[i])
+        {
+            for (j = k; j < yang_length; j++)
+            {
+                if (yang_flag[j])
+                {
+                    k = j + 1;
+                    break;
+                }
+            }
+            if (ying[i] != yang[j])
+            {
+                trans_count++;
+            }
+        }
+    }
+    trans_count /= 2;
+    scratch_release(mark);
+
+    // adjust for similarities in nonmatched characters
+
+    // Main weight computation.
+    weight= common_chars / ((double) ying_length) + common_chars / ((double) yang_length)
+        + ((double) (common_chars - trans_count)) / ((double) common_chars);
+    weight /= 3.0;
+
+    // Continue to boost the weight if the strings are similar
+    if (winklerize && weight > 0.7)
+    {
+        // Adjust for having up to the first 4 characters in common
+        j = MIN(4, MIN(ying_length, yang_length));
+        for (i = 0; i < j; i++)
+        {
+            if (ying[i] != yang[i])
+            {
+                break;
+            }
+            if (!NOTNUM(ying[i]))
+            {
+                break;
+            }
+        }
+        if (i)
+        {
+            weight += i * 0.1 * (1.0 - weight);
+        }
+
+        /* Optionally adjust for long strings. */
+        /* After agreeing beginning chars, at least two more must agree and
+           the agreeing characters must be > .5 of remaining characters.
+        */
+        if ((long_tolerance) && (min_len > 4) && (common_chars > i + 1) && (2 * common_chars >= min_len + i))
+        {
+            if (NOTNUM(ying[0]))
+            {
+                weight += (double) (1.0 - weight) *
+                    ((double) (common_chars - i - 1) / ((double) (ying_length + yang_length - i * 2 + 2)));
+            }
+        }
+    }
+
+    return weight;
+}
@@ -2,11 +2,15 @@
 #define _JELLYFISH_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #ifndef MIN
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
 
 double jaro_winkler(const char* str1, const char* str2, bool long_tolerance);
 double jaro_distance(const char* str1, const char* str2);
@@ -22,16 +26,603 @@ char* soundex(const char *str);
 
 char* metaphone(const char *str);
 
+/* NFKD normalization to UTF-8 for strings of ASCII and Latin code points
+ * (nfkd.c).  nfkd_utf8_length returns the size of the normalized form, or
+ * -1 if str has a code point outside the tables; nfkd_utf8 then writes it
+ * to out, unterminated.  nfkd_utf8_partial, for callers that cannot fall
+ * back to unicodedata, normalizes the code points the tables cover and
+ * encodes the others unchanged, writing at most NFKD_UTF8_MAX bytes per
+ * code point; it returns the bytes written.  encode_utf8 encodes str
+ * without normalizing it, in at most 4 bytes per code point.
+ */
+#define NFKD_UTF8_MAX 5
+
+long nfkd_utf8_length(const void *str, size_t len, int kind);
+void nfkd_utf8(const void *str, size_t len, int kind, char *out);
+size_t nfkd_utf8_partial(const void *str, size_t len, int kind, char *out);
+size_t encode_utf8(const void *str, size_t len, int kind, char *out);
+
 char* nysiis(const char *str);
 
 char* match_rating_codex(const char* str);
 int match_rating_comparison(const char* str1, const char* str2);
+int match_rating_compare_codex(const char *codex1, const char *codex2);
+
+/* Length-based variants over code units of one width, matching the
+ * PyUnicode_*_KIND values so Python's compact string storage can be passed
+ * without encoding.  Both strings must use the same width.
+ */
+#define JELLYFISH_UCS1 1
+#define JELLYFISH_UCS2 2
+#define JELLYFISH_UCS4 4
+
+double jaro_winkler_kind(const void *str1, size_t len1, const void *str2, size_t len2,
+                         int kind, bool long_tolerance, bool winklerize);
+size_t hamming_distance_kind(const void *str1, size_t len1, const void *str2, size_t len2,
+                             int kind);
+int levenshtein_distance_kind(const void *str1, size_t len1, const void *str2, size_t len2,
+                              int kind);
+int damerau_levenshtein_distance_kind(const void *str1, size_t len1,
+                                      const void *str2, size_t len2, int kind);
+
+/* Normalized similarities in [0, 1]: 1 - distance / longer length, or 1 for
+ * two empty strings.  Scores below score_cutoff are returned as 0; the
+ * cutoff becomes a maximum distance, so the work stops as soon as it cannot
+ * be met.  These return NaN if memory runs out.
+ */
+double levenshtein_similarity(const char *str1, const char *str2, double score_cutoff);
+double damerau_levenshtein_similarity(const char *str1, const char *str2, double score_cutoff);
+double levenshtein_similarity_kind(const void *str1, size_t len1, const void *str2, size_t len2,
+                                   int kind, double score_cutoff);
+double damerau_levenshtein_similarity_kind(const void *str1, size_t len1,
+                                           const void *str2, size_t len2, int kind,
+                                           double score_cutoff);
+
+/* jaro_winkler_kind returning 0 for scores below score_cutoff.  Pairs whose
+ * lengths alone rule the cutoff out are rejected without matching.
+ */
+double jaro_winkler_cutoff_kind(const void *str1, size_t len1, const void *str2, size_t len2,
+                                int kind, bool long_tolerance, bool winklerize,
+                                double score_cutoff);
+
+/* The largest distance between strings whose longer length is longest that
+ * still scores at least score_cutoff, or -1 if no distance does.
+ */
+static inline long jellyfish_max_distance(size_t longest, double score_cutoff)
+{
+    if (score_cutoff > 1) {
+        return -1;
+    }
+    if (score_cutoff <= 0) {
+        return longest;
+    }
+    /* The epsilon keeps exact cutoffs such as 0.75 of 4 from rounding down. */
+    return (long) ((1 - score_cutoff) * longest + 1e-9);
+}
+
+/* Longest common subsequence (lcs.c).  indel_distance counts the
+ * insertions and deletions turning one string into the other, len1 + len2 -
+ * 2 * lcs, and lcs_similarity is 1 - indel_distance / (len1 + len2), with
+ * scores below score_cutoff returned as 0.  A pattern holds the bit masks
+ * of one string so it can be compared against many others, of any width,
+ * by LCS or by Levenshtein distance.  The lengths and distances return -1
+ * and the similarities NaN if memory runs out.
+ */
+long lcs_length(const char *str1, const char *str2);
+long indel_distance(const char *str1, const char *str2);
+double lcs_similarity(const char *str1, const char *str2, double score_cutoff);
+long lcs_length_kind(const void *str1, size_t len1, const void *str2, size_t len2, int kind);
+long indel_distance_kind(const void *str1, size_t len1, const void *str2, size_t len2, int kind);
+double lcs_similarity_kind(const void *str1, size_t len1, const void *str2, size_t len2,
+                           int kind, double score_cutoff);
+
+struct lcs_pattern;
+struct lcs_pattern* create_lcs_pattern(const void *str, size_t len, int kind);
+void free_lcs_pattern(struct lcs_pattern *pattern);
+long lcs_pattern_length(const struct lcs_pattern *pattern, const void *str, size_t len,
+                        int kind);
+double lcs_pattern_similarity(const struct lcs_pattern *pattern, const void *str, size_t len,
+                              int kind, double score_cutoff);
+long lcs_pattern_levenshtein(const struct lcs_pattern *pattern, const void *str, size_t len,
+                             int kind);
+double lcs_pattern_levenshtein_similarity(const struct lcs_pattern *pattern, const void *str,
+                                          size_t len, int kind, double score_cutoff);
+
+/* Similarity metrics selectable by name (metric.c), for comparators that
+ * take the metric as a parameter.  jellyfish_metric_from_name returns -1
+ * for an unknown name; jellyfish_similarity returns NaN if memory runs out.
+ * jellyfish_distance is the edit distance of the metrics that have one
+ * (all but the jaro metrics), or -1 if memory runs out.
+ */
+enum jellyfish_metric {
+    METRIC_LEVENSHTEIN,
+    METRIC_DAMERAU_LEVENSHTEIN,
+    METRIC_JARO,
+    METRIC_JARO_WINKLER,
+    METRIC_LCS
+};
+
+int jellyfish_metric_from_name(const char *name);
+const char* jellyfish_metric_name(enum jellyfish_metric metric);
+double jellyfish_similarity(enum jellyfish_metric metric,
+                            const void *str1, size_t len1, const void *str2, size_t len2,
+                            int kind, double score_cutoff);
+bool jellyfish_metric_has_distance(enum jellyfish_metric metric);
+long jellyfish_distance(enum jellyfish_metric metric,
+                        const void *str1, size_t len1, const void *str2, size_t len2,
+                        int kind);
+
+/* Word splitting (tokenize.c), shared by get_matches and the token
+ * comparators.  Fields are split on runs of non-word characters like
+ * re.split(r"\W+"); code points at or above 0x80 count as word characters.
+ * word_iter yields every field, including empty leading and trailing ones;
+ * tokenize collects the non-empty ones in scratch memory.  Spans are code
+ * unit offsets.
+ */
+struct token_span {
+    size_t start;
+    size_t end;
+};
+
+struct word_iter {
+    const void *str;
+    size_t len;
+    int kind;
+    size_t pos;
+    bool done;
+};
+
+void word_iter_init(struct word_iter *it, const void *str, size_t len, int kind);
+bool word_iter_next(struct word_iter *it, struct token_span *span);
+int tokenize(const void *str, size_t len, int kind,
+             struct token_span **spans, size_t *n_spans);
+int token_compare(const void *str_a, const struct token_span *a,
+                  const void *str_b, const struct token_span *b, int kind);
+int sort_tokens(const void *str, int kind, struct token_span *spans, size_t n);
+size_t join_tokens(const void *str, int kind, const struct token_span *spans, size_t n,
+                   void *out);
+
+/* Word order insensitive comparators (token.c), scoring with any metric.
+ * token_sort compares the sorted tokens; token_set compares the shared and
+ * differing token sets; monge_elkan averages, over the tokens of str1, the
+ * best score against any token of str2 (and the reverse, averaged, when
+ * symmetric).  These return NaN if memory runs out.
+ */
+double token_sort_similarity_kind(enum jellyfish_metric metric,
+                                  const void *str1, size_t len1,
+                                  const void *str2, size_t len2, int kind,
+                                  double score_cutoff);
+double token_set_similarity_kind(enum jellyfish_metric metric,
+                                 const void *str1, size_t len1,
+                                 const void *str2, size_t len2, int kind,
+                                 double score_cutoff);
+double monge_elkan_similarity_kind(enum jellyfish_metric metric,
+                                   const void *str1, size_t len1,
+                                   const void *str2, size_t len2, int kind,
+                                   bool symmetric, double score_cutoff);
+
+/* Edit costs for the weighted distances (weighted_levenshtein.c).  Code
+ * points below 256 have their own entries; anything wider uses the
+ * default_* costs.  Substituting a character for itself is always free.
+ */
+struct cost_table {
+    double insert[256];
+    double delete[256];
+    double substitute[256][256];
+    double transpose;
+    double default_insert;
+    double default_delete;
+    double default_substitute;
+};
+
+struct cost_table* create_cost_table(double insert, double delete,
+                                     double substitute, double transpose);
+void free_cost_table(struct cost_table *costs);
+
+/* These return -1 if memory runs out. */
+double weighted_levenshtein_distance(const char *str1, const char *str2,
+                                     const struct cost_table *costs);
+double weighted_damerau_levenshtein_distance(const char *str1, const char *str2,
+                                             const struct cost_table *costs);
+double weighted_levenshtein_distance_kind(const void *str1, size_t len1,
+                                          const void *str2, size_t len2, int kind,
+                                          const struct cost_table *costs);
+double weighted_damerau_levenshtein_distance_kind(const void *str1, size_t len1,
+                                                  const void *str2, size_t len2, int kind,
+                                                  const struct cost_table *costs);
+
+/* Levenshtein edit scripts (alignment.c).  An edit_op replaces str1[i] with
+ * str2[j], deletes str1[i] (j is the matching position in str2) or inserts
+ * str2[j] before str1[i].  Spans group them difflib style: str1[i1..i2)
+ * becomes str2[j1..j2).  Both functions return -1 if memory runs out; on
+ * success the caller frees the returned array.
+ */
+enum edit_type {
+    EDIT_EQUAL,
+    EDIT_REPLACE,
+    EDIT_INSERT,
+    EDIT_DELETE
+};
+
+struct edit_op {
+    enum edit_type type;
+    size_t i;
+    size_t j;
+};
+
+struct edit_span {
+    enum edit_type type;
+    size_t i1, i2;
+    size_t j1, j2;
+};
+
+int levenshtein_editops(const char *str1, const char *str2,
+                        struct edit_op **ops, size_t *n_ops);
+int levenshtein_editops_kind(const void *str1, size_t len1, const void *str2, size_t len2,
+                             int kind, struct edit_op **ops, size_t *n_ops);
+int editops_to_spans(const struct edit_op *ops, size_t n_ops, size_t len1, size_t len2,
+                     struct edit_span **spans, size_t *n_spans);
+
+/* Threads (threadpool.c).  parallel_for calls fn on consecutive blocks of
+ * [0, n) from up to threads threads (0 for one per CPU), each block at
+ * least grain items long, and returns when all of them have finished.
+ * Idle threads steal work from busy ones.  parallel_for_cost also takes
+ * cost(ctx, i), an estimate of the work for item i (such as the product of
+ * the lengths it compares), and splits the work evenly rather than the
+ * items.  run_pooled queues fn(arg) to run on a worker, returning -1 if
+ * it cannot.  Both run on one shared pool of jellyfish_default_threads()
+ * workers, so concurrent calls queue for the CPUs rather than oversubscribe
+ * them, and threads beyond the pool's size add no parallelism.
+ */
+typedef void (*parallel_fn)(void *ctx, size_t begin, size_t end);
+typedef double (*parallel_cost_fn)(void *ctx, size_t i);
+
+size_t jellyfish_default_threads(void);
+int run_pooled(void (*fn)(void *arg), void *arg);
+void parallel_for(size_t n, size_t grain, size_t threads, parallel_fn fn, void *ctx);
+void parallel_for_cost(size_t n, size_t grain, size_t threads, parallel_fn fn,
+                       parallel_cost_fn cost, void *ctx);
+
+/* Columns of strings scored row by row (pairwise.c).  A column is read in
+ * place: an array of refs (data NULL for a missing value), fixed width NUL
+ * padded rows like numpy's U and S arrays, or Arrow style offsets into a
+ * data buffer with an optional validity bitmap, whose bytes are UTF-8
+ * when utf8 is set.
+ */
+enum column_layout {
+    COLUMN_REFS,
+    COLUMN_FIXED,
+    COLUMN_OFFSETS32,
+    COLUMN_OFFSETS64
+};
+
+struct string_ref {
+    const void *data;
+    size_t len;
+    int kind;
+};
+
+struct string_column {
+    enum column_layout layout;
+    size_t length;
+    const struct string_ref *refs;  /* COLUMN_REFS */
+    const char *data;               /* COLUMN_FIXED and the offset layouts */
+    size_t width;                   /* COLUMN_FIXED: code units per row */
+    int kind;                       /* COLUMN_FIXED: code unit width */
+    const void *offsets;            /* the offset layouts: int32_t or int64_t */
+    const uint8_t *validity;
+    size_t offset;                  /* index of row 0 in offsets and validity */
+    bool utf8;
+};
+
+/* column_row fetches row i of col, returning 1, 0 for a missing value or
+ * -1 if memory runs out; widen_row copies a row to the wider code unit
+ * width kind.  Decoded and widened rows are stored in buf, which grows as
+ * needed and whose data the caller frees.
+ */
+struct row_buffer {
+    void *data;
+    size_t size;
+};
+
+int column_row(const struct string_column *col, size_t i, struct string_ref *row,
+               struct row_buffer *buf);
+int widen_row(struct string_ref *row, int kind, struct row_buffer *buf);
+
+/* The bytes of string data in col, as stored: UTF-8 for utf8 columns.
+ * column_units is the stored length of row i, in code units (0 when
+ * missing), an upper bound on its length that is cheap to get.
+ */
+size_t column_bytes(const struct string_column *col);
+size_t column_units(const struct string_column *col, size_t i);
+
+/* Score row i of a against row i of b for the shorter column's length.  A
+ * missing value scores NaN, or a distance of -1.  pairwise_distance needs a
+ * metric with a distance.  Both return -1 if memory runs out.
+ */
+int pairwise_similarity(enum jellyfish_metric metric,
+                        const struct string_column *a, const struct string_column *b,
+                        double score_cutoff, double *out, size_t threads);
+int pairwise_distance(enum jellyfish_metric metric,
+                      const struct string_column *a, const struct string_column *b,
+                      int32_t *out, size_t threads);
+
+/* All pairs: cdist fills the a->length x b->length matrix row by row;
+ * pdist fills the condensed upper triangle of col against itself, in
+ * scipy's order (cell i, j for i < j at n*i - i*(i+1)/2 + j-i-1).  Missing
+ * values and failures are as for the pairwise functions.
+ */
+int cdist_similarity(enum jellyfish_metric metric,
+                     const struct string_column *a, const struct string_column *b,
+                     double score_cutoff, double *out, size_t threads);
+int cdist_distance(enum jellyfish_metric metric,
+                   const struct string_column *a, const struct string_column *b,
+                   int32_t *out, size_t threads);
+int pdist_similarity(enum jellyfish_metric metric, const struct string_column *col,
+                     double score_cutoff, double *out, size_t threads);
+int pdist_distance(enum jellyfish_metric metric, const struct string_column *col,
+                   int32_t *out, size_t threads);
+
+/* Fuzzy deduplication (cluster.c).  Pairs of rows are matched by a metric
+ * similarity of at least threshold, a metric distance of at most
+ * max_distance, or the match rating comparison, and the matches' connected
+ * components numbered 0, 1, ... in order of their first row; missing
+ * values get -1.  Only candidate pairs from the blocking are compared:
+ * rows with the same phonetic key (computed from str rows, when fold is
+ * set, as soundex(), metaphone() and nysiis() compute it), rows whose
+ * lengths could match under the metric (so nothing is missed), rows
+ * sharing a trigram, or every pair.  Returns -1 if memory runs out.
+ */
+enum dedupe_scorer {
+    SCORE_SIMILARITY,
+    SCORE_DISTANCE,
+    SCORE_MATCH_RATING
+};
+
+enum dedupe_blocking {
+    BLOCK_NONE,
+    BLOCK_LENGTH,
+    BLOCK_QGRAM,
+    BLOCK_SOUNDEX,
+    BLOCK_METAPHONE,
+    BLOCK_NYSIIS
+};
+
+struct dedupe_options {
+    enum dedupe_scorer scorer;
+    enum jellyfish_metric metric;
+    double threshold;
+    long max_distance;
+    enum dedupe_blocking blocking;
+    bool fold;
+    size_t threads;
+};
+
+int dedupe_blocking_from_name(const char *name);
+int dedupe(const struct string_column *col, const struct dedupe_options *options,
+           int32_t *cluster_ids);
+
+/* The phonetic key of row for a phonetic blocking, or its match rating
+ * codex when codex is set, as a malloc'ed string; NULL if memory runs out.
+ */
+char* row_phonetic_key(const struct string_ref *row, enum dedupe_blocking blocking, bool fold,
+                       bool codex);
+
+/* Preprocessed queries (query.c).  A query keeps everything about one
+ * string that scoring it against many candidates can reuse: Levenshtein
+ * and LCS bit masks, a character bitmap bounding the jaro metrics, copies
+ * at the wider code unit widths and its phonetic key.  The phonetic
+ * scorers give 1 when the candidate's key equals the query's (for match
+ * rating, when the codexes compare as a match) and 0 otherwise, with keys
+ * computed as dedupe computes them.  query_score widens
+ * candidates into scratch; query_score_column scores every row of col,
+ * missing values NaN.  create_query returns NULL, query_score NaN and
+ * query_score_column -1 if memory runs out.
+ */
+enum query_scorer {
+    QUERY_METRIC,
+    QUERY_SOUNDEX,
+    QUERY_METAPHONE,
+    QUERY_NYSIIS,
+    QUERY_MATCH_RATING
+};
+
+struct query;
+struct query* create_query(const struct string_ref *text, enum query_scorer scorer,
+                           enum jellyfish_metric metric, bool fold, double score_cutoff);
+void free_query(struct query *query);
+double query_score(const struct query *query, const struct string_ref *candidate,
+                   struct row_buffer *scratch);
+int query_score_column(const struct query *query, const struct string_column *col,
+                       double *out, size_t threads);
 
 struct stemmer;
 extern struct stemmer* create_stemmer(void);
 extern void free_stemmer(struct stemmer* z);
 extern int stem(struct stemmer* z, char* b, int k);
+int stem_in_place(char* b, int k);
+
+/* get_matches returns a -1 terminated array of word indexes scoring at least
+ * cutoff, or one of the error values below cast to a pointer.
+ */
+#define MAX_MATCHES (0x1000)
+
+#define BAD_REGEX ((UINTPTR_MAX)-(1))
+#define OUT_OF_RAM ((UINTPTR_MAX)-(2))
+#define TOO_MANY_MATCHES ((UINTPTR_MAX)-(3))
+#define RANDOM_ERROR ((UINTPTR_MAX)-(4))
 
 int* get_matches(const char* longDesc, const char* inTarget, double cutoff);
 
+/* Scratch memory (arena.c).  Every thread has a grow-only arena for the
+ * temporaries of a call: scratch_mark notes its top, scratch_alloc hands
+ * out 16 byte aligned blocks above it (NULL if memory runs out) and
+ * scratch_release gives back everything allocated since a mark, so calls
+ * nest freely.  Once a thread's arena fits its largest call, calls make no
+ * allocations at all.  scratch_buffer serves short strings from a buffer
+ * on the caller's stack instead, never more than SCRATCH_STACK bytes.
+ *
+ * Arena chunks come from the allocator passed to jellyfish_set_allocator,
+ * which must stay valid for good, or from malloc and free given NULL.
+ */
+#define SCRATCH_STACK 512
+
+struct jellyfish_allocator {
+    void* (*allocate)(size_t size);
+    void (*deallocate)(void *ptr);
+};
+
+void jellyfish_set_allocator(const struct jellyfish_allocator *allocator);
+size_t scratch_mark(void);
+void* scratch_alloc(size_t size);
+void scratch_release(size_t mark);
+
+static inline void* scratch_buffer(void *stack, size_t stack_size, size_t size)
+{
+    return size <= stack_size ? stack : scratch_alloc(size);
+}
+
+/* Call statistics (stats.c).  While jellyfish_stats_enable(true) is in
+ * effect, every public function records its call, the bytes of string it
+ * was given and its latency, in a log2 histogram of nanoseconds, under its
+ * jellyfish_stat.  Counters are kept per thread, so recording never
+ * contends; jellyfish_stats_read sums them since the last reset.  A call's
+ * time includes that of the calls it makes, so a cdist's pairs are counted
+ * both under cdist and under their metric.  Disabled, a function pays for
+ * one relaxed load.
+ */
+enum jellyfish_stat {
+    STAT_JARO,
+    STAT_JARO_WINKLER,
+    STAT_HAMMING,
+    STAT_LEVENSHTEIN,
+    STAT_DAMERAU_LEVENSHTEIN,
+    STAT_LCS,
+    STAT_WEIGHTED_LEVENSHTEIN,
+    STAT_WEIGHTED_DAMERAU_LEVENSHTEIN,
+    STAT_LEVENSHTEIN_EDITOPS,
+    STAT_TOKEN_SORT,
+    STAT_TOKEN_SET,
+    STAT_MONGE_ELKAN,
+    STAT_SOUNDEX,
+    STAT_METAPHONE,
+    STAT_NYSIIS,
+    STAT_MATCH_RATING_CODEX,
+    STAT_MATCH_RATING_COMPARISON,
+    STAT_PORTER_STEM,
+    STAT_GET_MATCHES,
+    STAT_PAIRWISE,
+    STAT_CDIST,
+    STAT_PDIST,
+    STAT_DEDUPE,
+    STAT_QUERY,
+    STAT_QUERY_COLUMN,
+    STAT_COUNT
+};
+
+/* Bucket i counts calls taking [2^i, 2^(i+1)) ns; the last also counts
+ * anything slower.
+ */
+#define STATS_BUCKETS 40
+
+struct jellyfish_stats {
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t time_ns;
+    uint64_t histogram[STATS_BUCKETS];
+};
+
+struct stats_scope {
+    enum jellyfish_stat stat;
+    size_t bytes;
+    uint64_t start;
+};
+
+extern int jellyfish_stats_enabled;
+
+uint64_t stats_clock(void);
+void stats_record(enum jellyfish_stat stat, size_t bytes, uint64_t start);
+
+static inline uint64_t stats_begin(void)
+{
+    return __atomic_load_n(&jellyfish_stats_enabled, __ATOMIC_RELAXED) ? stats_clock() : 0;
+}
+
+static inline void stats_scope_end(struct stats_scope *scope)
+{
+    if (scope->start) {
+        stats_record(scope->stat, scope->bytes, scope->start);
+    }
+}
+
+/* Record the rest of the enclosing function, however it returns.  size
+ * is only evaluated while recording.
+ */
+#define STATS_SCOPE(which, size) \
+    struct stats_scope stats_scope_ __attribute__((cleanup(stats_scope_end))) = \
+        { (which), 0, stats_begin() }; \
+    stats_scope_.bytes = stats_scope_.start ? (size_t) (size) : 0
+
+void jellyfish_stats_enable(bool enabled);
+const char* jellyfish_stat_name(enum jellyfish_stat stat);
+void jellyfish_stats_read(struct jellyfish_stats stats[STAT_COUNT]);
+void jellyfish_stats_reset(void);
+
+/* Runtime kernel dispatch (cpu.c).
+ *
+ * hamming_distance, levenshtein_distance and the jaro functions call through
+ * jellyfish_backend, which jellyfish_init_backend() points at the fastest
+ * implementation the running CPU supports.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define JELLYFISH_X86
+#endif
+
+#define JELLYFISH_CPU_SSE2      (1u << 0)
+#define JELLYFISH_CPU_SSE42     (1u << 1)
+#define JELLYFISH_CPU_POPCNT    (1u << 2)
+#define JELLYFISH_CPU_AVX2      (1u << 3)
+#define JELLYFISH_CPU_AVX512F   (1u << 4)
+#define JELLYFISH_CPU_AVX512BW  (1u << 5)
+
+struct jellyfish_backend
+{
+    const char *name;
+    unsigned requires;
+    size_t (*hamming)(const char *s1, size_t len1, const char *s2, size_t len2);
+    int (*levenshtein)(const char *s1, size_t len1, const char *s2, size_t len2);
+    double (*jaro)(const char *s1, size_t len1, const char *s2, size_t len2,
+                   bool long_tolerance, bool winklerize);
+};
+
+extern const struct jellyfish_backend *jellyfish_backend;
+
+/* Room for the processor's brand string, which jellyfish_cpu_model() writes. */
+#define JELLYFISH_CPU_MODEL_MAX 49
+
+unsigned jellyfish_cpu_features(void);
+void jellyfish_cpu_model(char model[JELLYFISH_CPU_MODEL_MAX]);
+const struct jellyfish_backend* jellyfish_backends(void);
+int jellyfish_init_backend(const char *name);
+
+size_t hamming_distance_generic(const char *s1, size_t len1, const char *s2, size_t len2);
+int levenshtein_distance_generic(const char *s1, size_t len1, const char *s2, size_t len2);
+double jaro_winkler_generic(const char *s1, size_t len1, const char *s2, size_t len2,
+                            bool long_tolerance, bool winklerize);
+
+#ifdef JELLYFISH_X86
+size_t hamming_distance_sse42(const char *s1, size_t len1, const char *s2, size_t len2);
+size_t hamming_distance_avx2(const char *s1, size_t len1, const char *s2, size_t len2);
+size_t hamming_distance_avx512(const char *s1, size_t len1, const char *s2, size_t len2);
+int levenshtein_distance_sse42(const char *s1, size_t len1, const char *s2, size_t len2);
+int levenshtein_distance_avx2(const char *s1, size_t len1, const char *s2, size_t len2);
+int levenshtein_distance_avx512(const char *s1, size_t len1, const char *s2, size_t len2);
+double jaro_winkler_sse42(const char *s1, size_t len1, const char *s2, size_t len2,
+                          bool long_tolerance, bool winklerize);
+double jaro_winkler_avx2(const char *s1, size_t len1, const char *s2, size_t len2,
+                         bool long_tolerance, bool winklerize);
+double jaro_winkler_avx512(const char *s1, size_t len1, const char *s2, size_t len2,
+                           bool long_tolerance, bool winklerize);
+#endif
+
 #endif
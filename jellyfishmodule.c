@@ -1,10 +1,24 @@
 #include <Python.h>
+#include <structmember.h>
 #include <math.h>
+#include <ctype.h>
+#include <string.h>
+#include <pthread.h>
 #include "jellyfish.h"
 
+/* Per-interpreter module state.  Python 3 builds the types from specs
+ * for every module object, so nothing Python-level is shared between
+ * interpreters; Python 2 has one static copy.
+ */
 struct jellyfish_state
 {
     PyObject *unicodedata_normalize;
+    PyObject *normalize_cache;
+    PyObject *CostTable_Type;
+    PyObject *Query_Type;
+    pthread_mutex_t submitted_lock;     /* submit() calls still running */
+    pthread_cond_t submitted_done;
+    size_t submitted;
 };
 
 #if PY_MAJOR_VERSION >= 3
@@ -14,23 +28,56 @@ struct jellyfish_state
 static struct jellyfish_state _state;
 #endif
 
+/* Free-threaded builds lock mutable objects with critical sections; with
+ * the GIL, and before 3.13, these are plain blocks.
+ */
+#ifndef Py_BEGIN_CRITICAL_SECTION
+#define Py_BEGIN_CRITICAL_SECTION(op) {
+#define Py_END_CRITICAL_SECTION() }
+#endif
+
+/* Heap type instances own a reference to their type from 3.8 on. */
+#if PY_VERSION_HEX >= 0x03080000
+#define RELEASE_HEAP_TYPE(type) Py_DECREF(type)
+#else
+#define RELEASE_HEAP_TYPE(type) ((void) (type))
+#endif
+
+#ifdef Py_TPFLAGS_IMMUTABLETYPE
+#define TYPE_FLAGS (Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE)
+#else
+#define TYPE_FLAGS Py_TPFLAGS_DEFAULT
+#endif
+
 #if PY_MAJOR_VERSION >= 3
 #define UTF8_BYTES(s) (PyBytes_AS_STRING(s))
 #else
 #define UTF8_BYTES(s) (PyString_AS_STRING(s))
 #endif
 
+/* Strings unicodedata.normalize has been called for, with their UTF-8
+ * results.  It is emptied when full, as the strings that need it are rare
+ * but tend to repeat.
+ */
+#define NORMALIZE_CACHE_SIZE 4096
+
 /* Returns a new reference to a PyString (python < 3) or
  * PyBytes (python >= 3.0).
  *
- * If passed a PyUnicode, the returned object will be NFKD UTF-8.
+ * If passed a PyUnicode, the returned object will be NFKD UTF-8.  ASCII
+ * strings are already NFKD, and strings of Latin code points are
+ * normalized from nfkd.c's tables; only other strings go through
+ * unicodedata.normalize.
  * If passed a PyString or PyBytes no conversion is done.
  */
 static inline PyObject* normalize(PyObject *mod, PyObject *pystr)
 {
-    PyObject *unicodedata_normalize;
+    struct jellyfish_state *state = GETSTATE(mod);
     PyObject *normalized;
     PyObject *utf8;
+#if PY_MAJOR_VERSION >= 3
+    long len;
+#endif
 
 #if PY_MAJOR_VERSION < 3
     if (PyString_Check(pystr))
@@ -48,14 +95,63 @@ static inline PyObject* normalize(PyObject *mod, PyObject *pystr)
 
     if (PyUnicode_Check(pystr))
     {
-        unicodedata_normalize = GETSTATE(mod)->unicodedata_normalize;
-        normalized = PyObject_CallFunction(unicodedata_normalize, "sO", "NFKD", pystr);
+#if PY_MAJOR_VERSION >= 3
+#if PY_VERSION_HEX < 0x030C0000
+        if (PyUnicode_READY(pystr) < 0)
+        {
+            return NULL;
+        }
+#endif
+        if (PyUnicode_IS_ASCII(pystr))
+        {
+            return PyBytes_FromStringAndSize(PyUnicode_DATA(pystr),
+                                             PyUnicode_GET_LENGTH(pystr));
+        }
+        len = nfkd_utf8_length(PyUnicode_DATA(pystr), PyUnicode_GET_LENGTH(pystr),
+                               PyUnicode_KIND(pystr));
+        if (len >= 0)
+        {
+            utf8 = PyBytes_FromStringAndSize(NULL, len);
+            if (utf8)
+            {
+                nfkd_utf8(PyUnicode_DATA(pystr), PyUnicode_GET_LENGTH(pystr),
+                          PyUnicode_KIND(pystr), PyBytes_AS_STRING(utf8));
+            }
+            return utf8;
+        }
+#endif
+
+#if PY_VERSION_HEX >= 0x030D0000
+        if (PyDict_GetItemRef(state->normalize_cache, pystr, &utf8) != 0)
+        {
+            return utf8;
+        }
+#else
+        utf8 = PyDict_GetItem(state->normalize_cache, pystr);
+        if (utf8)
+        {
+            Py_INCREF(utf8);
+            return utf8;
+        }
+#endif
+        normalized = PyObject_CallFunction(state->unicodedata_normalize, "sO", "NFKD", pystr);
         if (!normalized)
         {
             return NULL;
         }
         utf8 = PyUnicode_AsUTF8String(normalized);
         Py_DECREF(normalized);
+        if (utf8)
+        {
+            if (PyDict_Size(state->normalize_cache) >= NORMALIZE_CACHE_SIZE)
+            {
+                PyDict_Clear(state->normalize_cache);
+            }
+            if (PyDict_SetItem(state->normalize_cache, pystr, utf8) < 0)
+            {
+                Py_CLEAR(utf8);
+            }
+        }
         return utf8;
     }
 
@@ -63,17 +159,399 @@ static inline PyObject* normalize(PyObject *mod, PyObject *pystr)
     return NULL;
 }
 
-static PyObject * jellyfish_jaro_winkler(PyObject *self, PyObject *args)
+/* A view of a string argument's code units.  str arguments use PyUnicode's
+ * compact storage directly (1, 2 or 4 bytes per code point, no encoding);
+ * bytes arguments are compared byte by byte.  When the two arguments of a
+ * call have different widths the narrower one is widened into buffer,
+ * which release_pair() frees.
+ */
+struct string_view
 {
-    const char *s1, *s2;
-    double result;
+    const void *data;
+    size_t len;
+    int kind;
+    void *buffer;
+};
+
+static int get_string_view(PyObject *obj, struct string_view *view)
+{
+
+#if PY_MAJOR_VERSION >= 3
+    if (PyUnicode_Check(obj))
+    {
+#if PY_VERSION_HEX < 0x030C0000
+        if (PyUnicode_READY(obj) < 0)
+        {
+            return -1;
+        }
+#endif
+        view->data = PyUnicode_DATA(obj);
+        view->len = PyUnicode_GET_LENGTH(obj);
+        view->kind = PyUnicode_KIND(obj);
+        return 0;
+    }
+    if (PyBytes_Check(obj))
+    {
+        view->data = PyBytes_AS_STRING(obj);
+        view->len = PyBytes_GET_SIZE(obj);
+        view->kind = JELLYFISH_UCS1;
+        return 0;
+    }
+#else
+    if (PyUnicode_Check(obj))
+    {
+        view->data = PyUnicode_AS_UNICODE(obj);
+        view->len = PyUnicode_GET_SIZE(obj);
+        view->kind = sizeof(Py_UNICODE);
+        return 0;
+    }
+    if (PyString_Check(obj))
+    {
+        view->data = PyString_AS_STRING(obj);
+        view->len = PyString_GET_SIZE(obj);
+        view->kind = JELLYFISH_UCS1;
+        return 0;
+    }
+#endif
+
+    PyErr_Format(PyExc_TypeError, "expected str or bytes, got %.200s", Py_TYPE(obj)->tp_name);
+    return -1;
+}
+
+static int widen(struct string_view *view, int kind)
+{
+    size_t i;
+    void *buffer = PyMem_Malloc(view->len * kind + kind);
+
+    if (!buffer)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    for (i = 0; i < view->len; i++)
+    {
+        uint32_t c = view->kind == JELLYFISH_UCS1 ? ((const uint8_t *) view->data)[i] :
+                     view->kind == JELLYFISH_UCS2 ? ((const uint16_t *) view->data)[i] :
+                     ((const uint32_t *) view->data)[i];
+        if (kind == JELLYFISH_UCS2)
+        {
+            ((uint16_t *) buffer)[i] = c;
+        }
+        else
+        {
+            ((uint32_t *) buffer)[i] = c;
+        }
+    }
+
+    view->data = view->buffer = buffer;
+    view->kind = kind;
+    return 0;
+}
+
+static void release_pair(struct string_view *v1, struct string_view *v2)
+{
+    PyMem_Free(v1->buffer);
+    PyMem_Free(v2->buffer);
+}
+
+/* Fill v1 and v2 with views of the same code unit width. */
+static int string_pair(PyObject *o1, PyObject *o2,
+                       struct string_view *v1, struct string_view *v2)
+{
+    v1->buffer = v2->buffer = NULL;
+
+    if (get_string_view(o1, v1) < 0 || get_string_view(o2, v2) < 0)
+    {
+        return -1;
+    }
+
+    if (PyUnicode_Check(o1) != PyUnicode_Check(o2))
+    {
+        PyErr_SetString(PyExc_TypeError, "cannot compare str with bytes");
+        return -1;
+    }
+
+    if (v1->kind < v2->kind)
+    {
+        return widen(v1, v2->kind);
+    }
+    if (v2->kind < v1->kind)
+    {
+        return widen(v2, v1->kind);
+    }
+    return 0;
+}
+
+/* Argument parsing for the METH_FASTCALL | METH_KEYWORDS functions, which
+ * get their positional arguments in args[0:nargs] followed by the values
+ * of the keywords named by the kwnames tuple.  parse_args matches both
+ * against the NULL terminated names, of which the first required must be
+ * given, storing borrowed references in values; the slots of omitted
+ * arguments are left untouched, so they can hold defaults.
+ */
+#if PY_MAJOR_VERSION >= 3
+#define KEYWORD_IS(key, name) \
+    (PyUnicode_Check(key) && PyUnicode_CompareWithASCIIString(key, name) == 0)
+#define KEYWORD_FORMAT "%U"
+#else
+#define KEYWORD_IS(key, name) \
+    (PyString_Check(key) && strcmp(PyString_AS_STRING(key), name) == 0)
+#define KEYWORD_FORMAT "%s"
+#endif
+
+static int parse_args(const char *fname, PyObject *const *args, Py_ssize_t nargs,
+                      PyObject *kwnames, const char *const *names, Py_ssize_t required,
+                      PyObject **values)
+{
+    Py_ssize_t n_names = 0, n_kwargs, i, k;
+    PyObject *key;
+
+    while (names[n_names])
+    {
+        n_names++;
+    }
+    if (nargs > n_names)
+    {
+        PyErr_Format(PyExc_TypeError, "%s() takes at most %zd arguments (%zd given)",
+                     fname, n_names, nargs);
+        return -1;
+    }
+    for (i = 0; i < nargs; i++)
+    {
+        values[i] = args[i];
+    }
+
+    n_kwargs = kwnames ? PyTuple_GET_SIZE(kwnames) : 0;
+    for (k = 0; k < n_kwargs; k++)
+    {
+        key = PyTuple_GET_ITEM(kwnames, k);
+        for (i = 0; i < n_names && !KEYWORD_IS(key, names[i]); i++)
+        {
+        }
+        if (i == n_names)
+        {
+#if PY_MAJOR_VERSION >= 3
+            PyErr_Format(PyExc_TypeError, "%s() got an unexpected keyword argument '%S'",
+                         fname, key);
+#else
+            PyErr_Format(PyExc_TypeError, "%s() got an unexpected keyword argument '%s'",
+                         fname, PyString_Check(key) ? PyString_AS_STRING(key) : "?");
+#endif
+            return -1;
+        }
+        if (i < nargs)
+        {
+            PyErr_Format(PyExc_TypeError, "%s() got multiple values for argument '%s'",
+                         fname, names[i]);
+            return -1;
+        }
+        values[i] = args[nargs + k];
+    }
+
+    for (i = 0; i < required; i++)
+    {
+        if (!values[i])
+        {
+            PyErr_Format(PyExc_TypeError, "%s() missing required argument '%s' (pos %zd)",
+                         fname, names[i], i + 1);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Converters for optional arguments, leaving *out alone when o is NULL. */
+static int arg_double(PyObject *o, double *out)
+{
+    double value;
+
+    if (o)
+    {
+        value = PyFloat_AsDouble(o);
+        if (value == -1.0 && PyErr_Occurred())
+        {
+            return -1;
+        }
+        *out = value;
+    }
+    return 0;
+}
 
-    if (!PyArg_ParseTuple(args, "ss", &s1, &s2))
+static int arg_ssize(PyObject *o, Py_ssize_t *out)
+{
+    Py_ssize_t value;
+
+    if (o)
+    {
+        value = PyNumber_AsSsize_t(o, PyExc_OverflowError);
+        if (value == -1 && PyErr_Occurred())
+        {
+            return -1;
+        }
+        *out = value;
+    }
+    return 0;
+}
+
+static int arg_bool(PyObject *o, bool *out)
+{
+    int value;
+
+    if (o)
+    {
+        value = PyObject_IsTrue(o);
+        if (value < 0)
+        {
+            return -1;
+        }
+        *out = value;
+    }
+    return 0;
+}
+
+/* A str argument as NUL terminated UTF-8, valid while o is alive. */
+static int arg_string(const char *fname, PyObject *o, const char **out)
+{
+    const char *value;
+    Py_ssize_t len;
+
+    if (!o)
+    {
+        return 0;
+    }
+#if PY_MAJOR_VERSION >= 3
+    if (!PyUnicode_Check(o))
+    {
+        PyErr_Format(PyExc_TypeError, "%s() argument must be str, not %.50s",
+                     fname, Py_TYPE(o)->tp_name);
+        return -1;
+    }
+    value = PyUnicode_AsUTF8AndSize(o, &len);
+    if (!value)
+    {
+        return -1;
+    }
+#else
+    if (PyString_AsStringAndSize(o, (char **) &value, &len) < 0)
+    {
+        return -1;
+    }
+#endif
+    if (strlen(value) != (size_t) len)
+    {
+        PyErr_Format(PyExc_ValueError, "%s() argument contains a null character", fname);
+        return -1;
+    }
+    *out = value;
+    return 0;
+}
+
+/* Parse (string1, string2) into views of the same width. */
+static int parse_pair(const char *fname, PyObject *const *args, Py_ssize_t nargs,
+                      PyObject *kwnames, struct string_view *s1, struct string_view *s2)
+{
+    static const char *const names[] = { "string1", "string2", NULL };
+    PyObject *values[2] = { NULL, NULL };
+
+    s1->buffer = s2->buffer = NULL;
+    if (parse_args(fname, args, nargs, kwnames, names, 2, values) < 0)
+    {
+        return -1;
+    }
+    if (string_pair(values[0], values[1], s1, s2) < 0)
+    {
+        release_pair(s1, s2);
+        return -1;
+    }
+    return 0;
+}
+
+/* Interpreters older than 3.7 have no public METH_FASTCALL, so there each
+ * function is registered through a METH_VARARGS | METH_KEYWORDS shim that
+ * flattens the tuple and dict into the fast call layout.
+ */
+#if PY_VERSION_HEX >= 0x03070000
+#define FASTCALL_WRAPPER(fn)
+#define FASTCALL_METHOD(fn) (PyCFunction) (void (*)(void)) fn, METH_FASTCALL | METH_KEYWORDS
+#else
+typedef PyObject* (*fastcall_fn)(PyObject *, PyObject *const *, Py_ssize_t, PyObject *);
+
+static PyObject* call_fastcall(fastcall_fn fn, PyObject *self, PyObject *args,
+                               PyObject *kwargs)
+{
+    Py_ssize_t nargs = PyTuple_GET_SIZE(args), n_kwargs, pos = 0, i;
+    PyObject **stack, *kwnames = NULL, *key, *value, *result = NULL;
+
+    n_kwargs = kwargs ? PyDict_Size(kwargs) : 0;
+    stack = PyMem_Malloc((nargs + n_kwargs + 1) * sizeof(PyObject *));
+    if (!stack)
+    {
+        return PyErr_NoMemory();
+    }
+    for (i = 0; i < nargs; i++)
+    {
+        stack[i] = PyTuple_GET_ITEM(args, i);
+    }
+    if (n_kwargs)
+    {
+        kwnames = PyTuple_New(n_kwargs);
+        if (!kwnames)
+        {
+            goto done;
+        }
+        for (i = 0; PyDict_Next(kwargs, &pos, &key, &value); i++)
+        {
+            Py_INCREF(key);
+            PyTuple_SET_ITEM(kwnames, i, key);
+            stack[nargs + i] = value;
+        }
+    }
+
+    result = fn(self, stack, nargs, kwnames);
+
+done:
+    Py_XDECREF(kwnames);
+    PyMem_Free(stack);
+    return result;
+}
+
+#define FASTCALL_WRAPPER(fn) \
+    static PyObject* fn##_varargs(PyObject *self, PyObject *args, PyObject *kwargs) \
+    { \
+        return call_fastcall(fn, self, args, kwargs); \
+    }
+#define FASTCALL_METHOD(fn) (PyCFunction) (void (*)(void)) fn##_varargs, \
+    METH_VARARGS | METH_KEYWORDS
+#endif
+
+/* Shared body of the score functions taking (string1, string2,
+ * score_cutoff=0.0).
+ */
+typedef double (*similarity_fn)(const void *, size_t, const void *, size_t, int, double);
+
+static PyObject* similarity(const char *fname, PyObject *const *args, Py_ssize_t nargs,
+                            PyObject *kwnames, similarity_fn fn)
+{
+    static const char *const names[] = { "string1", "string2", "score_cutoff", NULL };
+    PyObject *values[3] = { NULL, NULL, NULL };
+    struct string_view s1, s2;
+    double score_cutoff = 0, result;
+
+    if (parse_args(fname, args, nargs, kwnames, names, 2, values) < 0 ||
+        arg_double(values[2], &score_cutoff) < 0)
+    {
+        return NULL;
+    }
+
+    if (string_pair(values[0], values[1], &s1, &s2) < 0)
     {
+        release_pair(&s1, &s2);
         return NULL;
     }
 
-    result = jaro_winkler(s1, s2, false);
+    result = fn(s1.data, s1.len, s2.data, s2.len, s1.kind, score_cutoff);
+    release_pair(&s1, &s2);
     if (isnan(result))
     {
         PyErr_NoMemory();
@@ -83,17 +561,42 @@ static PyObject * jellyfish_jaro_winkler(PyObject *self, PyObject *args)
     return Py_BuildValue("d", result);
 }
 
-static PyObject* jellyfish_jaro_distance(PyObject *self, PyObject *args)
+static double jaro_similarity(const void *s1, size_t len1, const void *s2, size_t len2,
+                              int kind, double score_cutoff)
 {
-    const char *s1, *s2;
-    double result;
+    return jaro_winkler_cutoff_kind(s1, len1, s2, len2, kind, false, false, score_cutoff);
+}
+
+/* long_tolerance extends the Winkler boost to long strings sharing more
+ * than the prefix, as in the pure Python jaro_winkler.  It keeps its place
+ * as the third argument, ahead of score_cutoff.
+ */
+static PyObject* jellyfish_jaro_winkler(PyObject *self, PyObject *const *args, Py_ssize_t nargs,
+                                        PyObject *kwnames)
+{
+    static const char *const names[] = { "string1", "string2", "long_tolerance",
+                                         "score_cutoff", NULL };
+    PyObject *values[4] = { NULL, NULL, NULL, NULL };
+    struct string_view s1, s2;
+    double score_cutoff = 0, result;
+    bool long_tolerance = false;
+
+    if (parse_args("jaro_winkler", args, nargs, kwnames, names, 2, values) < 0 ||
+        arg_bool(values[2], &long_tolerance) < 0 ||
+        arg_double(values[3], &score_cutoff) < 0)
+    {
+        return NULL;
+    }
 
-    if (!PyArg_ParseTuple(args, "ss", &s1, &s2))
+    if (string_pair(values[0], values[1], &s1, &s2) < 0)
     {
+        release_pair(&s1, &s2);
         return NULL;
     }
 
-    result = jaro_distance(s1, s2);
+    result = jaro_winkler_cutoff_kind(s1.data, s1.len, s2.data, s2.len, s1.kind,
+                                      long_tolerance, true, score_cutoff);
+    release_pair(&s1, &s2);
     if (isnan(result))
     {
         PyErr_NoMemory();
@@ -103,17 +606,25 @@ static PyObject* jellyfish_jaro_distance(PyObject *self, PyObject *args)
     return Py_BuildValue("d", result);
 }
 
-static PyObject* jellyfish_jaro_average(PyObject* self, PyObject* args)
+static PyObject* jellyfish_jaro_distance(PyObject *self, PyObject *const *args, Py_ssize_t nargs,
+                                         PyObject *kwnames)
+{
+    return similarity("jaro_distance", args, nargs, kwnames, jaro_similarity);
+}
+
+static PyObject* jellyfish_jaro_average(PyObject* self, PyObject *const *args, Py_ssize_t nargs,
+                                        PyObject *kwnames)
 {
-    const char* s1;
-    const char* s2;
+    struct string_view s1, s2;
 
-    if (!PyArg_ParseTuple(args, "ss", &s1, &s2))
+    if (parse_pair("jaro_average", args, nargs, kwnames, &s1, &s2) < 0)
     {
         return NULL;
     }
 
-    float result = jaro_average(s1, s2);
+    float result = 0.5f * (jaro_winkler_kind(s1.data, s1.len, s2.data, s2.len, s1.kind, false, true) +
+                           jaro_winkler_kind(s1.data, s1.len, s2.data, s2.len, s1.kind, false, false));
+    release_pair(&s1, &s2);
     if (isnanf(result))
     {
         PyErr_NoMemory();
@@ -122,32 +633,36 @@ static PyObject* jellyfish_jaro_average(PyObject* self, PyObject* args)
     return Py_BuildValue("f", result);
 }
 
-static PyObject * jellyfish_hamming_distance(PyObject *self, PyObject *args)
+static PyObject* jellyfish_hamming_distance(PyObject *self, PyObject *const *args,
+                                            Py_ssize_t nargs, PyObject *kwnames)
 {
-    const char *s1, *s2;
+    struct string_view s1, s2;
     unsigned result;
 
-    if (!PyArg_ParseTuple(args, "ss", &s1, &s2))
+    if (parse_pair("hamming_distance", args, nargs, kwnames, &s1, &s2) < 0)
     {
         return NULL;
     }
 
-    result = hamming_distance(s1, s2);
+    result = hamming_distance_kind(s1.data, s1.len, s2.data, s2.len, s1.kind);
+    release_pair(&s1, &s2);
 
     return Py_BuildValue("I", result);
 }
 
-static PyObject* jellyfish_levenshtein_distance(PyObject *self, PyObject *args)
+static PyObject* jellyfish_levenshtein_distance(PyObject *self, PyObject *const *args,
+                                                Py_ssize_t nargs, PyObject *kwnames)
 {
-    const char *s1, *s2;
+    struct string_view s1, s2;
     int result;
 
-    if (!PyArg_ParseTuple(args, "ss", &s1, &s2))
+    if (parse_pair("levenshtein_distance", args, nargs, kwnames, &s1, &s2) < 0)
     {
         return NULL;
     }
 
-    result = levenshtein_distance(s1, s2);
+    result = levenshtein_distance_kind(s1.data, s1.len, s2.data, s2.len, s1.kind);
+    release_pair(&s1, &s2);
     if (result == -1)
     {
         // levenshtein_distance only returns failure code (-1) on
@@ -159,34 +674,1874 @@ static PyObject* jellyfish_levenshtein_distance(PyObject *self, PyObject *args)
     return Py_BuildValue("i", result);
 }
 
-static PyObject* jellyfish_damerau_levenshtein_distance(PyObject *self, PyObject *args)
+static PyObject* jellyfish_damerau_levenshtein_distance(PyObject *self, PyObject *const *args,
+                                                        Py_ssize_t nargs, PyObject *kwnames)
 {
-    const char *s1, *s2;
+    struct string_view s1, s2;
     int result;
 
-    if (!PyArg_ParseTuple(args, "ss", &s1, &s2))
+    if (parse_pair("damerau_levenshtein_distance", args, nargs, kwnames, &s1, &s2) < 0)
     {
         return NULL;
     }
 
-    result = damerau_levenshtein_distance(s1, s2);
+    result = damerau_levenshtein_distance_kind(s1.data, s1.len, s2.data, s2.len, s1.kind);
+    release_pair(&s1, &s2);
     if (result == -1)
     {
         PyErr_NoMemory();
         return NULL;
     }
 
-    return Py_BuildValue("i", result);
-}
+    return Py_BuildValue("i", result);
+}
+
+static const char *edit_names[] = { "equal", "replace", "insert", "delete" };
+
+static int editops_pair(const char *fname, PyObject *const *args, Py_ssize_t nargs,
+                        PyObject *kwnames,
+                        struct string_view *s1, struct string_view *s2,
+                        struct edit_op **ops, size_t *n_ops)
+{
+    if (parse_pair(fname, args, nargs, kwnames, s1, s2) < 0)
+    {
+        return -1;
+    }
+
+    if (levenshtein_editops_kind(s1->data, s1->len, s2->data, s2->len, s1->kind,
+                                 ops, n_ops) < 0)
+    {
+        release_pair(s1, s2);
+        PyErr_NoMemory();
+        return -1;
+    }
+    release_pair(s1, s2);
+    return 0;
+}
+
+static PyObject* jellyfish_levenshtein_similarity(PyObject *self, PyObject *const *args,
+                                                  Py_ssize_t nargs, PyObject *kwnames)
+{
+    return similarity("levenshtein_similarity", args, nargs, kwnames, levenshtein_similarity_kind);
+}
+
+static PyObject* jellyfish_damerau_levenshtein_similarity(PyObject *self, PyObject *const *args,
+                                                          Py_ssize_t nargs, PyObject *kwnames)
+{
+    return similarity("damerau_levenshtein_similarity", args, nargs, kwnames,
+                      damerau_levenshtein_similarity_kind);
+}
+
+typedef long (*lcs_fn)(const void *, size_t, const void *, size_t, int);
+
+static PyObject* lcs_count(const char *fname, PyObject *const *args, Py_ssize_t nargs,
+                           PyObject *kwnames, lcs_fn fn)
+{
+    struct string_view s1, s2;
+    long result;
+
+    if (parse_pair(fname, args, nargs, kwnames, &s1, &s2) < 0)
+    {
+        return NULL;
+    }
+
+    result = fn(s1.data, s1.len, s2.data, s2.len, s1.kind);
+    release_pair(&s1, &s2);
+    if (result < 0)
+    {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    return Py_BuildValue("l", result);
+}
+
+static PyObject* jellyfish_lcs_length(PyObject *self, PyObject *const *args, Py_ssize_t nargs,
+                                      PyObject *kwnames)
+{
+    return lcs_count("lcs_length", args, nargs, kwnames, lcs_length_kind);
+}
+
+static PyObject* jellyfish_indel_distance(PyObject *self, PyObject *const *args, Py_ssize_t nargs,
+                                          PyObject *kwnames)
+{
+    return lcs_count("indel_distance", args, nargs, kwnames, indel_distance_kind);
+}
+
+static PyObject* jellyfish_lcs_similarity(PyObject *self, PyObject *const *args, Py_ssize_t nargs,
+                                          PyObject *kwnames)
+{
+    return similarity("lcs_similarity", args, nargs, kwnames, lcs_similarity_kind);
+}
+
+/* The query's bit masks are built once and scanned against every choice. */
+static PyObject* jellyfish_lcs_similarity_many(PyObject *self, PyObject *const *args,
+                                               Py_ssize_t nargs, PyObject *kwnames)
+{
+    static const char *const names[] = { "query", "choices", "score_cutoff", NULL };
+    PyObject *values[3] = { NULL, NULL, NULL };
+    PyObject *query, *choices, *seq, *result = NULL, *value;
+    struct string_view q, c;
+    struct lcs_pattern *pattern;
+    double score_cutoff = 0, score;
+    Py_ssize_t i, n;
+
+    if (parse_args("lcs_similarity_many", args, nargs, kwnames, names, 2, values) < 0 ||
+        arg_double(values[2], &score_cutoff) < 0)
+    {
+        return NULL;
+    }
+    query = values[0];
+    choices = values[1];
+
+    if (get_string_view(query, &q) < 0)
+    {
+        return NULL;
+    }
+
+    seq = PySequence_Fast(choices, "choices must be iterable");
+    if (!seq)
+    {
+        return NULL;
+    }
+
+    pattern = create_lcs_pattern(q.data, q.len, q.kind);
+    if (!pattern)
+    {
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+
+    /* The items are borrowed, so a list stays locked while they are read. */
+    Py_BEGIN_CRITICAL_SECTION(seq);
+    n = PySequence_Fast_GET_SIZE(seq);
+    result = PyList_New(n);
+    for (i = 0; result && i < n; i++)
+    {
+        PyObject *choice = PySequence_Fast_GET_ITEM(seq, i);
+
+        if (get_string_view(choice, &c) < 0)
+        {
+            Py_CLEAR(result);
+            break;
+        }
+        if (PyUnicode_Check(choice) != PyUnicode_Check(query))
+        {
+            PyErr_SetString(PyExc_TypeError, "cannot compare str with bytes");
+            Py_CLEAR(result);
+            break;
+        }
+
+        score = lcs_pattern_similarity(pattern, c.data, c.len, c.kind, score_cutoff);
+        if (isnan(score))
+        {
+            PyErr_NoMemory();
+            Py_CLEAR(result);
+            break;
+        }
+
+        value = PyFloat_FromDouble(score);
+        if (!value)
+        {
+            Py_CLEAR(result);
+            break;
+        }
+        PyList_SET_ITEM(result, i, value);
+    }
+    Py_END_CRITICAL_SECTION();
+
+    free_lcs_pattern(pattern);
+    Py_DECREF(seq);
+
+    return result;
+}
+
+/* Look up a metric name, raising ValueError for unknown ones. */
+static int parse_metric(const char *name, enum jellyfish_metric *metric)
+{
+    int found = jellyfish_metric_from_name(name);
+
+    if (found < 0)
+    {
+        PyErr_Format(PyExc_ValueError, "unknown metric '%.200s'", name);
+        return -1;
+    }
+    *metric = found;
+    return 0;
+}
+
+typedef double (*token_fn)(enum jellyfish_metric, const void *, size_t, const void *, size_t,
+                           int, double);
+
+static PyObject* token_similarity(const char *fname, PyObject *const *args, Py_ssize_t nargs,
+                                  PyObject *kwnames, token_fn fn)
+{
+    static const char *const names[] = { "string1", "string2", "metric", "score_cutoff", NULL };
+    PyObject *values[4] = { NULL, NULL, NULL, NULL };
+    struct string_view s1, s2;
+    const char *metric_name = "levenshtein";
+    enum jellyfish_metric metric;
+    double score_cutoff = 0, result;
+
+    if (parse_args(fname, args, nargs, kwnames, names, 2, values) < 0 ||
+        arg_string(fname, values[2], &metric_name) < 0 ||
+        arg_double(values[3], &score_cutoff) < 0)
+    {
+        return NULL;
+    }
+    if (parse_metric(metric_name, &metric) < 0)
+    {
+        return NULL;
+    }
+
+    if (string_pair(values[0], values[1], &s1, &s2) < 0)
+    {
+        release_pair(&s1, &s2);
+        return NULL;
+    }
+
+    result = fn(metric, s1.data, s1.len, s2.data, s2.len, s1.kind, score_cutoff);
+    release_pair(&s1, &s2);
+    if (isnan(result))
+    {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    return Py_BuildValue("d", result);
+}
+
+static PyObject* jellyfish_token_sort_similarity(PyObject *self, PyObject *const *args,
+                                                 Py_ssize_t nargs, PyObject *kwnames)
+{
+    return token_similarity("token_sort_similarity", args, nargs, kwnames,
+                            token_sort_similarity_kind);
+}
+
+static PyObject* jellyfish_token_set_similarity(PyObject *self, PyObject *const *args,
+                                                Py_ssize_t nargs, PyObject *kwnames)
+{
+    return token_similarity("token_set_similarity", args, nargs, kwnames,
+                            token_set_similarity_kind);
+}
+
+static PyObject* jellyfish_monge_elkan_similarity(PyObject *self, PyObject *const *args,
+                                                  Py_ssize_t nargs, PyObject *kwnames)
+{
+    static const char fname[] = "monge_elkan_similarity";
+    static const char *const names[] = { "string1", "string2", "metric", "symmetric",
+                                         "score_cutoff", NULL };
+    PyObject *values[5] = { NULL, NULL, NULL, NULL, NULL };
+    struct string_view s1, s2;
+    const char *metric_name = "jaro_winkler";
+    enum jellyfish_metric metric;
+    double score_cutoff = 0, result;
+    bool is_symmetric = false;
+
+    if (parse_args(fname, args, nargs, kwnames, names, 2, values) < 0 ||
+        arg_string(fname, values[2], &metric_name) < 0 ||
+        arg_bool(values[3], &is_symmetric) < 0 ||
+        arg_double(values[4], &score_cutoff) < 0)
+    {
+        return NULL;
+    }
+    if (parse_metric(metric_name, &metric) < 0)
+    {
+        return NULL;
+    }
+
+    if (string_pair(values[0], values[1], &s1, &s2) < 0)
+    {
+        release_pair(&s1, &s2);
+        return NULL;
+    }
+
+    result = monge_elkan_similarity_kind(metric, s1.data, s1.len, s2.data, s2.len, s1.kind,
+                                         is_symmetric, score_cutoff);
+    release_pair(&s1, &s2);
+    if (isnan(result))
+    {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    return Py_BuildValue("d", result);
+}
+
+static PyObject* jellyfish_levenshtein_editops(PyObject *self, PyObject *const *args,
+                                               Py_ssize_t nargs, PyObject *kwnames)
+{
+    static const char fname[] = "levenshtein_editops";
+    struct string_view s1, s2;
+    struct edit_op *ops;
+    size_t n_ops, k;
+    PyObject *result, *item;
+
+    if (editops_pair(fname, args, nargs, kwnames, &s1, &s2, &ops, &n_ops) < 0)
+    {
+        return NULL;
+    }
+
+    result = PyList_New(n_ops);
+    for (k = 0; result && k < n_ops; k++)
+    {
+        item = Py_BuildValue("(snn)", edit_names[ops[k].type],
+                             (Py_ssize_t) ops[k].i, (Py_ssize_t) ops[k].j);
+        if (!item)
+        {
+            Py_CLEAR(result);
+            break;
+        }
+        PyList_SET_ITEM(result, k, item);
+    }
+    free(ops);
+
+    return result;
+}
+
+static PyObject* jellyfish_levenshtein_opcodes(PyObject *self, PyObject *const *args,
+                                               Py_ssize_t nargs, PyObject *kwnames)
+{
+    static const char fname[] = "levenshtein_opcodes";
+    struct string_view s1, s2;
+    struct edit_op *ops;
+    struct edit_span *spans;
+    size_t n_ops, n_spans, k;
+    PyObject *result, *item;
+
+    if (editops_pair(fname, args, nargs, kwnames, &s1, &s2, &ops, &n_ops) < 0)
+    {
+        return NULL;
+    }
+
+    if (editops_to_spans(ops, n_ops, s1.len, s2.len, &spans, &n_spans) < 0)
+    {
+        free(ops);
+        return PyErr_NoMemory();
+    }
+    free(ops);
+
+    result = PyList_New(n_spans);
+    for (k = 0; result && k < n_spans; k++)
+    {
+        item = Py_BuildValue("(snnnn)", edit_names[spans[k].type],
+                             (Py_ssize_t) spans[k].i1, (Py_ssize_t) spans[k].i2,
+                             (Py_ssize_t) spans[k].j1, (Py_ssize_t) spans[k].j2);
+        if (!item)
+        {
+            Py_CLEAR(result);
+            break;
+        }
+        PyList_SET_ITEM(result, k, item);
+    }
+    free(spans);
+
+    return result;
+}
+
+/* CostTable: the Python wrapper for struct cost_table, built once and passed
+ * to the weighted distance functions.
+ */
+typedef struct
+{
+    PyObject_HEAD
+    struct cost_table *costs;
+} CostTableObject;
+
+/* Read a one character str or bytes into *c, which must fit the table. */
+static int table_char(PyObject *obj, unsigned *c)
+{
+    struct string_view view;
+
+    if (get_string_view(obj, &view) < 0)
+    {
+        return -1;
+    }
+    if (view.len != 1)
+    {
+        PyErr_SetString(PyExc_ValueError, "expected a single character");
+        return -1;
+    }
+
+    *c = view.kind == JELLYFISH_UCS1 ? ((const uint8_t *) view.data)[0] :
+         view.kind == JELLYFISH_UCS2 ? ((const uint16_t *) view.data)[0] :
+         ((const uint32_t *) view.data)[0];
+    if (*c >= 256)
+    {
+        PyErr_Format(PyExc_ValueError,
+                     "cost tables cover code points below 256, got U+%04X", *c);
+        return -1;
+    }
+    return 0;
+}
+
+static int check_cost(double cost)
+{
+    if (!(cost >= 0))
+    {
+        PyErr_SetString(PyExc_ValueError, "costs must be non-negative numbers");
+        return -1;
+    }
+    return 0;
+}
+
+static int set_substitute(CostTableObject *self, PyObject *o1, PyObject *o2,
+                          double cost, int symmetric)
+{
+    unsigned a, b;
+
+    if (table_char(o1, &a) < 0 || table_char(o2, &b) < 0 || check_cost(cost) < 0)
+    {
+        return -1;
+    }
+
+    self->costs->substitute[a][b] = cost;
+    if (symmetric)
+    {
+        self->costs->substitute[b][a] = cost;
+    }
+    return 0;
+}
+
+static PyObject* CostTable_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = { "insert", "delete", "substitute", "transpose",
+                              "substitutions", NULL };
+    double insert = 1, delete = 1, substitute = 1, transpose = 1;
+    PyObject *substitutions = NULL, *items = NULL, *key, *value;
+    CostTableObject *self;
+    Py_ssize_t i;
+    double cost;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|ddddO!", kwlist,
+                                     &insert, &delete, &substitute, &transpose,
+                                     &PyDict_Type, &substitutions))
+    {
+        return NULL;
+    }
+    if (check_cost(insert) < 0 || check_cost(delete) < 0 ||
+        check_cost(substitute) < 0 || check_cost(transpose) < 0)
+    {
+        return NULL;
+    }
+
+    self = (CostTableObject *) type->tp_alloc(type, 0);
+    if (!self)
+    {
+        return NULL;
+    }
+
+    self->costs = create_cost_table(insert, delete, substitute, transpose);
+    if (!self->costs)
+    {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+
+    /* A snapshot of the items, as another thread may change the dict. */
+    if (substitutions)
+    {
+        items = PyDict_Items(substitutions);
+        if (!items)
+        {
+            Py_DECREF(self);
+            return NULL;
+        }
+    }
+    for (i = 0; items && i < PyList_GET_SIZE(items); i++)
+    {
+        key = PyTuple_GET_ITEM(PyList_GET_ITEM(items, i), 0);
+        value = PyTuple_GET_ITEM(PyList_GET_ITEM(items, i), 1);
+        if (!PyTuple_Check(key) || PyTuple_GET_SIZE(key) != 2)
+        {
+            PyErr_SetString(PyExc_TypeError, "substitutions keys must be (char, char) tuples");
+            Py_CLEAR(self);
+            break;
+        }
+        cost = PyFloat_AsDouble(value);
+        if ((cost == -1 && PyErr_Occurred()) ||
+            set_substitute(self, PyTuple_GET_ITEM(key, 0), PyTuple_GET_ITEM(key, 1),
+                           cost, 1) < 0)
+        {
+            Py_CLEAR(self);
+            break;
+        }
+    }
+    Py_XDECREF(items);
+
+    return (PyObject *) self;
+}
+
+static void CostTable_dealloc(CostTableObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    free_cost_table(self->costs);
+    type->tp_free((PyObject *) self);
+    RELEASE_HEAP_TYPE(type);
+}
+
+static PyObject* CostTable_set_substitute(CostTableObject *self, PyObject *args,
+                                          PyObject *kwargs)
+{
+    static char *kwlist[] = { "a", "b", "cost", "symmetric", NULL };
+    PyObject *o1, *o2;
+    double cost;
+    int symmetric = 1, status;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOd|i", kwlist,
+                                     &o1, &o2, &cost, &symmetric))
+    {
+        return NULL;
+    }
+    Py_BEGIN_CRITICAL_SECTION(self);
+    status = set_substitute(self, o1, o2, cost, symmetric);
+    Py_END_CRITICAL_SECTION();
+    if (status < 0)
+    {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* CostTable_set_insert(CostTableObject *self, PyObject *args)
+{
+    PyObject *o;
+    unsigned c;
+    double cost;
+
+    if (!PyArg_ParseTuple(args, "Od", &o, &cost))
+    {
+        return NULL;
+    }
+    if (table_char(o, &c) < 0 || check_cost(cost) < 0)
+    {
+        return NULL;
+    }
+    Py_BEGIN_CRITICAL_SECTION(self);
+    self->costs->insert[c] = cost;
+    Py_END_CRITICAL_SECTION();
+    Py_RETURN_NONE;
+}
+
+static PyObject* CostTable_set_delete(CostTableObject *self, PyObject *args)
+{
+    PyObject *o;
+    unsigned c;
+    double cost;
+
+    if (!PyArg_ParseTuple(args, "Od", &o, &cost))
+    {
+        return NULL;
+    }
+    if (table_char(o, &c) < 0 || check_cost(cost) < 0)
+    {
+        return NULL;
+    }
+    Py_BEGIN_CRITICAL_SECTION(self);
+    self->costs->delete[c] = cost;
+    Py_END_CRITICAL_SECTION();
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef CostTable_methods[] =
+{
+    {
+        "set_substitute",
+        (PyCFunction) CostTable_set_substitute,
+        METH_VARARGS | METH_KEYWORDS,
+        "set_substitute(a, b, cost, symmetric=True)\n\n"
+        "Set the cost of replacing character a with b (and b with a unless\n"
+        "symmetric is false)."
+    },
+    {
+        "set_insert",
+        (PyCFunction) CostTable_set_insert,
+        METH_VARARGS,
+        "set_insert(c, cost)\n\nSet the cost of inserting character c."
+    },
+    {
+        "set_delete",
+        (PyCFunction) CostTable_set_delete,
+        METH_VARARGS,
+        "set_delete(c, cost)\n\nSet the cost of deleting character c."
+    },
+    { NULL, NULL, 0, NULL }
+};
+
+#define COSTTABLE_DOC \
+    "CostTable(insert=1.0, delete=1.0, substitute=1.0, transpose=1.0, " \
+    "substitutions=None)\n\n" \
+    "Per-operation and per-character edit costs for the weighted distance\n" \
+    "functions. substitutions maps (a, b) character pairs to the cost of\n" \
+    "replacing one with the other, in either direction. Characters at or\n" \
+    "above U+0100 always use the uniform costs."
+
+#if PY_MAJOR_VERSION >= 3
+static PyType_Slot CostTable_slots[] =
+{
+    { Py_tp_dealloc, CostTable_dealloc },
+    { Py_tp_doc, (void *) COSTTABLE_DOC },
+    { Py_tp_methods, CostTable_methods },
+    { Py_tp_new, CostTable_new },
+    { 0, NULL }
+};
+
+static PyType_Spec CostTable_spec =
+{
+    "jellyfish.CostTable",
+    sizeof(CostTableObject),
+    0,
+    TYPE_FLAGS,
+    CostTable_slots
+};
+#else
+static PyTypeObject CostTable_Type =
+{
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "jellyfish.CostTable",
+    .tp_basicsize = sizeof(CostTableObject),
+    .tp_dealloc = (destructor) CostTable_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = COSTTABLE_DOC,
+    .tp_methods = CostTable_methods,
+    .tp_new = CostTable_new,
+};
+#endif
+
+typedef double (*weighted_fn)(const void *, size_t, const void *, size_t, int,
+                              const struct cost_table *);
+
+static PyObject* weighted_distance(PyObject *module, const char *fname,
+                                   PyObject *const *args, Py_ssize_t nargs,
+                                   PyObject *kwnames, weighted_fn fn)
+{
+    static const char *const names[] = { "string1", "string2", "costs", NULL };
+    PyObject *values[3] = { NULL, NULL, NULL };
+    CostTableObject *table;
+    struct string_view s1, s2;
+    double result;
+
+    if (parse_args(fname, args, nargs, kwnames, names, 3, values) < 0)
+    {
+        return NULL;
+    }
+    if (!PyObject_TypeCheck(values[2], (PyTypeObject *) GETSTATE(module)->CostTable_Type))
+    {
+        PyErr_Format(PyExc_TypeError, "%s() argument 'costs' must be jellyfish.CostTable, "
+                     "not %.50s", fname, Py_TYPE(values[2])->tp_name);
+        return NULL;
+    }
+    table = (CostTableObject *) values[2];
+
+    if (string_pair(values[0], values[1], &s1, &s2) < 0)
+    {
+        release_pair(&s1, &s2);
+        return NULL;
+    }
+
+    Py_BEGIN_CRITICAL_SECTION(table);
+    result = fn(s1.data, s1.len, s2.data, s2.len, s1.kind, table->costs);
+    Py_END_CRITICAL_SECTION();
+    release_pair(&s1, &s2);
+    if (result < 0)
+    {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    return Py_BuildValue("d", result);
+}
+
+static PyObject* jellyfish_weighted_levenshtein_distance(PyObject *self, PyObject *const *args,
+                                                         Py_ssize_t nargs, PyObject *kwnames)
+{
+    return weighted_distance(self, "weighted_levenshtein_distance", args, nargs, kwnames,
+                             weighted_levenshtein_distance_kind);
+}
+
+static PyObject* jellyfish_weighted_damerau_levenshtein_distance(PyObject *self,
+                                                                 PyObject *const *args,
+                                                                 Py_ssize_t nargs,
+                                                                 PyObject *kwnames)
+{
+    return weighted_distance(self, "weighted_damerau_levenshtein_distance", args, nargs, kwnames,
+                             weighted_damerau_levenshtein_distance_kind);
+}
+
+/* The Arrow C data interface structures.  They are ABI stable, so Arrow
+ * arrays can be read without Arrow's headers or libraries.
+ */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+struct ArrowSchema
+{
+    const char *format;
+    const char *name;
+    const char *metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema **children;
+    struct ArrowSchema *dictionary;
+    void (*release)(struct ArrowSchema *);
+    void *private_data;
+};
+
+struct ArrowArray
+{
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void **buffers;
+    struct ArrowArray **children;
+    struct ArrowArray *dictionary;
+    void (*release)(struct ArrowArray *);
+    void *private_data;
+};
+
+#endif
+
+/* A string_column over a Python object, along with whatever keeps the
+ * rows alive until release_column(): the Arrow capsules, the exported
+ * buffer or the sequence holding the strings.
+ */
+struct column_source
+{
+    struct string_column column;
+    PyObject *owner;
+    Py_buffer buffer;
+    bool has_buffer;
+    struct string_ref *refs;
+    int text;   /* 1 for str rows, 0 for bytes, -1 while unknown */
+};
+
+static void release_column(struct column_source *source)
+{
+    Py_XDECREF(source->owner);
+    if (source->has_buffer)
+    {
+        PyBuffer_Release(&source->buffer);
+    }
+    PyMem_Free(source->refs);
+}
+
+/* Arrays exporting __arrow_c_array__: string, large_string, binary and
+ * large_binary, including slices and nulls.
+ */
+static int arrow_column(PyObject *obj, struct column_source *source)
+{
+    struct string_column *column = &source->column;
+    struct ArrowSchema *schema;
+    struct ArrowArray *array;
+    PyObject *capsules;
+
+    capsules = PyObject_CallMethod(obj, "__arrow_c_array__", NULL);
+    if (!capsules)
+    {
+        return -1;
+    }
+    source->owner = capsules;
+    if (!PyTuple_Check(capsules) || PyTuple_GET_SIZE(capsules) != 2)
+    {
+        PyErr_SetString(PyExc_TypeError, "__arrow_c_array__ must return a pair of capsules");
+        return -1;
+    }
+
+    schema = PyCapsule_GetPointer(PyTuple_GET_ITEM(capsules, 0), "arrow_schema");
+    array = PyCapsule_GetPointer(PyTuple_GET_ITEM(capsules, 1), "arrow_array");
+    if (!schema || !array)
+    {
+        return -1;
+    }
+
+    if (strcmp(schema->format, "u") == 0 || strcmp(schema->format, "z") == 0)
+    {
+        column->layout = COLUMN_OFFSETS32;
+    }
+    else if (strcmp(schema->format, "U") == 0 || strcmp(schema->format, "Z") == 0)
+    {
+        column->layout = COLUMN_OFFSETS64;
+    }
+    else
+    {
+        PyErr_Format(PyExc_TypeError, "unsupported Arrow type '%.50s', expected a string or "
+                     "binary array", schema->format);
+        return -1;
+    }
+    if (array->n_buffers != 3)
+    {
+        PyErr_SetString(PyExc_TypeError, "malformed Arrow string array");
+        return -1;
+    }
+
+    column->utf8 = tolower(schema->format[0]) == 'u';
+    column->length = array->length;
+    column->offset = array->offset;
+    column->validity = array->null_count ? array->buffers[0] : NULL;
+    column->offsets = array->buffers[1];
+    column->data = array->buffers[2];
+    source->text = column->utf8;
+    return 0;
+}
+
+/* The code unit width of a buffer format for fixed width strings, such as
+ * numpy's "<5w" (U5) or "5s" (S5), or 0 for any other format.
+ */
+static int fixed_width_kind(const char *format)
+{
+    switch (*format)
+    {
+        case '@':
+        case '=':
+            format++;
+            break;
+        case '<':
+        case '>':
+        case '!':
+            if ((*format == '<') != PY_LITTLE_ENDIAN)
+            {
+                return 0;
+            }
+            format++;
+            break;
+    }
+    while (isdigit((unsigned char) *format))
+    {
+        format++;
+    }
+
+    if (strcmp(format, "w") == 0)
+    {
+        return JELLYFISH_UCS4;
+    }
+    if (strcmp(format, "s") == 0)
+    {
+        return JELLYFISH_UCS1;
+    }
+    return 0;
+}
+
+/* One dimensional contiguous buffers of fixed width strings.  Returns 0
+ * without an error set if obj is not one.
+ */
+static int buffer_column(PyObject *obj, struct column_source *source)
+{
+    struct string_column *column = &source->column;
+    Py_buffer *view = &source->buffer;
+    int kind;
+
+    if (!PyObject_CheckBuffer(obj))
+    {
+        return 0;
+    }
+    if (PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0)
+    {
+        PyErr_Clear();
+        return 0;
+    }
+
+    kind = view->format && view->ndim == 1 ? fixed_width_kind(view->format) : 0;
+    if (!kind || view->itemsize % kind)
+    {
+        PyBuffer_Release(view);
+        return 0;
+    }
+    source->has_buffer = true;
+
+    column->layout = COLUMN_FIXED;
+    column->length = view->shape[0];
+    column->data = view->buf;
+    column->kind = kind;
+    column->width = view->itemsize / kind;
+    source->text = kind == JELLYFISH_UCS4;
+    return 1;
+}
+
+/* Any other sequence of str or bytes, with None for missing values.  The
+ * strings are read in place; a list is copied first so the rows outlive
+ * changes made to it while the GIL is released.
+ */
+static int sequence_column(PyObject *obj, struct column_source *source)
+{
+    struct string_column *column = &source->column;
+    struct string_view view;
+    PyObject *seq, *item;
+    Py_ssize_t i, n;
+    int text;
+
+    seq = PyList_Check(obj) ? PySequence_List(obj) :
+          PySequence_Fast(obj, "expected a sequence or array of strings");
+    if (!seq)
+    {
+        return -1;
+    }
+    source->owner = seq;
+
+    n = PySequence_Fast_GET_SIZE(seq);
+    source->refs = PyMem_Malloc(MAX(n, 1) * sizeof(struct string_ref));
+    if (!source->refs)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        if (item == Py_None)
+        {
+            source->refs[i].data = NULL;
+            continue;
+        }
+        if (get_string_view(item, &view) < 0)
+        {
+            return -1;
+        }
+
+        text = PyUnicode_Check(item);
+        if (source->text >= 0 && text != source->text)
+        {
+            PyErr_SetString(PyExc_TypeError, "cannot compare str with bytes");
+            return -1;
+        }
+        source->text = text;
+        source->refs[i].data = view.data;
+        source->refs[i].len = view.len;
+        source->refs[i].kind = view.kind;
+    }
+
+    column->layout = COLUMN_REFS;
+    column->length = n;
+    column->refs = source->refs;
+    return 0;
+}
+
+static int get_column(PyObject *obj, struct column_source *source)
+{
+    int found;
+
+    if (PyUnicode_Check(obj) || PyBytes_Check(obj))
+    {
+        PyErr_SetString(PyExc_TypeError, "expected a sequence or array of strings, not a string");
+        return -1;
+    }
+    if (PyObject_HasAttrString(obj, "__arrow_c_array__"))
+    {
+        return arrow_column(obj, source);
+    }
+    found = buffer_column(obj, source);
+    if (found)
+    {
+        return found < 0 ? -1 : 0;
+    }
+    return sequence_column(obj, source);
+}
+
+/* The buffer results are written to: out when given, which must be a
+ * writable contiguous buffer of n items with one of formats, or a new
+ * array.array of typecode formats[0].  Returns a new reference to the
+ * object result.
+ */
+static PyObject* result_buffer(PyObject *out, const char *formats, Py_ssize_t itemsize,
+                               Py_ssize_t n, Py_buffer *view)
+{
+    PyObject *array_module, *zero, *result;
+    const char typecode[2] = { formats[0], '\0' };
+    const char *format;
+
+    if (out && out != Py_None)
+    {
+        Py_INCREF(out);
+        result = out;
+    }
+    else
+    {
+        array_module = PyImport_ImportModule("array");
+        if (!array_module)
+        {
+            return NULL;
+        }
+        zero = PyObject_CallMethod(array_module, "array", "s(i)", typecode, 0);
+        Py_DECREF(array_module);
+        if (!zero)
+        {
+            return NULL;
+        }
+        result = PySequence_Repeat(zero, n);
+        Py_DECREF(zero);
+        if (!result)
+        {
+            return NULL;
+        }
+    }
+
+    if (PyObject_GetBuffer(result, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | PyBUF_WRITABLE) < 0)
+    {
+        Py_DECREF(result);
+        return NULL;
+    }
+
+    format = view->format ? view->format : "B";
+    if (*format == '@' || *format == '=' || *format == (PY_LITTLE_ENDIAN ? '<' : '>'))
+    {
+        format++;
+    }
+    if (view->itemsize != itemsize || strlen(format) != 1 || !strchr(formats, *format) ||
+        view->len != n * itemsize)
+    {
+        PyErr_Format(PyExc_ValueError, "out must be a writable buffer of %zd '%c' items",
+                     n, formats[0]);
+        PyBuffer_Release(view);
+        Py_DECREF(result);
+        return NULL;
+    }
+    return result;
+}
+
+/* What the column scoring functions compute: row i against row i, every
+ * row of one column against every row of the other, or the condensed
+ * upper triangle of one column against itself.
+ */
+enum score_shape
+{
+    SHAPE_ROWS,
+    SHAPE_MATRIX,
+    SHAPE_CONDENSED
+};
+
+/* A pairwise, cdist or pdist call: prepare_scores checks the arguments
+ * and holds the columns and the result buffer, run_scores does the work
+ * without the GIL, from any thread, and finish_scores releases the inputs
+ * and returns the result.  Results are doubles, or int32 distances when
+ * distances is set.
+ */
+struct score_job
+{
+    enum score_shape shape;
+    bool distances;
+    enum jellyfish_metric metric;
+    double score_cutoff;
+    Py_ssize_t threads;
+    struct column_source c1;
+    struct column_source c2;
+    PyObject *result;
+    Py_buffer view;
+    int status;
+};
+
+/* o2 is NULL for SHAPE_CONDENSED.  On failure nothing is held. */
+static int prepare_scores(struct score_job *job, enum score_shape shape, bool distances,
+                          PyObject *o1, PyObject *o2, const char *metric_name,
+                          double score_cutoff, PyObject *out, Py_ssize_t threads)
+{
+    struct column_source *c1 = &job->c1, *c2 = &job->c2;
+    Py_ssize_t n1, n2, cells;
+
+    memset(job, 0, sizeof(*job));
+    job->shape = shape;
+    job->distances = distances;
+    job->score_cutoff = score_cutoff;
+    job->threads = threads;
+    if (parse_metric(metric_name, &job->metric) < 0)
+    {
+        return -1;
+    }
+    if (distances && !jellyfish_metric_has_distance(job->metric))
+    {
+        PyErr_Format(PyExc_ValueError, "metric '%.200s' has no distance", metric_name);
+        return -1;
+    }
+    if (threads < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "threads must not be negative");
+        return -1;
+    }
+
+    c1->text = c2->text = -1;
+    if (get_column(o1, c1) < 0 || (o2 && get_column(o2, c2) < 0))
+    {
+        goto fail;
+    }
+    if (c1->text >= 0 && c2->text >= 0 && c1->text != c2->text)
+    {
+        PyErr_SetString(PyExc_TypeError, "cannot compare str with bytes");
+        goto fail;
+    }
+
+    n1 = c1->column.length;
+    n2 = c2->column.length;
+    switch (shape)
+    {
+        case SHAPE_ROWS:
+            if (n1 != n2)
+            {
+                PyErr_Format(PyExc_ValueError, "columns differ in length (%zd and %zd)", n1, n2);
+                goto fail;
+            }
+            cells = n1;
+            break;
+        case SHAPE_MATRIX:
+            if (n2 && n1 > PY_SSIZE_T_MAX / n2)
+            {
+                PyErr_NoMemory();
+                goto fail;
+            }
+            cells = n1 * n2;
+            break;
+        default:
+            if (n1 > 1 && n1 - 1 > PY_SSIZE_T_MAX / n1)
+            {
+                PyErr_NoMemory();
+                goto fail;
+            }
+            cells = n1 ? n1 * (n1 - 1) / 2 : 0;
+            break;
+    }
+
+    /* int32 is 'i' for array.array and numpy, and 'l' where long is 32 bits. */
+    job->result = distances ? result_buffer(out, sizeof(long) == 4 ? "il" : "i",
+                                            sizeof(int32_t), cells, &job->view)
+                            : result_buffer(out, "d", sizeof(double), cells, &job->view);
+    if (job->result)
+    {
+        return 0;
+    }
+
+fail:
+    release_column(c1);
+    release_column(c2);
+    return -1;
+}
+
+static void run_scores(struct score_job *job)
+{
+    const struct string_column *a = &job->c1.column, *b = &job->c2.column;
+    void *out = job->view.buf;
+
+    switch (job->shape)
+    {
+        case SHAPE_ROWS:
+            job->status = job->distances
+                              ? pairwise_distance(job->metric, a, b, out, job->threads)
+                              : pairwise_similarity(job->metric, a, b, job->score_cutoff, out,
+                                                    job->threads);
+            break;
+        case SHAPE_MATRIX:
+            job->status = job->distances
+                              ? cdist_distance(job->metric, a, b, out, job->threads)
+                              : cdist_similarity(job->metric, a, b, job->score_cutoff, out,
+                                                 job->threads);
+            break;
+        default:
+            job->status = job->distances
+                              ? pdist_distance(job->metric, a, out, job->threads)
+                              : pdist_similarity(job->metric, a, job->score_cutoff, out,
+                                                 job->threads);
+            break;
+    }
+}
+
+static PyObject* finish_scores(struct score_job *job)
+{
+    PyObject *result = job->result;
+
+    PyBuffer_Release(&job->view);
+    release_column(&job->c1);
+    release_column(&job->c2);
+    if (job->status < 0)
+    {
+        PyErr_NoMemory();
+        Py_CLEAR(result);
+    }
+    return result;
+}
+
+/* Parse the arguments of the pairwise, cdist and pdist functions, in
+ * names order: the column(s), metric, score_cutoff (similarities only),
+ * out and threads.  The columns are values[0] and, unless condensed,
+ * values[1].
+ */
+static int parse_scores(const char *fname, enum score_shape shape, bool distances,
+                        const char *const *names, PyObject *const *args, Py_ssize_t nargs,
+                        PyObject *kwnames, struct score_job *job)
+{
+    PyObject *values[6] = { NULL, NULL, NULL, NULL, NULL, NULL };
+    Py_ssize_t columns = shape == SHAPE_CONDENSED ? 1 : 2, out, threads = 0;
+    const char *metric = "levenshtein";
+    double score_cutoff = 0;
+
+    out = distances ? columns + 1 : columns + 2;
+    if (parse_args(fname, args, nargs, kwnames, names, columns, values) < 0 ||
+        arg_string(fname, values[columns], &metric) < 0 ||
+        (!distances && arg_double(values[columns + 1], &score_cutoff) < 0) ||
+        arg_ssize(values[out + 1], &threads) < 0)
+    {
+        return -1;
+    }
+    return prepare_scores(job, shape, distances, values[0], columns == 2 ? values[1] : NULL,
+                          metric, score_cutoff, values[out], threads);
+}
+
+static PyObject* score_args(const char *fname, enum score_shape shape, bool distances,
+                            const char *const *names, PyObject *const *args,
+                            Py_ssize_t nargs, PyObject *kwnames)
+{
+    struct score_job job;
+
+    if (parse_scores(fname, shape, distances, names, args, nargs, kwnames, &job) < 0)
+    {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    run_scores(&job);
+    Py_END_ALLOW_THREADS
+    return finish_scores(&job);
+}
+
+static const char *const pairwise_similarity_names[] = { "strings1", "strings2", "metric",
+                                                         "score_cutoff", "out", "threads",
+                                                         NULL };
+static const char *const pairwise_distance_names[] = { "strings1", "strings2", "metric", "out",
+                                                       "threads", NULL };
+static const char *const cdist_similarity_names[] = { "queries", "choices", "metric",
+                                                      "score_cutoff", "out", "threads", NULL };
+static const char *const cdist_distance_names[] = { "queries", "choices", "metric", "out",
+                                                    "threads", NULL };
+static const char *const pdist_similarity_names[] = { "strings", "metric", "score_cutoff",
+                                                      "out", "threads", NULL };
+static const char *const pdist_distance_names[] = { "strings", "metric", "out", "threads",
+                                                    NULL };
+
+static PyObject* jellyfish_pairwise_similarity(PyObject *self, PyObject *const *args,
+                                               Py_ssize_t nargs, PyObject *kwnames)
+{
+    return score_args("pairwise_similarity", SHAPE_ROWS, false, pairwise_similarity_names,
+                      args, nargs, kwnames);
+}
+
+static PyObject* jellyfish_pairwise_distance(PyObject *self, PyObject *const *args,
+                                             Py_ssize_t nargs, PyObject *kwnames)
+{
+    return score_args("pairwise_distance", SHAPE_ROWS, true, pairwise_distance_names, args,
+                      nargs, kwnames);
+}
+
+static PyObject* jellyfish_cdist_similarity(PyObject *self, PyObject *const *args,
+                                            Py_ssize_t nargs, PyObject *kwnames)
+{
+    return score_args("cdist_similarity", SHAPE_MATRIX, false, cdist_similarity_names, args,
+                      nargs, kwnames);
+}
+
+static PyObject* jellyfish_cdist_distance(PyObject *self, PyObject *const *args, Py_ssize_t nargs,
+                                          PyObject *kwnames)
+{
+    return score_args("cdist_distance", SHAPE_MATRIX, true, cdist_distance_names, args, nargs,
+                      kwnames);
+}
+
+static PyObject* jellyfish_pdist_similarity(PyObject *self, PyObject *const *args,
+                                            Py_ssize_t nargs, PyObject *kwnames)
+{
+    return score_args("pdist_similarity", SHAPE_CONDENSED, false, pdist_similarity_names, args,
+                      nargs, kwnames);
+}
+
+static PyObject* jellyfish_pdist_distance(PyObject *self, PyObject *const *args, Py_ssize_t nargs,
+                                          PyObject *kwnames)
+{
+    return score_args("pdist_distance", SHAPE_CONDENSED, true, pdist_distance_names, args,
+                      nargs, kwnames);
+}
+
+#if PY_MAJOR_VERSION >= 3
+/* submit(function, *args, **kwargs) runs a pairwise, cdist or pdist call
+ * on a thread of its own and returns a concurrent.futures.Future for its
+ * result.  The arguments are checked, and the columns pinned, before it
+ * returns; the thread then scores without the GIL and takes it only to
+ * complete the future, whose callbacks (asyncio.wrap_future's among them)
+ * run there.  The module counts the calls in flight, and interpreter exit
+ * waits for them, as it does for concurrent.futures' own executors.
+ */
+static const struct
+{
+    const char *name;
+    enum score_shape shape;
+    bool distances;
+    const char *const *names;
+} submittable[] =
+{
+    { "pairwise_similarity", SHAPE_ROWS, false, pairwise_similarity_names },
+    { "pairwise_distance", SHAPE_ROWS, true, pairwise_distance_names },
+    { "cdist_similarity", SHAPE_MATRIX, false, cdist_similarity_names },
+    { "cdist_distance", SHAPE_MATRIX, true, cdist_distance_names },
+    { "pdist_similarity", SHAPE_CONDENSED, false, pdist_similarity_names },
+    { "pdist_distance", SHAPE_CONDENSED, true, pdist_distance_names },
+};
+
+struct submitted
+{
+    struct score_job job;
+    PyObject *module;
+    PyInterpreterState *interp;
+    PyObject *future;
+};
+
+static void run_submitted(void *arg)
+{
+    struct submitted *call = arg;
+    struct jellyfish_state *state;
+    PyObject *module = call->module, *result, *type, *value, *traceback, *done;
+    PyThreadState *tstate;
+
+    run_scores(&call->job);
+
+    tstate = PyThreadState_New(call->interp);
+    PyEval_RestoreThread(tstate);
+
+    result = finish_scores(&call->job);
+    if (result)
+    {
+        done = PyObject_CallMethod(call->future, "set_result", "O", result);
+        Py_DECREF(result);
+    }
+    else
+    {
+        PyErr_Fetch(&type, &value, &traceback);
+        PyErr_NormalizeException(&type, &value, &traceback);
+        done = PyObject_CallMethod(call->future, "set_exception", "O", value);
+        Py_XDECREF(type);
+        Py_XDECREF(value);
+        Py_XDECREF(traceback);
+    }
+    if (done)
+    {
+        Py_DECREF(done);
+    }
+    else
+    {
+        PyErr_WriteUnraisable(call->future);
+    }
+    Py_DECREF(call->future);
+    PyMem_RawFree(call);
+
+    state = GETSTATE(module);
+    pthread_mutex_lock(&state->submitted_lock);
+    if (--state->submitted == 0)
+    {
+        pthread_cond_broadcast(&state->submitted_done);
+    }
+    pthread_mutex_unlock(&state->submitted_lock);
+    Py_DECREF(module);
+
+    PyThreadState_Clear(tstate);
+#if PY_VERSION_HEX >= 0x03090000
+    PyThreadState_DeleteCurrent();
+#else
+    PyEval_ReleaseThread(tstate);
+    PyThreadState_Delete(tstate);
+#endif
+}
+
+static PyObject* jellyfish_submit(PyObject *self, PyObject *const *args, Py_ssize_t nargs,
+                                  PyObject *kwnames)
+{
+    struct jellyfish_state *state = GETSTATE(self);
+    struct submitted *call;
+    PyObject *function, *futures, *started, *future;
+    size_t i;
+
+    if (nargs < 1)
+    {
+        PyErr_SetString(PyExc_TypeError, "submit() missing required argument 'function'");
+        return NULL;
+    }
+    for (i = 0; i < sizeof(submittable) / sizeof(submittable[0]); i++)
+    {
+        function = PyObject_GetAttrString(self, submittable[i].name);
+        Py_XDECREF(function);
+        if (function == args[0])
+        {
+            break;
+        }
+    }
+    if (i == sizeof(submittable) / sizeof(submittable[0]))
+    {
+        PyErr_SetString(PyExc_TypeError,
+                        "submit() takes pairwise_similarity, pairwise_distance, "
+                        "cdist_similarity, cdist_distance, pdist_similarity or pdist_distance");
+        return NULL;
+    }
+
+    call = PyMem_RawCalloc(1, sizeof(struct submitted));
+    if (!call)
+    {
+        return PyErr_NoMemory();
+    }
+    if (parse_scores(submittable[i].name, submittable[i].shape, submittable[i].distances,
+                     submittable[i].names, args + 1, nargs - 1, kwnames, &call->job) < 0)
+    {
+        PyMem_RawFree(call);
+        return NULL;
+    }
+
+    /* A running future can no longer be cancelled, so it is always ours to
+     * complete.
+     */
+    futures = PyImport_ImportModule("concurrent.futures");
+    call->future = futures ? PyObject_CallMethod(futures, "Future", NULL) : NULL;
+    Py_XDECREF(futures);
+    started = call->future ? PyObject_CallMethod(call->future, "set_running_or_notify_cancel",
+                                                 NULL)
+                           : NULL;
+    if (!started)
+    {
+        goto fail;
+    }
+    Py_DECREF(started);
+
+    Py_INCREF(self);
+    call->module = self;
+    call->interp = PyThreadState_Get()->interp;
+    pthread_mutex_lock(&state->submitted_lock);
+    state->submitted++;
+    pthread_mutex_unlock(&state->submitted_lock);
+
+    /* A worker may be done with call before run_pooled returns. */
+    future = call->future;
+    Py_INCREF(future);
+    if (run_pooled(run_submitted, call) < 0)
+    {
+        Py_DECREF(future);
+        pthread_mutex_lock(&state->submitted_lock);
+        state->submitted--;
+        pthread_mutex_unlock(&state->submitted_lock);
+        Py_DECREF(self);
+        PyErr_SetString(PyExc_RuntimeError, "cannot start a thread");
+        goto fail;
+    }
+    return future;
+
+fail:
+    Py_XDECREF(finish_scores(&call->job));
+    Py_XDECREF(call->future);
+    PyMem_RawFree(call);
+    return NULL;
+}
+
+/* Registered with atexit by jellyfish_exec. */
+static PyObject* wait_for_submitted(PyObject *module, PyObject *unused)
+{
+    struct jellyfish_state *state = GETSTATE(module);
+
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&state->submitted_lock);
+    while (state->submitted)
+    {
+        pthread_cond_wait(&state->submitted_done, &state->submitted_lock);
+    }
+    pthread_mutex_unlock(&state->submitted_lock);
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef wait_for_submitted_def =
+{
+    "wait_for_submitted", wait_for_submitted, METH_NOARGS, NULL
+};
+#endif
+static PyObject* jellyfish_dedupe(PyObject *self, PyObject *const *args, Py_ssize_t nargs,
+                                  PyObject *kwnames)
+{
+    static const char fname[] = "dedupe";
+    static const char *const names[] = { "strings", "metric", "threshold", "max_distance",
+                                         "blocking", "threads", "out", NULL };
+    PyObject *values[7] = { NULL, NULL, NULL, Py_None, NULL, NULL, NULL };
+    PyObject *strings, *max_distance, *out, *result = NULL;
+    const char *metric_name = "jaro_winkler", *blocking_name = "length";
+    struct dedupe_options options;
+    struct column_source column;
+    Py_ssize_t threads = 0;
+    Py_buffer view;
+    int blocking, status;
+
+    memset(&options, 0, sizeof(options));
+    options.threshold = 0.9;
+    if (parse_args(fname, args, nargs, kwnames, names, 1, values) < 0 ||
+        arg_string(fname, values[1], &metric_name) < 0 ||
+        arg_double(values[2], &options.threshold) < 0 ||
+        arg_string(fname, values[4], &blocking_name) < 0 ||
+        arg_ssize(values[5], &threads) < 0)
+    {
+        return NULL;
+    }
+    strings = values[0];
+    max_distance = values[3];
+    out = values[6];
+
+    if (strcmp(metric_name, "match_rating") == 0)
+    {
+        options.scorer = SCORE_MATCH_RATING;
+    }
+    else if (parse_metric(metric_name, &options.metric) < 0)
+    {
+        return NULL;
+    }
+    if (max_distance != Py_None)
+    {
+        if (options.scorer == SCORE_MATCH_RATING ||
+            !jellyfish_metric_has_distance(options.metric))
+        {
+            PyErr_Format(PyExc_ValueError, "metric '%.200s' has no distance", metric_name);
+            return NULL;
+        }
+        options.scorer = SCORE_DISTANCE;
+        options.max_distance = PyLong_AsLong(max_distance);
+        if (options.max_distance == -1 && PyErr_Occurred())
+        {
+            return NULL;
+        }
+        if (options.max_distance < 0)
+        {
+            PyErr_SetString(PyExc_ValueError, "max_distance must not be negative");
+            return NULL;
+        }
+    }
+
+    blocking = dedupe_blocking_from_name(blocking_name);
+    if (blocking < 0)
+    {
+        PyErr_Format(PyExc_ValueError, "unknown blocking '%.200s'", blocking_name);
+        return NULL;
+    }
+    options.blocking = blocking;
+    if (threads < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "threads must not be negative");
+        return NULL;
+    }
+    options.threads = threads;
+
+    memset(&column, 0, sizeof(column));
+    column.text = -1;
+    if (get_column(strings, &column) < 0)
+    {
+        goto done;
+    }
+    /* Only str is folded, as only str is NFKD normalized by soundex() etc. */
+    options.fold = column.text != 0;
+
+    result = result_buffer(out, sizeof(long) == 4 ? "il" : "i", sizeof(int32_t),
+                           column.column.length, &view);
+    if (!result)
+    {
+        goto done;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    status = dedupe(&column.column, &options, view.buf);
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&view);
+    if (status < 0)
+    {
+        PyErr_NoMemory();
+        Py_CLEAR(result);
+    }
+
+done:
+    release_column(&column);
+    return result;
+}
+
+/* Query: the Python wrapper for struct query, a string prepared once for
+ * scoring against many candidates.
+ */
+typedef struct
+{
+    PyObject_HEAD
+    struct query *query;
+    PyObject *string;
+    PyObject *metric;
+    int text;
+} QueryObject;
+
+static const struct
+{
+    const char *name;
+    enum query_scorer scorer;
+} query_scorers[] = {
+    { "soundex", QUERY_SOUNDEX },
+    { "metaphone", QUERY_METAPHONE },
+    { "nysiis", QUERY_NYSIIS },
+    { "match_rating", QUERY_MATCH_RATING },
+};
+
+static PyObject* Query_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = { "string", "metric", "score_cutoff", NULL };
+    PyObject *string, *metric = NULL;
+    const char *metric_name = "levenshtein";
+    enum query_scorer scorer = QUERY_METRIC;
+    enum jellyfish_metric parsed = METRIC_LEVENSHTEIN;
+    double score_cutoff = 0;
+    struct string_view view;
+    struct string_ref text;
+    QueryObject *self;
+    size_t i;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Od", kwlist,
+                                     &string, &metric, &score_cutoff))
+    {
+        return NULL;
+    }
+    if (arg_string("Query", metric, &metric_name) < 0)
+    {
+        return NULL;
+    }
+    for (i = 0; i < sizeof(query_scorers) / sizeof(query_scorers[0]); i++)
+    {
+        if (strcmp(metric_name, query_scorers[i].name) == 0)
+        {
+            scorer = query_scorers[i].scorer;
+        }
+    }
+    if (scorer == QUERY_METRIC && parse_metric(metric_name, &parsed) < 0)
+    {
+        return NULL;
+    }
+
+    view.buffer = NULL;
+    if (get_string_view(string, &view) < 0)
+    {
+        PyMem_Free(view.buffer);
+        return NULL;
+    }
+
+    self = (QueryObject *) type->tp_alloc(type, 0);
+    if (!self)
+    {
+        PyMem_Free(view.buffer);
+        return NULL;
+    }
+    Py_INCREF(string);
+    self->string = string;
+    self->metric = metric ? metric : PyUnicode_FromString(metric_name);
+    Py_XINCREF(metric);
+    self->text = PyUnicode_Check(string);
+
+    /* Only str is folded, as only str is NFKD normalized by soundex() etc. */
+    text.data = view.data;
+    text.len = view.len;
+    text.kind = view.kind;
+    self->query = create_query(&text, scorer, parsed, self->text, score_cutoff);
+    PyMem_Free(view.buffer);
+    if (!self->metric || !self->query)
+    {
+        if (self->metric)
+        {
+            PyErr_NoMemory();
+        }
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    return (PyObject *) self;
+}
+
+static void Query_dealloc(QueryObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    free_query(self->query);
+    Py_XDECREF(self->string);
+    Py_XDECREF(self->metric);
+    type->tp_free((PyObject *) self);
+    RELEASE_HEAP_TYPE(type);
+}
+
+static PyObject* Query_score(QueryObject *self, PyObject *const *args, Py_ssize_t nargs,
+                             PyObject *kwnames)
+{
+    static const char *const names[] = { "candidate", NULL };
+    PyObject *candidate = NULL;
+    struct string_view view;
+    struct string_ref row;
+    struct row_buffer scratch = { NULL, 0 };
+    double result;
+
+    if (parse_args("score", args, nargs, kwnames, names, 1, &candidate) < 0)
+    {
+        return NULL;
+    }
+    view.buffer = NULL;
+    if (get_string_view(candidate, &view) < 0)
+    {
+        PyMem_Free(view.buffer);
+        return NULL;
+    }
+    if (PyUnicode_Check(candidate) != self->text)
+    {
+        PyMem_Free(view.buffer);
+        PyErr_SetString(PyExc_TypeError, "cannot compare str with bytes");
+        return NULL;
+    }
+
+    row.data = view.data;
+    row.len = view.len;
+    row.kind = view.kind;
+    result = query_score(self->query, &row, &scratch);
+    free(scratch.data);
+    PyMem_Free(view.buffer);
+    if (isnan(result))
+    {
+        return PyErr_NoMemory();
+    }
+
+    return Py_BuildValue("d", result);
+}
+
+static PyObject* Query_score_many(QueryObject *self, PyObject *const *args, Py_ssize_t nargs,
+                                  PyObject *kwnames)
+{
+    static const char *const names[] = { "candidates", "out", "threads", NULL };
+    PyObject *values[3] = { NULL, NULL, NULL };
+    PyObject *result = NULL;
+    struct column_source column;
+    Py_ssize_t threads = 0;
+    Py_buffer view;
+    int status;
+
+    if (parse_args("score_many", args, nargs, kwnames, names, 1, values) < 0 ||
+        arg_ssize(values[2], &threads) < 0)
+    {
+        return NULL;
+    }
+    if (threads < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "threads must not be negative");
+        return NULL;
+    }
+
+    memset(&column, 0, sizeof(column));
+    column.text = self->text;
+    if (get_column(values[0], &column) < 0)
+    {
+        goto done;
+    }
+    if (column.text != self->text && column.column.length)
+    {
+        PyErr_SetString(PyExc_TypeError, "cannot compare str with bytes");
+        goto done;
+    }
+
+    result = result_buffer(values[1], "d", sizeof(double), column.column.length, &view);
+    if (!result)
+    {
+        goto done;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    status = query_score_column(self->query, &column.column, view.buf, threads);
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&view);
+    if (status < 0)
+    {
+        PyErr_NoMemory();
+        Py_CLEAR(result);
+    }
+
+done:
+    release_column(&column);
+    return result;
+}
+
+FASTCALL_WRAPPER(Query_score)
+FASTCALL_WRAPPER(Query_score_many)
+
+static PyMethodDef Query_methods[] =
+{
+    {
+        "score",
+        FASTCALL_METHOD(Query_score),
+        "score(candidate)\n\n"
+        "Score candidate, a str or bytes like the query, against the query."
+    },
+    {
+        "score_many",
+        FASTCALL_METHOD(Query_score_many),
+        "score_many(candidates, out=None, threads=0)\n\n"
+        "Score every candidate, returning an array.array('d') or filling out.\n"
+        "candidates may be any column accepted by pairwise_similarity; missing\n"
+        "values score NaN. The work runs on threads threads without the GIL."
+    },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyMemberDef Query_members[] =
+{
+    { "string", T_OBJECT_EX, offsetof(QueryObject, string), READONLY, "The query string." },
+    { "metric", T_OBJECT_EX, offsetof(QueryObject, metric), READONLY, "The metric name." },
+    { NULL, 0, 0, 0, NULL }
+};
+
+#define QUERY_DOC \
+    "Query(string, metric='levenshtein', score_cutoff=0.0)\n\n" \
+    "A string prepared for scoring against many candidates: the bit masks,\n" \
+    "character bitmap and phonetic key that depend on the query alone are\n" \
+    "built once. metric is any metric name accepted by pairwise_similarity,\n" \
+    "or 'soundex', 'metaphone', 'nysiis' or 'match_rating', which score 1.0\n" \
+    "when the candidate's code matches the query's and 0.0 otherwise. Scores\n" \
+    "below score_cutoff are returned as 0.0."
+
+#if PY_MAJOR_VERSION >= 3
+static PyType_Slot Query_slots[] =
+{
+    { Py_tp_dealloc, Query_dealloc },
+    { Py_tp_doc, (void *) QUERY_DOC },
+    { Py_tp_methods, Query_methods },
+    { Py_tp_members, Query_members },
+    { Py_tp_new, Query_new },
+    { 0, NULL }
+};
+
+static PyType_Spec Query_spec =
+{
+    "jellyfish.Query",
+    sizeof(QueryObject),
+    0,
+    TYPE_FLAGS,
+    Query_slots
+};
+#else
+static PyTypeObject Query_Type =
+{
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "jellyfish.Query",
+    .tp_basicsize = sizeof(QueryObject),
+    .tp_dealloc = (destructor) Query_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = QUERY_DOC,
+    .tp_methods = Query_methods,
+    .tp_members = Query_members,
+    .tp_new = Query_new,
+};
+#endif
 
-static PyObject* jellyfish_soundex(PyObject *self, PyObject *args)
+static PyObject* jellyfish_soundex(PyObject *self, PyObject *const *args, Py_ssize_t nargs,
+                                   PyObject *kwnames)
 {
-    PyObject *pystr;
+    static const char *const names[] = { "string", NULL };
+    PyObject *pystr = NULL;
     PyObject *normalized;
     PyObject* ret;
     char *result;
 
-    if (!PyArg_ParseTuple(args, "O", &pystr))
+    if (parse_args("soundex", args, nargs, kwnames, names, 1, &pystr) < 0)
     {
         return NULL;
     }
@@ -213,14 +2568,16 @@ static PyObject* jellyfish_soundex(PyObject *self, PyObject *args)
     return ret;
 }
 
-static PyObject* jellyfish_metaphone(PyObject *self, PyObject *args)
+static PyObject* jellyfish_metaphone(PyObject *self, PyObject *const *args, Py_ssize_t nargs,
+                                     PyObject *kwnames)
 {
-    PyObject *pystr;
+    static const char *const names[] = { "string", NULL };
+    PyObject *pystr = NULL;
     PyObject *normalized;
     PyObject *ret;
     char *result;
 
-    if (!PyArg_ParseTuple(args, "O", &pystr))
+    if (parse_args("metaphone", args, nargs, kwnames, names, 1, &pystr) < 0)
     {
         return NULL;
     }
@@ -247,13 +2604,17 @@ static PyObject* jellyfish_metaphone(PyObject *self, PyObject *args)
     return ret;
 }
 
-static PyObject* jellyfish_match_rating_codex(PyObject *self, PyObject *args)
+static PyObject* jellyfish_match_rating_codex(PyObject *self, PyObject *const *args,
+                                              Py_ssize_t nargs, PyObject *kwnames)
 {
-    const char *str;
+    static const char *const names[] = { "string", NULL };
+    PyObject *value = NULL;
+    const char *str = NULL;
     char *result;
     PyObject *ret;
 
-    if (!PyArg_ParseTuple(args, "s", &str))
+    if (parse_args("match_rating_codex", args, nargs, kwnames, names, 1, &value) < 0 ||
+        arg_string("match_rating_codex", value, &str) < 0)
     {
         return NULL;
     }
@@ -271,24 +2632,25 @@ static PyObject* jellyfish_match_rating_codex(PyObject *self, PyObject *args)
     return ret;
 }
 
-static PyObject* jellyfish_match_rating_comparison(PyObject *self, PyObject *args)
+static PyObject* jellyfish_match_rating_comparison(PyObject *self, PyObject *const *args,
+                                                   Py_ssize_t nargs, PyObject *kwnames)
 {
-    const char *str1, *str2;
+    static const char fname[] = "match_rating_comparison";
+    static const char *const names[] = { "string1", "string2", NULL };
+    PyObject *values[2] = { NULL, NULL };
+    const char *str1 = NULL, *str2 = NULL;
     int result;
 
-    if (!PyArg_ParseTuple(args, "ss", &str1, &str2))
+    if (parse_args(fname, args, nargs, kwnames, names, 2, values) < 0 ||
+        arg_string(fname, values[0], &str1) < 0 ||
+        arg_string(fname, values[1], &str2) < 0)
     {
         return NULL;
     }
 
+    /* -1, codexes too different in length to compare, is not a match. */
     result = match_rating_comparison(str1, str2);
-    if (result == -1)
-    {
-        PyErr_NoMemory();
-        return NULL;
-    }
-
-    if (result)
+    if (result > 0)
     {
         Py_RETURN_TRUE;
     }
@@ -298,13 +2660,17 @@ static PyObject* jellyfish_match_rating_comparison(PyObject *self, PyObject *arg
     }
 }
 
-static PyObject* jellyfish_nysiis(PyObject *self, PyObject *args)
+static PyObject* jellyfish_nysiis(PyObject *self, PyObject *const *args, Py_ssize_t nargs,
+                                  PyObject *kwnames)
 {
-    const char *str;
+    static const char *const names[] = { "string", NULL };
+    PyObject *value = NULL;
+    const char *str = NULL;
     char *result;
     PyObject *ret;
 
-    if (!PyArg_ParseTuple(args, "s", &str))
+    if (parse_args("nysiis", args, nargs, kwnames, names, 1, &value) < 0 ||
+        arg_string("nysiis", value, &str) < 0)
     {
         return NULL;
     }
@@ -322,183 +2688,749 @@ static PyObject* jellyfish_nysiis(PyObject *self, PyObject *args)
     return ret;
 }
 
-static PyObject* jellyfish_porter_stem(PyObject *self, PyObject *args)
+static PyObject* jellyfish_porter_stem(PyObject *self, PyObject *const *args, Py_ssize_t nargs,
+                                       PyObject *kwnames)
 {
-    const char *str;
-    char *result;
+    static const char *const names[] = { "string", NULL };
+    PyObject *value = NULL;
+    const char *str = NULL;
+    char stack[SCRATCH_STACK], *result;
+    size_t len, mark = scratch_mark();
     PyObject *ret;
-    struct stemmer *z;
     int end;
 
-    if (!PyArg_ParseTuple(args, "s", &str))
+    if (parse_args("porter_stem", args, nargs, kwnames, names, 1, &value) < 0 ||
+        arg_string("porter_stem", value, &str) < 0)
     {
         return NULL;
     }
 
-    z = create_stemmer();
-    if (!z)
+    len = strlen(str);
+    result = scratch_buffer(stack, sizeof(stack), len + 1);
+    if (!result)
     {
         PyErr_NoMemory();
         return NULL;
     }
+    memcpy(result, str, len + 1);
+
+    end = stem_in_place(result, len - 1);
+    result[end + 1] = '\0';
+
+    ret = Py_BuildValue("s", result);
+
+    scratch_release(mark);
 
-    result = strdup(str);
+    return ret;
+}
+
+static PyObject* jellyfish_py_cpu_features(PyObject *self, PyObject *args)
+{
+    static const struct
+    {
+        const char *name;
+        unsigned flag;
+    } flags[] =
+    {
+        { "sse2", JELLYFISH_CPU_SSE2 },
+        { "sse4.2", JELLYFISH_CPU_SSE42 },
+        { "popcnt", JELLYFISH_CPU_POPCNT },
+        { "avx2", JELLYFISH_CPU_AVX2 },
+        { "avx512f", JELLYFISH_CPU_AVX512F },
+        { "avx512bw", JELLYFISH_CPU_AVX512BW },
+    };
+    unsigned features = jellyfish_cpu_features();
+    const struct jellyfish_backend *b;
+    char model[JELLYFISH_CPU_MODEL_MAX];
+    PyObject *result, *available, *value;
+    size_t i;
+
+    result = PyDict_New();
     if (!result)
     {
-        free_stemmer(z);
-        PyErr_NoMemory();
         return NULL;
     }
 
-    end = stem(z, result, strlen(result) - 1);
-    result[end + 1] = '\0';
+    for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+    {
+        if (PyDict_SetItemString(result, flags[i].name,
+                                 (features & flags[i].flag) ? Py_True : Py_False) < 0)
+        {
+            Py_DECREF(result);
+            return NULL;
+        }
+    }
 
-    ret = Py_BuildValue("s", result);
+    available = PyList_New(0);
+    if (!available)
+    {
+        Py_DECREF(result);
+        return NULL;
+    }
+    for (b = jellyfish_backends(); b->name; b++)
+    {
+        if ((b->requires & features) != b->requires)
+        {
+            continue;
+        }
+        value = Py_BuildValue("s", b->name);
+        if (!value || PyList_Append(available, value) < 0)
+        {
+            Py_XDECREF(value);
+            Py_DECREF(available);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(value);
+    }
+    if (PyDict_SetItemString(result, "backends", available) < 0)
+    {
+        Py_DECREF(available);
+        Py_DECREF(result);
+        return NULL;
+    }
+    Py_DECREF(available);
 
-    free(result);
-    free_stemmer(z);
+    value = Py_BuildValue("s", jellyfish_backend->name);
+    if (!value || PyDict_SetItemString(result, "backend", value) < 0)
+    {
+        Py_XDECREF(value);
+        Py_DECREF(result);
+        return NULL;
+    }
+    Py_DECREF(value);
 
-    return ret;
+    jellyfish_cpu_model(model);
+    value = Py_BuildValue("s", model);
+    if (!value || PyDict_SetItemString(result, "model", value) < 0)
+    {
+        Py_XDECREF(value);
+        Py_DECREF(result);
+        return NULL;
+    }
+    Py_DECREF(value);
+
+    return result;
+}
+
+static PyObject* jellyfish_backend_name(PyObject *self, PyObject *args)
+{
+    return Py_BuildValue("s", jellyfish_backend->name);
+}
+
+static PyObject* jellyfish_enable_stats(PyObject *self, PyObject *const *args, Py_ssize_t nargs,
+                                        PyObject *kwnames)
+{
+    static const char *const names[] = { "enabled", NULL };
+    PyObject *values[1] = { NULL };
+    bool enabled = true;
+
+    if (parse_args("enable_stats", args, nargs, kwnames, names, 0, values) < 0 ||
+        arg_bool(values[0], &enabled) < 0)
+    {
+        return NULL;
+    }
+    jellyfish_stats_enable(enabled);
+    Py_RETURN_NONE;
+}
+
+/* One function's counters as a dict; the histogram lists every bucket. */
+static PyObject* stats_dict(const struct jellyfish_stats *stats)
+{
+    PyObject *histogram, *result;
+    Py_ssize_t b;
+
+    histogram = PyList_New(STATS_BUCKETS);
+    for (b = 0; histogram && b < STATS_BUCKETS; b++)
+    {
+        PyObject *count = PyLong_FromUnsignedLongLong(stats->histogram[b]);
+        if (!count)
+        {
+            Py_CLEAR(histogram);
+            break;
+        }
+        PyList_SET_ITEM(histogram, b, count);
+    }
+    if (!histogram)
+    {
+        return NULL;
+    }
+
+    result = Py_BuildValue("{sKsKsKsN}",
+                           "calls", (unsigned long long) stats->calls,
+                           "bytes", (unsigned long long) stats->bytes,
+                           "time_ns", (unsigned long long) stats->time_ns,
+                           "histogram", histogram);
+    return result;
+}
+
+static PyObject* jellyfish_stats(PyObject *self, PyObject *args)
+{
+    struct jellyfish_stats stats[STAT_COUNT];
+    PyObject *result, *value;
+    int i;
+
+    jellyfish_stats_read(stats);
+    result = PyDict_New();
+    for (i = 0; result && i < STAT_COUNT; i++)
+    {
+        value = stats_dict(&stats[i]);
+        if (!value || PyDict_SetItemString(result, jellyfish_stat_name(i), value) < 0)
+        {
+            Py_CLEAR(result);
+        }
+        Py_XDECREF(value);
+    }
+    return result;
+}
+
+static PyObject* jellyfish_reset_stats(PyObject *self, PyObject *args)
+{
+    jellyfish_stats_reset();
+    Py_RETURN_NONE;
 }
 
+FASTCALL_WRAPPER(jellyfish_jaro_winkler)
+FASTCALL_WRAPPER(jellyfish_jaro_distance)
+FASTCALL_WRAPPER(jellyfish_jaro_average)
+FASTCALL_WRAPPER(jellyfish_hamming_distance)
+FASTCALL_WRAPPER(jellyfish_levenshtein_distance)
+FASTCALL_WRAPPER(jellyfish_damerau_levenshtein_distance)
+FASTCALL_WRAPPER(jellyfish_levenshtein_similarity)
+FASTCALL_WRAPPER(jellyfish_damerau_levenshtein_similarity)
+FASTCALL_WRAPPER(jellyfish_lcs_length)
+FASTCALL_WRAPPER(jellyfish_indel_distance)
+FASTCALL_WRAPPER(jellyfish_lcs_similarity)
+FASTCALL_WRAPPER(jellyfish_lcs_similarity_many)
+FASTCALL_WRAPPER(jellyfish_token_sort_similarity)
+FASTCALL_WRAPPER(jellyfish_token_set_similarity)
+FASTCALL_WRAPPER(jellyfish_monge_elkan_similarity)
+FASTCALL_WRAPPER(jellyfish_levenshtein_editops)
+FASTCALL_WRAPPER(jellyfish_levenshtein_opcodes)
+FASTCALL_WRAPPER(jellyfish_weighted_levenshtein_distance)
+FASTCALL_WRAPPER(jellyfish_weighted_damerau_levenshtein_distance)
+FASTCALL_WRAPPER(jellyfish_pairwise_similarity)
+FASTCALL_WRAPPER(jellyfish_pairwise_distance)
+FASTCALL_WRAPPER(jellyfish_cdist_similarity)
+FASTCALL_WRAPPER(jellyfish_cdist_distance)
+FASTCALL_WRAPPER(jellyfish_pdist_similarity)
+FASTCALL_WRAPPER(jellyfish_pdist_distance)
+FASTCALL_WRAPPER(jellyfish_dedupe)
+#if PY_MAJOR_VERSION >= 3
+FASTCALL_WRAPPER(jellyfish_submit)
+#endif
+FASTCALL_WRAPPER(jellyfish_soundex)
+FASTCALL_WRAPPER(jellyfish_metaphone)
+FASTCALL_WRAPPER(jellyfish_match_rating_codex)
+FASTCALL_WRAPPER(jellyfish_match_rating_comparison)
+FASTCALL_WRAPPER(jellyfish_nysiis)
+FASTCALL_WRAPPER(jellyfish_porter_stem)
+FASTCALL_WRAPPER(jellyfish_enable_stats)
+
 static PyMethodDef jellyfish_methods[] =
 {
     {
         "jaro_winkler",
-        jellyfish_jaro_winkler,
-        METH_VARARGS,
-        "jaro_winkler(string1, string2, ignore_case=True)\n\nDo a Jaro-Winkler string comparison between "
-        "string1 and string2."
+        FASTCALL_METHOD(jellyfish_jaro_winkler),
+        "jaro_winkler(string1, string2, long_tolerance=False, score_cutoff=0.0)\n\n"
+        "Do a Jaro-Winkler string comparison between string1 and string2.\n"
+        "Scores below score_cutoff are returned as 0.0. With long_tolerance, long\n"
+        "strings agreeing beyond the common prefix get an extra boost."
     },
     {
         "jaro_distance",
-        jellyfish_jaro_distance,
-        METH_VARARGS,
-        "jaro_distance(string1, string2, ignore_case=True)\n\nGet a Jaro string distance metric for string1 "
-        "and string2."
+        FASTCALL_METHOD(jellyfish_jaro_distance),
+        "jaro_distance(string1, string2, score_cutoff=0.0)\n\nGet a Jaro string distance metric for string1 "
+        "and string2.\nScores below score_cutoff are returned as 0.0."
     },
     {
         "jaro_average",
-        jellyfish_jaro_average,
-        METH_VARARGS,
-        "jaro_average(string1, string2, ignore_case=True)\n\nGet the average Jaro metric for string1 and "
+        FASTCALL_METHOD(jellyfish_jaro_average),
+        "jaro_average(string1, string2)\n\nGet the average Jaro metric for string1 and "
         "string2."
     },
     {
         "hamming_distance",
-        jellyfish_hamming_distance,
-        METH_VARARGS | METH_KEYWORDS,
-        "hamming_distance(string1, string2, ignore_case=True)\n\nCompute the Hamming distance between "
+        FASTCALL_METHOD(jellyfish_hamming_distance),
+        "hamming_distance(string1, string2)\n\nCompute the Hamming distance between "
         "string1 and string2."
     },
     {
         "levenshtein_distance",
-        jellyfish_levenshtein_distance,
-        METH_VARARGS,
+        FASTCALL_METHOD(jellyfish_levenshtein_distance),
         "levenshtein_distance(string1, string2)\n\nCompute the Levenshtein distance between string1 and "
         "string2."
     },
 
     {
         "damerau_levenshtein_distance",
-        jellyfish_damerau_levenshtein_distance,
-        METH_VARARGS,
+        FASTCALL_METHOD(jellyfish_damerau_levenshtein_distance),
         "damerau_levenshtein_distance(string1, string2)\n\n"
         "Compute the Damerau-Levenshtein distance between string1 and string2."
     },
+    {
+        "levenshtein_similarity",
+        FASTCALL_METHOD(jellyfish_levenshtein_similarity),
+        "levenshtein_similarity(string1, string2, score_cutoff=0.0)\n\n"
+        "Return 1 - levenshtein_distance / the longer length, between 0.0 and 1.0.\n"
+        "Scores below score_cutoff are returned as 0.0, stopping as soon as the\n"
+        "cutoff can no longer be met."
+    },
+    {
+        "damerau_levenshtein_similarity",
+        FASTCALL_METHOD(jellyfish_damerau_levenshtein_similarity),
+        "damerau_levenshtein_similarity(string1, string2, score_cutoff=0.0)\n\n"
+        "Return 1 - damerau_levenshtein_distance / the longer length, between 0.0\n"
+        "and 1.0. Scores below score_cutoff are returned as 0.0, stopping as soon\n"
+        "as the cutoff can no longer be met."
+    },
+    {
+        "lcs_length",
+        FASTCALL_METHOD(jellyfish_lcs_length),
+        "lcs_length(string1, string2)\n\n"
+        "Compute the length of the longest common subsequence of string1 and\n"
+        "string2."
+    },
+    {
+        "indel_distance",
+        FASTCALL_METHOD(jellyfish_indel_distance),
+        "indel_distance(string1, string2)\n\n"
+        "Compute the number of insertions and deletions turning string1 into\n"
+        "string2, len(string1) + len(string2) - 2 * lcs_length(string1, string2)."
+    },
+    {
+        "lcs_similarity",
+        FASTCALL_METHOD(jellyfish_lcs_similarity),
+        "lcs_similarity(string1, string2, score_cutoff=0.0)\n\n"
+        "Return 1 - indel_distance / (len(string1) + len(string2)), between 0.0\n"
+        "and 1.0. Scores below score_cutoff are returned as 0.0."
+    },
+    {
+        "lcs_similarity_many",
+        FASTCALL_METHOD(jellyfish_lcs_similarity_many),
+        "lcs_similarity_many(query, choices, score_cutoff=0.0)\n\n"
+        "Return the list of lcs_similarity(query, choice, score_cutoff) for every\n"
+        "string in choices, preparing the query only once."
+    },
+    {
+        "token_sort_similarity",
+        FASTCALL_METHOD(jellyfish_token_sort_similarity),
+        "token_sort_similarity(string1, string2, metric='levenshtein', score_cutoff=0.0)\n\n"
+        "Split both strings into words, sort the words and compare the results\n"
+        "with metric: 'levenshtein', 'damerau_levenshtein', 'jaro', 'jaro_winkler'\n"
+        "or 'lcs'. Scores below score_cutoff are returned as 0.0."
+    },
+    {
+        "token_set_similarity",
+        FASTCALL_METHOD(jellyfish_token_set_similarity),
+        "token_set_similarity(string1, string2, metric='levenshtein', score_cutoff=0.0)\n\n"
+        "Compare the sets of distinct words in both strings with metric: the\n"
+        "best score between the shared words and each string's words, so one\n"
+        "word set containing the other scores 1.0. Scores below score_cutoff are\n"
+        "returned as 0.0."
+    },
+    {
+        "monge_elkan_similarity",
+        FASTCALL_METHOD(jellyfish_monge_elkan_similarity),
+        "monge_elkan_similarity(string1, string2, metric='jaro_winkler', symmetric=False,\n"
+        "                       score_cutoff=0.0)\n\n"
+        "Average, over the words of string1, the best metric score against any\n"
+        "word of string2. With symmetric=True the score is also computed from\n"
+        "string2 to string1 and the two are averaged. Scores below score_cutoff\n"
+        "are returned as 0.0."
+    },
+    {
+        "levenshtein_editops",
+        FASTCALL_METHOD(jellyfish_levenshtein_editops),
+        "levenshtein_editops(string1, string2)\n\n"
+        "Return a minimal list of (op, i, j) edits turning string1 into string2,\n"
+        "where op is 'replace' (string1[i] becomes string2[j]), 'delete' (remove\n"
+        "string1[i]) or 'insert' (insert string2[j] before string1[i])."
+    },
+    {
+        "levenshtein_opcodes",
+        FASTCALL_METHOD(jellyfish_levenshtein_opcodes),
+        "levenshtein_opcodes(string1, string2)\n\n"
+        "Return the edits turning string1 into string2 as difflib style\n"
+        "(tag, i1, i2, j1, j2) spans: string1[i1:i2] becomes string2[j1:j2], and\n"
+        "tag is 'equal', 'replace', 'delete' or 'insert'."
+    },
+    {
+        "weighted_levenshtein_distance",
+        FASTCALL_METHOD(jellyfish_weighted_levenshtein_distance),
+        "weighted_levenshtein_distance(string1, string2, costs)\n\n"
+        "Compute the Levenshtein distance between string1 and string2 using the\n"
+        "edit costs in the CostTable costs."
+    },
+    {
+        "weighted_damerau_levenshtein_distance",
+        FASTCALL_METHOD(jellyfish_weighted_damerau_levenshtein_distance),
+        "weighted_damerau_levenshtein_distance(string1, string2, costs)\n\n"
+        "Compute the Damerau-Levenshtein (optimal string alignment) distance\n"
+        "between string1 and string2 using the edit costs in the CostTable costs."
+    },
+    {
+        "pairwise_similarity",
+        FASTCALL_METHOD(jellyfish_pairwise_similarity),
+        "pairwise_similarity(strings1, strings2, metric='levenshtein', score_cutoff=0.0, "
+        "out=None, threads=0)\n\n"
+        "Score strings1[i] against strings2[i] for every i with the named metric,\n"
+        "returning an array.array('d'), or filling and returning out, any writable\n"
+        "float64 buffer such as a numpy array. The columns may be Arrow string or\n"
+        "binary arrays, numpy U or S arrays or sequences of str or bytes; missing\n"
+        "values (Arrow nulls, None) score NaN. The rows are scored in C, on up to\n"
+        "threads threads (0 for one per CPU), without the GIL."
+    },
+    {
+        "pairwise_distance",
+        FASTCALL_METHOD(jellyfish_pairwise_distance),
+        "pairwise_distance(strings1, strings2, metric='levenshtein', out=None, threads=0)\n\n"
+        "Like pairwise_similarity, but computing the metric's edit distance into an\n"
+        "array.array('i') or an int32 out buffer. Missing values give -1. The\n"
+        "metric may be levenshtein, damerau_levenshtein or lcs (the indel distance)."
+    },
+    {
+        "cdist_similarity",
+        FASTCALL_METHOD(jellyfish_cdist_similarity),
+        "cdist_similarity(queries, choices, metric='levenshtein', score_cutoff=0.0, "
+        "out=None, threads=0)\n\n"
+        "Score every query against every choice, returning the len(queries) x\n"
+        "len(choices) matrix row by row as an array.array('d'), or filling and\n"
+        "returning out, e.g. a float64 numpy array of that shape. Columns and\n"
+        "missing values are handled as by pairwise_similarity."
+    },
+    {
+        "cdist_distance",
+        FASTCALL_METHOD(jellyfish_cdist_distance),
+        "cdist_distance(queries, choices, metric='levenshtein', out=None, threads=0)\n\n"
+        "Like cdist_similarity, but computing the metric's edit distance into an\n"
+        "array.array('i') or an int32 out buffer."
+    },
+    {
+        "pdist_similarity",
+        FASTCALL_METHOD(jellyfish_pdist_similarity),
+        "pdist_similarity(strings, metric='levenshtein', score_cutoff=0.0, out=None, "
+        "threads=0)\n\n"
+        "Score every pair of strings once, returning the n * (n - 1) / 2 scores of\n"
+        "the upper triangle in scipy.spatial.distance.pdist order (pair i < j at\n"
+        "n*i - i*(i+1)/2 + j-i-1) as an array.array('d'), or filling out."
+    },
+    {
+        "pdist_distance",
+        FASTCALL_METHOD(jellyfish_pdist_distance),
+        "pdist_distance(strings, metric='levenshtein', out=None, threads=0)\n\n"
+        "Like pdist_similarity, but computing the metric's edit distance into an\n"
+        "array.array('i') or an int32 out buffer; the result can be passed to\n"
+        "scipy.spatial.distance.squareform or scipy.cluster.hierarchy.linkage."
+    },
+    {
+        "dedupe",
+        FASTCALL_METHOD(jellyfish_dedupe),
+        "dedupe(strings, metric='jaro_winkler', threshold=0.9, max_distance=None, "
+        "blocking='length', threads=0, out=None)\n\n"
+        "Cluster near-duplicate strings, returning a cluster id per string as an\n"
+        "array.array('i') (or filling an int32 out buffer). Two strings are linked\n"
+        "when their metric similarity is at least threshold, or with max_distance\n"
+        "set, when the metric's edit distance is at most max_distance; metric may\n"
+        "also be 'match_rating'. Clusters are the connected components of the\n"
+        "links, numbered from 0 in order of first appearance; None and nulls get\n"
+        "-1. Only candidate pairs chosen by blocking are compared: 'length'\n"
+        "(lengths that could still match, which loses nothing), 'soundex',\n"
+        "'metaphone' or 'nysiis' (same phonetic code), 'qgram' (a shared\n"
+        "trigram) or 'none' (all pairs). strings may be any column accepted by\n"
+        "pairwise_similarity; the work runs on threads threads without the GIL."
+    },
+#if PY_MAJOR_VERSION >= 3
+    {
+        "submit",
+        FASTCALL_METHOD(jellyfish_submit),
+        "submit(function, *args, **kwargs)\n\n"
+        "Start function(*args, **kwargs), one of pairwise_similarity,\n"
+        "pairwise_distance, cdist_similarity, cdist_distance, pdist_similarity or\n"
+        "pdist_distance, on a native thread and return a concurrent.futures.Future\n"
+        "for its result without waiting. The arguments are checked before it\n"
+        "returns; await asyncio.wrap_future(future) from a coroutine."
+    },
+#endif
     {
         "soundex",
-        jellyfish_soundex,
-        METH_VARARGS,
+        FASTCALL_METHOD(jellyfish_soundex),
         "soundex(string)\n\n"
         "Calculate the soundex code for a given name."
     },
     {
         "metaphone",
-        jellyfish_metaphone,
-        METH_VARARGS,
+        FASTCALL_METHOD(jellyfish_metaphone),
         "metaphone(string)\n\n"
         "Calculate the metaphone representation of a given string."
     },
     {
         "match_rating_codex",
-        jellyfish_match_rating_codex,
-        METH_VARARGS,
+        FASTCALL_METHOD(jellyfish_match_rating_codex),
         "match_rating_codex(string)\n\n"
         "Calculate the Match Rating Approach representation of a given string."
     },
     {
         "match_rating_comparison",
-        jellyfish_match_rating_comparison,
-        METH_VARARGS,
-        "match_rating_comparison(string, string)\n\n"
-            "Compute the Match Rating Approach similarity between string1 and string2."
+        FASTCALL_METHOD(jellyfish_match_rating_comparison),
+        "match_rating_comparison(string1, string2)\n\n"
+        "Compute the Match Rating Approach similarity between string1 and string2."
     },
     {
         "nysiis",
-        jellyfish_nysiis,
-        METH_VARARGS,
+        FASTCALL_METHOD(jellyfish_nysiis),
         "nysiis(string)\n\n"
         "Compute the NYSIIS (New York State Identification and Intelligence\n"
         "System) code for a string."
     },
     {
         "porter_stem",
-        jellyfish_porter_stem,
-        METH_VARARGS,
+        FASTCALL_METHOD(jellyfish_porter_stem),
         "porter_stem(string)\n\n"
         "Return the result of running the Porter stemming algorithm on a single-word string."
     },
+    {
+        "cpu_features",
+        jellyfish_py_cpu_features,
+        METH_NOARGS,
+        "cpu_features()\n\n"
+        "Return a dict of the CPU features jellyfish can use, the kernel backends\n"
+        "available on this CPU ('backends'), the one in use ('backend') and the\n"
+        "processor's brand string ('model')."
+    },
+    {
+        "backend",
+        jellyfish_backend_name,
+        METH_NOARGS,
+        "backend()\n\n"
+        "Return the name of the kernel backend selected at import time. Set the\n"
+        "JELLYFISH_BACKEND environment variable before import to force one."
+    },
+    {
+        "enable_stats",
+        FASTCALL_METHOD(jellyfish_enable_stats),
+        "enable_stats(enabled=True)\n\n"
+        "Start or stop recording call statistics, for every thread of the process.\n"
+        "Setting JELLYFISH_STATS=1 before import starts recording from the outset."
+    },
+    {
+        "stats",
+        jellyfish_stats,
+        METH_NOARGS,
+        "stats()\n\n"
+        "Return a dict mapping each function to its 'calls', the 'bytes' of string\n"
+        "it was given, its total 'time_ns' and a latency 'histogram', whose entry i\n"
+        "counts calls that took from 2**i to 2**(i+1) nanoseconds, since the last\n"
+        "reset_stats(). A batch function's time includes the metric calls it makes,\n"
+        "which are counted under the metric too."
+    },
+    {
+        "reset_stats",
+        jellyfish_reset_stats,
+        METH_NOARGS,
+        "reset_stats()\n\n"
+        "Restart the counts returned by stats() from zero."
+    },
 
     { NULL, NULL, 0, NULL } };
 
+/* Add type to the module under name, keeping the state's reference. */
+static int add_type(PyObject *module, const char *name, PyObject *type)
+{
+    Py_INCREF(type);
+    if (PyModule_AddObject(module, name, type) < 0)
+    {
+        Py_DECREF(type);
+        return -1;
+    }
+    return 0;
+}
+
+/* Fill in a new module object; run once per interpreter importing it. */
 #if PY_MAJOR_VERSION >= 3
-#define INITERROR return NULL
+/* Scratch memory comes from Python's raw allocator, which needs no GIL, so
+ * tracemalloc and PYTHONMALLOC=debug see it too.
+ */
+static const struct jellyfish_allocator scratch_allocator = { PyMem_RawMalloc, PyMem_RawFree };
+#endif
 
-static struct PyModuleDef moduledef =
+static int jellyfish_exec(PyObject *module)
 {
-    PyModuleDef_HEAD_INIT,
-    "strfry",
-    NULL,
-    sizeof(struct jellyfish_state),
-    jellyfish_methods,
-    NULL,
-    NULL,
-    NULL,
-    NULL
-};
+    struct jellyfish_state *state = GETSTATE(module);
+    const char *backend = getenv("JELLYFISH_BACKEND");
+    const char *stats = getenv("JELLYFISH_STATS");
+    PyObject *unicodedata;
+#if PY_MAJOR_VERSION >= 3
+    PyObject *atexit, *waiter, *registered;
+#endif
 
-PyObject* PyInit_jellyfish(void)
-#else
+    pthread_mutex_init(&state->submitted_lock, NULL);
+    pthread_cond_init(&state->submitted_done, NULL);
 
-#define INITERROR return
+    switch (jellyfish_init_backend(backend))
+    {
+        case -1:
+            PyErr_Format(PyExc_ImportError, "unknown JELLYFISH_BACKEND '%s'", backend);
+            return -1;
+        case -2:
+            PyErr_Format(PyExc_ImportError,
+                         "JELLYFISH_BACKEND '%s' is not supported by this CPU", backend);
+            return -1;
+    }
 
-PyMODINIT_FUNC initjellyfish(void)
+    if (stats && *stats && strcmp(stats, "0") != 0)
+    {
+        jellyfish_stats_enable(true);
+    }
+
+#if PY_MAJOR_VERSION >= 3
+    jellyfish_set_allocator(&scratch_allocator);
 #endif
-{
-    PyObject *unicodedata;
+
+    unicodedata = PyImport_ImportModule("unicodedata");
+    if (!unicodedata)
+    {
+        return -1;
+    }
+    state->unicodedata_normalize = PyObject_GetAttrString(unicodedata, "normalize");
+    Py_DECREF(unicodedata);
+    if (!state->unicodedata_normalize)
+    {
+        return -1;
+    }
+    state->normalize_cache = PyDict_New();
+    if (!state->normalize_cache)
+    {
+        return -1;
+    }
 
 #if PY_MAJOR_VERSION >= 3
-    PyObject *module = PyModule_Create(&moduledef);
+    state->CostTable_Type = PyType_FromSpec(&CostTable_spec);
+    state->Query_Type = PyType_FromSpec(&Query_spec);
+    if (!state->CostTable_Type || !state->Query_Type)
+    {
+        return -1;
+    }
 #else
-    PyObject *module = Py_InitModule("jellyfish", jellyfish_methods);
+    if (PyType_Ready(&CostTable_Type) < 0 || PyType_Ready(&Query_Type) < 0)
+    {
+        return -1;
+    }
+    state->CostTable_Type = (PyObject *) &CostTable_Type;
+    state->Query_Type = (PyObject *) &Query_Type;
+    Py_INCREF(state->CostTable_Type);
+    Py_INCREF(state->Query_Type);
 #endif
 
-    if (module == NULL)
+    if (add_type(module, "CostTable", state->CostTable_Type) < 0 ||
+        add_type(module, "Query", state->Query_Type) < 0)
     {
-        INITERROR;
+        return -1;
     }
 
-    unicodedata = PyImport_ImportModule("unicodedata");
-    if (!unicodedata)
+#if PY_MAJOR_VERSION >= 3
+    /* submit() threads need the interpreter to complete their futures, so
+     * its exit waits for them.
+     */
+    atexit = PyImport_ImportModule("atexit");
+    waiter = atexit ? PyCFunction_NewEx(&wait_for_submitted_def, module, NULL) : NULL;
+    registered = waiter ? PyObject_CallMethod(atexit, "register", "O", waiter) : NULL;
+    Py_XDECREF(atexit);
+    Py_XDECREF(waiter);
+    if (!registered)
     {
-        INITERROR;
+        return -1;
     }
-
-    GETSTATE(module)->unicodedata_normalize = PyObject_GetAttrString(unicodedata, "normalize");
-    Py_DECREF(unicodedata);
+    Py_DECREF(registered);
+#endif
+    return 0;
+}
 
 #if PY_MAJOR_VERSION >= 3
-    return module;
+static int jellyfish_traverse(PyObject *module, visitproc visit, void *arg)
+{
+    struct jellyfish_state *state = GETSTATE(module);
+
+    if (state)
+    {
+        Py_VISIT(state->unicodedata_normalize);
+        Py_VISIT(state->normalize_cache);
+        Py_VISIT(state->CostTable_Type);
+        Py_VISIT(state->Query_Type);
+    }
+    return 0;
+}
+
+static int jellyfish_clear(PyObject *module)
+{
+    struct jellyfish_state *state = GETSTATE(module);
+
+    if (state)
+    {
+        Py_CLEAR(state->unicodedata_normalize);
+        Py_CLEAR(state->normalize_cache);
+        Py_CLEAR(state->CostTable_Type);
+        Py_CLEAR(state->Query_Type);
+    }
+    return 0;
+}
+
+static void jellyfish_free(void *module)
+{
+    struct jellyfish_state *state = GETSTATE((PyObject *) module);
+
+    jellyfish_clear((PyObject *) module);
+    if (state)
+    {
+        pthread_mutex_destroy(&state->submitted_lock);
+        pthread_cond_destroy(&state->submitted_done);
+    }
+}
+
+/* Multi-phase initialization.  The state is per module object and the C
+ * code keeps no mutable globals (the kernel backend is chosen from the
+ * same CPU and environment by every interpreter), so the module supports
+ * subinterpreters with their own GIL and runs without the GIL on
+ * free-threaded builds; the only shared mutable objects, CostTables, are
+ * locked while they are changed or used.
+ */
+static PyModuleDef_Slot jellyfish_slots[] =
+{
+    { Py_mod_exec, jellyfish_exec },
+#ifdef Py_mod_multiple_interpreters
+    { Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED },
+#endif
+#ifdef Py_mod_gil
+    { Py_mod_gil, Py_MOD_GIL_NOT_USED },
 #endif
+    { 0, NULL }
+};
+
+static struct PyModuleDef moduledef =
+{
+    PyModuleDef_HEAD_INIT,
+    "jellyfish",
+    NULL,
+    sizeof(struct jellyfish_state),
+    jellyfish_methods,
+    jellyfish_slots,
+    jellyfish_traverse,
+    jellyfish_clear,
+    jellyfish_free
+};
+
+PyMODINIT_FUNC PyInit_jellyfish(void)
+{
+    return PyModuleDef_Init(&moduledef);
+}
+#else
+PyMODINIT_FUNC initjellyfish(void)
+{
+    PyObject *module = Py_InitModule("jellyfish", jellyfish_methods);
+
+    if (module)
+    {
+        jellyfish_exec(module);
+    }
 }
+#endif
@@ -0,0 +1,421 @@
+#include "jellyfish.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+/* Longest common subsequence length with the bit-parallel algorithm of
+ * Allison and Dix as refined by Hyyrö.
+ *
+ * For a pattern p, PM[c] has bit i set wherever p[i] == c.  Starting from
+ * V = all ones, every character c of the other string updates
+ *
+ *     U = V & PM[c];  V = (V + U) | (V - U)
+ *
+ * (V - U is V & ~PM[c]), and at the end the LCS length is the number of
+ * zero bits among the pattern's bits of V.  Patterns longer than 64
+ * characters use one word per 64 positions, with the addition's carry
+ * propagated from word to word.
+ *
+ * Masks for code points below 256 are a flat table; wider code points go
+ * in a small open addressing hash table.  A pattern can be built once and
+ * scanned against many strings of any width, and the same masks drive
+ * Myers' bit-parallel Levenshtein distance.
+ */
+struct lcs_pattern {
+    size_t len;
+    size_t words;
+    uint64_t *ascii;    /* 256 * words masks */
+    size_t map_size;    /* a power of two, or 0 without wide code points */
+    uint32_t *keys;     /* 0 marks an empty slot; 0 is never a wide code point */
+    uint64_t *masks;    /* map_size * words masks */
+};
+
+static inline size_t map_slot(uint32_t c, size_t map_size)
+{
+    return (c * 2654435761u) & (map_size - 1);
+}
+
+static inline const uint64_t* pattern_masks(const struct lcs_pattern *pattern, uint32_t c)
+{
+    size_t slot;
+
+    if (c < 256) {
+        return pattern->ascii + c * pattern->words;
+    }
+    if (!pattern->map_size) {
+        return NULL;
+    }
+    for (slot = map_slot(c, pattern->map_size); pattern->keys[slot];
+         slot = (slot + 1) & (pattern->map_size - 1)) {
+        if (pattern->keys[slot] == c) {
+            return pattern->masks + slot * pattern->words;
+        }
+    }
+    return NULL;
+}
+
+#define JF_CHAR unsigned char
+#define JF_NAME(name) name##_ucs1
+#include "lcs_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
+
+#define JF_CHAR uint16_t
+#define JF_NAME(name) name##_ucs2
+#include "lcs_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
+
+#define JF_CHAR uint32_t
+#define JF_NAME(name) name##_ucs4
+#include "lcs_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
+
+static inline uint32_t code_point(const void *str, size_t i, int kind)
+{
+    switch (kind) {
+    case JELLYFISH_UCS2:
+        return ((const uint16_t *) str)[i];
+    case JELLYFISH_UCS4:
+        return ((const uint32_t *) str)[i];
+    default:
+        return ((const unsigned char *) str)[i];
+    }
+}
+
+/* A zeroed table, from the heap or, for a pattern used only within the
+ * current call, from scratch memory.
+ */
+static void* pattern_table(size_t count, size_t size, bool scratch)
+{
+    void *table;
+
+    if (!scratch) {
+        return calloc(count, size);
+    }
+    table = scratch_alloc(count * size);
+    if (table) {
+        memset(table, 0, count * size);
+    }
+    return table;
+}
+
+/* Fill in pattern, which is zeroed, for str.  Returns -1 if memory runs
+ * out, leaving whatever tables were allocated in pattern.
+ */
+static int build_pattern(struct lcs_pattern *pattern, const void *str, size_t len, int kind,
+                         bool scratch)
+{
+    size_t i, wide = 0, slot;
+    uint32_t c;
+    uint64_t *m;
+
+    pattern->len = len;
+    pattern->words = len ? (len + 63) / 64 : 1;
+
+    for (i = 0; i < len; i++) {
+        wide += code_point(str, i, kind) >= 256;
+    }
+    if (wide) {
+        for (pattern->map_size = 8; pattern->map_size < 2 * wide; pattern->map_size *= 2) {
+        }
+    }
+
+    pattern->ascii = pattern_table(256 * pattern->words, sizeof(uint64_t), scratch);
+    if (pattern->map_size) {
+        pattern->keys = pattern_table(pattern->map_size, sizeof(uint32_t), scratch);
+        pattern->masks = pattern_table(pattern->map_size * pattern->words, sizeof(uint64_t),
+                                       scratch);
+    }
+    if (!pattern->ascii || (pattern->map_size && (!pattern->keys || !pattern->masks))) {
+        return -1;
+    }
+
+    for (i = 0; i < len; i++) {
+        c = code_point(str, i, kind);
+        if (c < 256) {
+            m = pattern->ascii + c * pattern->words;
+        } else {
+            for (slot = map_slot(c, pattern->map_size);
+                 pattern->keys[slot] && pattern->keys[slot] != c;
+                 slot = (slot + 1) & (pattern->map_size - 1)) {
+            }
+            pattern->keys[slot] = c;
+            m = pattern->masks + slot * pattern->words;
+        }
+        m[i / 64] |= (uint64_t) 1 << (i % 64);
+    }
+    return 0;
+}
+
+struct lcs_pattern* create_lcs_pattern(const void *str, size_t len, int kind)
+{
+    struct lcs_pattern *pattern = calloc(1, sizeof(struct lcs_pattern));
+
+    if (pattern && build_pattern(pattern, str, len, kind, false) < 0) {
+        free_lcs_pattern(pattern);
+        return NULL;
+    }
+    return pattern;
+}
+
+void free_lcs_pattern(struct lcs_pattern *pattern)
+{
+    if (pattern) {
+        free(pattern->ascii);
+        free(pattern->keys);
+        free(pattern->masks);
+        free(pattern);
+    }
+}
+
+static size_t count_lcs(const struct lcs_pattern *pattern, const uint64_t *v)
+{
+    size_t w, lcs = 0;
+    uint64_t bits;
+
+    for (w = 0; w < pattern->words; w++) {
+        bits = ~v[w];
+        if (w == pattern->words - 1 && pattern->len % 64) {
+            bits &= ((uint64_t) 1 << (pattern->len % 64)) - 1;
+        }
+        lcs += __builtin_popcountll(bits);
+    }
+    return lcs;
+}
+
+/* Length of the LCS of the pattern and str, or -1 if memory runs out. */
+static long pattern_length(const struct lcs_pattern *pattern, const void *str, size_t len,
+                           int kind)
+{
+    uint64_t stack[8];
+    uint64_t *v;
+    size_t mark = scratch_mark();
+    long lcs;
+
+    if (pattern->len == 0 || len == 0) {
+        return 0;
+    }
+    v = scratch_buffer(stack, sizeof(stack), pattern->words * sizeof(uint64_t));
+    if (!v) {
+        return -1;
+    }
+
+    switch (kind) {
+    case JELLYFISH_UCS2:
+        lcs_scan_ucs2(pattern, str, len, v);
+        break;
+    case JELLYFISH_UCS4:
+        lcs_scan_ucs4(pattern, str, len, v);
+        break;
+    default:
+        lcs_scan_ucs1(pattern, str, len, v);
+        break;
+    }
+
+    lcs = count_lcs(pattern, v);
+    scratch_release(mark);
+    return lcs;
+}
+
+long lcs_pattern_length(const struct lcs_pattern *pattern, const void *str, size_t len, int kind)
+{
+    STATS_SCOPE(STAT_LCS, (pattern->len + len) * kind);
+
+    return pattern_length(pattern, str, len, kind);
+}
+
+/* Levenshtein distance between the pattern and str, or -1 if memory runs
+ * out.
+ */
+static long pattern_levenshtein(const struct lcs_pattern *pattern, const void *str, size_t len,
+                                int kind)
+{
+    uint64_t stack[16];
+    uint64_t *v;
+    size_t mark = scratch_mark();
+    long distance;
+
+    if (pattern->len == 0 || len == 0) {
+        return pattern->len + len;
+    }
+    v = scratch_buffer(stack, sizeof(stack), 2 * pattern->words * sizeof(uint64_t));
+    if (!v) {
+        return -1;
+    }
+
+    switch (kind) {
+    case JELLYFISH_UCS2:
+        distance = levenshtein_scan_ucs2(pattern, str, len, v, v + pattern->words);
+        break;
+    case JELLYFISH_UCS4:
+        distance = levenshtein_scan_ucs4(pattern, str, len, v, v + pattern->words);
+        break;
+    default:
+        distance = levenshtein_scan_ucs1(pattern, str, len, v, v + pattern->words);
+        break;
+    }
+
+    scratch_release(mark);
+    return distance;
+}
+
+long lcs_pattern_levenshtein(const struct lcs_pattern *pattern, const void *str, size_t len,
+                             int kind)
+{
+    STATS_SCOPE(STAT_LEVENSHTEIN, (pattern->len + len) * kind);
+
+    return pattern_levenshtein(pattern, str, len, kind);
+}
+
+/* 1 - the pattern's Levenshtein distance / the longer length.  The length
+ * difference is a lower bound on the distance, so it can rule the cutoff
+ * out before the scan.
+ */
+double lcs_pattern_levenshtein_similarity(const struct lcs_pattern *pattern, const void *str,
+                                          size_t len, int kind, double score_cutoff)
+{
+    size_t longest = MAX(pattern->len, len);
+    long max = jellyfish_max_distance(longest, score_cutoff), distance;
+    size_t difference = pattern->len > len ? pattern->len - len : len - pattern->len;
+    STATS_SCOPE(STAT_LEVENSHTEIN, (pattern->len + len) * kind);
+
+    if (longest == 0) {
+        return score_cutoff <= 1 ? 1 : 0;
+    }
+    if (max < 0 || difference > (size_t) max) {
+        return 0;
+    }
+    distance = pattern_levenshtein(pattern, str, len, kind);
+    if (distance < 0) {
+        return NAN;
+    }
+    return distance > max ? 0 : 1 - (double) distance / longest;
+}
+
+/* One word patterns of one byte strings keep their table on the stack and
+ * clear only the entries the two strings touch.
+ */
+static long lcs_length_short(const unsigned char *s1, size_t len1,
+                             const unsigned char *s2, size_t len2)
+{
+    uint64_t ascii[256];
+    struct lcs_pattern pattern = { len1, 1, ascii, 0, NULL, NULL };
+    uint64_t v;
+    size_t i;
+
+    for (i = 0; i < len1; i++) {
+        ascii[s1[i]] = 0;
+    }
+    for (i = 0; i < len2; i++) {
+        ascii[s2[i]] = 0;
+    }
+    for (i = 0; i < len1; i++) {
+        ascii[s1[i]] |= (uint64_t) 1 << i;
+    }
+
+    lcs_scan_ucs1(&pattern, s2, len2, &v);
+    return count_lcs(&pattern, &v);
+}
+
+static long common_length(const void *s1, size_t len1, const void *s2, size_t len2, int kind)
+{
+    struct lcs_pattern pattern = { 0 };
+    size_t mark;
+    long lcs;
+
+    /* The shorter string makes the pattern, so it spans the fewest words. */
+    if (len1 > len2) {
+        return common_length(s2, len2, s1, len1, kind);
+    }
+    if (len1 == 0) {
+        return 0;
+    }
+    if (len1 <= 64 && kind == JELLYFISH_UCS1) {
+        return lcs_length_short(s1, len1, s2, len2);
+    }
+
+    mark = scratch_mark();
+    lcs = build_pattern(&pattern, s1, len1, kind, true) < 0 ? -1 :
+          pattern_length(&pattern, s2, len2, kind);
+    scratch_release(mark);
+
+    return lcs;
+}
+
+long lcs_length_kind(const void *s1, size_t len1, const void *s2, size_t len2, int kind)
+{
+    STATS_SCOPE(STAT_LCS, (len1 + len2) * kind);
+
+    return common_length(s1, len1, s2, len2, kind);
+}
+
+long lcs_length(const char *s1, const char *s2)
+{
+    return lcs_length_kind(s1, strlen(s1), s2, strlen(s2), JELLYFISH_UCS1);
+}
+
+long indel_distance_kind(const void *s1, size_t len1, const void *s2, size_t len2, int kind)
+{
+    long lcs;
+    STATS_SCOPE(STAT_LCS, (len1 + len2) * kind);
+
+    lcs = common_length(s1, len1, s2, len2, kind);
+
+    return lcs < 0 ? -1 : (long) (len1 + len2) - 2 * lcs;
+}
+
+long indel_distance(const char *s1, const char *s2)
+{
+    return indel_distance_kind(s1, strlen(s1), s2, strlen(s2), JELLYFISH_UCS1);
+}
+
+/* 1 - indel_distance / (len1 + len2), the share of both strings' characters
+ * in the LCS.  Equal to 2 * lcs / (len1 + len2), so a length difference
+ * alone can rule out the cutoff before any scan.
+ */
+static double lcs_score(long lcs, size_t len1, size_t len2, double score_cutoff)
+{
+    double similarity;
+
+    if (lcs < 0) {
+        return NAN;
+    }
+    similarity = len1 + len2 ? 2.0 * lcs / (len1 + len2) : 1;
+    return similarity >= score_cutoff ? similarity : 0;
+}
+
+static bool lcs_cutoff_unreachable(size_t len1, size_t len2, double score_cutoff)
+{
+    return len1 + len2 && 2.0 * MIN(len1, len2) / (len1 + len2) < score_cutoff;
+}
+
+double lcs_similarity_kind(const void *s1, size_t len1, const void *s2, size_t len2,
+                           int kind, double score_cutoff)
+{
+    STATS_SCOPE(STAT_LCS, (len1 + len2) * kind);
+
+    if (lcs_cutoff_unreachable(len1, len2, score_cutoff)) {
+        return 0;
+    }
+    return lcs_score(common_length(s1, len1, s2, len2, kind), len1, len2, score_cutoff);
+}
+
+double lcs_similarity(const char *s1, const char *s2, double score_cutoff)
+{
+    return lcs_similarity_kind(s1, strlen(s1), s2, strlen(s2), JELLYFISH_UCS1, score_cutoff);
+}
+
+double lcs_pattern_similarity(const struct lcs_pattern *pattern, const void *str, size_t len,
+                              int kind, double score_cutoff)
+{
+    STATS_SCOPE(STAT_LCS, (pattern->len + len) * kind);
+
+    if (lcs_cutoff_unreachable(pattern->len, len, score_cutoff)) {
+        return 0;
+    }
+    return lcs_score(pattern_length(pattern, str, len, kind), pattern->len, len,
+                     score_cutoff);
+}
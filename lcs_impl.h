@@ -0,0 +1,102 @@
+/* Bit-parallel LCS and Levenshtein scans, included by lcs.c once per code unit width.  The
+ * includer defines JF_CHAR, the code unit type, and JF_NAME(name), which
+ * appends the width suffix (_ucs1, _ucs2, _ucs4) to name.
+ *
+ * For lcs_scan, v holds pattern->words words and is left with a zero bit
+ * for every pattern position in the LCS.
+ */
+
+static void JF_NAME(lcs_scan)(const struct lcs_pattern *pattern,
+                              const JF_CHAR *str, size_t len, uint64_t *v)
+{
+    const uint64_t *m;
+    uint64_t u, t, sum, carry;
+    size_t i, w;
+
+    if (pattern->words == 1) {
+        uint64_t v0 = ~(uint64_t) 0;
+
+        for (i = 0; i < len; i++) {
+            m = pattern_masks(pattern, str[i]);
+            if (m) {
+                u = v0 & m[0];
+                v0 = (v0 + u) | (v0 & ~m[0]);
+            }
+        }
+        v[0] = v0;
+        return;
+    }
+
+    for (w = 0; w < pattern->words; w++) {
+        v[w] = ~(uint64_t) 0;
+    }
+
+    for (i = 0; i < len; i++) {
+        m = pattern_masks(pattern, str[i]);
+        if (!m) {
+            continue;
+        }
+        carry = 0;
+        for (w = 0; w < pattern->words; w++) {
+            u = v[w] & m[w];
+            t = v[w] + carry;
+            carry = t < carry;
+            sum = t + u;
+            carry |= sum < u;
+            v[w] = sum | (v[w] & ~m[w]);
+        }
+    }
+}
+
+/* Myers' bit-parallel Levenshtein distance in Hyyrö's formulation, over
+ * the same masks: vp and vn hold the vertical +1 and -1 deltas of the
+ * current column, one bit per pattern position.  Across words the
+ * horizontal deltas of each word's top bit carry into the next, and the
+ * distance follows the deltas of the pattern's last position.  vp and vn
+ * hold pattern->words words each.
+ */
+static long JF_NAME(levenshtein_scan)(const struct lcs_pattern *pattern,
+                                      const JF_CHAR *str, size_t len,
+                                      uint64_t *vp, uint64_t *vn)
+{
+    const uint64_t last = (uint64_t) 1 << ((pattern->len - 1) % 64);
+    const uint64_t *m;
+    uint64_t x, d0, hp, hn, hp_carry, hn_carry, hp_next, hn_next, pm;
+    long distance = pattern->len;
+    size_t i, w;
+
+    for (w = 0; w < pattern->words; w++) {
+        vp[w] = ~(uint64_t) 0;
+        vn[w] = 0;
+    }
+
+    for (i = 0; i < len; i++) {
+        m = pattern_masks(pattern, str[i]);
+        hp_carry = 1;
+        hn_carry = 0;
+        for (w = 0; w < pattern->words; w++) {
+            pm = m ? m[w] : 0;
+            x = pm | hn_carry;
+            d0 = (((x & vp[w]) + vp[w]) ^ vp[w]) | x | vn[w];
+            hp = vn[w] | ~(d0 | vp[w]);
+            hn = d0 & vp[w];
+
+            if (w == pattern->words - 1) {
+                hp_next = (hp & last) != 0;
+                hn_next = (hn & last) != 0;
+            } else {
+                hp_next = hp >> 63;
+                hn_next = hn >> 63;
+            }
+            hp = (hp << 1) | hp_carry;
+            hn = (hn << 1) | hn_carry;
+            hp_carry = hp_next;
+            hn_carry = hn_next;
+
+            vp[w] = hn | ~(d0 | hp);
+            vn[w] = hp & d0;
+        }
+        distance += (long) hp_carry - (long) hn_carry;
+    }
+    return distance;
+}
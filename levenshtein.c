@@ -2,48 +2,128 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include "probes.h"
 
-int levenshtein_distance(const char *s1, const char *s2)
+/* The dynamic programming kernel has no hand-written vector version; each
+ * backend gets its own copy compiled for that instruction set instead, so
+ * the compiler can use the wider registers for the row updates.
+ */
+#define JF_CHAR char
+#define JF_NAME(name) name##_ucs1
+#include "levenshtein_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
+
+#define JF_CHAR uint16_t
+#define JF_NAME(name) name##_ucs2
+#include "levenshtein_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
+
+#define JF_CHAR uint32_t
+#define JF_NAME(name) name##_ucs4
+#include "levenshtein_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
+
+/* Levenshtein distance over code units of the given width (JELLYFISH_UCS1,
+ * 2 or 4); one byte strings go through the selected backend.
+ */
+int levenshtein_distance_kind(const void *s1, size_t len1, const void *s2, size_t len2, int kind)
 {
-    size_t s1_len = strlen(s1);
-    size_t s2_len = strlen(s2);
-    size_t rows = s1_len + 1;
-    size_t cols = s2_len + 1;
-    size_t i, j;
-
-    unsigned result;
-    unsigned d1, d2, d3;
-    unsigned *dist = malloc(rows * cols * sizeof(unsigned));
-    if (!dist) {
-        return -1;
-    }
+    int distance;
+    STATS_SCOPE(STAT_LEVENSHTEIN, (len1 + len2) * kind);
 
-    for (i = 0; i < rows; i++) {
-        dist[i * cols] = i;
+    JELLYFISH_PROBE2(levenshtein__entry, len1, len2);
+    switch (kind) {
+    case JELLYFISH_UCS2:
+        distance = levenshtein_kernel_ucs2(s1, len1, s2, len2);
+        break;
+    case JELLYFISH_UCS4:
+        distance = levenshtein_kernel_ucs4(s1, len1, s2, len2);
+        break;
+    default:
+        distance = jellyfish_backend->levenshtein(s1, len1, s2, len2);
+        break;
     }
+    JELLYFISH_PROBE3(levenshtein__return, len1, len2, distance);
+    return distance;
+}
 
+int levenshtein_distance(const char *s1, const char *s2)
+{
+    return levenshtein_distance_kind(s1, strlen(s1), s2, strlen(s2), JELLYFISH_UCS1);
+}
+
+double levenshtein_similarity_kind(const void *s1, size_t len1, const void *s2, size_t len2,
+                                   int kind, double score_cutoff)
+{
+    size_t longest = len1 > len2 ? len1 : len2;
+    long max = jellyfish_max_distance(longest, score_cutoff);
+    int distance;
+    double similarity;
+    STATS_SCOPE(STAT_LEVENSHTEIN, (len1 + len2) * kind);
 
-    for (j = 0; j < cols; j++) {
-        dist[j] = j;
+    if (longest == 0) {
+        return score_cutoff <= 1 ? 1 : 0;
+    }
+    if (max < 0) {
+        return 0;
     }
 
-    for (j = 1; j < cols; j++) {
-        for (i = 1; i < rows; i++) {
-            if (s1[i - 1] == s2[j - 1]) {
-                dist[(i * cols) + j] = dist[((i - 1) * cols) + (j - 1)];
-            } else {
-                d1 = dist[((i - 1) * cols) + j] + 1;
-                d2 = dist[(i * cols) + (j - 1)] + 1;
-                d3 = dist[((i - 1) * cols) + (j - 1)] + 1;
-
-                dist[(i * cols) + j] = MIN(d1, MIN(d2, d3));
-            }
-        }
+    switch (kind) {
+    case JELLYFISH_UCS2:
+        distance = levenshtein_bounded_kernel_ucs2(s1, len1, s2, len2, max);
+        break;
+    case JELLYFISH_UCS4:
+        distance = levenshtein_bounded_kernel_ucs4(s1, len1, s2, len2, max);
+        break;
+    default:
+        distance = levenshtein_bounded_kernel_ucs1(s1, len1, s2, len2, max);
+        break;
     }
 
-    result = dist[(cols * rows) - 1];
+    if (distance < 0) {
+        return NAN;
+    }
+    if (distance > max) {
+        return 0;
+    }
+    similarity = 1 - (double) distance / longest;
+    return similarity >= score_cutoff ? similarity : 0;
+}
 
-    free(dist);
+double levenshtein_similarity(const char *s1, const char *s2, double score_cutoff)
+{
+    return levenshtein_similarity_kind(s1, strlen(s1), s2, strlen(s2), JELLYFISH_UCS1,
+                                       score_cutoff);
+}
+
+int levenshtein_distance_generic(const char *s1, size_t len1, const char *s2, size_t len2)
+{
+    return levenshtein_kernel_ucs1(s1, len1, s2, len2);
+}
+
+#ifdef JELLYFISH_X86
+
+__attribute__((target("sse4.2,popcnt")))
+int levenshtein_distance_sse42(const char *s1, size_t len1, const char *s2, size_t len2)
+{
+    return levenshtein_kernel_ucs1(s1, len1, s2, len2);
+}
 
-    return result;
+__attribute__((target("avx2,popcnt")))
+int levenshtein_distance_avx2(const char *s1, size_t len1, const char *s2, size_t len2)
+{
+    return levenshtein_kernel_ucs1(s1, len1, s2, len2);
 }
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+int levenshtein_distance_avx512(const char *s1, size_t len1, const char *s2, size_t len2)
+{
+    return levenshtein_kernel_ucs1(s1, len1, s2, len2);
+}
+
+#endif
@@ -0,0 +1,115 @@
+/* Levenshtein kernel, included by levenshtein.c once per code unit width.
+ * The includer defines JF_CHAR, the code unit type, and JF_NAME(name), which
+ * appends the width suffix (_ucs1, _ucs2, _ucs4) to name.
+ */
+
+static inline __attribute__((always_inline))
+int JF_NAME(levenshtein_kernel)(const JF_CHAR *s1, size_t s1_len,
+                               const JF_CHAR *s2, size_t s2_len)
+{
+    size_t rows = s1_len + 1;
+    size_t cols = s2_len + 1;
+    size_t i, j;
+
+    unsigned result;
+    unsigned d1, d2, d3;
+    unsigned stack[SCRATCH_STACK / sizeof(unsigned)];
+    size_t mark = scratch_mark();
+    unsigned *dist = scratch_buffer(stack, sizeof(stack), rows * cols * sizeof(unsigned));
+    if (!dist) {
+        return -1;
+    }
+
+    for (i = 0; i < rows; i++) {
+        dist[i * cols] = i;
+    }
+
+
+    for (j = 0; j < cols; j++) {
+        dist[j] = j;
+    }
+
+    for (j = 1; j < cols; j++) {
+        for (i = 1; i < rows; i++) {
+            if (s1[i - 1] == s2[j - 1]) {
+                dist[(i * cols) + j] = dist[((i - 1) * cols) + (j - 1)];
+            } else {
+                d1 = dist[((i - 1) * cols) + j] + 1;
+                d2 = dist[(i * cols) + (j - 1)] + 1;
+                d3 = dist[((i - 1) * cols) + (j - 1)] + 1;
+
+                dist[(i * cols) + j] = MIN(d1, MIN(d2, d3));
+            }
+        }
+    }
+
+    result = dist[(cols * rows) - 1];
+
+    scratch_release(mark);
+
+    return result;
+}
+
+/* Levenshtein distance if it is at most max, otherwise max + 1.  Paths
+ * within max edits stay in the diagonal band |i - j| <= max, so only that
+ * band is computed, two rows at a time, and the search stops as soon as a
+ * whole row exceeds max.
+ */
+static int JF_NAME(levenshtein_bounded_kernel)(const JF_CHAR *s1, size_t s1_len,
+                                               const JF_CHAR *s2, size_t s2_len, size_t max)
+{
+    size_t i, j, lo, hi, d, row_min;
+    size_t big, result;
+    size_t *rows, *prev, *cur, *tmp;
+    size_t stack[SCRATCH_STACK / sizeof(size_t)];
+    size_t mark = scratch_mark();
+
+    /* No distance exceeds the longer length. */
+    max = MIN(max, s1_len > s2_len ? s1_len : s2_len);
+    big = max + 1;
+    if ((s1_len > s2_len ? s1_len - s2_len : s2_len - s1_len) > max) {
+        return big;
+    }
+
+    rows = scratch_buffer(stack, sizeof(stack), 2 * (s2_len + 1) * sizeof(size_t));
+    if (!rows) {
+        return -1;
+    }
+    prev = rows;
+    cur = rows + s2_len + 1;
+
+    for (j = 0; j <= s2_len; j++) {
+        prev[j] = MIN(j, big);
+    }
+
+    for (i = 1; i <= s1_len; i++) {
+        lo = i > max ? i - max : 1;
+        hi = MIN(s2_len, i + max);
+
+        cur[lo - 1] = lo == 1 ? MIN(i, big) : big;
+        row_min = cur[lo - 1];
+        for (j = lo; j <= hi; j++) {
+            d = prev[j - 1] + (s1[i - 1] != s2[j - 1]);
+            d = MIN(d, MIN(prev[j], cur[j - 1]) + 1);
+            cur[j] = MIN(d, big);
+            row_min = MIN(row_min, cur[j]);
+        }
+        if (hi < s2_len) {
+            cur[hi + 1] = big;
+        }
+
+        if (row_min > max) {
+            scratch_release(mark);
+            return big;
+        }
+
+        tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+
+    result = prev[s2_len];
+    scratch_release(mark);
+
+    return result;
+}
@@ -0,0 +1,1035 @@
+/* Record linkage between two CSV files.
+ *
+ *   ./jellyfish_link [options] left.csv right.csv > pairs.csv
+ *
+ *   -a COLUMNS   key columns of left.csv, header names or 1-based numbers,
+ *                comma separated (default 1)
+ *   -b COLUMNS   key columns of right.csv (default those of -a)
+ *   -k BLOCKING  soundex, metaphone, nysiis or qgram (default nysiis)
+ *   -q SHARE     for qgram blocking, the share of a right key's trigrams a
+ *                left key must have to be a candidate (default 0.5)
+ *   -w WEIGHTS   the score, as jaro_winkler=W,levenshtein=W,match_rating=W
+ *                (default jaro_winkler=1)
+ *   -t CUTOFF    the least score written (default 0.9)
+ *   -j THREADS   scoring threads (default one per CPU)
+ *   -d DELIM     the field delimiter (default ,)
+ *
+ * Both files start with a header.  A record's key is its key columns
+ * joined by spaces, upper cased, with punctuation removed and whitespace
+ * collapsed; records with empty keys are skipped.  Candidates are the left
+ * records with the right one's phonetic code, or with enough of its
+ * trigrams, and are scored by the weighted mean of their Jaro-Winkler
+ * similarity, Levenshtein similarity and match rating comparison (1 for a
+ * match).  Pairs scoring at least the cutoff are written as
+ *
+ *     left_row,right_row,score,left_key,right_key
+ *
+ * rows counting data records from 1, in right file order.
+ *
+ * The left file is indexed in memory; the right file is streamed through
+ * a reader, a blocker and the scoring threads, in batches passed along
+ * bounded queues, and the pages it was read from are dropped as it goes,
+ * so memory does not grow with its length.  Put the larger file on the
+ * right.  Build with "make jellyfish_link".
+ */
+#define _DEFAULT_SOURCE
+#include <ctype.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "jellyfish.h"
+
+#define MAX_KEY_COLUMNS 16
+#define MAX_FIELDS 1024
+
+/* Right records per batch, and batches each queue holds. */
+#define BATCH_ROWS 256
+#define QUEUE_DEPTH 16
+
+/* The reader drops the pages behind it every this many bytes. */
+#define DROP_BYTES (8 << 20)
+
+enum blocking {
+    BLOCK_BY_SOUNDEX,
+    BLOCK_BY_METAPHONE,
+    BLOCK_BY_NYSIIS,
+    BLOCK_BY_QGRAM
+};
+
+struct buffer {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+struct mapped_file {
+    const char *path;
+    const char *data;
+    size_t size;
+};
+
+struct csv {
+    const char *p;
+    const char *end;
+    char delim;
+};
+
+struct csv_field {
+    const char *start;
+    size_t len;
+};
+
+struct key_columns {
+    size_t index[MAX_KEY_COLUMNS];
+    size_t n;
+};
+
+/* The left file's keys and blocking index.  Phonetic blocking sorts the
+ * rows by code, so a block is a range of block_rows; q-gram blocking keeps
+ * a posting list of rows per hashed trigram.
+ */
+struct left_index {
+    size_t n;
+    struct buffer text;
+    size_t *offset;
+    size_t *row_number;
+    char (*codex)[7];
+    const char **block_codes;
+    size_t *block_rows;
+    struct buffer codes;
+    size_t gram_slots;
+    size_t *post_start;
+    size_t *postings;
+};
+
+struct batch {
+    size_t seq;                     /* batches are written in this order */
+    size_t n;
+    size_t row[BATCH_ROWS];
+    size_t offset[BATCH_ROWS];
+    struct buffer text;
+    const size_t *cands[BATCH_ROWS];
+    size_t n_cands[BATCH_ROWS];
+    size_t *owned;                  /* q-gram candidates, owned by the batch */
+    size_t owned_len;
+    size_t owned_cap;
+    struct buffer out;
+};
+
+struct queue {
+    struct batch *items[QUEUE_DEPTH];
+    size_t head;
+    size_t count;
+    bool closed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+};
+
+struct linkage {
+    struct mapped_file right;
+    struct key_columns right_columns;
+    char delim;
+    enum blocking blocking;
+    double share;
+    double w_jaro_winkler;
+    double w_levenshtein;
+    double w_match_rating;
+    double cutoff;
+    struct left_index left;
+    struct queue parsed;
+    struct queue blocked;
+    pthread_mutex_t out_lock;
+    pthread_cond_t out_turn;
+    size_t next_seq;
+};
+
+static void out_of_memory(void)
+{
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+}
+
+static void* checked(void *p)
+{
+    if (!p) {
+        out_of_memory();
+    }
+    return p;
+}
+
+static void buffer_reserve(struct buffer *buf, size_t extra)
+{
+    size_t cap;
+
+    if (buf->len + extra <= buf->cap) {
+        return;
+    }
+    for (cap = MAX(buf->cap, 256); cap < buf->len + extra; cap *= 2) {
+    }
+    buf->data = checked(realloc(buf->data, cap));
+    buf->cap = cap;
+}
+
+static void buffer_append(struct buffer *buf, const char *s, size_t len)
+{
+    buffer_reserve(buf, len);
+    memcpy(buf->data + buf->len, s, len);
+    buf->len += len;
+}
+
+static int map_file(struct mapped_file *file, const char *path)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    file->path = path;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    file->size = st.st_size;
+    file->data = "";
+    if (file->size) {
+        file->data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (file->data == MAP_FAILED) {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+        madvise((void *) file->data, file->size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    return 0;
+}
+
+static void unmap_file(struct mapped_file *file)
+{
+    if (file->size) {
+        munmap((void *) file->data, file->size);
+    }
+}
+
+/* Split the next record into fields, keeping at most max of them, and
+ * return how many it has, or -1 at the end of the input.  Blank lines are
+ * skipped.  Quoted fields keep their quotes, doubled ones included, which
+ * normalization drops along with the other punctuation.
+ */
+static long csv_record(struct csv *csv, struct csv_field *fields, size_t max)
+{
+    const char *p = csv->p, *end = csv->end, *start;
+    size_t n = 0;
+
+    while (p < end && (*p == '\n' || *p == '\r')) {
+        p++;
+    }
+    if (p == end) {
+        csv->p = p;
+        return -1;
+    }
+
+    for (;;) {
+        start = p;
+        if (p < end && *p == '"') {
+            for (p++; p < end; p++) {
+                if (*p == '"') {
+                    if (p + 1 < end && p[1] == '"') {
+                        p++;
+                    } else {
+                        break;
+                    }
+                }
+            }
+        }
+        while (p < end && *p != csv->delim && *p != '\n') {
+            p++;
+        }
+        if (n < max) {
+            fields[n].start = start;
+            fields[n].len = p - start;
+            if (fields[n].len && (p == end || *p == '\n') && p[-1] == '\r') {
+                fields[n].len--;
+            }
+        }
+        n++;
+        if (p == end || *p == '\n') {
+            break;
+        }
+        p++;
+    }
+
+    csv->p = p < end ? p + 1 : p;
+    return n;
+}
+
+/* A header field's name, without quotes. */
+static void field_name(const struct csv_field *field, char *out, size_t size)
+{
+    const char *s = field->start, *end = s + field->len;
+    size_t n = 0;
+
+    if (s < end && *s == '"') {
+        s++;
+        if (end > s && end[-1] == '"') {
+            end--;
+        }
+    }
+    for (; s < end && n + 1 < size; s++) {
+        if (*s == '"' && s + 1 < end && s[1] == '"') {
+            s++;
+        }
+        out[n++] = *s;
+    }
+    out[n] = '\0';
+}
+
+/* Resolve spec, comma separated names or 1-based numbers, against the
+ * header.  Returns -1 after reporting an unknown column.
+ */
+static int parse_columns(const char *spec, const struct csv_field *header, size_t n_header,
+                         const char *path, struct key_columns *columns)
+{
+    char name[256], field[256];
+    const char *p = spec, *comma;
+    size_t len, i;
+    char *end;
+    long number;
+
+    columns->n = 0;
+    for (;;) {
+        comma = strchr(p, ',');
+        len = comma ? (size_t) (comma - p) : strlen(p);
+        if (len >= sizeof(name) || columns->n == MAX_KEY_COLUMNS) {
+            fprintf(stderr, "%s: too many or too long key columns\n", path);
+            return -1;
+        }
+        memcpy(name, p, len);
+        name[len] = '\0';
+
+        number = strtol(name, &end, 10);
+        if (len && *end == '\0') {
+            if (number < 1) {
+                fprintf(stderr, "%s: bad column number %s\n", path, name);
+                return -1;
+            }
+            columns->index[columns->n++] = number - 1;
+        } else {
+            for (i = 0; i < MIN(n_header, MAX_FIELDS); i++) {
+                field_name(&header[i], field, sizeof(field));
+                if (strcmp(field, name) == 0) {
+                    break;
+                }
+            }
+            if (i == MIN(n_header, MAX_FIELDS)) {
+                fprintf(stderr, "%s: no column named '%s'\n", path, name);
+                return -1;
+            }
+            columns->index[columns->n++] = i;
+        }
+
+        if (!comma) {
+            return 0;
+        }
+        p = comma + 1;
+    }
+}
+
+/* Append the record's key to buf, NUL terminated, and return its length:
+ * the key columns upper cased and joined, ASCII punctuation removed and
+ * whitespace collapsed to single spaces.  Bytes of multibyte characters
+ * are kept as they are.
+ */
+static size_t normalize_key(const struct csv_field *fields, size_t n_fields,
+                            const struct key_columns *columns, struct buffer *buf)
+{
+    size_t start = buf->len, c, i;
+    const struct csv_field *field;
+    unsigned char ch;
+    bool space = false;
+
+    for (c = 0; c < columns->n; c++) {
+        if (columns->index[c] >= MIN(n_fields, MAX_FIELDS)) {
+            continue;
+        }
+        field = &fields[columns->index[c]];
+        buffer_reserve(buf, field->len + 2);
+        space = true;
+        for (i = 0; i < field->len; i++) {
+            ch = field->start[i];
+            if (ch >= 0x80 || isalnum(ch)) {
+                if (space && buf->len > start) {
+                    buf->data[buf->len++] = ' ';
+                }
+                buf->data[buf->len++] = ch < 0x80 ? toupper(ch) : ch;
+                space = false;
+            } else if (isspace(ch)) {
+                space = true;
+            }
+        }
+    }
+    buffer_reserve(buf, 1);
+    buf->data[buf->len++] = '\0';
+    return buf->len - start - 1;
+}
+
+static char* phonetic_code(enum blocking blocking, const char *key)
+{
+    switch (blocking) {
+    case BLOCK_BY_SOUNDEX:
+        return soundex(key);
+    case BLOCK_BY_METAPHONE:
+        return metaphone(key);
+    default:
+        return nysiis(key);
+    }
+}
+
+static inline uint32_t trigram_slot(const char *key, size_t k, size_t len, size_t slots)
+{
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = k; i < k + MIN(len, 3); i++) {
+        h = (h ^ (unsigned char) key[i]) * 16777619u;
+    }
+    return h & (slots - 1);
+}
+
+static inline size_t trigram_count(size_t len)
+{
+    return len >= 3 ? len - 2 : 1;
+}
+
+struct keyed_code {
+    const char *code;
+    size_t row;
+};
+
+static int compare_codes(const void *a, const void *b)
+{
+    const struct keyed_code *x = a, *y = b;
+    int cmp = strcmp(x->code, y->code);
+
+    if (cmp) {
+        return cmp;
+    }
+    return x->row < y->row ? -1 : x->row > y->row;
+}
+
+static void index_phonetic(struct linkage *link)
+{
+    struct left_index *left = &link->left;
+    struct keyed_code *keyed = checked(malloc(MAX(left->n, 1) * sizeof(struct keyed_code)));
+    size_t *code_offset = checked(malloc(MAX(left->n, 1) * sizeof(size_t)));
+    size_t r;
+    char *code;
+
+    for (r = 0; r < left->n; r++) {
+        code = checked(phonetic_code(link->blocking, left->text.data + left->offset[r]));
+        code_offset[r] = left->codes.len;
+        buffer_append(&left->codes, code, strlen(code) + 1);
+        free(code);
+    }
+    for (r = 0; r < left->n; r++) {
+        keyed[r].code = left->codes.data + code_offset[r];
+        keyed[r].row = r;
+    }
+    qsort(keyed, left->n, sizeof(struct keyed_code), compare_codes);
+
+    left->block_codes = checked(malloc(MAX(left->n, 1) * sizeof(const char *)));
+    left->block_rows = checked(malloc(MAX(left->n, 1) * sizeof(size_t)));
+    for (r = 0; r < left->n; r++) {
+        left->block_codes[r] = keyed[r].code;
+        left->block_rows[r] = keyed[r].row;
+    }
+    free(keyed);
+    free(code_offset);
+}
+
+static void index_qgrams(struct left_index *left)
+{
+    size_t r, k, len, total = 0, slots;
+    const char *key;
+
+    for (r = 0; r < left->n; r++) {
+        total += trigram_count(strlen(left->text.data + left->offset[r]));
+    }
+    for (slots = 1024; slots < total; slots *= 2) {
+    }
+    left->gram_slots = slots;
+    left->post_start = checked(calloc(slots + 1, sizeof(size_t)));
+    left->postings = checked(malloc(MAX(total, 1) * sizeof(size_t)));
+
+    for (r = 0; r < left->n; r++) {
+        key = left->text.data + left->offset[r];
+        len = strlen(key);
+        for (k = 0; k < trigram_count(len); k++) {
+            left->post_start[trigram_slot(key, k, len, slots) + 1]++;
+        }
+    }
+    for (k = 0; k < slots; k++) {
+        left->post_start[k + 1] += left->post_start[k];
+    }
+    /* Filled in row order, so each list is sorted; a row repeating a
+     * trigram is listed once per repeat.
+     */
+    for (r = 0; r < left->n; r++) {
+        key = left->text.data + left->offset[r];
+        len = strlen(key);
+        for (k = 0; k < trigram_count(len); k++) {
+            left->postings[left->post_start[trigram_slot(key, k, len, slots)]++] = r;
+        }
+    }
+    for (k = slots; k > 0; k--) {
+        left->post_start[k] = left->post_start[k - 1];
+    }
+    left->post_start[0] = 0;
+}
+
+/* Read the left file's keys, skipping empty ones, and index them. */
+static int index_left(struct linkage *link, const struct mapped_file *file, const char *spec)
+{
+    struct left_index *left = &link->left;
+    struct csv csv = { file->data, file->data + file->size, link->delim };
+    struct csv_field fields[MAX_FIELDS];
+    struct key_columns columns;
+    size_t cap = 1024, record = 0, start;
+    long n;
+
+    n = csv_record(&csv, fields, MAX_FIELDS);
+    if (n < 0 || parse_columns(spec, fields, n, file->path, &columns) < 0) {
+        if (n < 0) {
+            fprintf(stderr, "%s: no header\n", file->path);
+        }
+        return -1;
+    }
+
+    left->offset = checked(malloc(cap * sizeof(size_t)));
+    left->row_number = checked(malloc(cap * sizeof(size_t)));
+    while ((n = csv_record(&csv, fields, MAX_FIELDS)) >= 0) {
+        record++;
+        start = left->text.len;
+        if (normalize_key(fields, n, &columns, &left->text) == 0) {
+            left->text.len = start;
+            continue;
+        }
+        if (left->n == cap) {
+            cap *= 2;
+            left->offset = checked(realloc(left->offset, cap * sizeof(size_t)));
+            left->row_number = checked(realloc(left->row_number, cap * sizeof(size_t)));
+        }
+        left->offset[left->n] = start;
+        left->row_number[left->n++] = record;
+    }
+
+    if (link->w_match_rating > 0) {
+        left->codex = checked(malloc(MAX(left->n, 1) * sizeof(*left->codex)));
+        for (start = 0; start < left->n; start++) {
+            char *codex = checked(match_rating_codex(left->text.data + left->offset[start]));
+            memcpy(left->codex[start], codex, strlen(codex) + 1);
+            free(codex);
+        }
+    }
+
+    if (link->blocking == BLOCK_BY_QGRAM) {
+        index_qgrams(left);
+    } else {
+        index_phonetic(link);
+    }
+    return 0;
+}
+
+static void queue_init(struct queue *q)
+{
+    memset(q, 0, sizeof(*q));
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+}
+
+static void queue_push(struct queue *q, struct batch *batch)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->count == QUEUE_DEPTH) {
+        pthread_cond_wait(&q->not_full, &q->lock);
+    }
+    q->items[(q->head + q->count++) % QUEUE_DEPTH] = batch;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* The next batch, or NULL once the queue is closed and empty. */
+static struct batch* queue_pop(struct queue *q)
+{
+    struct batch *batch = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->closed) {
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    }
+    if (q->count) {
+        batch = q->items[q->head];
+        q->head = (q->head + 1) % QUEUE_DEPTH;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return batch;
+}
+
+static void queue_close(struct queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->closed = true;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void free_batch(struct batch *batch)
+{
+    free(batch->text.data);
+    free(batch->owned);
+    free(batch->out.data);
+    free(batch);
+}
+
+/* Parse the right file into batches of keys. */
+static void* read_right(void *arg)
+{
+    struct linkage *link = arg;
+    const struct mapped_file *file = &link->right;
+    struct csv csv = { file->data, file->data + file->size, link->delim };
+    struct csv_field fields[MAX_FIELDS];
+    struct batch *batch = NULL;
+    size_t record = 0, seq = 0, start, dropped = 0, done;
+    long page = sysconf(_SC_PAGESIZE), n;
+
+    csv_record(&csv, fields, MAX_FIELDS);
+    while ((n = csv_record(&csv, fields, MAX_FIELDS)) >= 0) {
+        record++;
+        if (!batch) {
+            batch = checked(calloc(1, sizeof(struct batch)));
+            batch->seq = seq++;
+        }
+        start = batch->text.len;
+        if (normalize_key(fields, n, &link->right_columns, &batch->text) == 0) {
+            batch->text.len = start;
+            continue;
+        }
+        batch->offset[batch->n] = start;
+        batch->row[batch->n++] = record;
+        if (batch->n == BATCH_ROWS) {
+            queue_push(&link->parsed, batch);
+            batch = NULL;
+        }
+
+        /* Keys are copied out, so the pages read so far can go. */
+        done = (csv.p - file->data) / page * page;
+        if (done - dropped >= DROP_BYTES) {
+            madvise((void *) (file->data + dropped), done - dropped, MADV_DONTNEED);
+            dropped = done;
+        }
+    }
+    if (batch) {
+        queue_push(&link->parsed, batch);
+    }
+    queue_close(&link->parsed);
+    return NULL;
+}
+
+/* The phonetic block of key: the rows whose code equals its code. */
+static void phonetic_candidates(const struct linkage *link, const char *key,
+                                const size_t **cands, size_t *n_cands)
+{
+    const struct left_index *left = &link->left;
+    char *code = checked(phonetic_code(link->blocking, key));
+    size_t lo = 0, hi = left->n, mid, end;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (strcmp(left->block_codes[mid], code) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (end = lo; end < left->n && strcmp(left->block_codes[end], code) == 0; end++) {
+    }
+    free(code);
+
+    *cands = left->block_rows + lo;
+    *n_cands = end - lo;
+}
+
+static int compare_slots(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Append to the batch the left rows sharing at least the linkage's share
+ * of key's distinct trigrams.  counts is zero for every left row on entry
+ * and on return.
+ */
+static void qgram_candidates(const struct linkage *link, const char *key, struct batch *batch,
+                             uint32_t *counts, struct buffer *slots_buf)
+{
+    const struct left_index *left = &link->left;
+    size_t len = strlen(key), grams = trigram_count(len), distinct, need, k, p, r;
+    size_t first = batch->owned_len;
+    uint32_t *slots;
+
+    buffer_reserve(slots_buf, grams * sizeof(uint32_t));
+    slots = (uint32_t *) slots_buf->data;
+    for (k = 0; k < grams; k++) {
+        slots[k] = trigram_slot(key, k, len, left->gram_slots);
+    }
+    qsort(slots, grams, sizeof(uint32_t), compare_slots);
+    for (k = 0, distinct = 0; k < grams; k++) {
+        if (k == 0 || slots[k] != slots[distinct - 1]) {
+            slots[distinct++] = slots[k];
+        }
+    }
+    need = MAX(1, (size_t) ceil(link->share * distinct - 1e-9));
+
+    /* Rows are counted once per shared slot; the first count of a row
+     * lists it, and the rows short of need are dropped afterwards.
+     */
+    for (k = 0; k < distinct; k++) {
+        for (p = left->post_start[slots[k]]; p < left->post_start[slots[k] + 1]; p++) {
+            r = left->postings[p];
+            if (p > left->post_start[slots[k]] && left->postings[p - 1] == r) {
+                continue;
+            }
+            if (counts[r]++ == 0) {
+                if (batch->owned_len == batch->owned_cap) {
+                    batch->owned_cap = MAX(1024, 2 * batch->owned_cap);
+                    batch->owned = checked(realloc(batch->owned,
+                                                   batch->owned_cap * sizeof(size_t)));
+                }
+                batch->owned[batch->owned_len++] = r;
+            }
+        }
+    }
+    for (p = k = first; p < batch->owned_len; p++) {
+        r = batch->owned[p];
+        if (counts[r] >= need) {
+            batch->owned[k++] = r;
+        }
+        counts[r] = 0;
+    }
+    batch->owned_len = k;
+}
+
+/* Find each right key's candidates. */
+static void* block_right(void *arg)
+{
+    struct linkage *link = arg;
+    struct batch *batch;
+    struct buffer slots = { NULL, 0, 0 };
+    uint32_t *counts = NULL;
+    size_t i, start[BATCH_ROWS];
+
+    if (link->blocking == BLOCK_BY_QGRAM) {
+        counts = checked(calloc(MAX(link->left.n, 1), sizeof(uint32_t)));
+    }
+    while ((batch = queue_pop(&link->parsed))) {
+        for (i = 0; i < batch->n; i++) {
+            if (counts) {
+                start[i] = batch->owned_len;
+                qgram_candidates(link, batch->text.data + batch->offset[i], batch, counts,
+                                 &slots);
+                batch->n_cands[i] = batch->owned_len - start[i];
+            } else {
+                phonetic_candidates(link, batch->text.data + batch->offset[i],
+                                    &batch->cands[i], &batch->n_cands[i]);
+            }
+        }
+        /* owned only stops moving once the whole batch is blocked. */
+        for (i = 0; counts && i < batch->n; i++) {
+            batch->cands[i] = batch->owned + start[i];
+        }
+        queue_push(&link->blocked, batch);
+    }
+    queue_close(&link->blocked);
+    free(counts);
+    free(slots.data);
+    return NULL;
+}
+
+/* The weighted score of a pair, or -1 once it cannot reach the cutoff.
+ * The cheap match rating goes first, and Levenshtein last, with the cutoff
+ * left for it, so hopeless pairs stop early.
+ */
+static double score_pair(const struct linkage *link, size_t left_row, const char *key,
+                         const char *codex)
+{
+    const struct left_index *left = &link->left;
+    const char *left_key = left->text.data + left->offset[left_row];
+    double total = link->w_jaro_winkler + link->w_levenshtein + link->w_match_rating;
+    double need = link->cutoff * total, rest = total, score = 0, s;
+
+    if (link->w_match_rating > 0) {
+        score += link->w_match_rating * (match_rating_compare_codex(left->codex[left_row],
+                                                                    codex) > 0);
+        rest -= link->w_match_rating;
+        if (score + rest < need - 1e-9) {
+            return -1;
+        }
+    }
+    if (link->w_jaro_winkler > 0) {
+        score += link->w_jaro_winkler * jaro_winkler(left_key, key, false);
+        rest -= link->w_jaro_winkler;
+        if (score + rest < need - 1e-9) {
+            return -1;
+        }
+    }
+    if (link->w_levenshtein > 0) {
+        s = levenshtein_similarity(left_key, key, (need - score) / link->w_levenshtein - 1e-9);
+        if (isnan(s)) {
+            out_of_memory();
+        }
+        score += link->w_levenshtein * s;
+    }
+    return score / total;
+}
+
+/* Score the candidates, then write the batch's pairs once every earlier
+ * batch has been written.
+ */
+static void* score_right(void *arg)
+{
+    struct linkage *link = arg;
+    const struct left_index *left = &link->left;
+    struct batch *batch;
+    char line[128], *codex = NULL;
+    const char *key, *left_key;
+    double score;
+    size_t i, c;
+    int len;
+
+    while ((batch = queue_pop(&link->blocked))) {
+        for (i = 0; i < batch->n; i++) {
+            key = batch->text.data + batch->offset[i];
+            if (link->w_match_rating > 0) {
+                codex = checked(match_rating_codex(key));
+            }
+            for (c = 0; c < batch->n_cands[i]; c++) {
+                score = score_pair(link, batch->cands[i][c], key, codex);
+                if (score < link->cutoff - 1e-9) {
+                    continue;
+                }
+                left_key = left->text.data + left->offset[batch->cands[i][c]];
+                len = snprintf(line, sizeof(line), "%zu,%zu,%.6f,",
+                               left->row_number[batch->cands[i][c]], batch->row[i], score);
+                buffer_append(&batch->out, line, len);
+                buffer_append(&batch->out, left_key, strlen(left_key));
+                buffer_append(&batch->out, ",", 1);
+                buffer_append(&batch->out, key, strlen(key));
+                buffer_append(&batch->out, "\n", 1);
+            }
+            free(codex);
+            codex = NULL;
+        }
+
+        pthread_mutex_lock(&link->out_lock);
+        while (link->next_seq != batch->seq) {
+            pthread_cond_wait(&link->out_turn, &link->out_lock);
+        }
+        fwrite(batch->out.data, 1, batch->out.len, stdout);
+        link->next_seq++;
+        pthread_cond_broadcast(&link->out_turn);
+        pthread_mutex_unlock(&link->out_lock);
+
+        free_batch(batch);
+    }
+    return NULL;
+}
+
+/* Parse -w: comma separated name=weight pairs. */
+static int parse_weights(struct linkage *link, const char *spec)
+{
+    const char *p = spec;
+    char *end;
+    double *weight;
+    size_t len;
+
+    link->w_jaro_winkler = link->w_levenshtein = link->w_match_rating = 0;
+    for (;;) {
+        len = strcspn(p, "=");
+        if (len == strlen("jaro_winkler") && strncmp(p, "jaro_winkler", len) == 0) {
+            weight = &link->w_jaro_winkler;
+        } else if (len == strlen("levenshtein") && strncmp(p, "levenshtein", len) == 0) {
+            weight = &link->w_levenshtein;
+        } else if (len == strlen("match_rating") && strncmp(p, "match_rating", len) == 0) {
+            weight = &link->w_match_rating;
+        } else {
+            return -1;
+        }
+        if (p[len] != '=') {
+            return -1;
+        }
+        *weight = strtod(p + len + 1, &end);
+        if (end == p + len + 1 || *weight < 0 || (*end && *end != ',')) {
+            return -1;
+        }
+        if (!*end) {
+            break;
+        }
+        p = end + 1;
+    }
+    return link->w_jaro_winkler + link->w_levenshtein + link->w_match_rating > 0 ? 0 : -1;
+}
+
+static int usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-a columns] [-b columns] [-k soundex|metaphone|nysiis|qgram] "
+            "[-q share] [-w weights] [-t cutoff] [-j threads] [-d delim] left.csv right.csv\n",
+            prog);
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    static struct linkage link;
+    struct mapped_file left_file;
+    struct csv_field fields[MAX_FIELDS];
+    struct csv csv;
+    const char *left_spec = "1", *right_spec = NULL;
+    size_t threads = 0, t;
+    pthread_t reader, blocker, *scorers;
+    long n;
+    int opt;
+
+    link.delim = ',';
+    link.blocking = BLOCK_BY_NYSIIS;
+    link.share = 0.5;
+    link.w_jaro_winkler = 1;
+    link.cutoff = 0.9;
+
+    while ((opt = getopt(argc, argv, "a:b:k:q:w:t:j:d:")) != -1) {
+        switch (opt) {
+        case 'a':
+            left_spec = optarg;
+            break;
+        case 'b':
+            right_spec = optarg;
+            break;
+        case 'k':
+            if (strcmp(optarg, "soundex") == 0) {
+                link.blocking = BLOCK_BY_SOUNDEX;
+            } else if (strcmp(optarg, "metaphone") == 0) {
+                link.blocking = BLOCK_BY_METAPHONE;
+            } else if (strcmp(optarg, "nysiis") == 0) {
+                link.blocking = BLOCK_BY_NYSIIS;
+            } else if (strcmp(optarg, "qgram") == 0) {
+                link.blocking = BLOCK_BY_QGRAM;
+            } else {
+                return usage(argv[0]);
+            }
+            break;
+        case 'q':
+            link.share = atof(optarg);
+            break;
+        case 'w':
+            if (parse_weights(&link, optarg) < 0) {
+                fprintf(stderr, "bad weights '%s'\n", optarg);
+                return 2;
+            }
+            break;
+        case 't':
+            link.cutoff = atof(optarg);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'd':
+            if (strlen(optarg) != 1 || *optarg == '"' || *optarg == '\n') {
+                return usage(argv[0]);
+            }
+            link.delim = *optarg;
+            break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2) {
+        return usage(argv[0]);
+    }
+    if (threads == 0) {
+        threads = jellyfish_default_threads();
+    }
+
+    if (jellyfish_init_backend(getenv("JELLYFISH_BACKEND")) != 0) {
+        fprintf(stderr, "JELLYFISH_BACKEND is unknown or unsupported by this CPU\n");
+        return 1;
+    }
+
+    if (map_file(&left_file, argv[optind]) < 0 || map_file(&link.right, argv[optind + 1]) < 0) {
+        return 1;
+    }
+    if (index_left(&link, &left_file, left_spec) < 0) {
+        return 1;
+    }
+    unmap_file(&left_file);
+
+    csv.p = link.right.data;
+    csv.end = link.right.data + link.right.size;
+    csv.delim = link.delim;
+    n = csv_record(&csv, fields, MAX_FIELDS);
+    if (n < 0) {
+        fprintf(stderr, "%s: no header\n", link.right.path);
+        return 1;
+    }
+    if (parse_columns(right_spec ? right_spec : left_spec, fields, n, link.right.path,
+                      &link.right_columns) < 0) {
+        return 1;
+    }
+
+    printf("left_row,right_row,score,left_key,right_key\n");
+
+    queue_init(&link.parsed);
+    queue_init(&link.blocked);
+    pthread_mutex_init(&link.out_lock, NULL);
+    pthread_cond_init(&link.out_turn, NULL);
+    scorers = checked(malloc(threads * sizeof(pthread_t)));
+    if (pthread_create(&reader, NULL, read_right, &link) != 0 ||
+        pthread_create(&blocker, NULL, block_right, &link) != 0) {
+        fprintf(stderr, "cannot start threads\n");
+        return 1;
+    }
+    for (t = 0; t < threads; t++) {
+        if (pthread_create(&scorers[t], NULL, score_right, &link) != 0) {
+            break;
+        }
+    }
+    if (t == 0) {
+        fprintf(stderr, "cannot start threads\n");
+        return 1;
+    }
+    threads = t;
+
+    pthread_join(reader, NULL);
+    pthread_join(blocker, NULL);
+    for (t = 0; t < threads; t++) {
+        pthread_join(scorers[t], NULL);
+    }
+    free(scorers);
+    unmap_file(&link.right);
+
+    if (fflush(stdout) != 0) {
+        perror("stdout");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <ctype.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "jellyfish.h"
+#include "probes.h"
+
+/* Per-word diagnostics are only printed by the demo build
+ * (-DJELLYFISH_VERBOSE_MATCHES); library and benchmark callers stay quiet.
+ */
+#ifdef JELLYFISH_VERBOSE_MATCHES
+#define VERBOSE(...) printf(__VA_ARGS__)
+#else
+#define VERBOSE(...) ((void) 0)
+#endif
+
+
+static char* _to_lower(const char* inStr)
+{
+    if (!inStr)
+    {
+        return NULL;
+    }
+    size_t len = strlen(inStr);
+    char* newStr = scratch_alloc(len + 1);
+    if (!newStr)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        char lowerChar = tolower(inStr[i]);
+        newStr[i] = lowerChar;
+    }
+    newStr[len] = '\0';
+    return newStr;
+}
+
+
+/* The lowered target and the word buffer are scratch memory, released by
+ * get_matches.
+ */
+static int* find_matches(const char* long_desc, const char* inTarget, double cutoff)
+{
+    struct word_iter it;
+    struct token_span span;
+
+    //Start by making the target word lower-case if it isn't already.
+    char* target = _to_lower(inTarget);
+    if (!target)
+    {
+        return (int *) OUT_OF_RAM;
+    }
+
+    //Words are split on runs of non-word characters, as with the regex \W+.
+    size_t endPos = strlen(long_desc);
+    int curWordIndex = 0; //The current word index.
+    char* word = scratch_alloc(endPos + 1);
+    if (!word)
+    {
+        return (int *) OUT_OF_RAM;
+    }
+
+    //Allocate an array of indexes where high-scoring words can be found.
+    int* indexesAboveCutoff = (int *) malloc(MAX_MATCHES * sizeof(int)); //Array to hold indexes of matches
+    if (!indexesAboveCutoff)
+    {
+        return (int *) OUT_OF_RAM;
+    }
+    memset(indexesAboveCutoff, UINT8_MAX, MAX_MATCHES * sizeof(int));
+    int numWordsAboveCutoff = 0; //Counter for the number of words with scores above our cutoff.
+
+    word_iter_init(&it, long_desc, endPos, JELLYFISH_UCS1);
+    while (word_iter_next(&it, &span))
+    {
+        //Get the next word.
+        for (size_t i = span.start; i < span.end; i++)
+        {
+            word[i - span.start] = tolower(long_desc[i]);
+        }
+        word[span.end - span.start] = '\0';
+        if (it.done)
+        {
+            VERBOSE("Last word in the phrase: %s (index = %d)\n", &long_desc[span.start], curWordIndex);
+        }
+
+        //Measure the Jaro average similarity of the next word. Is it above the cutoff?
+        float approxScore = jaro_average(word, target);
+        if (approxScore >= cutoff)
+        {
+            //Append the current index to the list of matching indexes.
+            if (!it.done)
+            {
+                VERBOSE("Word %s [%d] matches with a score of %.4f\n", word, curWordIndex, approxScore);
+            }
+            indexesAboveCutoff[numWordsAboveCutoff++] = curWordIndex;
+            if (numWordsAboveCutoff >= MAX_MATCHES)
+            {
+                if (!it.done)
+                {
+                    VERBOSE("Too many matches!\n");
+                }
+                free(indexesAboveCutoff);
+                return (int *) TOO_MANY_MATCHES;
+            }
+        }
+
+        curWordIndex++;
+    }
+
+    return indexesAboveCutoff;
+}
+
+/* The return probe passes the result as is: the -1 terminated indexes, or
+ * OUT_OF_RAM or TOO_MANY_MATCHES.
+ */
+int* get_matches(const char* long_desc, const char* inTarget, double cutoff)
+{
+    size_t desc_len = strlen(long_desc), target_len = strlen(inTarget);
+    size_t mark = scratch_mark();
+    int* result;
+    STATS_SCOPE(STAT_GET_MATCHES, desc_len + target_len);
+
+    JELLYFISH_PROBE2(get_matches__entry, desc_len, target_len);
+    result = find_matches(long_desc, inTarget, cutoff);
+    scratch_release(mark);
+    JELLYFISH_PROBE3(get_matches__return, desc_len, target_len, result);
+    return result;
+}
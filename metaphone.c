@@ -2,12 +2,13 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include "probes.h"
 #include <stdio.h>
 
 #define ISVOWEL(a) ((a) == 'a' || (a) == 'e' || (a) == 'i' || \
                     (a) == 'o' || (a) == 'u')
 
-char* metaphone(const char *str)
+static char* metaphone_kernel(const char *str)
 {
     const char *s;
     char c, next, temp = '\0';
@@ -201,3 +202,15 @@ char* metaphone(const char *str)
 
     return result;
 }
+
+char* metaphone(const char *str)
+{
+    size_t len = strlen(str);
+    char *result;
+    STATS_SCOPE(STAT_METAPHONE, len);
+
+    JELLYFISH_PROBE1(metaphone__entry, len);
+    result = metaphone_kernel(str);
+    JELLYFISH_PROBE2(metaphone__return, len, result);
+    return result;
+}
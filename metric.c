@@ -0,0 +1,84 @@
+#include "jellyfish.h"
+#include <string.h>
+
+/* Similarity metrics by name, for the comparators that score tokens or
+ * whole strings with a caller-chosen metric.  Every metric maps to a
+ * similarity in [0, 1] and honours score_cutoff; the edit distance based
+ * ones also have a distance.
+ */
+static const struct {
+    const char *name;
+    enum jellyfish_metric metric;
+} metric_names[] = {
+    { "levenshtein", METRIC_LEVENSHTEIN },
+    { "damerau_levenshtein", METRIC_DAMERAU_LEVENSHTEIN },
+    { "jaro", METRIC_JARO },
+    { "jaro_winkler", METRIC_JARO_WINKLER },
+    { "lcs", METRIC_LCS },
+};
+
+int jellyfish_metric_from_name(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(metric_names) / sizeof(metric_names[0]); i++) {
+        if (strcmp(name, metric_names[i].name) == 0) {
+            return metric_names[i].metric;
+        }
+    }
+    return -1;
+}
+
+const char* jellyfish_metric_name(enum jellyfish_metric metric)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(metric_names) / sizeof(metric_names[0]); i++) {
+        if (metric_names[i].metric == metric) {
+            return metric_names[i].name;
+        }
+    }
+    return NULL;
+}
+
+double jellyfish_similarity(enum jellyfish_metric metric,
+                            const void *str1, size_t len1, const void *str2, size_t len2,
+                            int kind, double score_cutoff)
+{
+    switch (metric) {
+    case METRIC_DAMERAU_LEVENSHTEIN:
+        return damerau_levenshtein_similarity_kind(str1, len1, str2, len2, kind, score_cutoff);
+    case METRIC_JARO:
+        return jaro_winkler_cutoff_kind(str1, len1, str2, len2, kind, false, false,
+                                        score_cutoff);
+    case METRIC_JARO_WINKLER:
+        return jaro_winkler_cutoff_kind(str1, len1, str2, len2, kind, false, true,
+                                        score_cutoff);
+    case METRIC_LCS:
+        return lcs_similarity_kind(str1, len1, str2, len2, kind, score_cutoff);
+    case METRIC_LEVENSHTEIN:
+    default:
+        return levenshtein_similarity_kind(str1, len1, str2, len2, kind, score_cutoff);
+    }
+}
+
+bool jellyfish_metric_has_distance(enum jellyfish_metric metric)
+{
+    return metric != METRIC_JARO && metric != METRIC_JARO_WINKLER;
+}
+
+/* The lcs metric's distance is indel_distance. */
+long jellyfish_distance(enum jellyfish_metric metric,
+                        const void *str1, size_t len1, const void *str2, size_t len2,
+                        int kind)
+{
+    switch (metric) {
+    case METRIC_DAMERAU_LEVENSHTEIN:
+        return damerau_levenshtein_distance_kind(str1, len1, str2, len2, kind);
+    case METRIC_LCS:
+        return indel_distance_kind(str1, len1, str2, len2, kind);
+    case METRIC_LEVENSHTEIN:
+    default:
+        return levenshtein_distance_kind(str1, len1, str2, len2, kind);
+    }
+}
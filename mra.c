@@ -1,32 +1,28 @@
 #include "jellyfish.h"
 #include <string.h>
 #include <ctype.h>
+#include "probes.h"
 
-int match_rating_comparison(const char *s1, const char *s2) {
+/* Compare two codexes from match_rating_codex.  Returns -1 when their
+ * lengths differ by 3 or more, else whether they match.
+ */
+int match_rating_compare_codex(const char *codex1, const char *codex2) {
     size_t s1c_len, s2c_len;
     size_t i, j;
     int diff;
+    char s1_codex[7], s2_codex[7];
     char *longer;
 
-    char *s1_codex = match_rating_codex(s1);
-    if (!s1_codex) {
-        return -1;
-    }
+    s1c_len = strlen(codex1);
+    s2c_len = strlen(codex2);
 
-    char *s2_codex = match_rating_codex(s2);
-    if (!s2_codex) {
-        free(s1_codex);
+    if ((s1c_len > s2c_len ? s1c_len - s2c_len : s2c_len - s1c_len) >= 3) {
         return -1;
     }
 
-    s1c_len = strlen(s1_codex);
-    s2c_len = strlen(s2_codex);
-
-    if (abs(s1c_len - s2c_len) >= 3) {
-        free(s1_codex);
-        free(s2_codex);
-        return -1;
-    }
+    /* The comparison blanks out matched letters, so work on copies. */
+    memcpy(s1_codex, codex1, s1c_len + 1);
+    memcpy(s2_codex, codex2, s2c_len + 1);
 
     for (i = 0; i < s1c_len && i < s2c_len; i++) {
         if (s1_codex[i] == s2_codex[i]) {
@@ -35,8 +31,9 @@ int match_rating_comparison(const char *s1, const char *s2) {
         }
     }
 
-    i = s1c_len - 1;
-    j = s2c_len - 1;
+    /* An empty codex has nothing left to match from the end. */
+    i = s1c_len ? s1c_len - 1 : 0;
+    j = s2c_len ? s2c_len - 1 : 0;
 
     while (i != 0 && j != 0) {
         if (s1_codex[i] == ' ') {
@@ -70,9 +67,6 @@ int match_rating_comparison(const char *s1, const char *s2) {
         }
     }
 
-    free(s1_codex);
-    free(s2_codex);
-
     diff = 6 - diff;
     i = s1c_len + s2c_len;
 
@@ -87,16 +81,12 @@ int match_rating_comparison(const char *s1, const char *s2) {
     }
 }
 
-char* match_rating_codex(const char *str) {
+/* Write the codex of str, at most 6 letters, into codex. */
+static void codex_into(const char *str, char codex[7]) {
     size_t len = strlen(str);
     size_t i, j;
     char c, prev;
 
-    char *codex = malloc(7 * sizeof(char));
-    if (!codex) {
-        return NULL;
-    }
-
     prev = '\0';
     for(i = 0, j = 0; i < len && j < 7; i++) {
         c = toupper(str[i]);
@@ -120,6 +110,34 @@ char* match_rating_codex(const char *str) {
     }
 
     codex[j] = '\0';
+}
 
+int match_rating_comparison(const char *s1, const char *s2) {
+    STATS_SCOPE(STAT_MATCH_RATING_COMPARISON, strlen(s1) + strlen(s2));
+    char s1_codex[7], s2_codex[7];
+
+    codex_into(s1, s1_codex);
+    codex_into(s2, s2_codex);
+    return match_rating_compare_codex(s1_codex, s2_codex);
+}
+
+static char* match_rating_codex_kernel(const char *str) {
+    char *codex = malloc(7 * sizeof(char));
+    if (!codex) {
+        return NULL;
+    }
+
+    codex_into(str, codex);
     return codex;
 }
+
+char* match_rating_codex(const char *str) {
+    size_t len = strlen(str);
+    char *result;
+    STATS_SCOPE(STAT_MATCH_RATING_CODEX, len);
+
+    JELLYFISH_PROBE1(match_rating_codex__entry, len);
+    result = match_rating_codex_kernel(str);
+    JELLYFISH_PROBE2(match_rating_codex__return, len, result);
+    return result;
+}
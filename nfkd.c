@@ -0,0 +1,290 @@
+#include "jellyfish.h"
+#include <string.h>
+
+/* NFKD normalization of the Latin blocks, to UTF-8, without a trip through
+ * unicodedata.  Every code point below U+0250 and in Latin Extended
+ * Additional (U+1E00-U+1EFF) is a starter whose decomposition starts with
+ * a starter, so no canonical reordering crosses code points and the NFKD
+ * form of a string of them is the concatenation of their own NFKD forms.
+ * The tables hold those forms as NUL padded UTF-8 and were generated with
+ * unicodedata.normalize("NFKD", c) (Unicode 14.0.0).
+ */
+
+#define NFKD_MAX NFKD_UTF8_MAX
+
+static const char nfkd_latin[0x1D0][NFKD_MAX + 1] = {
+    "\xC2\x80", "\xC2\x81", "\xC2\x82", "\xC2\x83", "\xC2\x84", "\xC2\x85", "\xC2\x86", "\xC2\x87",
+    "\xC2\x88", "\xC2\x89", "\xC2\x8A", "\xC2\x8B", "\xC2\x8C", "\xC2\x8D", "\xC2\x8E", "\xC2\x8F",
+    "\xC2\x90", "\xC2\x91", "\xC2\x92", "\xC2\x93", "\xC2\x94", "\xC2\x95", "\xC2\x96", "\xC2\x97",
+    "\xC2\x98", "\xC2\x99", "\xC2\x9A", "\xC2\x9B", "\xC2\x9C", "\xC2\x9D", "\xC2\x9E", "\xC2\x9F",
+    " ", "\xC2\xA1", "\xC2\xA2", "\xC2\xA3", "\xC2\xA4", "\xC2\xA5", "\xC2\xA6", "\xC2\xA7",
+    " \xCC\x88", "\xC2\xA9", "a", "\xC2\xAB", "\xC2\xAC", "\xC2\xAD", "\xC2\xAE", " \xCC\x84",
+    "\xC2\xB0", "\xC2\xB1", "2", "3", " \xCC\x81", "\xCE\xBC", "\xC2\xB6", "\xC2\xB7",
+    " \xCC\xA7", "1", "o", "\xC2\xBB",
+    "1\xE2\x81\x84" "4", "1\xE2\x81\x84" "2", "3\xE2\x81\x84" "4", "\xC2\xBF",
+    "A\xCC\x80", "A\xCC\x81", "A\xCC\x82", "A\xCC\x83",
+    "A\xCC\x88", "A\xCC\x8A", "\xC3\x86", "C\xCC\xA7",
+    "E\xCC\x80", "E\xCC\x81", "E\xCC\x82", "E\xCC\x88",
+    "I\xCC\x80", "I\xCC\x81", "I\xCC\x82", "I\xCC\x88",
+    "\xC3\x90", "N\xCC\x83", "O\xCC\x80", "O\xCC\x81",
+    "O\xCC\x82", "O\xCC\x83", "O\xCC\x88", "\xC3\x97",
+    "\xC3\x98", "U\xCC\x80", "U\xCC\x81", "U\xCC\x82",
+    "U\xCC\x88", "Y\xCC\x81", "\xC3\x9E", "\xC3\x9F",
+    "a\xCC\x80", "a\xCC\x81", "a\xCC\x82", "a\xCC\x83",
+    "a\xCC\x88", "a\xCC\x8A", "\xC3\xA6", "c\xCC\xA7",
+    "e\xCC\x80", "e\xCC\x81", "e\xCC\x82", "e\xCC\x88",
+    "i\xCC\x80", "i\xCC\x81", "i\xCC\x82", "i\xCC\x88",
+    "\xC3\xB0", "n\xCC\x83", "o\xCC\x80", "o\xCC\x81",
+    "o\xCC\x82", "o\xCC\x83", "o\xCC\x88", "\xC3\xB7",
+    "\xC3\xB8", "u\xCC\x80", "u\xCC\x81", "u\xCC\x82",
+    "u\xCC\x88", "y\xCC\x81", "\xC3\xBE", "y\xCC\x88",
+    "A\xCC\x84", "a\xCC\x84", "A\xCC\x86", "a\xCC\x86",
+    "A\xCC\xA8", "a\xCC\xA8", "C\xCC\x81", "c\xCC\x81",
+    "C\xCC\x82", "c\xCC\x82", "C\xCC\x87", "c\xCC\x87",
+    "C\xCC\x8C", "c\xCC\x8C", "D\xCC\x8C", "d\xCC\x8C",
+    "\xC4\x90", "\xC4\x91", "E\xCC\x84", "e\xCC\x84",
+    "E\xCC\x86", "e\xCC\x86", "E\xCC\x87", "e\xCC\x87",
+    "E\xCC\xA8", "e\xCC\xA8", "E\xCC\x8C", "e\xCC\x8C",
+    "G\xCC\x82", "g\xCC\x82", "G\xCC\x86", "g\xCC\x86",
+    "G\xCC\x87", "g\xCC\x87", "G\xCC\xA7", "g\xCC\xA7",
+    "H\xCC\x82", "h\xCC\x82", "\xC4\xA6", "\xC4\xA7",
+    "I\xCC\x83", "i\xCC\x83", "I\xCC\x84", "i\xCC\x84",
+    "I\xCC\x86", "i\xCC\x86", "I\xCC\xA8", "i\xCC\xA8",
+    "I\xCC\x87", "\xC4\xB1", "IJ", "ij", "J\xCC\x82", "j\xCC\x82", "K\xCC\xA7", "k\xCC\xA7",
+    "\xC4\xB8", "L\xCC\x81", "l\xCC\x81", "L\xCC\xA7",
+    "l\xCC\xA7", "L\xCC\x8C", "l\xCC\x8C", "L\xC2\xB7",
+    "l\xC2\xB7", "\xC5\x81", "\xC5\x82", "N\xCC\x81",
+    "n\xCC\x81", "N\xCC\xA7", "n\xCC\xA7", "N\xCC\x8C",
+    "n\xCC\x8C", "\xCA\xBCn", "\xC5\x8A", "\xC5\x8B",
+    "O\xCC\x84", "o\xCC\x84", "O\xCC\x86", "o\xCC\x86",
+    "O\xCC\x8B", "o\xCC\x8B", "\xC5\x92", "\xC5\x93",
+    "R\xCC\x81", "r\xCC\x81", "R\xCC\xA7", "r\xCC\xA7",
+    "R\xCC\x8C", "r\xCC\x8C", "S\xCC\x81", "s\xCC\x81",
+    "S\xCC\x82", "s\xCC\x82", "S\xCC\xA7", "s\xCC\xA7",
+    "S\xCC\x8C", "s\xCC\x8C", "T\xCC\xA7", "t\xCC\xA7",
+    "T\xCC\x8C", "t\xCC\x8C", "\xC5\xA6", "\xC5\xA7",
+    "U\xCC\x83", "u\xCC\x83", "U\xCC\x84", "u\xCC\x84",
+    "U\xCC\x86", "u\xCC\x86", "U\xCC\x8A", "u\xCC\x8A",
+    "U\xCC\x8B", "u\xCC\x8B", "U\xCC\xA8", "u\xCC\xA8",
+    "W\xCC\x82", "w\xCC\x82", "Y\xCC\x82", "y\xCC\x82",
+    "Y\xCC\x88", "Z\xCC\x81", "z\xCC\x81", "Z\xCC\x87", "z\xCC\x87", "Z\xCC\x8C", "z\xCC\x8C", "s",
+    "\xC6\x80", "\xC6\x81", "\xC6\x82", "\xC6\x83", "\xC6\x84", "\xC6\x85", "\xC6\x86", "\xC6\x87",
+    "\xC6\x88", "\xC6\x89", "\xC6\x8A", "\xC6\x8B", "\xC6\x8C", "\xC6\x8D", "\xC6\x8E", "\xC6\x8F",
+    "\xC6\x90", "\xC6\x91", "\xC6\x92", "\xC6\x93", "\xC6\x94", "\xC6\x95", "\xC6\x96", "\xC6\x97",
+    "\xC6\x98", "\xC6\x99", "\xC6\x9A", "\xC6\x9B", "\xC6\x9C", "\xC6\x9D", "\xC6\x9E", "\xC6\x9F",
+    "O\xCC\x9B", "o\xCC\x9B", "\xC6\xA2", "\xC6\xA3",
+    "\xC6\xA4", "\xC6\xA5", "\xC6\xA6", "\xC6\xA7",
+    "\xC6\xA8", "\xC6\xA9", "\xC6\xAA", "\xC6\xAB", "\xC6\xAC", "\xC6\xAD", "\xC6\xAE", "U\xCC\x9B",
+    "u\xCC\x9B", "\xC6\xB1", "\xC6\xB2", "\xC6\xB3", "\xC6\xB4", "\xC6\xB5", "\xC6\xB6", "\xC6\xB7",
+    "\xC6\xB8", "\xC6\xB9", "\xC6\xBA", "\xC6\xBB", "\xC6\xBC", "\xC6\xBD", "\xC6\xBE", "\xC6\xBF",
+    "\xC7\x80", "\xC7\x81", "\xC7\x82", "\xC7\x83", "DZ\xCC\x8C", "Dz\xCC\x8C", "dz\xCC\x8C", "LJ",
+    "Lj", "lj", "NJ", "Nj", "nj", "A\xCC\x8C", "a\xCC\x8C", "I\xCC\x8C",
+    "i\xCC\x8C", "O\xCC\x8C", "o\xCC\x8C", "U\xCC\x8C",
+    "u\xCC\x8C", "U\xCC\x88\xCC\x84", "u\xCC\x88\xCC\x84", "U\xCC\x88\xCC\x81",
+    "u\xCC\x88\xCC\x81", "U\xCC\x88\xCC\x8C", "u\xCC\x88\xCC\x8C", "U\xCC\x88\xCC\x80",
+    "u\xCC\x88\xCC\x80", "\xC7\x9D", "A\xCC\x88\xCC\x84", "a\xCC\x88\xCC\x84",
+    "A\xCC\x87\xCC\x84", "a\xCC\x87\xCC\x84", "\xC3\x86\xCC\x84", "\xC3\xA6\xCC\x84",
+    "\xC7\xA4", "\xC7\xA5", "G\xCC\x8C", "g\xCC\x8C",
+    "K\xCC\x8C", "k\xCC\x8C", "O\xCC\xA8", "o\xCC\xA8",
+    "O\xCC\xA8\xCC\x84", "o\xCC\xA8\xCC\x84", "\xC6\xB7\xCC\x8C", "\xCA\x92\xCC\x8C",
+    "j\xCC\x8C", "DZ", "Dz", "dz", "G\xCC\x81", "g\xCC\x81", "\xC7\xB6", "\xC7\xB7",
+    "N\xCC\x80", "n\xCC\x80", "A\xCC\x8A\xCC\x81", "a\xCC\x8A\xCC\x81",
+    "\xC3\x86\xCC\x81", "\xC3\xA6\xCC\x81", "\xC3\x98\xCC\x81", "\xC3\xB8\xCC\x81",
+    "A\xCC\x8F", "a\xCC\x8F", "A\xCC\x91", "a\xCC\x91",
+    "E\xCC\x8F", "e\xCC\x8F", "E\xCC\x91", "e\xCC\x91",
+    "I\xCC\x8F", "i\xCC\x8F", "I\xCC\x91", "i\xCC\x91",
+    "O\xCC\x8F", "o\xCC\x8F", "O\xCC\x91", "o\xCC\x91",
+    "R\xCC\x8F", "r\xCC\x8F", "R\xCC\x91", "r\xCC\x91",
+    "U\xCC\x8F", "u\xCC\x8F", "U\xCC\x91", "u\xCC\x91",
+    "S\xCC\xA6", "s\xCC\xA6", "T\xCC\xA6", "t\xCC\xA6",
+    "\xC8\x9C", "\xC8\x9D", "H\xCC\x8C", "h\xCC\x8C",
+    "\xC8\xA0", "\xC8\xA1", "\xC8\xA2", "\xC8\xA3",
+    "\xC8\xA4", "\xC8\xA5", "A\xCC\x87", "a\xCC\x87",
+    "E\xCC\xA7", "e\xCC\xA7", "O\xCC\x88\xCC\x84", "o\xCC\x88\xCC\x84",
+    "O\xCC\x83\xCC\x84", "o\xCC\x83\xCC\x84", "O\xCC\x87", "o\xCC\x87",
+    "O\xCC\x87\xCC\x84", "o\xCC\x87\xCC\x84", "Y\xCC\x84", "y\xCC\x84",
+    "\xC8\xB4", "\xC8\xB5", "\xC8\xB6", "\xC8\xB7",
+    "\xC8\xB8", "\xC8\xB9", "\xC8\xBA", "\xC8\xBB", "\xC8\xBC", "\xC8\xBD", "\xC8\xBE", "\xC8\xBF",
+    "\xC9\x80", "\xC9\x81", "\xC9\x82", "\xC9\x83", "\xC9\x84", "\xC9\x85", "\xC9\x86", "\xC9\x87",
+    "\xC9\x88", "\xC9\x89", "\xC9\x8A", "\xC9\x8B", "\xC9\x8C", "\xC9\x8D", "\xC9\x8E", "\xC9\x8F",
+};
+
+static const char nfkd_latin_additional[0x100][NFKD_MAX + 1] = {
+    "A\xCC\xA5", "a\xCC\xA5", "B\xCC\x87", "b\xCC\x87",
+    "B\xCC\xA3", "b\xCC\xA3", "B\xCC\xB1", "b\xCC\xB1",
+    "C\xCC\xA7\xCC\x81", "c\xCC\xA7\xCC\x81", "D\xCC\x87", "d\xCC\x87",
+    "D\xCC\xA3", "d\xCC\xA3", "D\xCC\xB1", "d\xCC\xB1",
+    "D\xCC\xA7", "d\xCC\xA7", "D\xCC\xAD", "d\xCC\xAD",
+    "E\xCC\x84\xCC\x80", "e\xCC\x84\xCC\x80", "E\xCC\x84\xCC\x81", "e\xCC\x84\xCC\x81",
+    "E\xCC\xAD", "e\xCC\xAD", "E\xCC\xB0", "e\xCC\xB0",
+    "E\xCC\xA7\xCC\x86", "e\xCC\xA7\xCC\x86", "F\xCC\x87", "f\xCC\x87",
+    "G\xCC\x84", "g\xCC\x84", "H\xCC\x87", "h\xCC\x87",
+    "H\xCC\xA3", "h\xCC\xA3", "H\xCC\x88", "h\xCC\x88",
+    "H\xCC\xA7", "h\xCC\xA7", "H\xCC\xAE", "h\xCC\xAE",
+    "I\xCC\xB0", "i\xCC\xB0", "I\xCC\x88\xCC\x81", "i\xCC\x88\xCC\x81",
+    "K\xCC\x81", "k\xCC\x81", "K\xCC\xA3", "k\xCC\xA3",
+    "K\xCC\xB1", "k\xCC\xB1", "L\xCC\xA3", "l\xCC\xA3",
+    "L\xCC\xA3\xCC\x84", "l\xCC\xA3\xCC\x84", "L\xCC\xB1", "l\xCC\xB1",
+    "L\xCC\xAD", "l\xCC\xAD", "M\xCC\x81", "m\xCC\x81",
+    "M\xCC\x87", "m\xCC\x87", "M\xCC\xA3", "m\xCC\xA3",
+    "N\xCC\x87", "n\xCC\x87", "N\xCC\xA3", "n\xCC\xA3",
+    "N\xCC\xB1", "n\xCC\xB1", "N\xCC\xAD", "n\xCC\xAD",
+    "O\xCC\x83\xCC\x81", "o\xCC\x83\xCC\x81", "O\xCC\x83\xCC\x88", "o\xCC\x83\xCC\x88",
+    "O\xCC\x84\xCC\x80", "o\xCC\x84\xCC\x80", "O\xCC\x84\xCC\x81", "o\xCC\x84\xCC\x81",
+    "P\xCC\x81", "p\xCC\x81", "P\xCC\x87", "p\xCC\x87",
+    "R\xCC\x87", "r\xCC\x87", "R\xCC\xA3", "r\xCC\xA3",
+    "R\xCC\xA3\xCC\x84", "r\xCC\xA3\xCC\x84", "R\xCC\xB1", "r\xCC\xB1",
+    "S\xCC\x87", "s\xCC\x87", "S\xCC\xA3", "s\xCC\xA3",
+    "S\xCC\x81\xCC\x87", "s\xCC\x81\xCC\x87", "S\xCC\x8C\xCC\x87", "s\xCC\x8C\xCC\x87",
+    "S\xCC\xA3\xCC\x87", "s\xCC\xA3\xCC\x87", "T\xCC\x87", "t\xCC\x87",
+    "T\xCC\xA3", "t\xCC\xA3", "T\xCC\xB1", "t\xCC\xB1",
+    "T\xCC\xAD", "t\xCC\xAD", "U\xCC\xA4", "u\xCC\xA4",
+    "U\xCC\xB0", "u\xCC\xB0", "U\xCC\xAD", "u\xCC\xAD",
+    "U\xCC\x83\xCC\x81", "u\xCC\x83\xCC\x81", "U\xCC\x84\xCC\x88", "u\xCC\x84\xCC\x88",
+    "V\xCC\x83", "v\xCC\x83", "V\xCC\xA3", "v\xCC\xA3",
+    "W\xCC\x80", "w\xCC\x80", "W\xCC\x81", "w\xCC\x81",
+    "W\xCC\x88", "w\xCC\x88", "W\xCC\x87", "w\xCC\x87",
+    "W\xCC\xA3", "w\xCC\xA3", "X\xCC\x87", "x\xCC\x87",
+    "X\xCC\x88", "x\xCC\x88", "Y\xCC\x87", "y\xCC\x87",
+    "Z\xCC\x82", "z\xCC\x82", "Z\xCC\xA3", "z\xCC\xA3",
+    "Z\xCC\xB1", "z\xCC\xB1", "h\xCC\xB1", "t\xCC\x88",
+    "w\xCC\x8A", "y\xCC\x8A", "a\xCA\xBE", "s\xCC\x87",
+    "\xE1\xBA\x9C", "\xE1\xBA\x9D", "\xE1\xBA\x9E", "\xE1\xBA\x9F",
+    "A\xCC\xA3", "a\xCC\xA3", "A\xCC\x89", "a\xCC\x89",
+    "A\xCC\x82\xCC\x81", "a\xCC\x82\xCC\x81", "A\xCC\x82\xCC\x80", "a\xCC\x82\xCC\x80",
+    "A\xCC\x82\xCC\x89", "a\xCC\x82\xCC\x89", "A\xCC\x82\xCC\x83", "a\xCC\x82\xCC\x83",
+    "A\xCC\xA3\xCC\x82", "a\xCC\xA3\xCC\x82", "A\xCC\x86\xCC\x81", "a\xCC\x86\xCC\x81",
+    "A\xCC\x86\xCC\x80", "a\xCC\x86\xCC\x80", "A\xCC\x86\xCC\x89", "a\xCC\x86\xCC\x89",
+    "A\xCC\x86\xCC\x83", "a\xCC\x86\xCC\x83", "A\xCC\xA3\xCC\x86", "a\xCC\xA3\xCC\x86",
+    "E\xCC\xA3", "e\xCC\xA3", "E\xCC\x89", "e\xCC\x89",
+    "E\xCC\x83", "e\xCC\x83", "E\xCC\x82\xCC\x81", "e\xCC\x82\xCC\x81",
+    "E\xCC\x82\xCC\x80", "e\xCC\x82\xCC\x80", "E\xCC\x82\xCC\x89", "e\xCC\x82\xCC\x89",
+    "E\xCC\x82\xCC\x83", "e\xCC\x82\xCC\x83", "E\xCC\xA3\xCC\x82", "e\xCC\xA3\xCC\x82",
+    "I\xCC\x89", "i\xCC\x89", "I\xCC\xA3", "i\xCC\xA3",
+    "O\xCC\xA3", "o\xCC\xA3", "O\xCC\x89", "o\xCC\x89",
+    "O\xCC\x82\xCC\x81", "o\xCC\x82\xCC\x81", "O\xCC\x82\xCC\x80", "o\xCC\x82\xCC\x80",
+    "O\xCC\x82\xCC\x89", "o\xCC\x82\xCC\x89", "O\xCC\x82\xCC\x83", "o\xCC\x82\xCC\x83",
+    "O\xCC\xA3\xCC\x82", "o\xCC\xA3\xCC\x82", "O\xCC\x9B\xCC\x81", "o\xCC\x9B\xCC\x81",
+    "O\xCC\x9B\xCC\x80", "o\xCC\x9B\xCC\x80", "O\xCC\x9B\xCC\x89", "o\xCC\x9B\xCC\x89",
+    "O\xCC\x9B\xCC\x83", "o\xCC\x9B\xCC\x83", "O\xCC\x9B\xCC\xA3", "o\xCC\x9B\xCC\xA3",
+    "U\xCC\xA3", "u\xCC\xA3", "U\xCC\x89", "u\xCC\x89",
+    "U\xCC\x9B\xCC\x81", "u\xCC\x9B\xCC\x81", "U\xCC\x9B\xCC\x80", "u\xCC\x9B\xCC\x80",
+    "U\xCC\x9B\xCC\x89", "u\xCC\x9B\xCC\x89", "U\xCC\x9B\xCC\x83", "u\xCC\x9B\xCC\x83",
+    "U\xCC\x9B\xCC\xA3", "u\xCC\x9B\xCC\xA3", "Y\xCC\x80", "y\xCC\x80",
+    "Y\xCC\xA3", "y\xCC\xA3", "Y\xCC\x89", "y\xCC\x89",
+    "Y\xCC\x83", "y\xCC\x83", "\xE1\xBB\xBA", "\xE1\xBB\xBB",
+    "\xE1\xBB\xBC", "\xE1\xBB\xBD", "\xE1\xBB\xBE", "\xE1\xBB\xBF",
+};
+
+static const char* nfkd_entry(uint32_t c)
+{
+    if (c < 0x80) {
+        return NULL;
+    } else if (c < 0x250) {
+        return nfkd_latin[c - 0x80];
+    } else if (c >= 0x1E00 && c < 0x1F00) {
+        return nfkd_latin_additional[c - 0x1E00];
+    }
+    return NULL;
+}
+
+static inline uint32_t code_point(const void *str, size_t i, int kind)
+{
+    switch (kind) {
+    case JELLYFISH_UCS2:
+        return ((const uint16_t *) str)[i];
+    case JELLYFISH_UCS4:
+        return ((const uint32_t *) str)[i];
+    default:
+        return ((const unsigned char *) str)[i];
+    }
+}
+
+long nfkd_utf8_length(const void *str, size_t len, int kind)
+{
+    const char *entry;
+    size_t i, n = 0;
+    uint32_t c;
+
+    for (i = 0; i < len; i++) {
+        c = code_point(str, i, kind);
+        if (c < 0x80) {
+            n++;
+        } else if ((entry = nfkd_entry(c))) {
+            n += strlen(entry);
+        } else {
+            return -1;
+        }
+    }
+    return (long) n;
+}
+
+void nfkd_utf8(const void *str, size_t len, int kind, char *out)
+{
+    const char *entry;
+    size_t i;
+    uint32_t c;
+
+    for (i = 0; i < len; i++) {
+        c = code_point(str, i, kind);
+        if (c < 0x80) {
+            *out++ = (char) c;
+        } else {
+            entry = nfkd_entry(c);
+            while (*entry) {
+                *out++ = *entry++;
+            }
+        }
+    }
+}
+
+static size_t put_utf8(uint32_t c, char *out)
+{
+    if (c < 0x80) {
+        out[0] = (char) c;
+        return 1;
+    } else if (c < 0x800) {
+        out[0] = (char) (0xC0 | (c >> 6));
+        out[1] = (char) (0x80 | (c & 0x3F));
+        return 2;
+    } else if (c < 0x10000) {
+        out[0] = (char) (0xE0 | (c >> 12));
+        out[1] = (char) (0x80 | ((c >> 6) & 0x3F));
+        out[2] = (char) (0x80 | (c & 0x3F));
+        return 3;
+    }
+    out[0] = (char) (0xF0 | (c >> 18));
+    out[1] = (char) (0x80 | ((c >> 12) & 0x3F));
+    out[2] = (char) (0x80 | ((c >> 6) & 0x3F));
+    out[3] = (char) (0x80 | (c & 0x3F));
+    return 4;
+}
+
+size_t encode_utf8(const void *str, size_t len, int kind, char *out)
+{
+    size_t i, n = 0;
+
+    for (i = 0; i < len; i++) {
+        n += put_utf8(code_point(str, i, kind), out + n);
+    }
+    return n;
+}
+
+size_t nfkd_utf8_partial(const void *str, size_t len, int kind, char *out)
+{
+    const char *entry;
+    size_t i, n = 0;
+    uint32_t c;
+
+    for (i = 0; i < len; i++) {
+        c = code_point(str, i, kind);
+        if ((entry = nfkd_entry(c))) {
+            while (*entry) {
+                out[n++] = *entry++;
+            }
+        } else {
+            n += put_utf8(c, out + n);
+        }
+    }
+    return n;
+}
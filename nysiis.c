@@ -2,21 +2,15 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include "probes.h"
 
 #define ISVOWEL(a) ((a) == 'A' || (a) == 'E' || (a) == 'I' || \
                     (a) == 'O' || (a) == 'U')
 
-char *nysiis(const char *str)
+/* Encode copy, a writable copy of the len characters of the string. */
+static char *nysiis_kernel(char *copy, size_t len)
 {
-    size_t len = strlen(str);
-
     char c1, c2, c3;
-    char *copy = alloca((len + 1) * sizeof(char));
-    memcpy(copy, str, len + 1);
-    if (!copy)
-    {
-        return NULL;
-    }
 
     if (!*copy)
     {
@@ -223,3 +217,22 @@ char *nysiis(const char *str)
 
     return code;
 }
+
+char *nysiis(const char *str)
+{
+    size_t len = strlen(str);
+    char stack[SCRATCH_STACK];
+    size_t mark = scratch_mark();
+    char *copy, *result = NULL;
+    STATS_SCOPE(STAT_NYSIIS, len);
+
+    JELLYFISH_PROBE1(nysiis__entry, len);
+    copy = scratch_buffer(stack, sizeof(stack), len + 1);
+    if (copy) {
+        memcpy(copy, str, len + 1);
+        result = nysiis_kernel(copy, len);
+    }
+    scratch_release(mark);
+    JELLYFISH_PROBE2(nysiis__return, len, result);
+    return result;
+}
@@ -0,0 +1,584 @@
+#include "jellyfish.h"
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+/* Row by row and all pairs scoring of string columns (pairwise_* and
+ * cdist_* / pdist_*), split across threads.  Rows are read in place from
+ * the column's storage; the only copies are UTF-8 rows with non-ASCII
+ * characters, decoded to code points, and rows widened to match the code
+ * unit width of the row they are compared with.  Each thread keeps its
+ * own buffers for these, so the workers share nothing but the output.
+ */
+
+static void* reserve(struct row_buffer *buf, size_t size)
+{
+    void *data;
+
+    if (size > buf->size) {
+        data = realloc(buf->data, size);
+        if (!data) {
+            return NULL;
+        }
+        buf->data = data;
+        buf->size = size;
+    }
+    return buf->data;
+}
+
+static inline uint32_t code_point(const void *str, size_t i, int kind)
+{
+    switch (kind) {
+    case JELLYFISH_UCS2:
+        return ((const uint16_t *) str)[i];
+    case JELLYFISH_UCS4:
+        return ((const uint32_t *) str)[i];
+    default:
+        return ((const unsigned char *) str)[i];
+    }
+}
+
+/* Decode UTF-8 to code points; each byte of a malformed sequence decodes
+ * to U+FFFD.  Returns the number of code points written to out, which has
+ * room for len of them.
+ */
+static size_t decode_utf8(const unsigned char *s, size_t len, uint32_t *out)
+{
+    size_t i = 0, n = 0, need, k;
+    uint32_t c, min;
+
+    while (i < len) {
+        c = s[i];
+        if (c < 0x80) {
+            out[n++] = c;
+            i++;
+            continue;
+        }
+        if (c >= 0xF0 && c <= 0xF4) {
+            need = 3;
+            c &= 0x07;
+            min = 0x10000;
+        } else if (c >= 0xE0) {
+            need = 2;
+            c &= 0x0F;
+            min = 0x800;
+        } else if (c >= 0xC2 && c <= 0xDF) {
+            need = 1;
+            c &= 0x1F;
+            min = 0x80;
+        } else {
+            need = 0;
+        }
+
+        for (k = 1; need && k <= need; k++) {
+            if (i + k >= len || (s[i + k] & 0xC0) != 0x80) {
+                need = 0;
+                break;
+            }
+            c = (c << 6) | (s[i + k] & 0x3F);
+        }
+        if (need && c >= min && c <= 0x10FFFF && (c < 0xD800 || c > 0xDFFF)) {
+            out[n++] = c;
+            i += need + 1;
+        } else {
+            out[n++] = 0xFFFD;
+            i++;
+        }
+    }
+    return n;
+}
+
+int column_row(const struct string_column *col, size_t i, struct string_ref *row,
+               struct row_buffer *buf)
+{
+    size_t pos = col->offset + i, start, end, k;
+    const unsigned char *bytes;
+    uint32_t *decoded;
+
+    switch (col->layout) {
+    case COLUMN_REFS:
+        *row = col->refs[i];
+        return row->data != NULL;
+
+    case COLUMN_FIXED:
+        row->data = col->data + i * col->width * col->kind;
+        row->kind = col->kind;
+        /* Rows are padded with NULs, which numpy strips too. */
+        for (row->len = col->width; row->len && !code_point(row->data, row->len - 1, row->kind);
+             row->len--) {
+        }
+        return 1;
+
+    case COLUMN_OFFSETS32:
+    case COLUMN_OFFSETS64:
+        if (col->validity && !(col->validity[pos / 8] & (1 << (pos % 8)))) {
+            return 0;
+        }
+        if (col->layout == COLUMN_OFFSETS32) {
+            start = ((const int32_t *) col->offsets)[pos];
+            end = ((const int32_t *) col->offsets)[pos + 1];
+        } else {
+            start = ((const int64_t *) col->offsets)[pos];
+            end = ((const int64_t *) col->offsets)[pos + 1];
+        }
+        bytes = (const unsigned char *) col->data + start;
+        row->data = bytes;
+        row->len = end - start;
+        row->kind = JELLYFISH_UCS1;
+
+        if (col->utf8) {
+            for (k = 0; k < row->len && bytes[k] < 0x80; k++) {
+            }
+            if (k < row->len) {
+                decoded = reserve(buf, row->len * sizeof(uint32_t));
+                if (!decoded) {
+                    return -1;
+                }
+                row->len = decode_utf8(bytes, row->len, decoded);
+                row->data = decoded;
+                row->kind = JELLYFISH_UCS4;
+            }
+        }
+        return 1;
+    }
+    return 0;
+}
+
+size_t column_bytes(const struct string_column *col)
+{
+    size_t i, bytes = 0;
+
+    switch (col->layout) {
+    case COLUMN_REFS:
+        for (i = 0; i < col->length; i++) {
+            bytes += col->refs[i].data ? col->refs[i].len * col->refs[i].kind : 0;
+        }
+        return bytes;
+    case COLUMN_FIXED:
+        return col->length * col->width * col->kind;
+    case COLUMN_OFFSETS32:
+        return ((const int32_t *) col->offsets)[col->offset + col->length] -
+               ((const int32_t *) col->offsets)[col->offset];
+    case COLUMN_OFFSETS64:
+        return ((const int64_t *) col->offsets)[col->offset + col->length] -
+               ((const int64_t *) col->offsets)[col->offset];
+    }
+    return 0;
+}
+
+size_t column_units(const struct string_column *col, size_t i)
+{
+    size_t pos = col->offset + i;
+
+    switch (col->layout) {
+    case COLUMN_REFS:
+        return col->refs[i].data ? col->refs[i].len : 0;
+    case COLUMN_FIXED:
+        return col->width;
+    case COLUMN_OFFSETS32:
+        return ((const int32_t *) col->offsets)[pos + 1] - ((const int32_t *) col->offsets)[pos];
+    case COLUMN_OFFSETS64:
+        return ((const int64_t *) col->offsets)[pos + 1] - ((const int64_t *) col->offsets)[pos];
+    }
+    return 0;
+}
+
+int widen_row(struct string_ref *row, int kind, struct row_buffer *buf)
+{
+    void *out = reserve(buf, row->len * kind + kind);
+    size_t i;
+
+    if (!out) {
+        return -1;
+    }
+    for (i = 0; i < row->len; i++) {
+        if (kind == JELLYFISH_UCS2) {
+            ((uint16_t *) out)[i] = code_point(row->data, i, row->kind);
+        } else {
+            ((uint32_t *) out)[i] = code_point(row->data, i, row->kind);
+        }
+    }
+    row->data = out;
+    row->kind = kind;
+    return 0;
+}
+
+struct pairwise_job {
+    enum jellyfish_metric metric;
+    const struct string_column *a;
+    const struct string_column *b;  /* NULL for the condensed matrix of a */
+    double score_cutoff;
+    double *similarities;
+    int32_t *distances;
+    int failed;
+};
+
+/* Fetch row i of both columns at a common width.  Returns 1, 0 if either
+ * value is missing or -1 if memory runs out.
+ */
+static int row_pair(const struct pairwise_job *job, size_t i,
+                    struct string_ref *ra, struct string_ref *rb,
+                    struct row_buffer *buf_a, struct row_buffer *buf_b)
+{
+    int found_a, found_b;
+
+    found_a = column_row(job->a, i, ra, buf_a);
+    found_b = column_row(job->b, i, rb, buf_b);
+    if (found_a < 0 || found_b < 0) {
+        return -1;
+    }
+    if (!found_a || !found_b) {
+        return 0;
+    }
+
+    /* A decoded row is already UCS4 and so is never the one widened. */
+    if (ra->kind < rb->kind) {
+        return widen_row(ra, rb->kind, buf_a) < 0 ? -1 : 1;
+    }
+    if (rb->kind < ra->kind) {
+        return widen_row(rb, ra->kind, buf_b) < 0 ? -1 : 1;
+    }
+    return 1;
+}
+
+static void score_rows(void *ctx, size_t begin, size_t end)
+{
+    struct pairwise_job *job = ctx;
+    struct row_buffer buf_a = { NULL, 0 }, buf_b = { NULL, 0 };
+    struct string_ref ra, rb;
+    size_t i;
+    long distance;
+    int found;
+
+    for (i = begin; i < end && !__atomic_load_n(&job->failed, __ATOMIC_RELAXED); i++) {
+        found = row_pair(job, i, &ra, &rb, &buf_a, &buf_b);
+        if (found < 0) {
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+
+        if (job->similarities) {
+            job->similarities[i] = found ? jellyfish_similarity(job->metric, ra.data, ra.len,
+                                                                rb.data, rb.len, ra.kind,
+                                                                job->score_cutoff)
+                                         : NAN;
+            if (found && isnan(job->similarities[i])) {
+                __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            }
+        } else {
+            distance = found ? jellyfish_distance(job->metric, ra.data, ra.len,
+                                                  rb.data, rb.len, ra.kind)
+                             : -1;
+            if (found && distance < 0) {
+                __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            }
+            job->distances[i] = distance;
+        }
+    }
+
+    free(buf_a.data);
+    free(buf_b.data);
+}
+
+/* The cost of row i grows with the product of its lengths. */
+static double row_cost(void *ctx, size_t i)
+{
+    struct pairwise_job *job = ctx;
+
+    return (double) (column_units(job->a, i) + 1) * (column_units(job->b, i) + 1);
+}
+
+/* Rows per block below which splitting the work costs more than it saves. */
+#define PAIRWISE_GRAIN 256
+
+int pairwise_similarity(enum jellyfish_metric metric,
+                        const struct string_column *a, const struct string_column *b,
+                        double score_cutoff, double *out, size_t threads)
+{
+    struct pairwise_job job = { metric, a, b, score_cutoff, out, NULL, 0 };
+    STATS_SCOPE(STAT_PAIRWISE, column_bytes(a) + column_bytes(b));
+
+    parallel_for_cost(MIN(a->length, b->length), PAIRWISE_GRAIN, threads, score_rows, row_cost,
+                      &job);
+    return job.failed ? -1 : 0;
+}
+
+int pairwise_distance(enum jellyfish_metric metric,
+                      const struct string_column *a, const struct string_column *b,
+                      int32_t *out, size_t threads)
+{
+    struct pairwise_job job = { metric, a, b, 0, NULL, out, 0 };
+    STATS_SCOPE(STAT_PAIRWISE, column_bytes(a) + column_bytes(b));
+
+    parallel_for_cost(MIN(a->length, b->length), PAIRWISE_GRAIN, threads, score_rows, row_cost,
+                      &job);
+    return job.failed ? -1 : 0;
+}
+
+/* All pairs matrices.  The first column is walked in tiles of TILE_ROWS
+ * rows and the second in tiles of as many, each tile fetched (and decoded)
+ * once and then compared against the whole other tile, so both stay in
+ * cache.  The lcs and levenshtein metrics build the bit masks of each row
+ * of the first tile once and scan them against every row of the second.
+ */
+#define TILE_ROWS 64
+
+struct tile {
+    size_t n;
+    struct string_ref rows[TILE_ROWS];
+    bool present[TILE_ROWS];
+    struct row_buffer buffers[TILE_ROWS];
+    struct lcs_pattern *patterns[TILE_ROWS];
+};
+
+static void clear_patterns(struct tile *tile)
+{
+    size_t i;
+
+    for (i = 0; i < TILE_ROWS; i++) {
+        free_lcs_pattern(tile->patterns[i]);
+        tile->patterns[i] = NULL;
+    }
+}
+
+static void free_tile(struct tile *tile)
+{
+    size_t i;
+
+    if (tile) {
+        clear_patterns(tile);
+        for (i = 0; i < TILE_ROWS; i++) {
+            free(tile->buffers[i].data);
+        }
+        free(tile);
+    }
+}
+
+/* Fetch rows [start, start + TILE_ROWS) of col, clipped to its length,
+ * with their bit parallel patterns when asked.  Returns -1 if memory runs out.
+ */
+static int load_tile(const struct string_column *col, size_t start, struct tile *tile,
+                     bool patterns)
+{
+    size_t i;
+    int found;
+
+    clear_patterns(tile);
+    tile->n = MIN(TILE_ROWS, col->length - start);
+    for (i = 0; i < tile->n; i++) {
+        found = column_row(col, start + i, &tile->rows[i], &tile->buffers[i]);
+        if (found < 0) {
+            return -1;
+        }
+        tile->present[i] = found;
+        if (found && patterns) {
+            tile->patterns[i] = create_lcs_pattern(tile->rows[i].data, tile->rows[i].len,
+                                                   tile->rows[i].kind);
+            if (!tile->patterns[i]) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Score row i of tile a against row j of tile b into cell index of the
+ * output.  Returns -1 if memory runs out.
+ */
+static int score_cell(struct pairwise_job *job, const struct tile *a, size_t i,
+                      const struct tile *b, size_t j, size_t index, struct row_buffer *scratch)
+{
+    struct string_ref ra = a->rows[i], rb = b->rows[j];
+    double score = 0;
+    long distance = 0;
+
+    if (!a->present[i] || !b->present[j]) {
+        if (job->similarities) {
+            job->similarities[index] = NAN;
+        } else {
+            job->distances[index] = -1;
+        }
+        return 0;
+    }
+
+    if (a->patterns[i] && job->metric == METRIC_LEVENSHTEIN) {
+        if (job->similarities) {
+            score = lcs_pattern_levenshtein_similarity(a->patterns[i], rb.data, rb.len, rb.kind,
+                                                       job->score_cutoff);
+        } else {
+            distance = lcs_pattern_levenshtein(a->patterns[i], rb.data, rb.len, rb.kind);
+        }
+    } else if (a->patterns[i]) {
+        if (job->similarities) {
+            score = lcs_pattern_similarity(a->patterns[i], rb.data, rb.len, rb.kind,
+                                           job->score_cutoff);
+        } else {
+            distance = lcs_pattern_length(a->patterns[i], rb.data, rb.len, rb.kind);
+            distance = distance < 0 ? -1 : (long) (ra.len + rb.len) - 2 * distance;
+        }
+    } else {
+        if (ra.kind < rb.kind && widen_row(&ra, rb.kind, scratch) < 0) {
+            return -1;
+        }
+        if (rb.kind < ra.kind && widen_row(&rb, ra.kind, scratch) < 0) {
+            return -1;
+        }
+        if (job->similarities) {
+            score = jellyfish_similarity(job->metric, ra.data, ra.len, rb.data, rb.len,
+                                         ra.kind, job->score_cutoff);
+        } else {
+            distance = jellyfish_distance(job->metric, ra.data, ra.len, rb.data, rb.len,
+                                          ra.kind);
+        }
+    }
+
+    if (job->similarities) {
+        job->similarities[index] = score;
+        return isnan(score) ? -1 : 0;
+    }
+    job->distances[index] = distance;
+    return distance < 0 ? -1 : 0;
+}
+
+/* Score tile t of the first column against the second, or for the
+ * condensed matrix against the rows after it.
+ */
+static int score_tile_row(struct pairwise_job *job, size_t t, struct tile *rows,
+                          struct tile *cols, struct row_buffer *scratch)
+{
+    const struct string_column *b = job->b ? job->b : job->a;
+    size_t n = job->a->length, start = t * TILE_ROWS, col_start, i, j, gi, gj, index;
+
+    if (load_tile(job->a, start, rows,
+                  job->metric == METRIC_LCS || job->metric == METRIC_LEVENSHTEIN) < 0) {
+        return -1;
+    }
+
+    for (col_start = job->b ? 0 : start; col_start < b->length; col_start += TILE_ROWS) {
+        if (load_tile(b, col_start, cols, false) < 0) {
+            return -1;
+        }
+        for (i = 0; i < rows->n; i++) {
+            gi = start + i;
+            for (j = 0; j < cols->n; j++) {
+                gj = col_start + j;
+                if (job->b) {
+                    index = gi * b->length + gj;
+                } else if (gj > gi) {
+                    /* scipy's condensed order: row after row of the upper triangle. */
+                    index = n * gi - gi * (gi + 1) / 2 + (gj - gi - 1);
+                } else {
+                    continue;
+                }
+                if (score_cell(job, rows, i, cols, j, index, scratch) < 0) {
+                    return -1;
+                }
+            }
+        }
+        if (__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+/* Blocks of tile rows.  The condensed matrix pairs tile k with the last
+ * but k, whose rows have the fewest cells after them, so every block of
+ * the split gets about as much of the triangle.
+ */
+static void score_tiles(void *ctx, size_t begin, size_t end)
+{
+    struct pairwise_job *job = ctx;
+    size_t tiles = (job->a->length + TILE_ROWS - 1) / TILE_ROWS, k;
+    struct tile *rows = calloc(1, sizeof(struct tile));
+    struct tile *cols = calloc(1, sizeof(struct tile));
+    struct row_buffer scratch = { NULL, 0 };
+    int status = rows && cols ? 0 : -1;
+
+    for (k = begin; status == 0 && k < end && !__atomic_load_n(&job->failed, __ATOMIC_RELAXED);
+         k++) {
+        status = score_tile_row(job, k, rows, cols, &scratch);
+        if (status == 0 && !job->b && tiles - 1 - k != k) {
+            status = score_tile_row(job, tiles - 1 - k, rows, cols, &scratch);
+        }
+    }
+    if (status < 0) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    }
+
+    free_tile(rows);
+    free_tile(cols);
+    free(scratch.data);
+}
+
+/* The cost of tile row t is about the length of its rows times the rows
+ * they are compared with, and for the condensed matrix includes its
+ * partner tile row.
+ */
+static double tile_row_cost(const struct pairwise_job *job, size_t t)
+{
+    size_t start = t * TILE_ROWS, end = MIN(start + TILE_ROWS, job->a->length), i;
+    double units = 0;
+
+    for (i = start; i < end; i++) {
+        units += column_units(job->a, i) + 1;
+    }
+    return units * (job->b ? job->b->length : job->a->length - start);
+}
+
+static double tile_cost(void *ctx, size_t k)
+{
+    struct pairwise_job *job = ctx;
+    size_t tiles = (job->a->length + TILE_ROWS - 1) / TILE_ROWS;
+
+    if (job->b || tiles - 1 - k == k) {
+        return tile_row_cost(job, k);
+    }
+    return tile_row_cost(job, k) + tile_row_cost(job, tiles - 1 - k);
+}
+
+static int score_matrix(struct pairwise_job *job, size_t threads)
+{
+    size_t tiles = (job->a->length + TILE_ROWS - 1) / TILE_ROWS;
+
+    parallel_for_cost(job->b ? tiles : (tiles + 1) / 2, 1, threads, score_tiles, tile_cost, job);
+    return job->failed ? -1 : 0;
+}
+
+int cdist_similarity(enum jellyfish_metric metric,
+                     const struct string_column *a, const struct string_column *b,
+                     double score_cutoff, double *out, size_t threads)
+{
+    struct pairwise_job job = { metric, a, b, score_cutoff, out, NULL, 0 };
+    STATS_SCOPE(STAT_CDIST, column_bytes(a) + column_bytes(b));
+
+    return score_matrix(&job, threads);
+}
+
+int cdist_distance(enum jellyfish_metric metric,
+                   const struct string_column *a, const struct string_column *b,
+                   int32_t *out, size_t threads)
+{
+    struct pairwise_job job = { metric, a, b, 0, NULL, out, 0 };
+    STATS_SCOPE(STAT_CDIST, column_bytes(a) + column_bytes(b));
+
+    return score_matrix(&job, threads);
+}
+
+int pdist_similarity(enum jellyfish_metric metric, const struct string_column *col,
+                     double score_cutoff, double *out, size_t threads)
+{
+    struct pairwise_job job = { metric, col, NULL, score_cutoff, out, NULL, 0 };
+    STATS_SCOPE(STAT_PDIST, column_bytes(col));
+
+    return score_matrix(&job, threads);
+}
+
+int pdist_distance(enum jellyfish_metric metric, const struct string_column *col,
+                   int32_t *out, size_t threads)
+{
+    struct pairwise_job job = { metric, col, NULL, 0, NULL, out, 0 };
+    STATS_SCOPE(STAT_PDIST, column_bytes(col));
+
+    return score_matrix(&job, threads);
+}
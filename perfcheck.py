@@ -0,0 +1,89 @@
+#!/usr/bin/env python
+"""Compare a benchmark run against stored baseline numbers.
+
+    python perfcheck.py [--max-regression PCT] [--noise-ns NS] baseline.json current.json
+
+Both files are reports written by jellyfish_bench (or bench.py).  A case,
+keyed by function and input length, regresses when its ns/op grows by more
+than PCT percent over the baseline (and by more than NS nanoseconds, so
+that timer noise on very fast cases is ignored), or when it makes more heap
+allocations per call than before.  The exit status is 1 if anything
+regressed, so "make perfcheck" can gate a release.
+
+Timings only compare between runs on one CPU model with one backend, so a
+baseline recorded on another processor or with another backend is refused
+(exit status 2): record one with "make perfbaseline" first.
+"""
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        report = json.load(f)
+    cases = {}
+    for result in report["results"]:
+        cases[(result["function"], result["length"])] = result
+    return report, cases
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--max-regression", type=float, default=25.0,
+                        help="allowed slowdown in percent (default 25)")
+    parser.add_argument("--noise-ns", type=float, default=20.0,
+                        help="ignore slowdowns smaller than this many ns/op (default 20)")
+    args = parser.parse_args()
+
+    baseline_report, baseline = load(args.baseline)
+    current_report, current = load(args.current)
+
+    for field in ("cpu", "backend"):
+        if baseline_report.get(field) != current_report.get(field):
+            sys.stderr.write("error: the baseline was measured with %s %r, this run with %r; "
+                             "run \"make perfbaseline\" on this kind of machine first\n"
+                             % (field, baseline_report.get(field), current_report.get(field)))
+            return 2
+
+    regressions = 0
+    for key in sorted(current):
+        if key not in baseline:
+            print("%-32s %5d  new, no baseline" % key)
+            continue
+
+        old, new = baseline[key], current[key]
+        if old["ns_per_op"] > 0:
+            change = (new["ns_per_op"] - old["ns_per_op"]) / old["ns_per_op"] * 100.0
+        else:
+            change = float("inf") if new["ns_per_op"] > 0 else 0.0
+        slower = (change > args.max_regression and
+                  new["ns_per_op"] - old["ns_per_op"] > args.noise_ns)
+        more_allocs = new.get("allocs_per_op", 0) > old.get("allocs_per_op", 0)
+
+        status = "ok"
+        if slower:
+            status = "REGRESSED"
+        if more_allocs:
+            status = "REGRESSED (allocs %.2f -> %.2f)" % (old["allocs_per_op"],
+                                                         new["allocs_per_op"])
+        if slower or more_allocs:
+            regressions += 1
+
+        print("%-32s %5d  %12.1f -> %12.1f ns/op  %+7.1f%%  %s"
+              % (key[0], key[1], old["ns_per_op"], new["ns_per_op"], change, status))
+
+    for key in sorted(set(baseline) - set(current)):
+        print("%-32s %5d  missing from this run" % key)
+
+    if regressions:
+        print("%d case(s) regressed (limit %.0f%% slower, no new allocations)"
+              % (regressions, args.max_regression))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
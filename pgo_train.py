@@ -0,0 +1,65 @@
+#!/usr/bin/env python
+"""Training workload for profile-guided builds (see ``make pgo``).
+
+Runs an instrumented jellyfish build over representative input so the
+compiler sees realistic branch frequencies: the Porter stemmer over
+porter-test.csv, and every distance, token and phonetic function over the
+name pairs in pgo-names.csv.  The token functions also train the word
+splitter in tokenize.c.  get_matches is not part of the extension, so this
+script does not train it.  ``make pgo`` builds regex_demo, which links
+get_matches, with a profile of its own.  That profile is recorded by
+running regex_demo and only applies to regex_demo.
+"""
+import csv
+import sys
+
+import jellyfish
+
+
+DISTANCES = [jellyfish.jaro_winkler,
+             jellyfish.jaro_distance,
+             jellyfish.jaro_average,
+             jellyfish.hamming_distance,
+             jellyfish.levenshtein_distance,
+             jellyfish.damerau_levenshtein_distance,
+             jellyfish.match_rating_comparison]
+
+TOKENS = [jellyfish.token_sort_similarity,
+          jellyfish.token_set_similarity,
+          jellyfish.monge_elkan_similarity]
+
+PHONETICS = [jellyfish.soundex,
+             jellyfish.metaphone,
+             jellyfish.match_rating_codex]
+
+
+def train_stemmer(path):
+    with open(path) as f:
+        for (word, _) in csv.reader(f):
+            jellyfish.porter_stem(word.lower())
+
+
+def train_names(path):
+    with open(path) as f:
+        pairs = list(csv.reader(f))
+
+    for (name1, name2) in pairs:
+        for func in DISTANCES:
+            func(name1, name2)
+            func(name1.lower(), name2.lower())
+        for func in TOKENS:
+            func(name1 + " " + name2, name2 + ", " + name1)
+        for name in (name1, name2):
+            for func in PHONETICS:
+                func(name)
+            jellyfish.nysiis(name.upper())
+
+
+def main(rounds):
+    for _ in range(rounds):
+        train_stemmer("porter-test.csv")
+        train_names("pgo-names.csv")
+
+
+if __name__ == "__main__":
+    main(int(sys.argv[1]) if len(sys.argv) > 1 else 5)
@@ -33,6 +33,8 @@
 
 #include <stdlib.h>  /* for malloc, free */
 #include <string.h>  /* for memcmp, memmove */
+#include "jellyfish.h" /* for STATS_SCOPE */
+#include "probes.h"
 
 /* You will probably want to move the following declarations to a central
  header file.
@@ -44,6 +46,7 @@ extern struct stemmer * create_stemmer(void);
 extern void free_stemmer(struct stemmer * z);
 
 extern int stem(struct stemmer * z, char * b, int k);
+extern int stem_in_place(char * b, int k);
 
 /* The main part of the stemming algorithm starts here.
  */
@@ -613,7 +616,7 @@ static void step5(struct stemmer * z)
  length, so 0 <= k' <= k.
  */
 
-extern int stem(struct stemmer * z, char * b, int k)
+static int stem_word(struct stemmer * z, char * b, int k)
 {
     if (k <= 1)
         return k; /*-DEPARTURE-*/
@@ -633,3 +636,22 @@ extern int stem(struct stemmer * z, char * b, int k)
     step5(z);
     return z->k;
 }
+
+extern int stem(struct stemmer * z, char * b, int k)
+{
+    int end;
+    STATS_SCOPE(STAT_PORTER_STEM, k + 1);
+
+    JELLYFISH_PROBE1(stem__entry, k + 1);
+    end = stem_word(z, b, k);
+    JELLYFISH_PROBE2(stem__return, k + 1, end + 1);
+    return end;
+}
+
+/* stem with its state on the stack, for callers with no stemmer to reuse. */
+int stem_in_place(char * b, int k)
+{
+    struct stemmer z;
+
+    return stem(&z, b, k);
+}
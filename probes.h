@@ -0,0 +1,27 @@
+#ifndef _JELLYFISH_PROBES_H_
+#define _JELLYFISH_PROBES_H_
+
+/* USDT tracepoints under the "jellyfish" provider, for SystemTap, perf or
+ * bpftrace, e.g.
+ *
+ *     bpftrace -e 'usdt:./jellyfish*.so:jellyfish:levenshtein__return
+ *                  { @[arg0 + arg1] = hist(arg2); }' -p PID
+ *
+ * Each traced function has an X__entry probe with its input lengths and an
+ * X__return probe with the same lengths and the result.  A probe is a
+ * single nop in the code until a tracer attaches, so they stay compiled in.
+ * setup.py and the Makefile define JELLYFISH_HAVE_SDT when <sys/sdt.h> is
+ * installed; without it the probes compile to nothing.
+ */
+#ifdef JELLYFISH_HAVE_SDT
+#include <sys/sdt.h>
+#define JELLYFISH_PROBE1(name, a) DTRACE_PROBE1(jellyfish, name, a)
+#define JELLYFISH_PROBE2(name, a, b) DTRACE_PROBE2(jellyfish, name, a, b)
+#define JELLYFISH_PROBE3(name, a, b, c) DTRACE_PROBE3(jellyfish, name, a, b, c)
+#else
+#define JELLYFISH_PROBE1(name, a) ((void) 0)
+#define JELLYFISH_PROBE2(name, a, b) ((void) 0)
+#define JELLYFISH_PROBE3(name, a, b, c) ((void) 0)
+#endif
+
+#endif
@@ -0,0 +1,255 @@
+#include "jellyfish.h"
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+/* A query string prepared once for scoring against many candidates.
+ * Everything that depends on the query alone is built by create_query:
+ * copies of the query at every code unit width from its own up, so a
+ * wider candidate never forces a copy of the query; the bit masks of the
+ * bit-parallel Levenshtein and LCS scans; a bitmap of the query's
+ * characters, which bounds the jaro metrics' score before any matching;
+ * and the phonetic key or match rating codex.  A query is never modified
+ * after creation, so any number of threads can score with it at once.
+ */
+struct query {
+    enum query_scorer scorer;
+    enum jellyfish_metric metric;
+    double score_cutoff;
+    bool fold;
+    size_t len;
+    int kind;
+    void *text[JELLYFISH_UCS4 + 1];     /* indexed by code unit width */
+    struct lcs_pattern *pattern;
+    uint64_t chars[4];                  /* low bytes of the query's code points */
+    char *key;
+};
+
+static inline uint32_t code_point(const void *str, size_t i, int kind)
+{
+    switch (kind) {
+    case JELLYFISH_UCS2:
+        return ((const uint16_t *) str)[i];
+    case JELLYFISH_UCS4:
+        return ((const uint32_t *) str)[i];
+    default:
+        return ((const unsigned char *) str)[i];
+    }
+}
+
+static enum dedupe_blocking phonetic_blocking(enum query_scorer scorer)
+{
+    switch (scorer) {
+    case QUERY_SOUNDEX:
+        return BLOCK_SOUNDEX;
+    case QUERY_METAPHONE:
+        return BLOCK_METAPHONE;
+    default:
+        return BLOCK_NYSIIS;
+    }
+}
+
+struct query* create_query(const struct string_ref *text, enum query_scorer scorer,
+                           enum jellyfish_metric metric, bool fold, double score_cutoff)
+{
+    struct query *query = calloc(1, sizeof(struct query));
+    uint32_t c;
+    size_t i;
+    int kind;
+
+    if (!query) {
+        return NULL;
+    }
+    query->scorer = scorer;
+    query->metric = metric;
+    query->score_cutoff = score_cutoff;
+    query->fold = fold;
+    query->len = text->len;
+    query->kind = text->kind;
+
+    for (kind = text->kind; kind <= JELLYFISH_UCS4; kind *= 2) {
+        query->text[kind] = malloc(text->len * kind + kind);
+        if (!query->text[kind]) {
+            goto fail;
+        }
+        for (i = 0; i < text->len; i++) {
+            c = code_point(text->data, i, text->kind);
+            if (kind == JELLYFISH_UCS1) {
+                ((unsigned char *) query->text[kind])[i] = c;
+            } else if (kind == JELLYFISH_UCS2) {
+                ((uint16_t *) query->text[kind])[i] = c;
+            } else {
+                ((uint32_t *) query->text[kind])[i] = c;
+            }
+        }
+    }
+
+    if (scorer != QUERY_METRIC) {
+        query->key = row_phonetic_key(text, phonetic_blocking(scorer), fold,
+                                      scorer == QUERY_MATCH_RATING);
+        if (!query->key) {
+            goto fail;
+        }
+    } else if (metric == METRIC_LEVENSHTEIN || metric == METRIC_LCS) {
+        query->pattern = create_lcs_pattern(text->data, text->len, text->kind);
+        if (!query->pattern) {
+            goto fail;
+        }
+    } else {
+        for (i = 0; i < text->len; i++) {
+            c = code_point(text->data, i, text->kind) & 0xFF;
+            query->chars[c / 64] |= (uint64_t) 1 << (c % 64);
+        }
+    }
+    return query;
+
+fail:
+    free_query(query);
+    return NULL;
+}
+
+void free_query(struct query *query)
+{
+    int kind;
+
+    if (query) {
+        for (kind = JELLYFISH_UCS1; kind <= JELLYFISH_UCS4; kind *= 2) {
+            free(query->text[kind]);
+        }
+        free_lcs_pattern(query->pattern);
+        free(query->key);
+        free(query);
+    }
+}
+
+/* The best jaro score row could reach: at most as many characters can
+ * match as row has characters in the query's bitmap, with no
+ * transpositions and, for Jaro-Winkler, a full four character prefix.
+ */
+static double jaro_bound(const struct query *query, const struct string_ref *row)
+{
+    size_t i, common = 0;
+    uint32_t c;
+    double bound;
+
+    for (i = 0; i < row->len; i++) {
+        c = code_point(row->data, i, row->kind) & 0xFF;
+        common += (query->chars[c / 64] >> (c % 64)) & 1;
+    }
+    common = MIN(common, MIN(query->len, row->len));
+    if (common == 0) {
+        return 0;
+    }
+    bound = ((double) common / query->len + (double) common / row->len + 1) / 3;
+    if (query->metric == METRIC_JARO_WINKLER) {
+        bound += 0.4 * (1 - bound);
+    }
+    return bound;
+}
+
+double query_score(const struct query *query, const struct string_ref *candidate,
+                   struct row_buffer *scratch)
+{
+    struct string_ref row = *candidate;
+    const void *text;
+    char *key;
+    double score;
+    STATS_SCOPE(STAT_QUERY, query->len * query->kind + row.len * row.kind);
+
+    if (query->scorer != QUERY_METRIC) {
+        key = row_phonetic_key(&row, phonetic_blocking(query->scorer), query->fold,
+                               query->scorer == QUERY_MATCH_RATING);
+        if (!key) {
+            return NAN;
+        }
+        if (query->scorer == QUERY_MATCH_RATING) {
+            score = match_rating_compare_codex(query->key, key) > 0;
+        } else {
+            score = strcmp(query->key, key) == 0;
+        }
+        free(key);
+        return score;
+    }
+
+    switch (query->metric) {
+    case METRIC_LEVENSHTEIN:
+        return lcs_pattern_levenshtein_similarity(query->pattern, row.data, row.len, row.kind,
+                                                  query->score_cutoff);
+    case METRIC_LCS:
+        return lcs_pattern_similarity(query->pattern, row.data, row.len, row.kind,
+                                      query->score_cutoff);
+    case METRIC_JARO:
+    case METRIC_JARO_WINKLER:
+        if (query->score_cutoff > 0 && jaro_bound(query, &row) < query->score_cutoff - 1e-9) {
+            return 0;
+        }
+        break;
+    default:
+        break;
+    }
+
+    /* The remaining metrics compare code units of one width. */
+    if (row.kind < query->kind && widen_row(&row, query->kind, scratch) < 0) {
+        return NAN;
+    }
+    text = query->text[row.kind];
+    return jellyfish_similarity(query->metric, text, query->len, row.data, row.len, row.kind,
+                                query->score_cutoff);
+}
+
+struct query_job {
+    const struct query *query;
+    const struct string_column *col;
+    double *out;
+    int failed;
+};
+
+static void score_candidates(void *ctx, size_t begin, size_t end)
+{
+    struct query_job *job = ctx;
+    struct row_buffer buf = { NULL, 0 }, scratch = { NULL, 0 };
+    struct string_ref row;
+    size_t i;
+    int found;
+
+    for (i = begin; i < end && !__atomic_load_n(&job->failed, __ATOMIC_RELAXED); i++) {
+        found = column_row(job->col, i, &row, &buf);
+        if (found < 0) {
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        job->out[i] = found ? query_score(job->query, &row, &scratch) : NAN;
+        if (found && isnan(job->out[i])) {
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    free(buf.data);
+    free(scratch.data);
+}
+
+/* Every candidate is compared with the same query, so its cost grows with
+ * its length.
+ */
+static double candidate_cost(void *ctx, size_t i)
+{
+    struct query_job *job = ctx;
+
+    return column_units(job->col, i) + 1;
+}
+
+/* Candidates per block below which splitting the work costs more than it
+ * saves.
+ */
+#define QUERY_GRAIN 256
+
+int query_score_column(const struct query *query, const struct string_column *col,
+                       double *out, size_t threads)
+{
+    struct query_job job = { query, col, out, 0 };
+    STATS_SCOPE(STAT_QUERY_COLUMN, column_bytes(col));
+
+    parallel_for_cost(col->length, QUERY_GRAIN, threads, score_candidates, candidate_cost,
+                      &job);
+    return job.failed ? -1 : 0;
+}
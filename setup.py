@@ -1,4 +1,6 @@
 #!/usr/bin/env python
+import os
+import subprocess
 from setuptools import setup, Extension
 
 
@@ -9,10 +11,76 @@ with open("VERSION", "r") as f:
     VERSION = f.read().strip()
 
 SOURCES = ['jellyfishmodule.c', 'jaro.c', 'hamming.c', 'levenshtein.c',
-           'nysiis.c', 'damerau_levenshtein.c', 'mra.c', 'soundex.c',
-           'metaphone.c', 'porter.c']
+           'nysiis.c', 'damerau_levenshtein.c', 'weighted_levenshtein.c', 'mra.c',
+           'alignment.c', 'lcs.c', 'metric.c', 'tokenize.c', 'token.c',
+           'soundex.c', 'metaphone.c', 'porter.c', 'cpu.c', 'threadpool.c',
+           'pairwise.c', 'cluster.c', 'query.c', 'nfkd.c',
+           'stats.c', 'arena.c']
 
-COMPILE_ARGS = ["-O3", "-std=c11", "-pg", "-fprofile-arcs", "-ftest-coverage"]
+# Build modes, selected with the JELLYFISH_BUILD environment variable:
+#
+#   release       optimized build for installs and wheels (the default)
+#   instrumented  gprof (-pg) and gcov coverage counters, for analysis only
+#   pgo-generate  writes branch profiles to JELLYFISH_PGO_DIR when run
+#   pgo-use       optimized build using the profiles collected above
+#
+# "make pgo" drives the two PGO stages with pgo_train.py as the workload.
+PGO_DIR = os.path.abspath(os.environ.get("JELLYFISH_PGO_DIR",
+                                         os.path.join("build", "pgo")))
+
+BUILD_MODES = {
+    "release": {
+        "compile": ["-O3", "-std=c11"],
+        "link": [],
+    },
+    "instrumented": {
+        "compile": ["-O3", "-std=c11", "-g", "-pg", "-fprofile-arcs",
+                    "-ftest-coverage"],
+        "link": ["-pg", "-lgcov"],
+    },
+    "pgo-generate": {
+        "compile": ["-O3", "-std=c11", "-fprofile-generate=" + PGO_DIR,
+                    "-fprofile-update=atomic"],
+        "link": ["-fprofile-generate=" + PGO_DIR],
+    },
+    "pgo-use": {
+        "compile": ["-O3", "-std=c11", "-fprofile-use=" + PGO_DIR,
+                    "-fprofile-correction", "-Wno-missing-profile"],
+        "link": [],
+    },
+}
+
+BUILD_MODE = os.environ.get("JELLYFISH_BUILD", "release")
+if BUILD_MODE not in BUILD_MODES:
+    raise SystemExit("unknown JELLYFISH_BUILD mode %r (expected one of: %s)"
+                     % (BUILD_MODE, ", ".join(sorted(BUILD_MODES))))
+
+# Kernel templates are #included once per code unit width.
+DEPENDS = ['jellyfish.h', 'jaro_impl.h', 'hamming_impl.h', 'levenshtein_impl.h',
+           'damerau_levenshtein_impl.h', 'weighted_levenshtein_impl.h',
+           'lcs_impl.h', 'probes.h']
+
+# pairwise_similarity and pairwise_distance run on POSIX threads.
+COMPILE_ARGS = BUILD_MODES[BUILD_MODE]["compile"] + ["-pthread"]
+LINK_ARGS = BUILD_MODES[BUILD_MODE]["link"] + ["-pthread"]
+
+
+def have_header(header):
+    """Whether the C compiler can #include header."""
+    command = os.environ.get("CC", "cc").split() + ["-E", "-x", "c", "-"]
+    with open(os.devnull, "w") as devnull:
+        try:
+            proc = subprocess.Popen(command, stdin=subprocess.PIPE, stdout=devnull,
+                                    stderr=devnull)
+        except OSError:
+            return False
+        proc.communicate(("#include <%s>\n" % header).encode("ascii"))
+    return proc.returncode == 0
+
+
+# The USDT probes in probes.h need systemtap's sys/sdt.h; without it they
+# compile to nothing.
+DEFINE_MACROS = [("JELLYFISH_HAVE_SDT", "1")] if have_header("sys/sdt.h") else []
 
 setup(name="jellyfish",
       version=VERSION,
@@ -30,5 +98,7 @@ setup(name="jellyfish",
                    "Topic :: Text Processing :: Linguistic"],
       ext_modules=[Extension(name="jellyfish",
                              sources=SOURCES,
+                             depends=DEPENDS,
+                             define_macros=DEFINE_MACROS,
                              extra_compile_args=COMPILE_ARGS,
-                             extra_link_args=["-lgcov"])])
+                             extra_link_args=LINK_ARGS)])
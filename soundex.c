@@ -1,8 +1,10 @@
 #include "jellyfish.h"
 #include <ctype.h>
 #include <stdlib.h>
+#include <string.h>
+#include "probes.h"
 
-char* soundex(const char *str)
+static char* soundex_kernel(const char *str)
 {
     const char *s;
     char c, prev;
@@ -68,3 +70,15 @@ char* soundex(const char *str)
 
     return result;
 }
+
+char* soundex(const char *str)
+{
+    size_t len = strlen(str);
+    char *result;
+    STATS_SCOPE(STAT_SOUNDEX, len);
+
+    JELLYFISH_PROBE1(soundex__entry, len);
+    result = soundex_kernel(str);
+    JELLYFISH_PROBE2(soundex__return, len, result);
+    return result;
+}
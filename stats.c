@@ -0,0 +1,188 @@
+#define _POSIX_C_SOURCE 199309L
+#include "jellyfish.h"
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+/* Each thread that records a call gets its own block of counters, which
+ * only that thread writes, so recording is plain loads and relaxed stores.
+ * Blocks are linked into a list that readers walk under stats_lock; when
+ * a thread exits its counts are added to retired and its block freed, so
+ * the threads of a long-lived service do not pile up.  Resetting keeps a
+ * baseline that later reads subtract, as the counters belong to their
+ * threads and cannot be cleared from outside.
+ */
+struct stats_block {
+    struct jellyfish_stats stats[STAT_COUNT];
+    struct stats_block *next;
+};
+
+static const char *const stat_names[STAT_COUNT] = {
+    "jaro_distance",
+    "jaro_winkler",
+    "hamming_distance",
+    "levenshtein",
+    "damerau_levenshtein",
+    "lcs",
+    "weighted_levenshtein_distance",
+    "weighted_damerau_levenshtein_distance",
+    "levenshtein_editops",
+    "token_sort",
+    "token_set",
+    "monge_elkan",
+    "soundex",
+    "metaphone",
+    "nysiis",
+    "match_rating_codex",
+    "match_rating_comparison",
+    "porter_stem",
+    "get_matches",
+    "pairwise",
+    "cdist",
+    "pdist",
+    "dedupe",
+    "query",
+    "query_column",
+};
+
+int jellyfish_stats_enabled;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key;
+static struct stats_block *blocks;
+static struct jellyfish_stats retired[STAT_COUNT];
+static struct jellyfish_stats baseline[STAT_COUNT];
+static __thread struct stats_block *local;
+
+static void add_stats(struct jellyfish_stats *to, const struct jellyfish_stats *from)
+{
+    int i, b;
+
+    for (i = 0; i < STAT_COUNT; i++) {
+        to[i].calls += __atomic_load_n(&from[i].calls, __ATOMIC_RELAXED);
+        to[i].bytes += __atomic_load_n(&from[i].bytes, __ATOMIC_RELAXED);
+        to[i].time_ns += __atomic_load_n(&from[i].time_ns, __ATOMIC_RELAXED);
+        for (b = 0; b < STATS_BUCKETS; b++) {
+            to[i].histogram[b] += __atomic_load_n(&from[i].histogram[b], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void retire_block(void *arg)
+{
+    struct stats_block *block = arg, **p;
+
+    pthread_mutex_lock(&stats_lock);
+    for (p = &blocks; *p; p = &(*p)->next) {
+        if (*p == block) {
+            *p = block->next;
+            break;
+        }
+    }
+    add_stats(retired, block->stats);
+    pthread_mutex_unlock(&stats_lock);
+    free(block);
+}
+
+static void create_key(void)
+{
+    pthread_key_create(&stats_key, retire_block);
+}
+
+static struct stats_block* local_block(void)
+{
+    struct stats_block *block;
+
+    if (local) {
+        return local;
+    }
+    block = calloc(1, sizeof(struct stats_block));
+    if (!block) {
+        return NULL;
+    }
+    pthread_once(&stats_once, create_key);
+    pthread_setspecific(stats_key, block);
+
+    pthread_mutex_lock(&stats_lock);
+    block->next = blocks;
+    blocks = block;
+    pthread_mutex_unlock(&stats_lock);
+    local = block;
+    return block;
+}
+
+uint64_t stats_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+#define BUMP(counter, n) \
+    __atomic_store_n(&(counter), (counter) + (n), __ATOMIC_RELAXED)
+
+void stats_record(enum jellyfish_stat stat, size_t bytes, uint64_t start)
+{
+    struct stats_block *block = local_block();
+    uint64_t elapsed = stats_clock() - start;
+    int bucket = elapsed ? 63 - __builtin_clzll(elapsed) : 0;
+    struct jellyfish_stats *s;
+
+    /* Without memory for the counters the call goes unrecorded. */
+    if (!block) {
+        return;
+    }
+    s = &block->stats[stat];
+    BUMP(s->calls, 1);
+    BUMP(s->bytes, bytes);
+    BUMP(s->time_ns, elapsed);
+    BUMP(s->histogram[MIN(bucket, STATS_BUCKETS - 1)], 1);
+}
+
+void jellyfish_stats_enable(bool enabled)
+{
+    __atomic_store_n(&jellyfish_stats_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+const char* jellyfish_stat_name(enum jellyfish_stat stat)
+{
+    return stat < STAT_COUNT ? stat_names[stat] : NULL;
+}
+
+/* The totals over live and retired threads, before the baseline. */
+static void read_totals(struct jellyfish_stats stats[STAT_COUNT])
+{
+    struct stats_block *block;
+
+    memset(stats, 0, STAT_COUNT * sizeof(struct jellyfish_stats));
+    add_stats(stats, retired);
+    for (block = blocks; block; block = block->next) {
+        add_stats(stats, block->stats);
+    }
+}
+
+void jellyfish_stats_read(struct jellyfish_stats stats[STAT_COUNT])
+{
+    int i, b;
+
+    pthread_mutex_lock(&stats_lock);
+    read_totals(stats);
+    for (i = 0; i < STAT_COUNT; i++) {
+        stats[i].calls -= baseline[i].calls;
+        stats[i].bytes -= baseline[i].bytes;
+        stats[i].time_ns -= baseline[i].time_ns;
+        for (b = 0; b < STATS_BUCKETS; b++) {
+            stats[i].histogram[b] -= baseline[i].histogram[b];
+        }
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void jellyfish_stats_reset(void)
+{
+    pthread_mutex_lock(&stats_lock);
+    read_totals(baseline);
+    pthread_mutex_unlock(&stats_lock);
+}
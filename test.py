@@ -1,8 +1,33 @@
 # -*- coding: utf-8 -*-
 import csv
+import json
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
 import unittest
 import jellyfish
 
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
+try:
+    import pyarrow
+except ImportError:
+    pyarrow = None
+
+
+def find_program(name):
+    for directory in os.environ.get("PATH", "").split(os.pathsep):
+        path = os.path.join(directory, name)
+        if os.path.isfile(path) and os.access(path, os.X_OK):
+            return path
+    return None
+
 
 class JellyfishTestCase(unittest.TestCase):
 
@@ -16,6 +41,30 @@ class JellyfishTestCase(unittest.TestCase):
             actual = jellyfish.jaro_winkler(s1, s2)
             self.assertAlmostEqual(actual, value, places=4)
 
+    def test_jaro_winkler_long_tolerance(self):
+        s1, s2 = u"thisisalongstring", u"thisisalongstrnig"
+        self.assertAlmostEqual(jellyfish.jaro_winkler(s1, s2), 0.9882, places=4)
+        self.assertAlmostEqual(jellyfish.jaro_winkler(s1, s2, long_tolerance=True), 0.9933,
+                               places=4)
+        self.assertEqual(jellyfish.jaro_winkler(u"abcd", u"abdc", long_tolerance=True),
+                         jellyfish.jaro_winkler(u"abcd", u"abdc"))
+        self.assertAlmostEqual(jellyfish.jaro_winkler(s1, s2, True), 0.9933, places=4)
+        self.assertAlmostEqual(jellyfish.jaro_winkler(u"martha", u"marhta", True), 0.9708,
+                               places=4)
+        self.assertEqual(jellyfish.jaro_winkler(u"dixon", u"dicksonx", False, 0.9), 0.0)
+
+    def test_keyword_arguments(self):
+        self.assertAlmostEqual(jellyfish.jaro_winkler(string2=u"duane", string1=u"dwayne"),
+                               0.84, places=4)
+        self.assertEqual(jellyfish.hamming_distance(u"acc", string2=u"abc"), 1)
+        self.assertEqual(jellyfish.soundex(string=u"Robert"), u"R163")
+        self.assertEqual(list(jellyfish.pdist_distance(strings=[u"a", u"ab"], threads=1)), [1])
+        self.assertRaises(TypeError, jellyfish.jaro_winkler, u"a", u"b", bogus=1)
+        self.assertRaises(TypeError, jellyfish.jaro_winkler, u"a", string1=u"b")
+        self.assertRaises(TypeError, jellyfish.levenshtein_distance, u"a")
+        self.assertRaises(TypeError, jellyfish.levenshtein_distance, u"a", u"b", u"c")
+        self.assertRaises(TypeError, jellyfish.nysiis, b"a")
+
     def test_jaro_distance(self):
         cases = [("dicksonx", "dixon", 0.767),
                  ("dixon", "dicksonx", 0.767),
@@ -55,6 +104,8 @@ class JellyfishTestCase(unittest.TestCase):
                  ("abc", "", 3),
                  ("bc", "abc", 1),
                  ("abc", "acb", 1),
+                 ("ab", "ba", 1),
+                 ("ba", "abc", 2),
                  ]
 
         for (s1, s2, value) in cases:
@@ -119,6 +170,9 @@ class JellyfishTestCase(unittest.TestCase):
                  ("Smith", "Smyth", True),
                  ("Catherine", "Kathryn", True),
                  ("Michael", "Mike", False),
+                 ("Tim", "Timothy", False),
+                 ("", "abc", False),
+                 ("Timothy", "", False),
                  ]
 
         for (s1, s2, value) in cases:
@@ -126,7 +180,7 @@ class JellyfishTestCase(unittest.TestCase):
 
     def test_match_rating_comparison_segfault(self):
         import hashlib
-        sha1s = [hashlib.sha1(str(v)).hexdigest() for v in range(100)]
+        sha1s = [hashlib.sha1(str(v).encode("ascii")).hexdigest() for v in range(100)]
         # this segfaulted on 0.1.2
         assert [[jellyfish.match_rating_comparison(h1, h2) for h1 in sha1s]
                 for h2 in sha1s]
@@ -137,5 +191,611 @@ class JellyfishTestCase(unittest.TestCase):
             for (a, b) in reader:
                 self.assertEqual(jellyfish.porter_stem(a.lower()), b.lower())
 
+    def test_code_points(self):
+        # accented and non-Latin characters count as one edit, not one per
+        # UTF-8 byte, whatever the storage width of each argument
+        cases = [(u"café", u"cafe", 1),
+                 (u"naïve", u"naive", 1),
+                 (u"Дмитрий", u"Дмитри", 1),
+                 (u"ab€", u"abc", 1),
+                 (u"a\U0001F600", u"a\U0001F601", 1),
+                 (u"a\U0001F600", u"aé", 1)]
+
+        for (s1, s2, value) in cases:
+            self.assertEqual(jellyfish.levenshtein_distance(s1, s2), value)
+            self.assertEqual(jellyfish.damerau_levenshtein_distance(s1, s2), value)
+            self.assertEqual(jellyfish.hamming_distance(s1, s2), value)
+
+        self.assertEqual(jellyfish.jaro_winkler(u"Дмитрий", u"Дмитрий"), 1.0)
+        self.assertAlmostEqual(jellyfish.jaro_distance(u"mаrtha", u"mаrhta"),
+                               jellyfish.jaro_distance("martha", "marhta"))
+        self.assertEqual(jellyfish.levenshtein_distance(b"caf\xc3\xa9", b"cafe"), 2)
+        self.assertRaises(TypeError, jellyfish.levenshtein_distance, u"abc", b"abc")
+
+    def test_token_similarity(self):
+        self.assertEqual(jellyfish.token_sort_similarity(u"john smith", u"smith, john"), 1.0)
+        self.assertEqual(jellyfish.token_sort_similarity(u"caf\u00e9 au lait",
+                                                         u"lait au caf\u00e9"), 1.0)
+        self.assertAlmostEqual(jellyfish.token_sort_similarity(u"smith john", u"jon smith"),
+                               jellyfish.levenshtein_similarity(u"john smith", u"jon smith"))
+        self.assertAlmostEqual(
+            jellyfish.token_sort_similarity(u"smith john", u"jon smith", metric="jaro_winkler"),
+            jellyfish.jaro_winkler(u"john smith", u"jon smith"))
+        self.assertEqual(jellyfish.token_sort_similarity(u"", u""), 1.0)
+
+        self.assertEqual(jellyfish.token_set_similarity(u"acme corp", u"corp acme acme inc"), 1.0)
+        self.assertAlmostEqual(
+            jellyfish.token_set_similarity(u"new york mets", u"new york yankees", metric="lcs"),
+            jellyfish.lcs_similarity(u"new york", u"new york mets"))
+        self.assertEqual(jellyfish.token_set_similarity(u"", u"acme"), 0.0)
+        self.assertEqual(jellyfish.token_set_similarity(u"new york mets", u"new york yankees",
+                                                        metric="lcs", score_cutoff=0.8), 0.0)
+
+        self.assertRaises(ValueError, jellyfish.token_sort_similarity, u"a", u"b", "hamming")
+
+    def test_monge_elkan(self):
+        def reference(s1, s2, metric):
+            tokens1, tokens2 = s1.split(), s2.split()
+            return sum(max(metric(t1, t2) for t2 in tokens2) for t1 in tokens1) / len(tokens1)
+
+        pairs = [(u"john quincy adams", u"adams, john"),
+                 (u"jon smyth", u"john smith"),
+                 (u"mary ann mary", u"maryanne")]
+        for (s1, s2) in pairs:
+            self.assertAlmostEqual(jellyfish.monge_elkan_similarity(s1, s2),
+                                   reference(s1.replace(u",", u""), s2.replace(u",", u""),
+                                             jellyfish.jaro_winkler))
+            self.assertAlmostEqual(jellyfish.monge_elkan_similarity(s1, s2, metric="levenshtein"),
+                                   reference(s1.replace(u",", u""), s2.replace(u",", u""),
+                                             jellyfish.levenshtein_similarity))
+            self.assertAlmostEqual(jellyfish.monge_elkan_similarity(s1, s2, symmetric=True),
+                                   (jellyfish.monge_elkan_similarity(s1, s2) +
+                                    jellyfish.monge_elkan_similarity(s2, s1)) / 2)
+
+        self.assertEqual(jellyfish.monge_elkan_similarity(u"adams john", u"john quincy adams"), 1.0)
+        self.assertEqual(jellyfish.monge_elkan_similarity(u"jon smyth", u"john smith",
+                                                          score_cutoff=0.95), 0.0)
+        self.assertEqual(jellyfish.monge_elkan_similarity(u"", u"john"), 0.0)
+
+    def test_lcs(self):
+        def reference(s1, s2):
+            row = [0] * (len(s2) + 1)
+            for c in s1:
+                new = [0]
+                for (j, d) in enumerate(s2):
+                    new.append(row[j] + 1 if c == d else max(row[j + 1], new[j]))
+                row = new
+            return row[-1]
+
+        self.assertEqual(jellyfish.lcs_length(u"ABCBDAB", u"BDCABA"), 4)
+        self.assertEqual(jellyfish.indel_distance(u"kitten", u"sitting"), 5)
+        self.assertAlmostEqual(jellyfish.lcs_similarity(u"kitten", u"sitting"), 8 / 13.0)
+        self.assertEqual(jellyfish.lcs_similarity(u"", u""), 1.0)
+        self.assertEqual(jellyfish.lcs_similarity(u"kitten", u"sitting", score_cutoff=0.7), 0.0)
+        self.assertEqual(jellyfish.lcs_length(b"caf\xc3\xa9", b"cafe"), 3)
+
+        # Patterns of several 64 bit words and with code points above U+00FF.
+        rng = random.Random(35)
+        for (n1, n2) in [(1, 70), (64, 64), (65, 100), (200, 130)]:
+            s1 = u"".join(rng.choice(u"ab\u00e9\u20ac\U0001f600") for _ in range(n1))
+            s2 = u"".join(rng.choice(u"ab\u20ac\U0001f600") for _ in range(n2))
+            self.assertEqual(jellyfish.lcs_length(s1, s2), reference(s1, s2))
+            self.assertEqual(jellyfish.lcs_length(s2, s1), reference(s1, s2))
+
+        choices = [u"sitting", u"kitchen", u"", u"kitten", u"\u20ackitten"]
+        self.assertEqual(jellyfish.lcs_similarity_many(u"kitten", choices, score_cutoff=0.5),
+                         [jellyfish.lcs_similarity(u"kitten", c, 0.5) for c in choices])
+        self.assertRaises(TypeError, jellyfish.lcs_similarity_many, u"kitten", [b"kitten"])
+
+    def test_similarity(self):
+        self.assertAlmostEqual(jellyfish.levenshtein_similarity(u"kitten", u"sitting"), 4 / 7.0)
+        self.assertAlmostEqual(jellyfish.damerau_levenshtein_similarity(u"abcd", u"abdc"), 0.75)
+        self.assertEqual(jellyfish.levenshtein_similarity(u"", u""), 1.0)
+        self.assertEqual(jellyfish.levenshtein_similarity(u"abc", u""), 0.0)
+
+        # The cutoff is inclusive and anything below it scores 0.
+        self.assertEqual(jellyfish.damerau_levenshtein_similarity(u"abcd", u"abdc",
+                                                                  score_cutoff=0.75), 0.75)
+        self.assertEqual(jellyfish.damerau_levenshtein_similarity(u"abcd", u"abdc",
+                                                                  score_cutoff=0.76), 0.0)
+        self.assertEqual(jellyfish.levenshtein_similarity(u"kitten", u"sitting", 0.6), 0.0)
+        self.assertEqual(jellyfish.levenshtein_similarity(u"a" * 50, u"b" * 60, 0.5), 0.0)
+
+        rng = random.Random(34)
+        for _ in range(200):
+            s1 = u"".join(rng.choice(u"ab\u00e9") for _ in range(rng.randrange(40)))
+            s2 = u"".join(rng.choice(u"abc") for _ in range(rng.randrange(40)))
+            longest = max(len(s1), len(s2)) or 1
+            for (distance, similarity) in [
+                    (jellyfish.levenshtein_distance, jellyfish.levenshtein_similarity),
+                    (jellyfish.damerau_levenshtein_distance,
+                     jellyfish.damerau_levenshtein_similarity)]:
+                expected = 1 - distance(s1, s2) / float(longest)
+                for cutoff in (0.0, 0.5, 0.8, expected):
+                    self.assertAlmostEqual(similarity(s1, s2, score_cutoff=cutoff),
+                                           expected if expected >= cutoff else 0.0)
+
+        self.assertAlmostEqual(jellyfish.jaro_winkler(u"dixon", u"dicksonx", score_cutoff=0.8),
+                               0.8133, places=4)
+        self.assertEqual(jellyfish.jaro_winkler(u"dixon", u"dicksonx", score_cutoff=0.9), 0.0)
+        self.assertEqual(jellyfish.jaro_distance(u"ab", u"abcdefghij", score_cutoff=0.8), 0.0)
+
+    def test_levenshtein_editops(self):
+        def apply(s1, s2, ops):
+            out, pos = [], 0
+            for (op, i, j) in ops:
+                out.append(s1[pos:i])
+                pos = i
+                if op != "insert":
+                    pos += 1
+                if op != "delete":
+                    out.append(s2[j])
+            out.append(s1[pos:])
+            return u"".join(out)
+
+        self.assertEqual(jellyfish.levenshtein_editops(u"kitten", u"sitting"),
+                         [("replace", 0, 0), ("replace", 4, 4), ("insert", 6, 6)])
+        self.assertEqual(jellyfish.levenshtein_opcodes(u"kitten", u"sitting"),
+                         [("replace", 0, 1, 0, 1), ("equal", 1, 4, 1, 4),
+                          ("replace", 4, 5, 4, 5), ("equal", 5, 6, 5, 6),
+                          ("insert", 6, 6, 6, 7)])
+        self.assertEqual(jellyfish.levenshtein_editops(u"abc", u"abc"), [])
+        self.assertEqual(jellyfish.levenshtein_opcodes(u"", u""), [])
+
+        # Long enough to go through the divide and conquer splits.
+        rng = random.Random(33)
+        for (n1, n2) in [(0, 5), (5, 0), (1, 300), (300, 1), (200, 250), (500, 450)]:
+            s1 = u"".join(rng.choice(u"ab\u00e9\u20ac") for _ in range(n1))
+            s2 = u"".join(rng.choice(u"abc") for _ in range(n2))
+            ops = jellyfish.levenshtein_editops(s1, s2)
+            self.assertEqual(len(ops), jellyfish.levenshtein_distance(s1, s2))
+            self.assertEqual(apply(s1, s2, ops), s2)
+            for (tag, i1, i2, j1, j2) in jellyfish.levenshtein_opcodes(s1, s2):
+                if tag == "equal":
+                    self.assertEqual(s1[i1:i2], s2[j1:j2])
+
+    def test_weighted_distance(self):
+        uniform = jellyfish.CostTable()
+        for (s1, s2) in [(u"", u""), (u"abc", u""), (u"kitten", u"sitting"),
+                         (u"Saturday", u"Sunday"), (u"caf\u00e9", u"cafe")]:
+            self.assertEqual(jellyfish.weighted_levenshtein_distance(s1, s2, uniform),
+                             jellyfish.levenshtein_distance(s1, s2))
+        for (s1, s2) in [(u"ab", u"ba"), (u"abcd", u"badc"), (u"ca", u"abc"),
+                         (u"\u20acx", u"x\u20ac")]:
+            self.assertEqual(jellyfish.weighted_damerau_levenshtein_distance(s1, s2, uniform),
+                             jellyfish.damerau_levenshtein_distance(s1, s2))
+
+        ocr = jellyfish.CostTable(substitutions={(u"0", u"O"): 0.25})
+        self.assertEqual(jellyfish.weighted_levenshtein_distance(u"B0B", u"BOB", ocr), 0.25)
+        self.assertEqual(jellyfish.weighted_levenshtein_distance(u"BOB", u"B0B", ocr), 0.25)
+        ocr.set_substitute(u"l", u"1", 0.5, symmetric=False)
+        self.assertEqual(jellyfish.weighted_levenshtein_distance(u"l", u"1", ocr), 0.5)
+        self.assertEqual(jellyfish.weighted_levenshtein_distance(u"1", u"l", ocr), 1.0)
+
+        gaps = jellyfish.CostTable(insert=2.0, delete=0.5, substitute=3.0)
+        gaps.set_insert(u" ", 0.1)
+        self.assertEqual(jellyfish.weighted_levenshtein_distance(u"ab", u"a b", gaps), 0.1)
+        self.assertEqual(jellyfish.weighted_levenshtein_distance(u"ab", u"ac", gaps), 2.5)
+
+        swaps = jellyfish.CostTable(transpose=0.5)
+        self.assertEqual(jellyfish.weighted_damerau_levenshtein_distance(u"ab", u"ba", swaps),
+                         0.5)
+        self.assertEqual(jellyfish.weighted_damerau_levenshtein_distance(u"abc", u"ca", swaps),
+                         jellyfish.damerau_levenshtein_distance(u"abc", u"ca"))
+        self.assertEqual(jellyfish.weighted_levenshtein_distance(u"ab", u"ba", swaps), 2.0)
+
+        self.assertRaises(ValueError, ocr.set_substitute, u"\u20ac", u"E", 0.1)
+        self.assertRaises(ValueError, ocr.set_insert, u"ab", 0.1)
+        self.assertRaises(ValueError, jellyfish.CostTable, insert=-1.0)
+        self.assertRaises(TypeError, jellyfish.weighted_levenshtein_distance, u"a", u"b", {})
+
+    def test_pairwise(self):
+        strings1 = [u"jellyfish", u"dixon", u"", u"caf\u00e9", u"\u20ac\U0001d11e", None]
+        strings2 = [u"smellyfish", u"dicksonx", u"", u"cafe", u"\u20ac", u"x"]
+        single = {"levenshtein": jellyfish.levenshtein_similarity,
+                  "damerau_levenshtein": jellyfish.damerau_levenshtein_similarity,
+                  "jaro": jellyfish.jaro_distance,
+                  "jaro_winkler": jellyfish.jaro_winkler,
+                  "lcs": jellyfish.lcs_similarity}
+        for (metric, func) in single.items():
+            scores = jellyfish.pairwise_similarity(strings1, tuple(strings2), metric=metric)
+            self.assertEqual(list(scores[:-1]),
+                             [func(s1, s2) for (s1, s2) in zip(strings1[:-1], strings2)])
+            self.assertNotEqual(scores[-1], scores[-1])
+        self.assertEqual(list(jellyfish.pairwise_distance(strings1, strings2)),
+                         [2, 4, 0, 1, 1, -1])
+        self.assertEqual(list(jellyfish.pairwise_distance(strings1[:-1], strings2[:-1],
+                                                          metric="lcs")),
+                         [jellyfish.indel_distance(s1, s2)
+                          for (s1, s2) in zip(strings1[:-1], strings2)])
+
+        words = [u"".join(random.choice(u"abc\u00e9") for _ in range(random.randrange(8)))
+                 for _ in range(2000)]
+        others = words[::-1]
+        self.assertEqual(list(jellyfish.pairwise_distance(words, others, threads=4)),
+                         [jellyfish.levenshtein_distance(s1, s2) for (s1, s2) in zip(words, others)])
+        self.assertEqual(list(jellyfish.pairwise_similarity([b"ab"], [b"ac"])), [0.5])
+
+        self.assertRaises(TypeError, jellyfish.pairwise_similarity, [u"a"], [b"a"])
+        self.assertRaises(TypeError, jellyfish.pairwise_similarity, u"ab", u"cd")
+        self.assertRaises(ValueError, jellyfish.pairwise_similarity, [u"a"], [u"a", u"b"])
+        self.assertRaises(ValueError, jellyfish.pairwise_distance, [u"a"], [u"b"],
+                          metric="jaro")
+
+    def test_skewed_batches(self):
+        # A few long rows among many short ones, and one large bucket: the
+        # threads split the work by cost but every row is still scored once.
+        words = [u"".join(random.choice(u"ab") for _ in range(random.choice((3, 5, 300))
+                                                                if i % 97 == 0 else 6))
+                 for i in range(3000)]
+        others = words[1:] + words[:1]
+        expected = [jellyfish.levenshtein_distance(s1, s2) for (s1, s2) in zip(words, others)]
+        for threads in (1, 3, 16):
+            self.assertEqual(list(jellyfish.pairwise_distance(words, others, threads=threads)),
+                             expected)
+        self.assertEqual(list(jellyfish.cdist_distance(words[:100], words[:70], threads=5)),
+                         list(jellyfish.cdist_distance(words[:100], words[:70], threads=1)))
+
+        names = [u"Smith"] * 500 + [u"Name%d" % i for i in range(2000)]
+        for blocking in ("soundex", "qgram"):
+            self.assertEqual(list(jellyfish.dedupe(names, blocking=blocking, threads=8)),
+                             list(jellyfish.dedupe(names, blocking=blocking, threads=1)))
+
+    @unittest.skipUnless(numpy and pyarrow, "needs numpy and pyarrow")
+    def test_pairwise_arrays(self):
+        strings1 = [u"jellyfish", u"dixon", u"", u"caf\u00e9", u"\u20ac\U0001d11e", u"ab"]
+        strings2 = [u"smellyfish", u"dicksonx", u"", u"cafe", u"\u20ac", u"x"]
+        expected = list(jellyfish.pairwise_similarity(strings1, strings2, metric="jaro_winkler"))
+
+        for column1 in (numpy.array(strings1), numpy.array(strings1, dtype=object),
+                        pyarrow.array(strings1), pyarrow.array(strings1, pyarrow.large_string())):
+            for column2 in (numpy.array(strings2), pyarrow.array(strings2)):
+                self.assertEqual(list(jellyfish.pairwise_similarity(column1, column2,
+                                                                    metric="jaro_winkler")),
+                                 expected)
+
+        out = numpy.zeros(len(strings1), dtype=numpy.int32)
+        result = jellyfish.pairwise_distance(pyarrow.array(strings1), numpy.array(strings2),
+                                             out=out)
+        self.assertIs(result, out)
+        self.assertEqual(list(out), list(jellyfish.pairwise_distance(strings1, strings2)))
+
+        sliced = pyarrow.array([u"x", None, u"ab", u"b"])[1:]
+        scores = jellyfish.pairwise_similarity(sliced, [u"ab", u"ab", u"b"])
+        self.assertNotEqual(scores[0], scores[0])
+        self.assertEqual(list(scores[1:]), [1.0, 1.0])
+        self.assertEqual(list(jellyfish.pairwise_distance(numpy.array([b"ab", b"c"]),
+                                                          pyarrow.array([b"ab", b"d"]))),
+                         [0, 1])
+
+        self.assertRaises(ValueError, jellyfish.pairwise_similarity, strings1, strings2,
+                          out=numpy.zeros(len(strings1), dtype=numpy.float32))
+        self.assertRaises(TypeError, jellyfish.pairwise_similarity, pyarrow.array([1]), [u"a"])
+
+    def test_cdist(self):
+        queries = [u"kitten", u"caf\u00e9", u"", None]
+        choices = [u"sitting", u"cafe", u"\u20ac"]
+        for metric in ("levenshtein", "jaro_winkler", "lcs"):
+            matrix = jellyfish.cdist_similarity(queries, choices, metric=metric,
+                                                score_cutoff=0.5)
+            expected = jellyfish.pairwise_similarity(
+                [q for q in queries for _ in choices], choices * len(queries),
+                metric=metric, score_cutoff=0.5)
+            self.assertEqual(len(matrix), len(queries) * len(choices))
+            self.assertEqual(list(matrix[:9]), list(expected[:9]))
+            self.assertTrue(all(score != score for score in matrix[9:]))
+
+        words = [u"".join(random.choice(u"ab\u00e9") for _ in range(random.randrange(100)))
+                 for _ in range(150)]
+        for metric in ("levenshtein", "damerau_levenshtein", "lcs"):
+            condensed = jellyfish.pdist_distance(words, metric=metric, threads=3)
+            square = jellyfish.cdist_distance(words, words, metric=metric)
+            n = len(words)
+            self.assertEqual(list(condensed),
+                             [square[i * n + j] for i in range(n) for j in range(i + 1, n)])
+        mixed = words[:40] + [u"\u20ac" + w for w in words[40:60]] + [u"\U0001F600ab"]
+        self.assertEqual(list(jellyfish.cdist_distance(mixed, words[60:100])),
+                         [jellyfish.levenshtein_distance(a, b)
+                          for a in mixed for b in words[60:100]])
+        self.assertEqual(list(jellyfish.cdist_similarity(mixed, words[60:100], score_cutoff=0.6)),
+                         [jellyfish.levenshtein_similarity(a, b, 0.6)
+                          for a in mixed for b in words[60:100]])
+        self.assertEqual(list(jellyfish.pdist_similarity([u"ab", u"ab", u"ac"])),
+                         [1.0, 0.5, 0.5])
+        self.assertEqual(len(jellyfish.pdist_distance([u"a"])), 0)
+        self.assertRaises(ValueError, jellyfish.pdist_distance, [u"a"], metric="jaro")
+        self.assertRaises(ValueError, jellyfish.cdist_distance, [u"a"], [u"b"], metric="hamming")
+
+    def test_dedupe(self):
+        names = [u"John Smith", u"Jon Smith", u"Jane Doe", None, u"Jane Doe", u"M\u00fcller",
+                 u"Muller", u"Robert"]
+        self.assertEqual(list(jellyfish.dedupe(names, threshold=0.85)),
+                         [0, 0, 1, -1, 1, 2, 2, 3])
+        for blocking in ("none", "length", "qgram", "soundex", "metaphone"):
+            self.assertEqual(list(jellyfish.dedupe(names, threshold=0.85, blocking=blocking)),
+                             [0, 0, 1, -1, 1, 2, 2, 3])
+        self.assertEqual(list(jellyfish.dedupe([u"M\u00fcller", u"Muller", u"Mueller"],
+                                               threshold=0.8, blocking="soundex")), [0, 0, 0])
+        # Blocks use the codes soundex() gives: both of these are S530.
+        self.assertEqual(list(jellyfish.dedupe([u"\u015amith", u"Smith"], threshold=0.8,
+                                               blocking="soundex")), [0, 0])
+        self.assertEqual(list(jellyfish.dedupe(names, metric="levenshtein", max_distance=1)),
+                         [0, 0, 1, -1, 1, 2, 2, 3])
+        self.assertEqual(list(jellyfish.dedupe([u"Smith", u"Smyth", u"Jones"],
+                                               metric="match_rating")), [0, 0, 1])
+
+        # Links are transitive: a-b and b-c join a and c even though they differ.
+        chain = [u"aaaa", u"aaab", u"aabb", u"abbb", u"bbbb"]
+        self.assertEqual(list(jellyfish.dedupe(chain, metric="levenshtein", max_distance=1,
+                                               threads=2)), [0] * 5)
+
+        # Length blocking only skips pairs that cannot match.
+        words = [u"".join(random.choice(u"ab") for _ in range(random.randrange(1, 12)))
+                 for _ in range(300)]
+        self.assertEqual(list(jellyfish.dedupe(words, metric="levenshtein", threshold=0.8)),
+                         list(jellyfish.dedupe(words, metric="levenshtein", threshold=0.8,
+                                               blocking="none")))
+
+        self.assertRaises(ValueError, jellyfish.dedupe, names, blocking="zip")
+        self.assertRaises(ValueError, jellyfish.dedupe, names, metric="jaro", max_distance=1)
+
+    def test_query(self):
+        random.seed(42)
+        alphabet = u"abcde\xe9\u0101\U0001F600"
+        strings = [u"".join(random.choice(alphabet) for _ in range(random.randint(0, 140)))
+                   for _ in range(60)]
+        scorers = {"levenshtein": jellyfish.levenshtein_similarity,
+                   "damerau_levenshtein": jellyfish.damerau_levenshtein_similarity,
+                   "jaro": jellyfish.jaro_distance,
+                   "jaro_winkler": jellyfish.jaro_winkler,
+                   "lcs": jellyfish.lcs_similarity}
+        for metric, fn in scorers.items():
+            for cutoff in (0.0, 0.6):
+                for s1 in strings[:10] + [u"", u"abc"]:
+                    query = jellyfish.Query(s1, metric=metric, score_cutoff=cutoff)
+                    expected = [fn(s1, s2, score_cutoff=cutoff) for s2 in strings]
+                    for s2, value in zip(strings, expected):
+                        self.assertAlmostEqual(query.score(s2), value, places=12)
+                    scores = query.score_many(strings + [None])
+                    self.assertEqual(list(scores[:-1]), [query.score(s2) for s2 in strings])
+                    self.assertTrue(scores[-1] != scores[-1])
+
+        query = jellyfish.Query(b"kitten", metric="lcs")
+        self.assertEqual(query.score(b"sitting"), jellyfish.lcs_similarity(b"kitten", b"sitting"))
+        self.assertEqual(jellyfish.Query(u"Robert", metric="soundex").score(u"Rupert"), 1.0)
+        self.assertEqual(jellyfish.Query(u"Robert", metric="nysiis").score(u"Rubin"), 0.0)
+        self.assertEqual(jellyfish.Query(u"Byrne", metric="match_rating").score(u"Boern"), 1.0)
+        self.assertEqual(jellyfish.Query(u"Byrne").metric, u"levenshtein")
+
+        # Phonetic queries agree with the public functions on accented input.
+        self.assertEqual(jellyfish.Query(u"\u015amith", metric="soundex").score(u"Smith"), 1.0)
+        self.assertEqual(jellyfish.Query(u"\xf1\u0106o", metric="soundex").score(u"\xf1\xf6"),
+                         0.0)
+        self.assertEqual(jellyfish.Query(u"M\xfcller", metric="nysiis").score(u"Muller"),
+                         float(jellyfish.nysiis(u"M\xfcller") == jellyfish.nysiis(u"Muller")))
+        self.assertEqual(jellyfish.Query(u"Jos\xe9", metric="nysiis").score(u"Jose\u0301"), 0.0)
+        self.assertEqual(jellyfish.Query(u"Jos\xe9", metric="soundex").score(u"Jose\u0301"), 1.0)
+        letters = u"aeiosmtnrhSMT\u015a\xf1\u0106\xf6\xe9\xfc\xff\u0141\xdf\u1e03\u0416"
+        names = [random.choice(u"SMTanr") +
+                 u"".join(random.choice(letters) for _ in range(random.randint(0, 7)))
+                 for _ in range(80)]
+        for fn in (jellyfish.soundex, jellyfish.metaphone, jellyfish.nysiis):
+            for s1 in names[:20]:
+                query = jellyfish.Query(s1, metric=fn.__name__)
+                expected = [float(fn(s1) == fn(s2)) for s2 in names]
+                self.assertEqual([query.score(s2) for s2 in names], expected)
+                self.assertEqual(list(query.score_many(names)), expected)
+
+        self.assertRaises(TypeError, jellyfish.Query(u"a").score, b"a")
+        self.assertRaises(TypeError, jellyfish.Query(u"a").score_many, [b"a"])
+        self.assertRaises(ValueError, jellyfish.Query, u"a", metric="hamming")
+
+    def test_stats(self):
+        jellyfish.enable_stats()
+        try:
+            jellyfish.reset_stats()
+            jellyfish.levenshtein_distance(u"kitten", u"sitting")
+            jellyfish.soundex(u"Robert")
+            jellyfish.cdist_distance([u"a", u"bb"] * 300, [u"ccc"] * 2, threads=3)
+            stats = jellyfish.stats()
+        finally:
+            jellyfish.enable_stats(False)
+
+        self.assertEqual(stats["levenshtein"]["calls"], 1 + 600 * 2)
+        self.assertEqual(stats["levenshtein"]["bytes"], 13 + 600 * 2 * 3 + 300 * 2 * 3)
+        self.assertEqual(stats["soundex"]["calls"], 1)
+        self.assertEqual(stats["cdist"]["calls"], 1)
+        self.assertEqual(stats["jaro_winkler"]["calls"], 0)
+        for value in stats.values():
+            self.assertEqual(sum(value["histogram"]), value["calls"])
+        self.assertGreater(stats["cdist"]["time_ns"], 0)
+
+        jellyfish.levenshtein_distance(u"a", u"b")
+        self.assertEqual(jellyfish.stats()["levenshtein"]["calls"], 1201)
+        jellyfish.reset_stats()
+        self.assertEqual(jellyfish.stats()["levenshtein"]["calls"], 0)
+
+    def test_long_strings(self):
+        # Temporaries too big for the stack buffer come from the scratch
+        # arena; nysiis used to copy its whole input onto the stack.
+        self.assertEqual(jellyfish.nysiis(u"ab" * 5000000)[:6], u"ABABAB")
+
+        def levenshtein(s1, s2):
+            row = list(range(len(s2) + 1))
+            for i, c1 in enumerate(s1, 1):
+                prev, row[0] = row[0], i
+                for j, c2 in enumerate(s2, 1):
+                    prev, row[j] = row[j], min(row[j] + 1, row[j - 1] + 1, prev + (c1 != c2))
+            return row[-1]
+
+        # Lengths on both sides of the stack buffer, repeated so the arena
+        # is reused.
+        for n in (1, 10, 40, 100) * 2:
+            s1, s2 = u"kitten" * n, u"sitting" * n
+            self.assertEqual(jellyfish.levenshtein_distance(s1, s2), levenshtein(s1, s2))
+            self.assertEqual(jellyfish.damerau_levenshtein_distance(s1, s2), levenshtein(s1, s2))
+            self.assertEqual(jellyfish.jaro_winkler(s1, s1), 1)
+            self.assertEqual(jellyfish.porter_stem(s1 + u"s"), s1)
+
+    def test_phonetic_normalization(self):
+        import unicodedata
+        # ASCII, Latin (normalized natively) and other scripts (through
+        # unicodedata, and then from the cache) must all encode like the
+        # bytes of their NFKD form.
+        names = [u"Schmidt", u"Jos\xe9 Mu\xf1oz", u"\xc5ngstr\xf6m \xbd", u"Nguy\u1ec5n",
+                 u"\u0141ukasz \u0130nce", u"e\u0301e\u0301", u"\u0391\u03b8\u03b7\u03bd\u03b1",
+                 u"Ren\xe9e \u4e2d", u"\u00c7\u0327h"]
+        for name in names * 2:
+            nfkd = unicodedata.normalize("NFKD", name).encode("utf-8")
+            for fn in (jellyfish.soundex, jellyfish.metaphone):
+                try:
+                    expected = fn(nfkd)
+                except UnicodeDecodeError:
+                    self.assertRaises(UnicodeDecodeError, fn, name)
+                else:
+                    self.assertEqual(fn(name), expected)
+
+    @unittest.skipIf(sys.version_info < (3, 5), "needs multi-phase initialization")
+    def test_module_instances(self):
+        import importlib.util
+        spec = importlib.util.find_spec("jellyfish")
+        module = importlib.util.module_from_spec(spec)
+        spec.loader.exec_module(module)
+        self.assertEqual(module.__name__, "jellyfish")
+        self.assertIsNot(module.CostTable, jellyfish.CostTable)
+        self.assertIsNot(module.Query, jellyfish.Query)
+        costs = module.CostTable(substitute=0.5)
+        self.assertEqual(module.weighted_levenshtein_distance(u"a", u"b", costs), 0.5)
+        self.assertRaises(TypeError, jellyfish.weighted_levenshtein_distance, u"a", u"b", costs)
+        del module, costs
+
+        try:
+            import _xxsubinterpreters as interpreters
+        except ImportError:
+            return
+        interp = interpreters.create()
+        try:
+            interpreters.run_string(interp, "import sys\n"
+                                    "sys.path.insert(0, %r)\n"
+                                    "import jellyfish\n"
+                                    "assert jellyfish.Query(u'abc').score(u'abd') > 0.6\n"
+                                    % os.path.dirname(jellyfish.__file__))
+        finally:
+            interpreters.destroy(interp)
+
+    @unittest.skipUnless(numpy, "needs numpy")
+    def test_cdist_out(self):
+        out = numpy.zeros((3, 2), dtype=numpy.int32)
+        result = jellyfish.cdist_distance(numpy.array([u"a", u"ab", u"abc"]), [u"", u"b"],
+                                          out=out)
+        self.assertIs(result, out)
+        self.assertEqual(out.tolist(), [[1, 1], [2, 1], [3, 2]])
+        self.assertRaises(ValueError, jellyfish.cdist_distance, [u"a"], [u"b", u"c"],
+                          out=numpy.zeros(3, dtype=numpy.int32))
+
+    @unittest.skipIf(sys.version_info[0] < 3, "needs concurrent.futures")
+    def test_submit(self):
+        import asyncio
+        import concurrent.futures
+
+        words = [u"kitten", u"sitting", u"mitten"] * 400
+        others = words[::-1]
+        future = jellyfish.submit(jellyfish.pairwise_distance, words, others, threads=2)
+        self.assertIsInstance(future, concurrent.futures.Future)
+        self.assertEqual(list(future.result()), list(jellyfish.pairwise_distance(words, others)))
+        self.assertFalse(future.cancel())
+        self.assertEqual(list(jellyfish.submit(jellyfish.pdist_similarity, strings=words[:20],
+                                               metric="jaro").result()),
+                         list(jellyfish.pdist_similarity(words[:20], metric="jaro")))
+
+        async def score():
+            return await asyncio.gather(*[
+                asyncio.wrap_future(jellyfish.submit(jellyfish.cdist_similarity, words[:30],
+                                                     others[:20], score_cutoff=0.5))
+                for _ in range(4)])
+        expected = list(jellyfish.cdist_similarity(words[:30], others[:20], score_cutoff=0.5))
+        for result in asyncio.run(score()):
+            self.assertEqual(list(result), expected)
+
+        self.assertRaises(TypeError, jellyfish.submit, jellyfish.levenshtein_distance, u"a", u"b")
+        self.assertRaises(ValueError, jellyfish.submit, jellyfish.pairwise_distance, words,
+                          others[:3])
+
+    def test_cpu_features(self):
+        features = jellyfish.cpu_features()
+        self.assertEqual(features["backend"], jellyfish.backend())
+        self.assertIn(jellyfish.backend(), features["backends"])
+        self.assertIn("generic", features["backends"])
+        self.assertTrue(features["model"])
+
+    def test_backends_agree(self):
+        # Each backend is chosen at import, so score the same pairs in a
+        # fresh interpreter per backend and compare them with generic's.
+        script = u"""if True:
+            import json, jellyfish
+            pairs = [(u"martha", u"marhta"), (u"caf\\xe9", u"cafe"), (u"na\\xefve", u"naive"),
+                     (u"\\u0414\\u043c\\u0438\\u0442\\u0440\\u0438\\u0439",
+                      u"\\u0414\\u043c\\u0438\\u0442\\u0440\\u0438"),
+                     (u"a\\U0001F600b", u"a\\U0001F601b"), (u"", u"\\xe9"),
+                     (u"\\xe9t\\xe9" * 30, u"\\xe9te" * 31), (u"ab" * 70, u"ba" * 70),
+                     (u"\\u20ac" + u"x" * 100, u"x" * 100 + u"\\u20ac")]
+            print(json.dumps([jellyfish.backend()] +
+                             [[jellyfish.hamming_distance(a, b),
+                               jellyfish.levenshtein_distance(a, b),
+                               jellyfish.jaro_distance(a, b)] for (a, b) in pairs]))
+        """
+        path = os.path.dirname(os.path.abspath(jellyfish.__file__))
+        results = {}
+        for backend in jellyfish.cpu_features()["backends"]:
+            env = dict(os.environ, JELLYFISH_BACKEND=backend,
+                       PYTHONPATH=os.pathsep.join([path, os.environ.get("PYTHONPATH", "")]))
+            output = subprocess.check_output([sys.executable, "-c", script], env=env)
+            results[backend] = json.loads(output.decode("utf-8"))
+            self.assertEqual(results[backend][0], backend)
+        for backend in results:
+            self.assertEqual(results[backend][1:], results["generic"][1:], backend)
+
+    @unittest.skipIf(not find_program("make") or not find_program("gcc"),
+                     "needs make and gcc to build jellyfish_link")
+    def test_link(self):
+        here = os.path.dirname(os.path.abspath(__file__))
+        subprocess.check_call(["make", "-s", "jellyfish_link"], cwd=here)
+        program = os.path.join(here, "jellyfish_link")
+
+        # The left file has CRLF line ends, a blank line and an empty key;
+        # the right one quotes a delimiter and a line break.
+        directory = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, directory)
+        left = os.path.join(directory, "left.csv")
+        right = os.path.join(directory, "right.csv")
+        with open(left, "wb") as f:
+            f.write(b'name,city\r\n"Smith, John",Boston\r\n\r\nJon Smyth,Boston\r\n'
+                    b'"",Nowhere\r\n"Catherine ""Kate"" Jones",Denver\r\n')
+        with open(right, "wb") as f:
+            f.write(b'id,full name,town\n1,JOHN SMITH,boston\n2,,x\n\n'
+                    b'3,Katherine Jones,denver\n4,"Smyth, Jon",Boston\n5,"Jon\nSmith",Boston\n')
+
+        def link(*options):
+            output = subprocess.check_output([program] + list(options) + [left, right])
+            return output.decode("ascii").splitlines()
+
+        header = ["left_row,right_row,score,left_key,right_key"]
+        phonetic = header + ["2,1,0.917037,JON SMYTH,JOHN SMITH",
+                             "1,4,0.917037,SMITH JOHN,SMYTH JON",
+                             "2,5,0.955556,JON SMYTH,JON SMITH"]
+        spelled = header + ["4,3,0.830159,CATHERINE KATE JONES,KATHERINE JONES",
+                            "2,5,0.955556,JON SMYTH,JON SMITH"]
+        for (blocking, expected) in [("soundex", phonetic), ("metaphone", phonetic),
+                                     ("nysiis", spelled), ("qgram", spelled)]:
+            self.assertEqual(link("-a", "name", "-b", "full name", "-k", blocking,
+                                  "-t", "0.7", "-j", "2"), expected)
+
+        self.assertEqual(link("-a", "1", "-b", "2", "-k", "qgram", "-q", "0.2", "-t", "0.5",
+                              "-w", "jaro_winkler=2,levenshtein=1,match_rating=1", "-j", "1"),
+                         header + ["2,1,0.908519,JON SMYTH,JOHN SMITH",
+                                   "4,3,0.840079,CATHERINE KATE JONES,KATHERINE JONES",
+                                   "1,4,0.908519,SMITH JOHN,SMYTH JON",
+                                   "2,5,0.950000,JON SMYTH,JON SMITH"])
+
 if __name__ == '__main__':
     unittest.main()
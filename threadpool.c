@@ -0,0 +1,466 @@
+#include "jellyfish.h"
+#include <pthread.h>
+#include <unistd.h>
+
+/* One pool of jellyfish_default_threads() workers, started on first use,
+ * runs everything: the helpers of parallel_for_cost and the jobs handed to
+ * run_pooled.  Concurrent calls queue for the workers rather than each
+ * starting threads of their own.  Helpers go to the front of the queue, so
+ * calls already running finish before new jobs start, and a caller takes
+ * back the helpers no worker has picked up once it runs out of work, so a
+ * parallel_for_cost inside a pooled job never waits for a worker.
+ */
+struct task {
+    void (*fn)(void *arg);
+    void *arg;
+    bool owned;         /* allocated by run_pooled, freed when it starts */
+    bool queued;
+    struct task *next;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    struct task *head;
+    struct task *tail;
+    size_t workers;
+    bool at_fork;
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0, false };
+
+static void* run_pool_worker(void *unused)
+{
+    struct task *task;
+    void (*fn)(void *arg);
+    void *arg;
+
+    for (;;) {
+        pthread_mutex_lock(&pool.lock);
+        while (!pool.head) {
+            pthread_cond_wait(&pool.ready, &pool.lock);
+        }
+        task = pool.head;
+        pool.head = task->next;
+        if (!pool.head) {
+            pool.tail = NULL;
+        }
+        task->queued = false;
+        fn = task->fn;
+        arg = task->arg;
+        if (task->owned) {
+            free(task);
+        }
+        pthread_mutex_unlock(&pool.lock);
+        fn(arg);
+    }
+    return NULL;
+}
+
+/* A forked child has none of the parent's workers, and the queued tasks
+ * belong to its threads, so the child starts over.
+ */
+static void reset_pool(void)
+{
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.ready, NULL);
+    pool.head = NULL;
+    pool.tail = NULL;
+    pool.workers = 0;
+}
+
+/* Start the workers if they are not running.  Called with pool.lock held;
+ * returns false if not even one could be started.
+ */
+static bool start_pool(void)
+{
+    pthread_attr_t attr;
+    pthread_t id;
+    size_t n;
+
+    if (pool.workers) {
+        return true;
+    }
+    if (!pool.at_fork) {
+        pool.at_fork = pthread_atfork(NULL, NULL, reset_pool) == 0;
+    }
+    if (pthread_attr_init(&attr) != 0) {
+        return false;
+    }
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (n = jellyfish_default_threads(); pool.workers < n; pool.workers++) {
+        if (pthread_create(&id, &attr, run_pool_worker, NULL) != 0) {
+            break;
+        }
+    }
+    pthread_attr_destroy(&attr);
+    return pool.workers > 0;
+}
+
+/* Queue task at the front or the back.  Returns -1 without a worker. */
+static int queue_task(struct task *task, bool front)
+{
+    int status = -1;
+
+    pthread_mutex_lock(&pool.lock);
+    if (start_pool()) {
+        task->queued = true;
+        if (front) {
+            task->next = pool.head;
+            pool.head = task;
+            if (!pool.tail) {
+                pool.tail = task;
+            }
+        } else {
+            task->next = NULL;
+            if (pool.tail) {
+                pool.tail->next = task;
+            } else {
+                pool.head = task;
+            }
+            pool.tail = task;
+        }
+        pthread_cond_signal(&pool.ready);
+        status = 0;
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return status;
+}
+
+/* Take task off the queue if no worker has started it.  Returns whether it
+ * was still queued.
+ */
+static bool unqueue_task(struct task *task)
+{
+    struct task **link, *prev = NULL;
+    bool queued;
+
+    pthread_mutex_lock(&pool.lock);
+    queued = task->queued;
+    if (queued) {
+        for (link = &pool.head; *link != task; link = &(*link)->next) {
+            prev = *link;
+        }
+        *link = task->next;
+        if (pool.tail == task) {
+            pool.tail = prev;
+        }
+        task->queued = false;
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return queued;
+}
+
+int run_pooled(void (*fn)(void *arg), void *arg)
+{
+    struct task *task = malloc(sizeof(struct task));
+
+    if (!task) {
+        return -1;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    task->owned = true;
+    if (queue_task(task, false) < 0) {
+        free(task);
+        return -1;
+    }
+    return 0;
+}
+
+/* A work stealing parallel for.  [0, n) is cut into blocks of grain items
+ * (so short inputs stay on the calling thread), each weighted by the
+ * estimated cost of its items, and every thread starts with a run of
+ * consecutive blocks holding about an equal share of the weight.  A thread
+ * takes chunks of about an eighth of a share off the front of its own run;
+ * once that is empty it steals the back half, by weight, of the run with
+ * the most weight left.  Runs stay contiguous, so workers keep the locality
+ * of the static split, and a thread held up by an expensive chunk has the
+ * rest of its run taken over by the others.  Run 0 belongs to the calling
+ * thread and the others to helpers queued on the pool; a run whose helper
+ * never started is stolen from like any other, and whatever is left of it
+ * runs on the calling thread at the end.
+ */
+#define CHUNKS_PER_SHARE 8
+
+struct run {
+    pthread_mutex_t lock;
+    size_t begin;       /* the blocks not yet taken */
+    size_t end;
+} __attribute__((aligned(64)));
+
+struct scheduler {
+    parallel_fn fn;
+    void *ctx;
+    size_t n;
+    size_t grain;
+    size_t threads;
+    double *before;     /* before[b]: the weight of the blocks ahead of b, or NULL for 1 each */
+    double chunk;
+    struct run *runs;
+    unsigned long steals;
+    pthread_mutex_t done_lock;
+    pthread_cond_t done;
+    size_t finished;    /* helpers that have returned */
+};
+
+struct worker {
+    struct scheduler *s;
+    size_t id;
+    struct task task;
+};
+
+static inline double weight_before(const struct scheduler *s, size_t b)
+{
+    return s->before ? s->before[b] : (double) b;
+}
+
+/* The first block in [lo, hi] with at least weight w ahead of it, or hi. */
+static size_t block_at(const struct scheduler *s, size_t lo, size_t hi, double w)
+{
+    size_t mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (weight_before(s, mid) < w) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void run_blocks(struct scheduler *s, size_t begin, size_t end)
+{
+    s->fn(s->ctx, MIN(begin * s->grain, s->n), MIN(end * s->grain, s->n));
+}
+
+static bool take_chunk(struct scheduler *s, struct run *run, size_t *begin, size_t *end)
+{
+    bool found;
+
+    pthread_mutex_lock(&run->lock);
+    found = run->begin < run->end;
+    if (found) {
+        *begin = run->begin;
+        *end = block_at(s, run->begin + 1, run->end, weight_before(s, run->begin) + s->chunk);
+        __atomic_store_n(&run->begin, *end, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&run->lock);
+    return found;
+}
+
+/* Move the back half of the heaviest run with two blocks or more into the
+ * empty run id.  Returns false once there is none; a scan that raced with
+ * another steal is repeated, since work may have moved behind it.
+ */
+static bool steal_half(struct scheduler *s, size_t id)
+{
+    struct run *mine = &s->runs[id], *victim, *first, *second;
+    unsigned long steals;
+    size_t v, best, begin, end, mid;
+    double most, left;
+    bool stolen;
+
+    for (;;) {
+        steals = __atomic_load_n(&s->steals, __ATOMIC_ACQUIRE);
+        best = id;
+        most = 0;
+        for (v = 0; v < s->threads; v++) {
+            begin = __atomic_load_n(&s->runs[v].begin, __ATOMIC_ACQUIRE);
+            end = __atomic_load_n(&s->runs[v].end, __ATOMIC_ACQUIRE);
+            left = begin + 1 < end ? weight_before(s, end) - weight_before(s, begin) : 0;
+            if (v != id && left > most) {
+                best = v;
+                most = left;
+            }
+        }
+        if (best == id) {
+            if (steals == __atomic_load_n(&s->steals, __ATOMIC_ACQUIRE)) {
+                return false;
+            }
+            continue;
+        }
+
+        /* Both runs are locked, in index order, so the move is atomic. */
+        victim = &s->runs[best];
+        first = best < id ? victim : mine;
+        second = best < id ? mine : victim;
+        pthread_mutex_lock(&first->lock);
+        pthread_mutex_lock(&second->lock);
+        stolen = victim->begin + 1 < victim->end;
+        if (stolen) {
+            mid = block_at(s, victim->begin + 1, victim->end - 1,
+                           (weight_before(s, victim->begin) + weight_before(s, victim->end)) / 2);
+            __atomic_store_n(&mine->begin, mid, __ATOMIC_RELEASE);
+            __atomic_store_n(&mine->end, victim->end, __ATOMIC_RELEASE);
+            __atomic_store_n(&victim->end, mid, __ATOMIC_RELEASE);
+            __atomic_add_fetch(&s->steals, 1, __ATOMIC_ACQ_REL);
+        }
+        pthread_mutex_unlock(&second->lock);
+        pthread_mutex_unlock(&first->lock);
+        if (stolen) {
+            return true;
+        }
+    }
+}
+
+static void run_worker(struct worker *w)
+{
+    struct scheduler *s = w->s;
+    size_t begin, end;
+
+    for (;;) {
+        if (take_chunk(s, &s->runs[w->id], &begin, &end)) {
+            run_blocks(s, begin, end);
+        } else if (!steal_half(s, w->id)) {
+            return;
+        }
+    }
+}
+
+/* The caller may free s as soon as the count is in, so nothing is touched
+ * after the unlock.
+ */
+static void run_helper(void *arg)
+{
+    struct worker *w = arg;
+    struct scheduler *s = w->s;
+
+    run_worker(w);
+    pthread_mutex_lock(&s->done_lock);
+    s->finished++;
+    pthread_cond_signal(&s->done);
+    pthread_mutex_unlock(&s->done_lock);
+}
+
+size_t jellyfish_default_threads(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (size_t) n : 1;
+}
+
+/* Weigh the blocks by their items' costs.  Returns NULL, so that every
+ * block weighs the same, without a cost function or memory.
+ */
+static double* weigh_blocks(size_t n, size_t grain, size_t blocks, parallel_cost_fn cost,
+                            void *ctx)
+{
+    double *before, total = 0;
+    size_t b, i;
+
+    if (!cost) {
+        return NULL;
+    }
+    before = malloc((blocks + 1) * sizeof(double));
+    if (!before) {
+        return NULL;
+    }
+    for (b = 0; b < blocks; b++) {
+        before[b] = total;
+        for (i = b * grain; i < MIN((b + 1) * grain, n); i++) {
+            total += MAX(cost(ctx, i), 0);
+        }
+    }
+    before[blocks] = total;
+    if (total <= 0) {
+        free(before);
+        return NULL;
+    }
+    return before;
+}
+
+void parallel_for_cost(size_t n, size_t grain, size_t threads, parallel_fn fn,
+                       parallel_cost_fn cost, void *ctx)
+{
+    struct scheduler s;
+    struct worker *workers;
+    bool *started;
+    size_t blocks, t, helpers = 0;
+
+    if (threads == 0) {
+        threads = jellyfish_default_threads();
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+    blocks = (n + grain - 1) / grain;
+    threads = MIN(threads, blocks);
+    if (threads <= 1) {
+        fn(ctx, 0, n);
+        return;
+    }
+
+    s.fn = fn;
+    s.ctx = ctx;
+    s.n = n;
+    s.grain = grain;
+    s.threads = threads;
+    s.steals = 0;
+    s.before = weigh_blocks(n, grain, blocks, cost, ctx);
+    s.chunk = weight_before(&s, blocks) / (threads * CHUNKS_PER_SHARE);
+    s.runs = aligned_alloc(64, threads * sizeof(struct run));
+    workers = malloc(threads * sizeof(struct worker));
+    started = calloc(threads, sizeof(bool));
+    if (!s.runs || !workers || !started) {
+        free(s.before);
+        free(s.runs);
+        free(workers);
+        free(started);
+        fn(ctx, 0, n);
+        return;
+    }
+    pthread_mutex_init(&s.done_lock, NULL);
+    pthread_cond_init(&s.done, NULL);
+    s.finished = 0;
+
+    for (t = 0; t < threads; t++) {
+        pthread_mutex_init(&s.runs[t].lock, NULL);
+        s.runs[t].begin = t ? s.runs[t - 1].end : 0;
+        s.runs[t].end = t + 1 < threads
+                            ? block_at(&s, s.runs[t].begin, blocks,
+                                       weight_before(&s, blocks) * (t + 1) / threads)
+                            : blocks;
+        workers[t].s = &s;
+        workers[t].id = t;
+    }
+    for (t = 1; t < threads; t++) {
+        workers[t].task.fn = run_helper;
+        workers[t].task.arg = &workers[t];
+        workers[t].task.owned = false;
+        started[t] = queue_task(&workers[t].task, true) == 0;
+    }
+
+    run_worker(&workers[0]);
+    for (t = 1; t < threads; t++) {
+        if (started[t] && unqueue_task(&workers[t].task)) {
+            started[t] = false;
+        }
+        helpers += started[t];
+    }
+    pthread_mutex_lock(&s.done_lock);
+    while (s.finished < helpers) {
+        pthread_cond_wait(&s.done, &s.done_lock);
+    }
+    pthread_mutex_unlock(&s.done_lock);
+    for (t = 1; t < threads; t++) {
+        if (!started[t] && s.runs[t].begin < s.runs[t].end) {
+            run_blocks(&s, s.runs[t].begin, s.runs[t].end);
+        }
+    }
+
+    for (t = 0; t < threads; t++) {
+        pthread_mutex_destroy(&s.runs[t].lock);
+    }
+    pthread_mutex_destroy(&s.done_lock);
+    pthread_cond_destroy(&s.done);
+    free(s.before);
+    free(s.runs);
+    free(workers);
+    free(started);
+}
+
+void parallel_for(size_t n, size_t grain, size_t threads, parallel_fn fn, void *ctx)
+{
+    parallel_for_cost(n, grain, threads, fn, NULL, ctx);
+}
@@ -0,0 +1,239 @@
+#include "jellyfish.h"
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+/* Word order insensitive comparators.  Both strings are split with the
+ * shared tokenizer and the token spans sorted in place; the only strings
+ * built are the joined token lists handed to the metric.  Everything is
+ * scratch memory, released when the comparison returns.
+ */
+
+/* Drop adjacent duplicates from sorted spans, returning the new count. */
+static size_t dedupe_tokens(const void *str, int kind, struct token_span *spans, size_t n)
+{
+    size_t i, kept = 0;
+
+    for (i = 0; i < n; i++) {
+        if (kept == 0 || token_compare(str, &spans[kept - 1], str, &spans[i], kind) != 0) {
+            spans[kept++] = spans[i];
+        }
+    }
+    return kept;
+}
+
+static int sorted_tokens(const void *str, size_t len, int kind,
+                         struct token_span **spans, size_t *n)
+{
+    if (tokenize(str, len, kind, spans, n) < 0) {
+        return -1;
+    }
+    return sort_tokens(str, kind, *spans, *n);
+}
+
+/* Compare str1 and str2 with their tokens sorted and joined by single
+ * spaces, so "smith john" matches "john smith" exactly.
+ */
+double token_sort_similarity_kind(enum jellyfish_metric metric,
+                                  const void *str1, size_t len1,
+                                  const void *str2, size_t len2, int kind,
+                                  double score_cutoff)
+{
+    struct token_span *spans1, *spans2;
+    size_t n1, n2, joined1, joined2;
+    char *buffer;
+    double result = NAN;
+    size_t mark = scratch_mark();
+    STATS_SCOPE(STAT_TOKEN_SORT, (len1 + len2) * kind);
+
+    if (sorted_tokens(str1, len1, kind, &spans1, &n1) < 0 ||
+        sorted_tokens(str2, len2, kind, &spans2, &n2) < 0) {
+        goto done;
+    }
+
+    buffer = scratch_alloc((len1 + len2 + 2) * kind);
+    if (!buffer) {
+        goto done;
+    }
+
+    joined1 = join_tokens(str1, kind, spans1, n1, buffer);
+    joined2 = join_tokens(str2, kind, spans2, n2, buffer + (len1 + 1) * kind);
+    result = jellyfish_similarity(metric, buffer, joined1, buffer + (len1 + 1) * kind, joined2,
+                                  kind, score_cutoff);
+
+done:
+    scratch_release(mark);
+    return result;
+}
+
+/* Compare the sets of distinct tokens.  With the sorted intersection t0,
+ * t1 = t0 plus the tokens only in str1 and t2 = t0 plus those only in
+ * str2, the score is the best of metric(t0, t1), metric(t0, t2) and
+ * metric(t1, t2).  One token set containing the other scores 1.
+ */
+double token_set_similarity_kind(enum jellyfish_metric metric,
+                                 const void *str1, size_t len1,
+                                 const void *str2, size_t len2, int kind,
+                                 double score_cutoff)
+{
+    struct token_span *spans1, *spans2, *set1, *set2;
+    size_t n1, n2, i, j, common = 0, only1 = 0, only2 = 0;
+    size_t len0, lent1, lent2, mark = scratch_mark();
+    char *t0, *t1, *t2;
+    double best = 0, score, result = NAN;
+    int cmp;
+    STATS_SCOPE(STAT_TOKEN_SET, (len1 + len2) * kind);
+
+    if (sorted_tokens(str1, len1, kind, &spans1, &n1) < 0 ||
+        sorted_tokens(str2, len2, kind, &spans2, &n2) < 0) {
+        goto done;
+    }
+    n1 = dedupe_tokens(str1, kind, spans1, n1);
+    n2 = dedupe_tokens(str2, kind, spans2, n2);
+
+    if (n1 == 0 || n2 == 0) {
+        result = 0;
+        goto done;
+    }
+
+    /* set1 and set2 start with the shared tokens, from each string, and
+     * are then followed by the tokens only that string has.
+     */
+    set1 = scratch_alloc((n1 + n2) * sizeof(struct token_span));
+    set2 = scratch_alloc((n1 + n2) * sizeof(struct token_span));
+    t0 = scratch_alloc((2 * len1 + len2 + 3) * kind);
+    if (!set1 || !set2 || !t0) {
+        goto done;
+    }
+
+    for (i = 0, j = 0; i < n1 || j < n2; ) {
+        if (i == n1) {
+            cmp = 1;
+        } else if (j == n2) {
+            cmp = -1;
+        } else {
+            cmp = token_compare(str1, &spans1[i], str2, &spans2[j], kind);
+        }
+
+        if (cmp == 0) {
+            set1[common] = spans1[i++];
+            set2[common] = spans2[j++];
+            common++;
+        } else if (cmp < 0) {
+            spans1[only1++] = spans1[i++];
+        } else {
+            spans2[only2++] = spans2[j++];
+        }
+    }
+    memcpy(set1 + common, spans1, only1 * sizeof(struct token_span));
+    memcpy(set2 + common, spans2, only2 * sizeof(struct token_span));
+
+    if (common && (only1 == 0 || only2 == 0)) {
+        result = 1;
+        goto done;
+    }
+
+    t1 = t0 + (len1 + 1) * kind;
+    t2 = t1 + (len1 + 1) * kind;
+    len0 = join_tokens(str1, kind, set1, common, t0);
+    lent1 = join_tokens(str1, kind, set1, common + only1, t1);
+    lent2 = join_tokens(str2, kind, set2, common + only2, t2);
+
+    best = jellyfish_similarity(metric, t1, lent1, t2, lent2, kind, score_cutoff);
+    if (common && !isnan(best)) {
+        score = jellyfish_similarity(metric, t0, len0, t1, lent1, kind, MAX(best, score_cutoff));
+        best = isnan(score) ? score : MAX(best, score);
+    }
+    if (common && !isnan(best)) {
+        score = jellyfish_similarity(metric, t0, len0, t2, lent2, kind, MAX(best, score_cutoff));
+        best = isnan(score) ? score : MAX(best, score);
+    }
+    result = best;
+
+done:
+    scratch_release(mark);
+    return result;
+}
+
+/* Average over the tokens of str1 of the best metric score against any
+ * token of str2.  Tokens of str1 are sorted so repeats reuse the previous
+ * best, each inner search passes its running best as the metric's cutoff
+ * (so hopeless pairs stop early) and ends at a perfect match, and the
+ * whole scan stops once the average can no longer reach score_cutoff.
+ */
+static double monge_elkan_direction(enum jellyfish_metric metric,
+                                    const void *str1, const struct token_span *spans1, size_t n1,
+                                    const void *str2, const struct token_span *spans2, size_t n2,
+                                    int kind, double score_cutoff)
+{
+    size_t i, j;
+    double sum = 0, best = 0, score;
+
+    for (i = 0; i < n1; i++) {
+        if (i == 0 || token_compare(str1, &spans1[i - 1], str1, &spans1[i], kind) != 0) {
+            best = 0;
+            for (j = 0; j < n2 && best < 1; j++) {
+                score = jellyfish_similarity(metric,
+                                             (const char *) str1 + spans1[i].start * kind,
+                                             spans1[i].end - spans1[i].start,
+                                             (const char *) str2 + spans2[j].start * kind,
+                                             spans2[j].end - spans2[j].start,
+                                             kind, best);
+                if (isnan(score)) {
+                    return score;
+                }
+                best = MAX(best, score);
+            }
+        }
+        sum += best;
+
+        /* The epsilon keeps rounding from pruning a score that lands
+         * exactly on the cutoff.
+         */
+        if ((sum + (n1 - i - 1)) / n1 < score_cutoff - 1e-9) {
+            return 0;
+        }
+    }
+    return sum / n1;
+}
+
+double monge_elkan_similarity_kind(enum jellyfish_metric metric,
+                                   const void *str1, size_t len1,
+                                   const void *str2, size_t len2, int kind,
+                                   bool symmetric, double score_cutoff)
+{
+    struct token_span *spans1, *spans2;
+    size_t n1, n2, mark = scratch_mark();
+    double forward, backward, result = NAN;
+    STATS_SCOPE(STAT_MONGE_ELKAN, (len1 + len2) * kind);
+
+    if (sorted_tokens(str1, len1, kind, &spans1, &n1) < 0 ||
+        sorted_tokens(str2, len2, kind, &spans2, &n2) < 0) {
+        goto done;
+    }
+
+    if (n1 == 0 || n2 == 0) {
+        result = 0;
+        goto done;
+    }
+
+    /* The symmetric score averages both directions, so the first one has
+     * to reach 2 * score_cutoff - 1 for the mean to reach score_cutoff.
+     */
+    forward = monge_elkan_direction(metric, str1, spans1, n1, str2, spans2, n2, kind,
+                                    symmetric ? 2 * score_cutoff - 1 : score_cutoff);
+    if (!symmetric || isnan(forward)) {
+        result = forward;
+    } else {
+        backward = monge_elkan_direction(metric, str2, spans2, n2, str1, spans1, n1, kind,
+                                         2 * score_cutoff - forward);
+        result = isnan(backward) ? backward : (forward + backward) / 2;
+    }
+    if (result < score_cutoff - 1e-9) {
+        result = 0;
+    }
+
+done:
+    scratch_release(mark);
+    return result;
+}
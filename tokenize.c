@@ -0,0 +1,185 @@
+#include "jellyfish.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Word splitting shared by get_matches and the token comparators.
+ *
+ * Fields are separated by runs of non-word characters, like
+ * re.split(r"\W+", str): a leading or trailing separator yields an empty
+ * field.  ASCII letters, digits and '_' are word characters, and so is any
+ * code point (or byte, for one byte strings) at or above 0x80, so UTF-8 and
+ * non-Latin words are not broken apart.
+ */
+
+static inline uint32_t code_point(const void *str, size_t i, int kind)
+{
+    switch (kind) {
+    case JELLYFISH_UCS2:
+        return ((const uint16_t *) str)[i];
+    case JELLYFISH_UCS4:
+        return ((const uint32_t *) str)[i];
+    default:
+        return ((const unsigned char *) str)[i];
+    }
+}
+
+static inline bool is_word_char(uint32_t c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+void word_iter_init(struct word_iter *it, const void *str, size_t len, int kind)
+{
+    it->str = str;
+    it->len = len;
+    it->kind = kind;
+    it->pos = 0;
+    it->done = false;
+}
+
+bool word_iter_next(struct word_iter *it, struct token_span *span)
+{
+    size_t i;
+
+    if (it->done) {
+        return false;
+    }
+
+    for (i = it->pos; i < it->len && is_word_char(code_point(it->str, i, it->kind)); i++) {
+    }
+    span->start = it->pos;
+    span->end = i;
+
+    for (; i < it->len && !is_word_char(code_point(it->str, i, it->kind)); i++) {
+    }
+    if (i == span->end) {
+        /* No separator follows: this was the last field. */
+        it->done = true;
+    }
+    it->pos = i;
+
+    return true;
+}
+
+/* Collect the non-empty fields of str into an array in scratch memory,
+ * which the caller releases.  Returns -1 if memory runs out.
+ */
+int tokenize(const void *str, size_t len, int kind,
+             struct token_span **spans, size_t *n_spans)
+{
+    struct word_iter it;
+    struct token_span span, *out;
+    size_t n = 0;
+
+    /* At most one token per two code units, plus one. */
+    out = scratch_alloc((len / 2 + 1) * sizeof(struct token_span));
+    if (!out) {
+        return -1;
+    }
+
+    word_iter_init(&it, str, len, kind);
+    while (word_iter_next(&it, &span)) {
+        if (span.end > span.start) {
+            out[n++] = span;
+        }
+    }
+
+    *spans = out;
+    *n_spans = n;
+    return 0;
+}
+
+/* Compare token a of str_a with token b of str_b code point by code
+ * point; a prefix sorts first.
+ */
+int token_compare(const void *str_a, const struct token_span *a,
+                  const void *str_b, const struct token_span *b, int kind)
+{
+    size_t i, la = a->end - a->start, lb = b->end - b->start;
+    uint32_t ca, cb;
+
+    for (i = 0; i < la && i < lb; i++) {
+        ca = code_point(str_a, a->start + i, kind);
+        cb = code_point(str_b, b->start + i, kind);
+        if (ca != cb) {
+            return ca < cb ? -1 : 1;
+        }
+    }
+    return la < lb ? -1 : la > lb;
+}
+
+/* Sort spans into token order with a bottom-up merge sort, so no strings
+ * are copied.  Returns -1 if memory runs out.
+ */
+int sort_tokens(const void *str, int kind, struct token_span *spans, size_t n)
+{
+    struct token_span *tmp, *from = spans, *to, *swap;
+    size_t width, lo, mid, hi, i, j, k, mark;
+
+    if (n < 2) {
+        return 0;
+    }
+    mark = scratch_mark();
+    tmp = scratch_alloc(n * sizeof(struct token_span));
+    if (!tmp) {
+        return -1;
+    }
+    to = tmp;
+
+    for (width = 1; width < n; width *= 2) {
+        for (lo = 0; lo < n; lo += 2 * width) {
+            mid = MIN(lo + width, n);
+            hi = MIN(lo + 2 * width, n);
+            for (i = lo, j = mid, k = lo; k < hi; k++) {
+                if (i < mid && (j >= hi || token_compare(str, &from[i], str, &from[j], kind) <= 0)) {
+                    to[k] = from[i++];
+                } else {
+                    to[k] = from[j++];
+                }
+            }
+        }
+        swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != spans) {
+        memcpy(spans, from, n * sizeof(struct token_span));
+    }
+    scratch_release(mark);
+    return 0;
+}
+
+/* Write the tokens to out separated by single spaces, in code units of
+ * the string's width.  out must hold the tokens plus separators; returns
+ * the number of code units written.
+ */
+size_t join_tokens(const void *str, int kind, const struct token_span *spans, size_t n,
+                   void *out)
+{
+    size_t t, len = 0, span_len;
+
+    for (t = 0; t < n; t++) {
+        if (t) {
+            switch (kind) {
+            case JELLYFISH_UCS2:
+                ((uint16_t *) out)[len] = ' ';
+                break;
+            case JELLYFISH_UCS4:
+                ((uint32_t *) out)[len] = ' ';
+                break;
+            default:
+                ((char *) out)[len] = ' ';
+                break;
+            }
+            len++;
+        }
+        span_len = spans[t].end - spans[t].start;
+        memcpy((char *) out + len * kind, (const char *) str + spans[t].start * kind,
+               span_len * kind);
+        len += span_len;
+    }
+    return len;
+}
@@ -0,0 +1,121 @@
+#include "jellyfish.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Costs of code points outside the 256 entry tables fall back to the
+ * table's defaults.
+ */
+#define IN_TABLE(c) ((uint32_t) (c) < 256)
+
+#define INSERT_COST(t, c) \
+    (IN_TABLE(c) ? (t)->insert[(uint8_t) (c)] : (t)->default_insert)
+#define DELETE_COST(t, c) \
+    (IN_TABLE(c) ? (t)->delete[(uint8_t) (c)] : (t)->default_delete)
+#define SUBSTITUTE_COST(t, a, b) \
+    ((a) == (b) ? 0.0 : \
+     IN_TABLE(a) && IN_TABLE(b) ? (t)->substitute[(uint8_t) (a)][(uint8_t) (b)] : \
+     (t)->default_substitute)
+
+#define JF_CHAR unsigned char
+#define JF_NAME(name) name##_ucs1
+#include "weighted_levenshtein_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
+
+#define JF_CHAR uint16_t
+#define JF_NAME(name) name##_ucs2
+#include "weighted_levenshtein_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
+
+#define JF_CHAR uint32_t
+#define JF_NAME(name) name##_ucs4
+#include "weighted_levenshtein_impl.h"
+#undef JF_CHAR
+#undef JF_NAME
+
+/* Create a cost table where every insertion, deletion, substitution and
+ * transposition has the given uniform cost.  Individual entries can then be
+ * adjusted with cost_table_set_*.
+ */
+struct cost_table* create_cost_table(double insert, double delete,
+                                     double substitute, double transpose)
+{
+    size_t a, b;
+    struct cost_table *costs = malloc(sizeof(struct cost_table));
+    if (!costs) {
+        return NULL;
+    }
+
+    for (a = 0; a < 256; a++) {
+        costs->insert[a] = insert;
+        costs->delete[a] = delete;
+        for (b = 0; b < 256; b++) {
+            costs->substitute[a][b] = substitute;
+        }
+    }
+    costs->default_insert = insert;
+    costs->default_delete = delete;
+    costs->default_substitute = substitute;
+    costs->transpose = transpose;
+
+    return costs;
+}
+
+void free_cost_table(struct cost_table *costs)
+{
+    free(costs);
+}
+
+double weighted_levenshtein_distance_kind(const void *s1, size_t len1,
+                                          const void *s2, size_t len2, int kind,
+                                          const struct cost_table *costs)
+{
+    STATS_SCOPE(STAT_WEIGHTED_LEVENSHTEIN, (len1 + len2) * kind);
+
+    switch (kind) {
+    case JELLYFISH_UCS2:
+        return weighted_levenshtein_kernel_ucs2(s1, len1, s2, len2, costs);
+    case JELLYFISH_UCS4:
+        return weighted_levenshtein_kernel_ucs4(s1, len1, s2, len2, costs);
+    default:
+        return weighted_levenshtein_kernel_ucs1(s1, len1, s2, len2, costs);
+    }
+}
+
+double weighted_damerau_levenshtein_distance_kind(const void *s1, size_t len1,
+                                                  const void *s2, size_t len2, int kind,
+                                                  const struct cost_table *costs)
+{
+    STATS_SCOPE(STAT_WEIGHTED_DAMERAU_LEVENSHTEIN, (len1 + len2) * kind);
+
+    switch (kind) {
+    case JELLYFISH_UCS2:
+        return weighted_damerau_levenshtein_kernel_ucs2(s1, len1, s2, len2, costs);
+    case JELLYFISH_UCS4:
+        return weighted_damerau_levenshtein_kernel_ucs4(s1, len1, s2, len2, costs);
+    default:
+        return weighted_damerau_levenshtein_kernel_ucs1(s1, len1, s2, len2, costs);
+    }
+}
+
+double weighted_levenshtein_distance(const char *s1, const char *s2,
+                                     const struct cost_table *costs)
+{
+    size_t len1 = strlen(s1), len2 = strlen(s2);
+    STATS_SCOPE(STAT_WEIGHTED_LEVENSHTEIN, len1 + len2);
+
+    return weighted_levenshtein_kernel_ucs1((const unsigned char *) s1, len1,
+                                            (const unsigned char *) s2, len2, costs);
+}
+
+double weighted_damerau_levenshtein_distance(const char *s1, const char *s2,
+                                             const struct cost_table *costs)
+{
+    size_t len1 = strlen(s1), len2 = strlen(s2);
+    STATS_SCOPE(STAT_WEIGHTED_DAMERAU_LEVENSHTEIN, len1 + len2);
+
+    return weighted_damerau_levenshtein_kernel_ucs1((const unsigned char *) s1, len1,
+                                                    (const unsigned char *) s2, len2, costs);
+}
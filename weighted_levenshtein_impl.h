@@ -0,0 +1,97 @@
+/* Weighted Levenshtein and Damerau-Levenshtein kernels, included by
+ * weighted_levenshtein.c once per code unit width.  The includer defines
+ * JF_CHAR, the code unit type, and JF_NAME(name), which appends the width
+ * suffix (_ucs1, _ucs2, _ucs4) to name.
+ *
+ * Only the previous row (two rows for Damerau-Levenshtein) of the matrix is
+ * kept, so memory is O(len2).
+ */
+
+static double JF_NAME(weighted_levenshtein_kernel)(const JF_CHAR *s1, size_t s1_len,
+                                                   const JF_CHAR *s2, size_t s2_len,
+                                                   const struct cost_table *costs)
+{
+    size_t i, j;
+    double d1, d2, d3, result;
+    double *prev, *cur, *tmp;
+    double stack[SCRATCH_STACK / sizeof(double)];
+    size_t mark = scratch_mark();
+    double *rows = scratch_buffer(stack, sizeof(stack), 2 * (s2_len + 1) * sizeof(double));
+    if (!rows) {
+        return -1;
+    }
+
+    prev = rows;
+    cur = rows + s2_len + 1;
+
+    prev[0] = 0;
+    for (j = 1; j <= s2_len; j++) {
+        prev[j] = prev[j - 1] + INSERT_COST(costs, s2[j - 1]);
+    }
+
+    for (i = 1; i <= s1_len; i++) {
+        cur[0] = prev[0] + DELETE_COST(costs, s1[i - 1]);
+        for (j = 1; j <= s2_len; j++) {
+            d1 = prev[j] + DELETE_COST(costs, s1[i - 1]);
+            d2 = cur[j - 1] + INSERT_COST(costs, s2[j - 1]);
+            d3 = prev[j - 1] + SUBSTITUTE_COST(costs, s1[i - 1], s2[j - 1]);
+            cur[j] = MIN(d1, MIN(d2, d3));
+        }
+        tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+
+    result = prev[s2_len];
+    scratch_release(mark);
+
+    return result;
+}
+
+static double JF_NAME(weighted_damerau_levenshtein_kernel)(const JF_CHAR *s1, size_t s1_len,
+                                                           const JF_CHAR *s2, size_t s2_len,
+                                                           const struct cost_table *costs)
+{
+    size_t i, j;
+    double d1, d2, d3, result;
+    double *prev2, *prev, *cur, *tmp;
+    double stack[SCRATCH_STACK / sizeof(double)];
+    size_t mark = scratch_mark();
+    double *rows = scratch_buffer(stack, sizeof(stack), 3 * (s2_len + 1) * sizeof(double));
+    if (!rows) {
+        return -1;
+    }
+
+    prev2 = rows;
+    prev = rows + s2_len + 1;
+    cur = rows + 2 * (s2_len + 1);
+
+    prev[0] = 0;
+    for (j = 1; j <= s2_len; j++) {
+        prev[j] = prev[j - 1] + INSERT_COST(costs, s2[j - 1]);
+    }
+
+    for (i = 1; i <= s1_len; i++) {
+        cur[0] = prev[0] + DELETE_COST(costs, s1[i - 1]);
+        for (j = 1; j <= s2_len; j++) {
+            d1 = prev[j] + DELETE_COST(costs, s1[i - 1]);
+            d2 = cur[j - 1] + INSERT_COST(costs, s2[j - 1]);
+            d3 = prev[j - 1] + SUBSTITUTE_COST(costs, s1[i - 1], s2[j - 1]);
+            cur[j] = MIN(d1, MIN(d2, d3));
+
+            if (i > 1 && j > 1 && s1[i - 1] == s2[j - 2] && s1[i - 2] == s2[j - 1] &&
+                s1[i - 1] != s2[j - 1]) {
+                cur[j] = MIN(cur[j], prev2[j - 2] + costs->transpose);
+            }
+        }
+        tmp = prev2;
+        prev2 = prev;
+        prev = cur;
+        cur = tmp;
+    }
+
+    result = prev[s2_len];
+    scratch_release(mark);
+
+    return result;
+}